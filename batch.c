@@ -0,0 +1,1801 @@
+/*
+ * batch - test a list of h*2^n-1 candidates on a pool of worker processes
+ *
+ * A list file contains one candidate per line:
+ *
+ *      h n
+ *
+ * such as the files found in the test sub-directory, or is a binary list
+ * (see hnlist.h).  The list is read by a pipeline of stages that run ahead
+ * of the workers on threads of their own (see stage.c): a candidate found
+ * there to have a small factor is reported composite without a Lucas test.
+ * The batch scheduler
+ * forks one worker process per core.  Each worker tests one candidate at
+ * a time, via lucas_test(), and reports the result back over a pipe.
+ * A worker that dies (such as when h*2^n-1 cannot be tested) is replaced.
+ *
+ * While candidates remain to be dispatched, every worker squares with
+ * a single thread: one core per candidate gives the best throughput.  Once
+ * the list has been drained, cores freed by idle workers are handed to
+ * the large candidates that are still running, which then square using
+ * several threads (see parsqr.c).  This keeps the whole machine busy instead
+ * of leaving the last large tests of a batch as a long single-core tail.
+ *
+ * With a memory budget (-M), the memory each candidate will use is
+ * predicted from h, n and its engine (see lucas_footprint()), and a
+ * candidate is only dispatched when it fits in what the busy workers leave
+ * of the budget.  While the oldest candidate waits for memory, a much
+ * smaller candidate from the next BATCH_LOOKAHEAD in the list may backfill
+ * an idle core.  A candidate larger than the whole budget is tested alone.
+ *
+ * Candidates in an urgent list (-U) are dispatched ahead of all others.  The
+ * urgent list is watched while the batch runs, so a line appended to it is
+ * picked up within BATCH_URGENT_POLL milliseconds.  With a checkpoint
+ * directory (-d), tests with n >= BATCH_CHECKPOINT_MIN_N checkpoint under
+ * checkpoint_dir/h-n.  When an urgent candidate finds every worker busy, the
+ * preemption policy (-P) picks one of those tests and sends its worker a
+ * SIGINT: the test checkpoints and exits, just as a single test would.  The
+ * preempted test then resumes from its checkpoint ahead of the rest of the
+ * list.  A checkpointed test lets go of its checkpoint directory once it
+ * is over, so its worker goes on to test other candidates.
+ *
+ * Instead of a list, the workers may search for the smallest m in a range
+ * such that h*2^m-1 is prime (-S).  Each m for which h*2^m-1 has a factor
+ * below BATCH_SIEVE_LIMIT is skipped, and the next surviving values of m
+ * are tested in parallel, up to BATCH_SEARCH_AHEAD per core past the lowest
+ * one not yet tested.  Results are announced in order of m.  Once h*2^m-1
+ * is found to be prime, the tests of larger m are killed, as their results
+ * no longer matter, while the tests of smaller m run to completion.
+ *
+ * As a worker runs many candidates, the prime stats of the worker process
+ * (see -t) say little about any one of them.  With -t, each worker instead
+ * measures the resources used by each candidate it tests: the change in
+ * the rusage of the worker (every thread of it, so squaring helper threads
+ * count) and of its squaring thread alone (RUSAGE_THREAD), and what was
+ * allocated through GMP, as counted by memory functions the worker installs
+ * (see mp_set_memory_functions()).  The usage comes back with the result of
+ * the candidate and is printed to stderr as a line following its result.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 120-129	batch.c - reserved for internal errors */
+
+#define _GNU_SOURCE		/* for MAP_ANONYMOUS and RUSAGE_THREAD */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <gmp.h>
+
+#include "gmprime.h"
+#include "debug.h"
+#include "parsqr.h"
+#include "lucas.h"
+#include "checkpoint.h"
+#include "hnlist.h"
+#include "stage.h"
+#include "batch.h"
+
+/*
+ * a candidate from the list
+ */
+struct batch_cand {
+    unsigned long h;		/* multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+    size_t footprint;		/* predicted bytes its test uses, 0 ==> no -M budget */
+    bool urgent;		/* true ==> from the urgent list */
+    bool resume;		/* true ==> preempted, resume from its checkpoint */
+    unsigned long idx;		/* with -S, position of n in the search */
+};
+
+/*
+ * candidates waiting ahead of the list, oldest first
+ */
+struct batch_queue {
+    struct batch_cand *cand;	/* queued candidates */
+    int len;			/* number of queued candidates */
+    int max;			/* number of candidates allocated */
+};
+
+/*
+ * resources used by the test of a candidate, with -t
+ */
+struct batch_usage {
+    uint64_t wall;		/* wall clock microseconds */
+    uint64_t utime;		/* user CPU microseconds, every thread of the worker */
+    uint64_t stime;		/* system CPU microseconds, every thread of the worker */
+    uint64_t thread;		/* user + system CPU microseconds of the squaring thread */
+    uint64_t minflt;		/* page reclaims */
+    uint64_t majflt;		/* page faults */
+    uint64_t nvcsw;		/* voluntary context switches */
+    uint64_t nivcsw;		/* involuntary context switches */
+    uint64_t gmp_allocs;	/* GMP allocations and reallocations */
+    uint64_t gmp_bytes;		/* bytes allocated and grown by GMP */
+    uint64_t gmp_peak;		/* most bytes allocated by GMP at once, over what was allocated at the start */
+};
+
+/*
+ * a search result waiting for the results of smaller n
+ */
+struct batch_done {
+    struct batch_cand cand;	/* candidate tested */
+    int status;			/* lucas_test() return */
+    struct batch_usage usage;	/* resources used, with -t */
+    bool have_usage;		/* true ==> usage is set */
+    bool valid;			/* true ==> cand and status are set */
+};
+
+/*
+ * job flags
+ */
+#define BATCH_JOB_CHECKPOINT	(0x1)	// checkpoint under checkpoint_dir/h-n
+#define BATCH_JOB_RESUME	(0x2)	// resume from the checkpoint under checkpoint_dir/h-n
+
+/*
+ * a job sent to a worker, and the result sent back
+ */
+struct batch_job {
+    uint64_t idx;		/* candidate number in the list */
+    uint64_t h;			/* multiplier of 2 */
+    uint64_t n;			/* power of 2 */
+    uint64_t flags;		/* BATCH_JOB_* flags */
+};
+struct batch_result {
+    uint64_t idx;		/* candidate number in the list */
+    int32_t status;		/* lucas_test() return */
+    struct batch_usage usage;	/* resources used, with -t */
+};
+
+/*
+ * per worker state shared between the scheduler and the worker
+ */
+struct batch_slot {
+    volatile int threads;	/* squaring threads the worker should use */
+};
+
+/*
+ * a worker process as seen by the scheduler
+ */
+struct batch_worker {
+    pid_t pid;			/* worker process ID, 0 ==> no worker */
+    int job_fd;			/* write jobs to the worker */
+    int result_fd;		/* read results from the worker */
+    bool busy;			/* true ==> worker is testing a candidate */
+    struct batch_cand cand;	/* if busy, candidate being tested */
+    unsigned long seq;		/* if busy, when cand was dispatched */
+    bool preempted;		/* true ==> told to checkpoint and exit */
+    bool cancelled;		/* true ==> killed, as the search no longer needs its result */
+};
+
+/*
+ * batch scheduler state
+ */
+struct batch {
+    struct hnlist list;		/* mapped candidate list */
+    struct batch_cand pending;	/* next candidate to dispatch */
+    bool have_pending;		/* true ==> pending is set, false ==> list is drained */
+    struct stages *stages;	/* stages the list flows through, NULL ==> search */
+    bool flowing;		/* true ==> more candidates are on their way out of the stages */
+    unsigned long count;	/* candidates dispatched so far, not counting resumes */
+    unsigned long dispatched;	/* jobs sent to workers so far */
+    int cores;			/* cores we may use */
+    int max_threads;		/* most squaring threads a single candidate may use */
+    int nworker;		/* number of worker slots */
+    struct batch_worker *worker;	/* worker slots */
+    struct batch_slot *slot;	/* shared worker slots */
+    struct lucas_opts *opts;	/* how each candidate is to be tested */
+    int status;			/* batch exit status so far */
+    size_t budget;		/* memory budget in bytes, 0 ==> no budget */
+    size_t in_use;		/* predicted bytes used by busy workers */
+    struct batch_cand wait[BATCH_LOOKAHEAD];	/* read ahead candidates, oldest first */
+    int nwait;			/* number of read ahead candidates */
+    struct hnlist urgent_list;	/* mapped urgent candidate list */
+    bool watch;			/* true ==> watch urgent_list for new candidates */
+    struct batch_queue urgent;	/* urgent candidates to dispatch first */
+    struct batch_queue held;	/* preempted candidates to resume before the list */
+    int preempt;		/* BATCH_PREEMPT_* policy */
+    bool search;		/* true ==> search for a prime instead of testing a list */
+    unsigned long search_h;	/* h of the search */
+    unsigned long search_odd;	/* search_h made odd */
+    int search_shift;		/* search_h is search_odd*2^search_shift */
+    unsigned long next_n;	/* next n of the search to sieve */
+    unsigned long search_max;	/* largest n of the search */
+    unsigned long nsearch;	/* candidates of the search that survived the sieve so far */
+    uint32_t *sieve_p;		/* odd primes below BATCH_SIEVE_LIMIT */
+    uint32_t *sieve_r;		/* search_h*2^(next_n-1) mod each prime */
+    int nsieve;			/* number of sieve primes */
+    unsigned long commit;	/* position of the next search result to announce */
+    unsigned long hit;		/* lowest position found prime, ULONG_MAX ==> none */
+    bool found;			/* true ==> the prime at position hit has been announced */
+    unsigned long window;	/* search positions tested ahead of commit */
+    struct batch_done *done;	/* search results by position mod window */
+    bool usage;			/* true ==> print the resources each candidate used (-t) */
+};
+
+/*
+ * GMP allocations of a worker, with -t
+ *
+ * Squaring helper threads may allocate too, so these are atomic.
+ */
+static void *(*gmp_alloc_func)(size_t size);	/* GMP allocation function we wrap */
+static void *(*gmp_realloc_func)(void *ptr, size_t old_size, size_t new_size);	/* GMP reallocation function we wrap */
+static void (*gmp_free_func)(void *ptr, size_t size);	/* GMP free function we wrap */
+static _Atomic uint64_t gmp_allocs = 0;	/* allocations and reallocations */
+static _Atomic uint64_t gmp_bytes = 0;	/* bytes allocated and grown */
+static _Atomic int64_t gmp_live = 0;	/* bytes allocated now, since the memory functions were installed */
+static _Atomic int64_t gmp_peak = 0;	/* most of gmp_live since the peak was reset */
+
+/*
+ * static functions
+ */
+static char *batch_abspath(const char *dir);
+static void batch_cand_dir(const char *checkpoint_dir, unsigned long h, unsigned long n, char *buf, size_t len);
+static void batch_fetch(struct batch *b);
+static void batch_sieve_init(struct batch *b);
+static void batch_search_next(struct batch *b);
+static void batch_urgent(struct batch *b);
+static void batch_push(struct batch_queue *q, const struct batch_cand *c);
+static bool batch_take(struct batch *b, struct batch_queue *q, struct batch_cand *c);
+static bool batch_remaining(const struct batch *b);
+static bool batch_ready(const struct batch *b);
+static bool batch_in_window(const struct batch *b, const struct batch_cand *c);
+static size_t batch_avail(const struct batch *b);
+static bool batch_pick(struct batch *b, struct batch_cand *c);
+static void batch_spawn(struct batch *b, int w);
+static void batch_worker_loop(int job_fd, int result_fd, struct batch_slot *slot, struct lucas_opts *opts);
+static void batch_dispatch(struct batch *b, int w);
+static void batch_record(struct batch *b, const struct batch_cand *c, int status, const struct batch_usage *u);
+static void batch_settle(struct batch *b, const struct batch_cand *c, int status, const struct batch_usage *u);
+static void batch_announce(struct batch *b, const struct batch_cand *c, int status, const struct batch_usage *u);
+static void batch_usage_begin(struct rusage *self, struct rusage *thread, struct timespec *wall, int64_t *live);
+static void batch_usage_end(const struct rusage *self, const struct rusage *thread, const struct timespec *wall,
+			    int64_t live, struct batch_usage *u);
+static uint64_t batch_usecs(const struct timeval *end, const struct timeval *start);
+static void *batch_gmp_alloc(size_t size);
+static void *batch_gmp_realloc(void *ptr, size_t old_size, size_t new_size);
+static void batch_gmp_free(void *ptr, size_t size);
+static void batch_gmp_grow(int64_t delta);
+static void batch_cancel(struct batch *b);
+static void batch_reap(struct batch *b, int w);
+static void batch_preempt(struct batch *b);
+static void batch_hold(struct batch *b, struct batch_cand *c);
+static void batch_rebalance(struct batch *b);
+static void careful_read(int fd, void *buf, size_t len, bool eof_ok, bool *eof);
+static void careful_write_fd(int fd, const void *buf, size_t len);
+
+
+/*
+ * batch_policy - convert a preemption policy name into a BATCH_PREEMPT_* value
+ *
+ * given:
+ *      name    none, largest or newest
+ *
+ * returns:
+ *      BATCH_PREEMPT_* value, or -1 if name is not a preemption policy
+ */
+int
+batch_policy(const char *name)
+{
+    if (name == NULL) {
+	return -1;
+    } else if (strcmp(name, "none") == 0) {
+	return BATCH_PREEMPT_NONE;
+    } else if (strcmp(name, "largest") == 0) {
+	return BATCH_PREEMPT_LARGEST;
+    } else if (strcmp(name, "newest") == 0) {
+	return BATCH_PREEMPT_NEWEST;
+    }
+    return -1;
+}
+
+
+/*
+ * batch_run - test a list of h*2^n-1 candidates
+ *
+ * given:
+ *      bopts           what list to test and with what resources
+ *      opts            how each candidate is to be tested
+ *
+ * returns:
+ *      EXIT_IS_PRIME           every candidate was proven prime
+ *      EXIT_IS_COMPOSITE       every candidate was tested and at least one is composite
+ *      otherwise               the largest exit code of a candidate that could not be tested
+ *
+ * Unless opts->quiet, as each test completes the result is printed to stdout
+ * using the same form as a single test.  Results appear in completion order.
+ * If opts->write_stats, the resources used by each test are printed to stderr.
+ *
+ * If opts->checkpoint_dir is not NULL, large tests checkpoint under it, and
+ * may be preempted by urgent candidates.
+ *
+ * This function does not return on error.
+ */
+int
+batch_run(const struct batch_opts *bopts, struct lucas_opts *opts)
+{
+    struct batch b;		/* batch scheduler state */
+    struct lucas_opts copts;	/* opts with an absolute checkpoint_dir */
+    struct pollfd *pfd;		/* result fds of busy workers */
+    int *pfd_worker;		/* worker slot of each pollfd */
+    int npfd;			/* number of pollfd in use */
+    int ret;			/* poll return */
+    int timeout;		/* poll timeout in milliseconds */
+    int w;			/* worker index */
+    int k;			/* pollfd index */
+    unsigned long first;	/* with -S, smallest m that can be tested */
+
+    /*
+     * firewall
+     */
+    if (bopts == NULL || (bopts->list == NULL && bopts->search_max == 0) || opts == NULL) {
+	err(120, __func__, "called with NULL arg(s)");
+	return EXIT_USAGE;	// NOT REACHED
+    }
+    if (bopts->cores < 1) {
+	err(120, __func__, "cores: %d must be >= 1", bopts->cores);
+	return EXIT_USAGE;	// NOT REACHED
+    }
+
+    /*
+     * map the candidate lists and parse the first candidates
+     */
+    memset(&b, 0, sizeof(b));
+    b.cores = bopts->cores;
+    b.max_threads = (bopts->max_threads < 1) ? 1 : bopts->max_threads;
+    b.opts = opts;
+    b.status = EXIT_IS_PRIME;
+    b.usage = opts->write_stats;
+    b.budget = bopts->budget;
+    b.preempt = BATCH_PREEMPT_NONE;
+    if (opts->checkpoint_dir != NULL) {
+	copts = *opts;
+	copts.checkpoint_dir = batch_abspath(opts->checkpoint_dir);
+	b.opts = &copts;
+	b.preempt = bopts->preempt;
+    }
+    b.hit = ULONG_MAX;
+    if (bopts->search_max > 0) {
+	b.search = true;
+	b.search_h = bopts->search_h;
+	b.next_n = bopts->search_n + 1;
+	b.search_max = bopts->search_max;
+	b.search_shift = __builtin_ctzl(b.search_h);
+	b.search_odd = b.search_h >> b.search_shift;
+	first = (unsigned long)(sizeof(unsigned long) * 8 - __builtin_clzl(b.search_odd));
+	first = (first > (unsigned long)b.search_shift) ? first - b.search_shift : 0;
+	if (first > b.next_n) {
+	    warn(__func__, "skipping m < %lu, for which %lu*2^m-1 with h made odd has h >= 2^m", first, b.search_h);
+	}
+	b.window = (unsigned long)b.cores * BATCH_SEARCH_AHEAD;
+	errno = 0;
+	b.done = calloc(b.window, sizeof(struct batch_done));
+	if (b.done == NULL) {
+	    errp(121, __func__, "calloc of %lu search results failed, errno: %d", b.window, errno);
+	    return EXIT_USAGE;	// NOT REACHED
+	}
+	batch_sieve_init(&b);
+    } else {
+	hnlist_open(&b.list, bopts->list);
+	b.stages = stage_start(&b.list);
+    }
+    batch_fetch(&b);
+    if (bopts->urgent != NULL) {
+	hnlist_watch(&b.urgent_list, bopts->urgent);
+	b.watch = true;
+	batch_urgent(&b);
+    }
+    if (b.search) {
+	dbg(DBG_LOW, "search for the smallest prime %lu*2^m-1 with %lu < m <= %lu on %d cores",
+	    b.search_h, bopts->search_n, b.search_max, b.cores);
+    } else {
+	dbg(DBG_LOW, "batch of candidates from %s on %d cores", bopts->list, b.cores);
+    }
+    if (b.budget > 0) {
+	dbg(DBG_LOW, "memory budget: %zu MB", b.budget / (1024 * 1024));
+    }
+    if (!batch_remaining(&b)) {
+	stage_stop(b.stages);
+	hnlist_close(&b.list);
+	hnlist_close(&b.urgent_list);
+	return (b.search ? EXIT_IS_COMPOSITE : EXIT_IS_PRIME);
+    }
+
+    /*
+     * allocate worker slots, one per core
+     */
+    b.nworker = b.cores;
+    errno = 0;
+    b.worker = calloc(b.nworker, sizeof(struct batch_worker));
+    pfd = calloc(b.nworker, sizeof(struct pollfd));
+    pfd_worker = calloc(b.nworker, sizeof(int));
+    if (b.worker == NULL || pfd == NULL || pfd_worker == NULL) {
+	errp(121, __func__, "calloc of %d workers failed, errno: %d", b.nworker, errno);
+	return EXIT_USAGE;	// NOT REACHED
+    }
+    errno = 0;
+    b.slot = mmap(NULL, b.nworker * sizeof(struct batch_slot), PROT_READ|PROT_WRITE,
+		  MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (b.slot == MAP_FAILED) {
+	errp(121, __func__, "mmap of %d shared worker slots failed, errno: %d", b.nworker, errno);
+	return EXIT_USAGE;	// NOT REACHED
+    }
+
+    /*
+     * collect results and hand out candidates until all have been tested
+     */
+    for (;;) {
+
+	/*
+	 * pick up candidates appended to the urgent list, and those out of the stages
+	 */
+	batch_urgent(&b);
+	if (!b.have_pending && b.flowing) {
+	    batch_fetch(&b);
+	}
+
+	/*
+	 * hand candidates to idle workers, starting workers as needed, but no more workers than candidates
+	 *
+	 * Memory freed by one test may admit several.
+	 */
+	for (w = 0; w < b.nworker; ++w) {
+	    if (b.worker[w].pid == 0 && batch_ready(&b)) {
+		b.slot[w].threads = 1;
+		batch_spawn(&b, w);
+	    }
+	    if (b.worker[w].pid != 0 && !b.worker[w].busy && !b.worker[w].cancelled) {
+		batch_dispatch(&b, w);
+	    }
+	}
+
+	/*
+	 * make room for urgent candidates that found no idle worker
+	 */
+	batch_preempt(&b);
+
+	/*
+	 * hand cores of idle workers to the large candidates still running
+	 */
+	batch_rebalance(&b);
+
+	/*
+	 * poll the busy workers, and now and then the urgent list and the stages
+	 */
+	npfd = 0;
+	for (w = 0; w < b.nworker; ++w) {
+	    if (b.worker[w].busy) {
+		pfd[npfd].fd = b.worker[w].result_fd;
+		pfd[npfd].events = POLLIN;
+		pfd[npfd].revents = 0;
+		pfd_worker[npfd] = w;
+		++npfd;
+	    }
+	}
+	if (npfd == 0 && !b.flowing) {
+	    break;
+	}
+	if (b.flowing && !b.have_pending) {
+	    timeout = BATCH_STAGE_POLL;
+	} else {
+	    timeout = (b.watch ? BATCH_URGENT_POLL : -1);
+	}
+	errno = 0;
+	ret = poll(pfd, npfd, timeout);
+	if (ret < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    errp(122, __func__, "poll of %d workers failed, errno: %d", npfd, errno);
+	    return EXIT_USAGE;	// NOT REACHED
+	}
+
+	/*
+	 * process each worker that has something to say
+	 */
+	for (k = 0; k < npfd; ++k) {
+	    struct batch_result result;	/* result from the worker */
+	    bool eof;			/* true ==> worker died */
+
+	    if (pfd[k].revents == 0) {
+		continue;
+	    }
+	    w = pfd_worker[k];
+	    careful_read(b.worker[w].result_fd, &result, sizeof(result), true, &eof);
+	    if (eof) {
+		/* the worker died in the middle of a candidate, or was preempted */
+		batch_reap(&b, w);
+	    } else {
+		b.worker[w].busy = false;
+		b.in_use -= b.worker[w].cand.footprint;
+		batch_record(&b, &b.worker[w].cand, result.status, (b.usage ? &result.usage : NULL));
+		if (b.worker[w].cancelled) {
+		    /* the result beat the SIGKILL of a cancelled test, so the worker is dying */
+		    batch_reap(&b, w);
+		}
+	    }
+	}
+    }
+
+    /*
+     * tell the workers that there is no more work and wait for them
+     */
+    for (w = 0; w < b.nworker; ++w) {
+	if (b.worker[w].pid != 0) {
+	    (void) close(b.worker[w].job_fd);
+	    (void) close(b.worker[w].result_fd);
+	    (void) waitpid(b.worker[w].pid, NULL, 0);
+	    b.worker[w].pid = 0;
+	}
+    }
+    (void) munmap(b.slot, b.nworker * sizeof(struct batch_slot));
+    free(pfd);
+    free(pfd_worker);
+    free(b.worker);
+    free(b.urgent.cand);
+    free(b.held.cand);
+    free(b.done);
+    free(b.sieve_p);
+    free(b.sieve_r);
+    stage_stop(b.stages);
+    hnlist_close(&b.list);
+    hnlist_close(&b.urgent_list);
+    if (b.opts == &copts) {
+	free(copts.checkpoint_dir);
+    }
+    if (b.search) {
+	if (b.status == EXIT_IS_PRIME || b.status == EXIT_IS_COMPOSITE) {
+	    b.status = (b.found ? EXIT_IS_PRIME : EXIT_IS_COMPOSITE);
+	}
+	dbg(DBG_LOW, "search of %lu candidates finished, status: %d", b.count, b.status);
+    } else {
+	dbg(DBG_LOW, "batch of %lu candidates from %s finished, status: %d", b.count, bopts->list, b.status);
+    }
+    return b.status;
+}
+
+
+/*
+ * batch_abspath - create a checkpoint directory if needed and return its absolute path
+ *
+ * given:
+ *      dir     checkpoint directory
+ *
+ * returns:
+ *      malloced absolute path of dir
+ *
+ * The workers form the checkpoint directory of each test they checkpoint
+ * under this path, so the paths they report do not depend on where the
+ * batch was started.
+ *
+ * This function does not return on error.
+ */
+static char *
+batch_abspath(const char *dir)
+{
+    char *path;			/* absolute path of dir */
+
+    errno = 0;
+    if (mkdir(dir, DEF_DIR_MODE) < 0 && errno != EEXIST) {
+	errp(EXIT_CHKPT_ACCESS, __func__, "cannot create checkpoint directory: %s, errno: %d", dir, errno);
+	// exit(4);
+	exit(EXIT_CHKPT_ACCESS);	// NOT REACHED
+    }
+    errno = 0;
+    path = realpath(dir, NULL);
+    if (path == NULL) {
+	errp(EXIT_CHKPT_ACCESS, __func__, "cannot determine the path of checkpoint directory: %s, errno: %d", dir, errno);
+	// exit(4);
+	exit(EXIT_CHKPT_ACCESS);	// NOT REACHED
+    }
+    return path;
+}
+
+
+/*
+ * batch_cand_dir - form the checkpoint directory of a candidate
+ *
+ * given:
+ *      checkpoint_dir  absolute batch checkpoint directory
+ *      h               multiplier of 2
+ *      n               power of 2
+ *      buf             where to form checkpoint_dir/h-n
+ *      len             size of buf
+ *
+ * This function does not return on error.
+ */
+static void
+batch_cand_dir(const char *checkpoint_dir, unsigned long h, unsigned long n, char *buf, size_t len)
+{
+    int ret;			/* snprintf return */
+
+    ret = snprintf(buf, len, "%s/%lu-%lu", checkpoint_dir, h, n);
+    if (ret < 0 || (size_t)ret >= len) {
+	err(128, __func__, "checkpoint directory of %lu*2^%lu-1 under %s is too long", h, n, checkpoint_dir);
+	return;	// NOT REACHED
+    }
+    return;
+}
+
+
+/*
+ * batch_fetch - take the next candidate to dispatch out of the stages
+ *
+ * given:
+ *      b       batch scheduler state
+ *
+ * Candidates in which the stages found a factor are reported composite
+ * as they come out.  When no candidate is out yet, but more will be,
+ * have_pending is false and flowing is true.
+ */
+static void
+batch_fetch(struct batch *b)
+{
+    struct stage_item item;	/* candidate out of the stages */
+    int ret;			/* stage_next() return */
+
+    if (b->search) {
+	batch_search_next(b);
+	return;
+    }
+    b->have_pending = false;
+    for (;;) {
+	ret = stage_next(b->stages, &item);
+	b->flowing = (ret == STAGE_EMPTY);
+	if (ret != STAGE_READY) {
+	    return;
+	}
+	b->pending.h = item.h;
+	b->pending.n = item.n;
+	b->pending.footprint = 0;
+	b->pending.urgent = false;
+	b->pending.resume = false;
+	if (item.factor == 0) {
+	    break;
+	}
+	dbg(DBG_MED, "%lu*2^%lu-1 has the factor %" PRIu32, item.h, item.n, item.factor);
+	++b->count;
+	batch_announce(b, &b->pending, EXIT_IS_COMPOSITE, NULL);
+    }
+    b->have_pending = true;
+    if (b->budget > 0) {
+	b->pending.footprint = lucas_footprint(b->pending.h, b->pending.n, b->opts->engine);
+    }
+    return;
+}
+
+
+/*
+ * batch_sieve_init - setup the sieve of a search
+ *
+ * given:
+ *      b       batch scheduler state
+ *
+ * This function does not return on error.
+ */
+static void
+batch_sieve_init(struct batch *b)
+{
+    uint32_t p;			/* odd number below BATCH_SIEVE_LIMIT */
+    uint32_t d;			/* trial divisor of p */
+    uint64_t r;			/* search_h*2^(next_n-1) mod p */
+    uint64_t sq;		/* 2^(2^bit) mod p */
+    unsigned long e;		/* bits of next_n-1 left to use */
+
+    errno = 0;
+    b->sieve_p = calloc(BATCH_SIEVE_LIMIT / 2, sizeof(uint32_t));
+    b->sieve_r = calloc(BATCH_SIEVE_LIMIT / 2, sizeof(uint32_t));
+    if (b->sieve_p == NULL || b->sieve_r == NULL) {
+	errp(121, __func__, "calloc of %d sieve primes failed, errno: %d", BATCH_SIEVE_LIMIT / 2, errno);
+	return;	// NOT REACHED
+    }
+    b->nsieve = 0;
+    for (p = 3; p < BATCH_SIEVE_LIMIT; p += 2) {
+	for (d = 3; d * d <= p && p % d != 0; d += 2) {
+	}
+	if (d * d <= p) {
+	    continue;
+	}
+	r = b->search_h % p;
+	sq = 2;
+	for (e = b->next_n - 1; e > 0; e >>= 1) {
+	    if (e & 1) {
+		r = (r * sq) % p;
+	    }
+	    sq = (sq * sq) % p;
+	}
+	b->sieve_p[b->nsieve] = p;
+	b->sieve_r[b->nsieve] = (uint32_t)r;
+	++b->nsieve;
+    }
+    return;
+}
+
+
+/*
+ * batch_search_next - find the next n of a search that survives the sieve
+ *
+ * given:
+ *      b       batch scheduler state
+ *
+ * An n is skipped when h*2^n-1 is a multiple of a sieve prime (and larger
+ * than it), or when, with h made odd, h >= 2^n as then h*2^n-1 is not a
+ * Riesel candidate.
+ */
+static void
+batch_search_next(struct batch *b)
+{
+    unsigned long n;		/* n being sieved */
+    bool factor;		/* true ==> h*2^n-1 has a small factor */
+    int k;			/* sieve prime index */
+
+    b->have_pending = false;
+    while (b->next_n <= b->search_max) {
+	n = b->next_n++;
+	factor = false;
+	for (k = 0; k < b->nsieve; ++k) {
+	    b->sieve_r[k] <<= 1;
+	    if (b->sieve_r[k] >= b->sieve_p[k]) {
+		b->sieve_r[k] -= b->sieve_p[k];
+	    }
+	    if (b->sieve_r[k] == 1) {
+		factor = true;
+	    }
+	}
+	if (factor && n >= BATCH_SIEVE_MIN_N) {
+	    dbg(DBG_VHIGH, "%lu*2^%lu-1 has a factor < %d", b->search_h, n, BATCH_SIEVE_LIMIT);
+	    continue;
+	}
+	if (n + b->search_shift < sizeof(unsigned long) * 8 && (b->search_odd >> (n + b->search_shift)) != 0) {
+	    continue;
+	}
+	b->pending.h = b->search_h;
+	b->pending.n = n;
+	b->pending.footprint = 0;
+	b->pending.urgent = false;
+	b->pending.resume = false;
+	b->pending.idx = b->nsearch++;
+	b->have_pending = true;
+	return;
+    }
+    return;
+}
+
+
+/*
+ * batch_urgent - queue the candidates appended to the urgent list
+ *
+ * given:
+ *      b       batch scheduler state
+ *
+ * This function does not return on a malformed list.
+ */
+static void
+batch_urgent(struct batch *b)
+{
+    struct batch_cand c;	/* urgent candidate */
+
+    if (!b->watch) {
+	return;
+    }
+    (void) hnlist_refresh(&b->urgent_list);
+    while (hnlist_next(&b->urgent_list, &c.h, &c.n)) {
+	c.footprint = 0;
+	if (b->budget > 0) {
+	    c.footprint = lucas_footprint(c.h, c.n, b->opts->engine);
+	}
+	c.urgent = true;
+	c.resume = false;
+	dbg(DBG_LOW, "urgent candidate: %lu*2^%lu-1", c.h, c.n);
+	batch_push(&b->urgent, &c);
+    }
+    return;
+}
+
+
+/*
+ * batch_push - add a candidate to the end of a queue
+ *
+ * given:
+ *      q       queue
+ *      c       candidate to add
+ *
+ * This function does not return on error.
+ */
+static void
+batch_push(struct batch_queue *q, const struct batch_cand *c)
+{
+    struct batch_cand *cand;	/* realloced queue */
+    int max;			/* new queue size */
+
+    if (q->len >= q->max) {
+	max = (q->max > 0) ? 2 * q->max : 16;
+	errno = 0;
+	cand = realloc(q->cand, max * sizeof(q->cand[0]));
+	if (cand == NULL) {
+	    errp(121, __func__, "realloc of %d queued candidates failed, errno: %d", max, errno);
+	    return;	// NOT REACHED
+	}
+	q->cand = cand;
+	q->max = max;
+    }
+    q->cand[q->len++] = *c;
+    return;
+}
+
+
+/*
+ * batch_take - take the oldest candidate of a queue if it fits in the budget
+ *
+ * given:
+ *      b       batch scheduler state
+ *      q       non-empty queue
+ *      c       where to store the candidate
+ *
+ * returns:
+ *      true ==> c is to be dispatched, false ==> the candidate waits for memory
+ *
+ * Nothing backfills while a queued candidate waits: the memory is kept for it.
+ */
+static bool
+batch_take(struct batch *b, struct batch_queue *q, struct batch_cand *c)
+{
+    if (b->budget > 0 && b->in_use > 0 && q->cand[0].footprint > batch_avail(b)) {
+	return false;
+    }
+    *c = q->cand[0];
+    memmove(&q->cand[0], &q->cand[1], (q->len - 1) * sizeof(q->cand[0]));
+    --q->len;
+    return true;
+}
+
+
+/*
+ * batch_remaining - determine if candidates remain to be dispatched
+ */
+static bool
+batch_remaining(const struct batch *b)
+{
+    if (b->search) {
+	return b->have_pending && batch_in_window(b, &b->pending);
+    }
+    return b->flowing || batch_ready(b);
+}
+
+
+/*
+ * batch_in_window - determine if a candidate may be dispatched now
+ *
+ * given:
+ *      b       batch scheduler state
+ *      c       candidate
+ *
+ * A search candidate may only be dispatched while no smaller n has been
+ * found to be prime, and while its result fits in the window of results
+ * waiting to be announced.  Other candidates always may.
+ */
+static bool
+batch_in_window(const struct batch *b, const struct batch_cand *c)
+{
+    if (!b->search) {
+	return true;
+    }
+    return c->idx < b->hit && c->idx < b->commit + b->window;
+}
+
+
+/*
+ * batch_ready - determine if candidates are ready to be dispatched
+ *
+ * Unlike batch_remaining(), candidates still on their way out of the
+ * stages do not count.
+ */
+static bool
+batch_ready(const struct batch *b)
+{
+    if (b->search) {
+	return batch_remaining(b);
+    }
+    return b->have_pending || b->nwait > 0 || b->urgent.len > 0 || b->held.len > 0;
+}
+
+
+/*
+ * batch_avail - bytes of the memory budget not used by busy workers
+ */
+static size_t
+batch_avail(const struct batch *b)
+{
+    return (b->budget > b->in_use) ? b->budget - b->in_use : 0;
+}
+
+
+/*
+ * batch_pick - choose the next candidate to dispatch
+ *
+ * given:
+ *      b       batch scheduler state
+ *      c       where to store the candidate
+ *
+ * returns:
+ *      true ==> c is to be dispatched, false ==> nothing to dispatch now
+ *
+ * Urgent candidates come first, then preempted candidates that resume.
+ * After that, without a budget, candidates are dispatched in list order.
+ * With one, the oldest candidate is dispatched if it fits, or if nothing is
+ * running.  Otherwise the first read ahead candidate that fits and whose n
+ * is at least BATCH_BACKFILL_RATIO times smaller backfills, so small tests
+ * keep the cores busy without holding the oldest candidate back for long.
+ * A search candidate waits while it is outside the window of the search
+ * (see batch_in_window()).
+ */
+static bool
+batch_pick(struct batch *b, struct batch_cand *c)
+{
+    size_t avail;		/* bytes of the budget not in use */
+    int k;			/* read ahead index */
+
+    /*
+     * urgent candidates, then preempted ones, in the order each was queued
+     */
+    if (b->urgent.len > 0) {
+	return batch_take(b, &b->urgent, c);
+    }
+    if (b->held.len > 0) {
+	return batch_take(b, &b->held, c);
+    }
+
+    /*
+     * without a budget, take candidates in order
+     */
+    if (b->budget == 0) {
+	if (!b->have_pending || !batch_in_window(b, &b->pending)) {
+	    return false;
+	}
+	*c = b->pending;
+	batch_fetch(b);
+	return true;
+    }
+
+    /*
+     * read ahead
+     */
+    while (b->nwait < BATCH_LOOKAHEAD && b->have_pending && batch_in_window(b, &b->pending)) {
+	b->wait[b->nwait++] = b->pending;
+	batch_fetch(b);
+    }
+    if (b->nwait == 0) {
+	return false;
+    }
+
+    /*
+     * the oldest candidate if it fits, otherwise a small one that fits
+     */
+    avail = batch_avail(b);
+    if (b->wait[0].footprint <= avail || b->in_use == 0) {
+	k = 0;
+	if (b->wait[0].footprint > b->budget) {
+	    warn(__func__, "%lu*2^%lu-1 needs about %zu MB, more than the budget, testing it alone",
+		 b->wait[0].h, b->wait[0].n, b->wait[0].footprint / (1024 * 1024));
+	}
+    } else {
+	for (k = 1; k < b->nwait; ++k) {
+	    if (b->wait[k].footprint <= avail && b->wait[k].n * BATCH_BACKFILL_RATIO <= b->wait[0].n) {
+		dbg(DBG_MED, "%lu*2^%lu-1 backfills while %lu*2^%lu-1 waits for %zu MB",
+		    b->wait[k].h, b->wait[k].n, b->wait[0].h, b->wait[0].n, b->wait[0].footprint / (1024 * 1024));
+		break;
+	    }
+	}
+	if (k >= b->nwait) {
+	    return false;
+	}
+    }
+    if (!batch_in_window(b, &b->wait[k])) {
+	return false;
+    }
+    *c = b->wait[k];
+    memmove(&b->wait[k], &b->wait[k + 1], (b->nwait - k - 1) * sizeof(b->wait[0]));
+    --b->nwait;
+    return true;
+}
+
+
+/*
+ * batch_spawn - fork a worker process
+ *
+ * given:
+ *      b       batch scheduler state
+ *      w       worker slot to start
+ *
+ * This function does not return on error.
+ */
+static void
+batch_spawn(struct batch *b, int w)
+{
+    int job_pipe[2];		/* scheduler to worker */
+    int result_pipe[2];		/* worker to scheduler */
+    pid_t pid;			/* fork return */
+    int i;			/* worker index */
+
+    /*
+     * setup pipes
+     */
+    errno = 0;
+    if (pipe(job_pipe) < 0 || pipe(result_pipe) < 0) {
+	errp(124, __func__, "pipe failed, errno: %d", errno);
+	return;	// NOT REACHED
+    }
+
+    /*
+     * do not let the worker inherit unflushed output
+     */
+    fflush(stdout);
+    fflush(stderr);
+
+    /*
+     * fork the worker
+     */
+    errno = 0;
+    pid = fork();
+    if (pid < 0) {
+	errp(124, __func__, "fork failed, errno: %d", errno);
+	return;	// NOT REACHED
+    } else if (pid == 0) {
+
+	/*
+	 * worker: close the pipes of the other workers and our scheduler ends
+	 */
+	for (i = 0; i < b->nworker; ++i) {
+	    if (i != w && b->worker[i].pid != 0) {
+		(void) close(b->worker[i].job_fd);
+		(void) close(b->worker[i].result_fd);
+	    }
+	}
+	(void) close(job_pipe[1]);
+	(void) close(result_pipe[0]);
+	batch_worker_loop(job_pipe[0], result_pipe[1], &b->slot[w], b->opts);
+	exit(EXIT_IS_PRIME);
+    }
+
+    /*
+     * scheduler
+     */
+    (void) close(job_pipe[0]);
+    (void) close(result_pipe[1]);
+    b->worker[w].pid = pid;
+    b->worker[w].job_fd = job_pipe[1];
+    b->worker[w].result_fd = result_pipe[0];
+    b->worker[w].busy = false;
+    b->slot[w].threads = 1;
+    dbg(DBG_MED, "started batch worker %d: pid %d", w, pid);
+    return;
+}
+
+
+/*
+ * batch_worker_loop - test candidates sent by the scheduler until EOF
+ *
+ * given:
+ *      job_fd          read jobs from this fd
+ *      result_fd       write results to this fd
+ *      slot            shared state of this worker
+ *      opts            how each candidate is to be tested
+ *
+ * This function does not return on error.
+ */
+static void
+batch_worker_loop(int job_fd, int result_fd, struct batch_slot *slot, struct lucas_opts *opts)
+{
+    struct lucas_opts wopts;	/* how this worker tests candidates */
+    struct batch_job job;	/* candidate to test */
+    struct batch_result result;	/* result of the test */
+    bool eof;			/* true ==> no more jobs */
+    char dir[PATH_MAX + 1];	/* checkpoint directory of a checkpointed test */
+    struct rusage self;		/* worker rusage when the test started */
+    struct rusage thread;	/* squaring thread rusage when the test started */
+    struct timespec wall;	/* when the test started */
+    int64_t live = 0;		/* GMP bytes allocated when the test started */
+
+    /*
+     * results, and with -t the resources each test used, are announced by the scheduler
+     */
+    wopts = *opts;
+    wopts.quiet = true;
+    wopts.write_stats = false;
+    wopts.threads = &slot->threads;
+    if (opts->write_stats) {
+	mp_get_memory_functions(&gmp_alloc_func, &gmp_realloc_func, &gmp_free_func);
+	mp_set_memory_functions(batch_gmp_alloc, batch_gmp_realloc, batch_gmp_free);
+    }
+
+    /*
+     * test candidates until the scheduler closes the job pipe
+     */
+    for (;;) {
+	careful_read(job_fd, &job, sizeof(job), true, &eof);
+	if (eof) {
+	    break;
+	}
+	dbg(DBG_MED, "worker %d testing %" PRIu64 "*2^%" PRIu64 "-1", getpid(), job.h, job.n);
+	wopts.checkpoint_dir = NULL;
+	wopts.restore = opts->restore;
+	wopts.force = opts->force;
+	if (job.flags & BATCH_JOB_CHECKPOINT) {
+	    batch_cand_dir(opts->checkpoint_dir, (unsigned long)job.h, (unsigned long)job.n, dir, sizeof(dir));
+	    wopts.checkpoint_dir = dir;
+	    wopts.restore = (job.flags & BATCH_JOB_RESUME) != 0;
+	    wopts.force = !wopts.restore;
+	    if (wopts.restore) {
+		dbg(DBG_MED, "worker %d resuming from: %s", getpid(), dir);
+	    }
+	}
+	memset(&result, 0, sizeof(result));
+	result.idx = job.idx;
+	if (opts->write_stats) {
+	    batch_usage_begin(&self, &thread, &wall, &live);
+	}
+	result.status = lucas_test((unsigned long)job.h, (unsigned long)job.n, &wopts);
+	if (opts->write_stats) {
+	    batch_usage_end(&self, &thread, &wall, live, &result.usage);
+	}
+	careful_write_fd(result_fd, &result, sizeof(result));
+    }
+    return;
+}
+
+
+/*
+ * batch_dispatch - send the next candidate, if any, to an idle worker
+ *
+ * given:
+ *      b       batch scheduler state
+ *      w       idle worker
+ *
+ * This function does not return on error.
+ */
+static void
+batch_dispatch(struct batch *b, int w)
+{
+    struct batch_job job;	/* candidate to test */
+    struct batch_cand c;	/* candidate chosen */
+
+    if (!batch_pick(b, &c)) {
+	return;
+    }
+    job.idx = b->dispatched;
+    job.h = c.h;
+    job.n = c.n;
+    job.flags = 0;
+    if (b->opts->checkpoint_dir != NULL && c.n >= BATCH_CHECKPOINT_MIN_N) {
+	job.flags |= BATCH_JOB_CHECKPOINT;
+	if (c.resume) {
+	    job.flags |= BATCH_JOB_RESUME;
+	}
+    }
+    if (!c.resume) {
+	++b->count;
+    }
+    b->worker[w].cand = c;
+    b->worker[w].seq = b->dispatched++;
+    b->worker[w].preempted = false;
+    b->worker[w].cancelled = false;
+    b->slot[w].threads = 1;
+    careful_write_fd(b->worker[w].job_fd, &job, sizeof(job));
+    b->worker[w].busy = true;
+    b->in_use += c.footprint;
+    return;
+}
+
+
+/*
+ * batch_record - record and announce the result of a candidate
+ *
+ * given:
+ *      b       batch scheduler state
+ *      c       candidate tested
+ *      status  exit code of the candidate's test
+ *      u       resources used by the test, NULL ==> not known
+ */
+static void
+batch_record(struct batch *b, const struct batch_cand *c, int status, const struct batch_usage *u)
+{
+    if (b->search) {
+	batch_settle(b, c, status, u);
+    } else {
+	batch_announce(b, c, status, u);
+    }
+    return;
+}
+
+
+/*
+ * batch_settle - record the result of a search candidate, announcing results in order
+ *
+ * given:
+ *      b       batch scheduler state
+ *      c       candidate tested
+ *      status  exit code of the candidate's test
+ *      u       resources used by the test, NULL ==> not known
+ *
+ * A prime cancels the tests of larger n.  Results of larger n than a prime
+ * are dropped, and so is everything once the smallest prime is announced.
+ */
+static void
+batch_settle(struct batch *b, const struct batch_cand *c, int status, const struct batch_usage *u)
+{
+    struct batch_done *d;	/* where to keep the result */
+
+    if (c->idx > b->hit || b->found) {
+	dbg(DBG_MED, "dropping the result of %lu*2^%lu-1", c->h, c->n);
+	return;
+    }
+    d = &b->done[c->idx % b->window];
+    d->cand = *c;
+    d->status = status;
+    d->have_usage = (u != NULL);
+    if (u != NULL) {
+	d->usage = *u;
+    }
+    d->valid = true;
+    if (status == EXIT_IS_PRIME) {
+	b->hit = c->idx;
+	batch_cancel(b);
+    }
+
+    /*
+     * announce results that no smaller n is waiting for
+     */
+    for (d = &b->done[b->commit % b->window]; d->valid; d = &b->done[b->commit % b->window]) {
+	d->valid = false;
+	++b->commit;
+	batch_announce(b, &d->cand, d->status, (d->have_usage ? &d->usage : NULL));
+	if (d->status == EXIT_IS_PRIME) {
+	    b->found = true;
+	    break;
+	}
+    }
+    return;
+}
+
+
+/*
+ * batch_cancel - kill the tests of a search that no longer matter
+ *
+ * given:
+ *      b       batch scheduler state
+ *
+ * This function does not return on error.
+ */
+static void
+batch_cancel(struct batch *b)
+{
+    int w;			/* worker index */
+
+    for (w = 0; w < b->nworker; ++w) {
+	if (b->worker[w].busy && !b->worker[w].cancelled && b->worker[w].cand.idx > b->hit) {
+	    dbg(DBG_LOW, "cancelling %lu*2^%lu-1 on worker %d", b->worker[w].cand.h, b->worker[w].cand.n, w);
+	    errno = 0;
+	    if (kill(b->worker[w].pid, SIGKILL) < 0 && errno != ESRCH) {
+		errp(129, __func__, "cannot signal worker %d pid %d, errno: %d", w, b->worker[w].pid, errno);
+		return;	// NOT REACHED
+	    }
+	    b->worker[w].cancelled = true;
+	}
+    }
+    return;
+}
+
+
+/*
+ * batch_announce - announce the result of a candidate and fold it into the batch status
+ *
+ * given:
+ *      b       batch scheduler state
+ *      c       candidate tested
+ *      status  exit code of the candidate's test
+ *      u       resources used by the test, NULL ==> not known
+ */
+static void
+batch_announce(struct batch *b, const struct batch_cand *c, int status, const struct batch_usage *u)
+{
+    switch (status) {
+    case EXIT_IS_PRIME:
+	if (!b->opts->quiet) {
+	    printf("%lu * 2 ^ %lu - 1 is prime\n", c->h, c->n);
+	}
+	break;
+    case EXIT_IS_COMPOSITE:
+	if (!b->opts->quiet) {
+	    printf("%lu * 2 ^ %lu - 1 is composite\n", c->h, c->n);
+	}
+	if (b->status == EXIT_IS_PRIME) {
+	    b->status = EXIT_IS_COMPOSITE;
+	}
+	break;
+    default:
+	warn(__func__, "%lu * 2 ^ %lu - 1 test ended with exit code: %d", c->h, c->n, status);
+	if (b->status == EXIT_IS_PRIME || b->status == EXIT_IS_COMPOSITE || status > b->status) {
+	    b->status = status;
+	}
+	break;
+    }
+    fflush(stdout);
+
+    /*
+     * follow the result with the resources the test used
+     */
+    if (u != NULL) {
+	fprintf(stderr, "%lu * 2 ^ %lu - 1 used: wall %.6f user %.6f sys %.6f thread %.6f "
+		"minflt %" PRIu64 " majflt %" PRIu64 " nvcsw %" PRIu64 " nivcsw %" PRIu64 " "
+		"gmp_allocs %" PRIu64 " gmp_bytes %" PRIu64 " gmp_peak %" PRIu64 "\n",
+		c->h, c->n, (double)u->wall / 1.0e6, (double)u->utime / 1.0e6, (double)u->stime / 1.0e6,
+		(double)u->thread / 1.0e6, u->minflt, u->majflt, u->nvcsw, u->nivcsw,
+		u->gmp_allocs, u->gmp_bytes, u->gmp_peak);
+	fflush(stderr);
+    }
+    return;
+}
+
+
+/*
+ * batch_reap - collect a worker that died while testing a candidate
+ *
+ * given:
+ *      b       batch scheduler state
+ *      w       worker that died
+ *
+ * The exit code of the worker becomes the result of the candidate it was testing,
+ * unless it was preempted and checkpointed (or was stopped before it could),
+ * in which case the candidate is queued to resume.
+ *
+ * This function does not return on error.
+ */
+static void
+batch_reap(struct batch *b, int w)
+{
+    int wstatus;		/* worker wait status */
+    int status;			/* candidate result */
+
+    (void) close(b->worker[w].job_fd);
+    (void) close(b->worker[w].result_fd);
+    errno = 0;
+    if (waitpid(b->worker[w].pid, &wstatus, 0) < 0) {
+	errp(125, __func__, "waitpid of worker %d pid %d failed, errno: %d", w, b->worker[w].pid, errno);
+	return;	// NOT REACHED
+    }
+    if (WIFEXITED(wstatus)) {
+	status = WEXITSTATUS(wstatus);
+    } else if (WIFSIGNALED(wstatus)) {
+	if (!b->worker[w].preempted && !b->worker[w].cancelled) {
+	    warn(__func__, "worker %d pid %d killed by signal: %d", w, b->worker[w].pid, WTERMSIG(wstatus));
+	}
+	status = FORCED_EXIT;
+    } else {
+	status = FORCED_EXIT;
+    }
+    dbg(DBG_MED, "batch worker %d: pid %d ended with: %d", w, b->worker[w].pid, status);
+    b->worker[w].pid = 0;
+    if (b->worker[w].busy) {
+	b->worker[w].busy = false;
+	b->in_use -= b->worker[w].cand.footprint;
+	if (b->worker[w].preempted && (status == EXIT_SIGNAL || WIFSIGNALED(wstatus))) {
+	    batch_hold(b, &b->worker[w].cand);
+	} else {
+	    batch_record(b, &b->worker[w].cand, status, NULL);
+	}
+    }
+    return;
+}
+
+
+/*
+ * batch_preempt - checkpoint and stop running tests so urgent candidates need not wait
+ *
+ * given:
+ *      b       batch scheduler state
+ *
+ * Each urgent candidate that can count on neither an idle worker, nor a
+ * worker already preempted, preempts a running test that checkpoints.
+ * The policy picks the test with the largest n, or the one started last.
+ * Urgent tests and tests too small to checkpoint are never preempted.
+ *
+ * Preemption frees cores, not memory: an urgent candidate waiting for
+ * memory under -M waits for running tests to finish.
+ *
+ * This function does not return on error.
+ */
+static void
+batch_preempt(struct batch *b)
+{
+    int avail = 0;		/* workers idle or being preempted */
+    int victim;			/* worker to preempt, -1 ==> none */
+    int w;			/* worker index */
+
+    if (b->preempt == BATCH_PREEMPT_NONE || b->urgent.len == 0) {
+	return;
+    }
+    for (w = 0; w < b->nworker; ++w) {
+	if (b->worker[w].pid == 0 || !b->worker[w].busy || b->worker[w].preempted) {
+	    ++avail;
+	}
+    }
+    while (b->urgent.len > avail) {
+
+	/*
+	 * pick the test to preempt
+	 */
+	victim = -1;
+	for (w = 0; w < b->nworker; ++w) {
+	    if (!b->worker[w].busy || b->worker[w].preempted || b->worker[w].cand.urgent ||
+		b->worker[w].cand.n < BATCH_CHECKPOINT_MIN_N) {
+		continue;
+	    }
+	    if (victim < 0 ||
+		(b->preempt == BATCH_PREEMPT_LARGEST && b->worker[w].cand.n > b->worker[victim].cand.n) ||
+		(b->preempt == BATCH_PREEMPT_NEWEST && b->worker[w].seq > b->worker[victim].seq)) {
+		victim = w;
+	    }
+	}
+	if (victim < 0) {
+	    return;
+	}
+
+	/*
+	 * ask it to checkpoint and exit
+	 */
+	dbg(DBG_LOW, "preempting %lu*2^%lu-1 on worker %d for urgent %lu*2^%lu-1",
+	    b->worker[victim].cand.h, b->worker[victim].cand.n, victim, b->urgent.cand[avail].h, b->urgent.cand[avail].n);
+	errno = 0;
+	if (kill(b->worker[victim].pid, SIGINT) < 0 && errno != ESRCH) {
+	    errp(129, __func__, "cannot signal worker %d pid %d, errno: %d", victim, b->worker[victim].pid, errno);
+	    return;	// NOT REACHED
+	}
+	b->worker[victim].preempted = true;
+	++avail;
+    }
+    return;
+}
+
+
+/*
+ * batch_hold - queue a preempted candidate to resume
+ *
+ * given:
+ *      b       batch scheduler state
+ *      c       candidate that was preempted
+ *
+ * A test preempted before it wrote its first checkpoint starts over.
+ *
+ * This function does not return on error.
+ */
+static void
+batch_hold(struct batch *b, struct batch_cand *c)
+{
+    char dir[PATH_MAX + 1];	/* checkpoint directory of c */
+    char path[PATH_MAX + 1];	/* current checkpoint file of c */
+    int ret;			/* snprintf return */
+
+    batch_cand_dir(b->opts->checkpoint_dir, c->h, c->n, dir, sizeof(dir));
+    ret = snprintf(path, sizeof(path), "%s/%s", dir, CHKPT_CUR_FILE);
+    if (ret < 0 || (size_t)ret >= sizeof(path)) {
+	err(128, __func__, "checkpoint file under %s is too long", dir);
+	return;	// NOT REACHED
+    }
+    c->resume = (access(path, R_OK) == 0);
+    dbg(DBG_LOW, "%lu*2^%lu-1 preempted, it will %s", c->h, c->n,
+	(c->resume ? "resume from its checkpoint" : "start over"));
+    batch_push(&b->held, c);
+    return;
+}
+
+
+/*
+ * batch_rebalance - decide how many squaring threads each running candidate uses
+ *
+ * given:
+ *      b       batch scheduler state
+ *
+ * While candidates remain to be dispatched, each worker squares with one thread.
+ * After that, the cores of idle workers are shared among the running candidates
+ * that are large enough to benefit from squaring with several threads.
+ */
+static void
+batch_rebalance(struct batch *b)
+{
+    int running = 0;		/* busy workers */
+    int large = 0;		/* busy workers testing a large candidate */
+    int spare;			/* cores not used by a busy worker */
+    int share;			/* spare cores given to each large candidate */
+    int extra;			/* large candidates that get one more core */
+    int threads;		/* threads for a worker */
+    int w;			/* worker index */
+
+    /*
+     * count running and large candidates
+     */
+    for (w = 0; w < b->nworker; ++w) {
+	if (b->worker[w].busy) {
+	    ++running;
+	    if (b->worker[w].cand.n >= PARSQR_MIN_BITS) {
+		++large;
+	    }
+	}
+    }
+
+    /*
+     * share spare cores once there is nothing left to dispatch
+     */
+    spare = b->cores - running;
+    if (batch_remaining(b) || large == 0 || spare <= 0) {
+	share = 0;
+	extra = 0;
+    } else {
+	share = spare / large;
+	extra = spare % large;
+    }
+    for (w = 0; w < b->nworker; ++w) {
+	if (!b->worker[w].busy) {
+	    continue;
+	}
+	threads = 1;
+	if (b->worker[w].cand.n >= PARSQR_MIN_BITS) {
+	    threads += share;
+	    if (extra > 0) {
+		++threads;
+		--extra;
+	    }
+	}
+	if (threads > b->max_threads) {
+	    threads = b->max_threads;
+	}
+	if (b->slot[w].threads != threads) {
+	    dbg(DBG_MED, "worker %d testing %lu*2^%lu-1 now squares with %d threads",
+		w, b->worker[w].cand.h, b->worker[w].cand.n, threads);
+	    b->slot[w].threads = threads;
+	}
+    }
+    return;
+}
+
+
+/*
+ * batch_usage_begin - note the resources used by a worker as a test starts
+ *
+ * given:
+ *      self            set to the rusage of the worker
+ *      thread          set to the rusage of the calling (squaring) thread
+ *      wall            set to the monotonic time now
+ *      live            set to the GMP bytes allocated now
+ */
+static void
+batch_usage_begin(struct rusage *self, struct rusage *thread, struct timespec *wall, int64_t *live)
+{
+    (void) getrusage(RUSAGE_SELF, self);
+    (void) getrusage(RUSAGE_THREAD, thread);
+    (void) clock_gettime(CLOCK_MONOTONIC, wall);
+    *live = gmp_live;
+    gmp_peak = *live;
+    gmp_allocs = 0;
+    gmp_bytes = 0;
+    return;
+}
+
+
+/*
+ * batch_usage_end - compute the resources used by a test since batch_usage_begin()
+ *
+ * given:
+ *      self            rusage of the worker when the test started
+ *      thread          rusage of the calling (squaring) thread when the test started
+ *      wall            monotonic time when the test started
+ *      live            GMP bytes allocated when the test started
+ *      u               set to the resources used by the test
+ */
+static void
+batch_usage_end(const struct rusage *self, const struct rusage *thread, const struct timespec *wall,
+		int64_t live, struct batch_usage *u)
+{
+    struct rusage self_now;	/* rusage of the worker now */
+    struct rusage thread_now;	/* rusage of the squaring thread now */
+    struct timespec wall_now;	/* monotonic time now */
+    int64_t peak;		/* most GMP bytes allocated at once during the test */
+
+    (void) getrusage(RUSAGE_SELF, &self_now);
+    (void) getrusage(RUSAGE_THREAD, &thread_now);
+    (void) clock_gettime(CLOCK_MONOTONIC, &wall_now);
+    u->wall = (uint64_t)((wall_now.tv_sec - wall->tv_sec) * 1000000L + (wall_now.tv_nsec - wall->tv_nsec) / 1000L);
+    u->utime = batch_usecs(&self_now.ru_utime, &self->ru_utime);
+    u->stime = batch_usecs(&self_now.ru_stime, &self->ru_stime);
+    u->thread = batch_usecs(&thread_now.ru_utime, &thread->ru_utime) +
+		batch_usecs(&thread_now.ru_stime, &thread->ru_stime);
+    u->minflt = (uint64_t)(self_now.ru_minflt - self->ru_minflt);
+    u->majflt = (uint64_t)(self_now.ru_majflt - self->ru_majflt);
+    u->nvcsw = (uint64_t)(self_now.ru_nvcsw - self->ru_nvcsw);
+    u->nivcsw = (uint64_t)(self_now.ru_nivcsw - self->ru_nivcsw);
+    u->gmp_allocs = gmp_allocs;
+    u->gmp_bytes = gmp_bytes;
+    peak = gmp_peak;
+    u->gmp_peak = (peak > live) ? (uint64_t)(peak - live) : 0;
+    return;
+}
+
+
+/*
+ * batch_usecs - microseconds from start to end
+ */
+static uint64_t
+batch_usecs(const struct timeval *end, const struct timeval *start)
+{
+    int64_t usecs;		/* microseconds */
+
+    usecs = (int64_t)(end->tv_sec - start->tv_sec) * 1000000 + (int64_t)(end->tv_usec - start->tv_usec);
+    return (usecs > 0) ? (uint64_t)usecs : 0;
+}
+
+
+/*
+ * batch_gmp_alloc - GMP allocation function of a worker with -t, counting what is allocated
+ */
+static void *
+batch_gmp_alloc(size_t size)
+{
+    ++gmp_allocs;
+    gmp_bytes += size;
+    batch_gmp_grow((int64_t)size);
+    return gmp_alloc_func(size);
+}
+
+
+/*
+ * batch_gmp_realloc - GMP reallocation function of a worker with -t, counting what is allocated
+ */
+static void *
+batch_gmp_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+    ++gmp_allocs;
+    if (new_size > old_size) {
+	gmp_bytes += new_size - old_size;
+    }
+    batch_gmp_grow((int64_t)new_size - (int64_t)old_size);
+    return gmp_realloc_func(ptr, old_size, new_size);
+}
+
+
+/*
+ * batch_gmp_free - GMP free function of a worker with -t, counting what is allocated
+ */
+static void
+batch_gmp_free(void *ptr, size_t size)
+{
+    gmp_live -= (int64_t)size;
+    gmp_free_func(ptr, size);
+    return;
+}
+
+
+/*
+ * batch_gmp_grow - note that GMP allocated delta bytes more, raising the peak if needed
+ */
+static void
+batch_gmp_grow(int64_t delta)
+{
+    int64_t now;		/* bytes allocated now */
+    int64_t peak;		/* most bytes allocated at once */
+
+    now = (gmp_live += delta);
+    peak = gmp_peak;
+    while (now > peak && !atomic_compare_exchange_weak(&gmp_peak, &peak, now)) {
+    }
+    return;
+}
+
+
+/*
+ * careful_read - read exactly len bytes from a pipe
+ *
+ * given:
+ *      fd      fd to read from
+ *      buf     where to read into
+ *      len     bytes to read
+ *      eof_ok  true ==> EOF before any bytes are read is allowed
+ *      eof     set to true if EOF was reached before any bytes were read
+ *
+ * This function does not return on error.
+ */
+static void
+careful_read(int fd, void *buf, size_t len, bool eof_ok, bool *eof)
+{
+    size_t done = 0;		/* bytes read so far */
+    ssize_t ret;		/* read return */
+
+    *eof = false;
+    while (done < len) {
+	errno = 0;
+	ret = read(fd, (char *)buf + done, len - done);
+	if (ret < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    errp(126, __func__, "read of fd %d failed, errno: %d", fd, errno);
+	    return;	// NOT REACHED
+	} else if (ret == 0) {
+	    if (done == 0 && eof_ok) {
+		*eof = true;
+		return;
+	    }
+	    err(126, __func__, "EOF after %zu of %zu bytes on fd %d", done, len, fd);
+	    return;	// NOT REACHED
+	}
+	done += (size_t)ret;
+    }
+    return;
+}
+
+
+/*
+ * careful_write_fd - write exactly len bytes to a pipe
+ *
+ * given:
+ *      fd      fd to write to
+ *      buf     what to write
+ *      len     bytes to write
+ *
+ * This function does not return on error.
+ */
+static void
+careful_write_fd(int fd, const void *buf, size_t len)
+{
+    size_t done = 0;		/* bytes written so far */
+    ssize_t ret;		/* write return */
+
+    while (done < len) {
+	errno = 0;
+	ret = write(fd, (const char *)buf + done, len - done);
+	if (ret < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    errp(127, __func__, "write of fd %d failed, errno: %d", fd, errno);
+	    return;	// NOT REACHED
+	}
+	done += (size_t)ret;
+    }
+    return;
+}
@@ -0,0 +1,77 @@
+/*
+ * batch - test a list of h*2^n-1 candidates on a pool of worker processes
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_BATCH_H)
+#define INCLUDE_BATCH_H
+
+#include <stddef.h>
+
+#include "lucas.h"
+
+/*
+ * batch constants
+ */
+#define BATCH_LOOKAHEAD		(64)	// with -M, candidates read ahead of the list to find one that fits
+#define BATCH_BACKFILL_RATIO	(4)	// with -M, only candidates with n this many times smaller backfill
+#define BATCH_CHECKPOINT_MIN_N	(100000)	// with -d, tests with at least this n checkpoint and may be preempted
+#define BATCH_URGENT_POLL	(1000)	// with -U, milliseconds between looks for urgent candidates
+#define BATCH_STAGE_POLL	(10)	// milliseconds between looks for candidates out of the stages
+#define BATCH_SEARCH_AHEAD	(2)	// with -S, a search runs at most this many candidates per core ahead
+#define BATCH_SIEVE_LIMIT	(4096)	// with -S, n with a factor below this are not tested
+#define BATCH_SIEVE_MIN_N	(12)	// with -S, sieve n only when h*2^n-1 >= 2^BATCH_SIEVE_MIN_N-1
+
+/*
+ * preemption policies (-P)
+ */
+#define BATCH_PREEMPT_NONE	(0)	// urgent candidates wait for a core to free up
+#define BATCH_PREEMPT_LARGEST	(1)	// checkpoint and stop the running test with the largest n
+#define BATCH_PREEMPT_NEWEST	(2)	// checkpoint and stop the running test started last
+
+/*
+ * how a list of candidates is to be tested
+ */
+struct batch_opts {
+    const char *list;		/* file of h n candidates */
+    const char *urgent;		/* file of urgent h n candidates, watched as it grows, NULL ==> none */
+    int cores;			/* number of cores (and worker processes) to use */
+    int max_threads;		/* most squaring threads a single candidate may use */
+    size_t budget;		/* memory budget in bytes, 0 ==> no budget */
+    int preempt;		/* BATCH_PREEMPT_* policy for urgent candidates */
+    unsigned long search_h;	/* with search_max > 0, search h*2^m-1 ... */
+    unsigned long search_n;	/* ... for the smallest prime with search_n < m ... */
+    unsigned long search_max;	/* ... and m <= search_max, 0 ==> test the list, not search */
+};
+
+/*
+ * external functions
+ */
+extern int batch_policy(const char *name);
+extern int batch_run(const struct batch_opts *bopts, struct lucas_opts *opts);
+
+#endif				/* INCLUDE_BATCH_H */
@@ -43,6 +43,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/utsname.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <signal.h>
@@ -51,17 +52,20 @@
 #include <sys/file.h>
 #include <fcntl.h>
 #include <stdbool.h>
+#include <ctype.h>
 #include <bits/local_lim.h>
 
 #include "gmprime.h"
 #include "riesel.h"
 #include "debug.h"
 #include "checkpoint.h"
+#include "hex.h"
+#include "housekeep.h"
 
 /*
  * checkpoint flags
  */
-uint64_t checkpoint_alarm = 0;		/* != 0 ==> a SIGALRM or SIGVTALRM went off, checkpoint and continue */
+_Atomic uint64_t checkpoint_alarm = 0;	/* != 0 ==> interval, SIGALRM or SIGVTALRM went off, checkpoint and continue */
 uint64_t checkpoint_and_end = 0;	/* != 0 ==> a SIGHUP, SIGINT, SIGQUIT, SIGPIPE went off, checkpoint and exit */
 
 /*
@@ -70,7 +74,6 @@ uint64_t checkpoint_and_end = 0;	/* != 0 ==> a SIGHUP, SIGINT, SIGQUIT, SIGPIPE
 static pid_t pid;				/* our process ID */
 static pid_t ppid;				/* our parent's process ID */
 static char hostname[HOST_NAME_MAX+1];		/* our hostname */
-static char cwd[PATH_MAX+1];			/* our current working directory */
 
 /*
  * prime test stats
@@ -79,6 +82,48 @@ static struct prime_stats beginrun;	/* program start (or program restore) prime
 static struct prime_stats current;	/* prime stats as of now */
 static struct prime_stats restored;	/* overall prime stats since restore (or start of not prior restore) */
 static struct prime_stats total;	/* updated total prime stats since start of the primality test */
+static struct timeval throttled;	/* wall clock time slept to keep to a CPU budget since we started */
+
+/*
+ * history of the test (see checkpoint_history())
+ */
+static bool history_begun = false;	/* true ==> checkpoint_history_begin() was called for this run */
+static bool history_first = true;	/* true ==> no history record was written for this run */
+static const char *history_engine = NULL;	/* engine computing the terms of this run */
+static struct utsname history_uts;	/* host operating system and kernel release */
+static unsigned long history_i = 0;	/* Lucas sequence index at the previous history record */
+static struct prime_stats history_prev;	/* prime stats as of the previous history record */
+
+/*
+ * base of the candidate being tested (see prp.c), 2 for h*2^n-1
+ */
+static unsigned long base = 2;
+
+/*
+ * checkpoint directory of the test (see setup_checkpoint())
+ *
+ * The files of the checkpoint directory are reached relative to an open
+ * descriptor of it, via openat(), renameat(), linkat() and the like, rather
+ * than by moving into it: the working directory of the process, and the
+ * relative paths given to it, are left alone, and the directory is let go
+ * of by checkpoint_close() once the test is over.
+ */
+#define CHKPT_SIGNALS (6)	/* signals caught while checkpointing */
+static struct checkpoint_dir {
+    int dirfd;			/* open checkpoint directory, AT_FDCWD ==> none set up */
+    FILE *lock;			/* open and locked LOCK_FILE, NULL ==> none */
+    char path[PATH_MAX+1];	/* real path of the checkpoint directory */
+    struct sigaction saved[CHKPT_SIGNALS];	/* signal actions before setup_checkpoint() */
+} chkpt = { AT_FDCWD, NULL, "", };
+static const int chkpt_signals[CHKPT_SIGNALS] = { SIGALRM, SIGVTALRM, SIGHUP, SIGINT, SIGQUIT, SIGPIPE };
+
+/*
+ * checkpoint interval (see checkpoint_interval())
+ */
+static int interval_task = -1;		/* housekeeping task keeping the interval, < 0 ==> none */
+static int interval_secs = 0;		/* CPU seconds between checkpoints, 0 ==> only on demand */
+static double interval_cpu = 0.0;	/* process CPU seconds when the interval started */
+static double interval_wall = 0.0;	/* monotonic seconds when the interval started */
 
 /*
  * static functions
@@ -88,13 +133,22 @@ static void record_signal_and_exit(int signum);
 static void zerosize_stats(struct prime_stats *ptr);
 static void load_prime_stats(struct prime_stats *ptr);
 static void careful_write(const char *calling_funcion_name, FILE *stream, char *fmt, ...);
+static void careful_fwrite(const char *calling_funcion_name, FILE *stream, const char *buf, size_t len);
+#if GMP_NUMB_BITS == 64
+static void write_hex_limbs(const char *calling_funcion_name, FILE *stream, const mpz_t value);
+#endif
 static void write_calc_timeval(FILE *stream, char *basename, char *subname, const struct timeval *value_ptr);
 static void write_calc_date_time_str(FILE *stream, char *basename, char *subname, const struct timeval *value_ptr);
 static void write_calc_prime_stats_ptr(FILE *stream, char *basename, struct prime_stats *ptr);
 static void initialize_total_stats(void);
-static void setup_checkpoint(char *checkpoint_dir, int checkpoint_secs);
+static void setup_checkpoint(const char *checkpoint_dir, int checkpoint_secs);
 static int mkdirp(char *path_arg, int mode, int duplicate);
 static void setup_chkpt_links(unsigned long h, unsigned long n, unsigned long i, mpz_t u_term);
+static double timeval_secs(const struct timeval *value_ptr);
+static double checkpoint_tick(void *arg);
+static double process_cpu_secs(void);
+static double process_wall_secs(void);
+static FILE *chkpt_fopen(const char *name, int flags, const char *mode);
 
 
 /*
@@ -228,6 +282,7 @@ zerosize_stats(struct prime_stats *ptr)
     timerclear(&ptr->ru_utime);	// clear user CPU time used
     timerclear(&ptr->ru_stime);	// clear system CPU time used
     timerclear(&ptr->wall_clock);	// clear wall clock time uused
+    timerclear(&ptr->throttled);	// clear throttled time
     return;
 }
 
@@ -290,6 +345,11 @@ load_prime_stats(struct prime_stats *ptr)
     ptr->ru_nvcsw = usage.ru_nvcsw;
     ptr->ru_nivcsw = usage.ru_nivcsw;
 
+    /*
+     * load the time slept to keep to a CPU budget
+     */
+    ptr->throttled = throttled;
+
     /*
      * prime stats has been loaded
      */
@@ -384,6 +444,91 @@ careful_write(const char *calling_funcion_name, FILE *stream, char *fmt, ...)
 }
 
 
+/*
+ * careful_fwrite - carefully write bytes to an open stream
+ *
+ * given:
+ *      calling_funcion_name - name of the calling function
+ *          NOTE: usually passed as __func__
+ *      stream - open checkpoint file stream to append to
+ *      buf - bytes to write
+ *      len - number of bytes to write
+ *
+ * This function does not return on error.
+ */
+static void
+careful_fwrite(const char *calling_funcion_name, FILE *stream, const char *buf, size_t len)
+{
+    size_t ret;			/* fwrite() return value */
+
+    clearerr(stream);
+    errno = 0;
+    ret = fwrite(buf, 1, len, stream);
+    if (ret != len || ferror(stream) || feof(stream)) {
+	errp(74, __func__, "error in careful_fwrite called by %s, errno: %d, wrote: %zu of %zu",
+			   calling_funcion_name, errno, ret, len);
+	return;	// NOT REACHED
+    }
+    return;
+}
+
+
+#if GMP_NUMB_BITS == 64
+/*
+ * write_hex_limbs - write the hex digits of an mpz value as mpz_out_str() would
+ *
+ * given:
+ *      calling_funcion_name - name of the calling function
+ *      stream - open checkpoint file stream to append to
+ *      value - const mpz_t value to write in hex
+ *
+ * The limbs are encoded HEX_CHUNK at a time into a buffer (see hex.c)
+ * and each buffer is written with one fwrite().
+ *
+ * This function does not return on error.
+ */
+static void
+write_hex_limbs(const char *calling_funcion_name, FILE *stream, const mpz_t value)
+{
+    char buf[HEX_CHUNK * HEX_LIMB_CHARS];	/* encoded digits */
+    const uint64_t *limbs;	/* limbs of value */
+    size_t size;		/* limbs in value */
+    size_t len;			/* limbs in this chunk */
+    size_t skip;		/* leading zero digits of the most significant limb */
+
+    size = mpz_size(value);
+    if (size == 0) {
+	careful_fwrite(calling_funcion_name, stream, "0", 1);
+	return;
+    }
+    if (mpz_sgn(value) < 0) {
+	careful_fwrite(calling_funcion_name, stream, "-", 1);
+    }
+    limbs = (const uint64_t *)mpz_limbs_read(value);
+
+    /*
+     * the most significant limb is written without leading zeros
+     */
+    hex_encode(buf, limbs + size - 1, 1);
+    skip = 0;
+    while (skip < HEX_LIMB_CHARS - 1 && buf[skip] == '0') {
+	++skip;
+    }
+    careful_fwrite(calling_funcion_name, stream, buf + skip, HEX_LIMB_CHARS - skip);
+
+    /*
+     * the rest a chunk at a time
+     */
+    for (--size; size > 0; size -= len) {
+	len = (size < HEX_CHUNK) ? size : HEX_CHUNK;
+	hex_encode(buf, limbs + size - len, len);
+	careful_fwrite(calling_funcion_name, stream, buf, len * HEX_LIMB_CHARS);
+    }
+    return;
+}
+#endif
+
+
 /*
  * write_calc_mpz_hex - write mpz value in hex to an open stream in calc format
  *
@@ -399,7 +544,9 @@ careful_write(const char *calling_funcion_name, FILE *stream, char *fmt, ...)
 void
 write_calc_mpz_hex(FILE *stream, char *basename, char *subname, const mpz_t value)
 {
+#if GMP_NUMB_BITS != 64
     int ret;	/* mpz_out_str return */
+#endif
 
     /*
      * firewall
@@ -428,7 +575,11 @@ write_calc_mpz_hex(FILE *stream, char *basename, char *subname, const mpz_t valu
 
     /*
      * write value in hex
-     *
+     */
+#if GMP_NUMB_BITS == 64
+    write_hex_limbs(__func__, stream, value);
+#else
+    /*
      * NOTE: We have to duplicate some of the careful_write() logic
      *       because mpz_out_str returns 0 on I/O error.
      */
@@ -445,6 +596,7 @@ write_calc_mpz_hex(FILE *stream, char *basename, char *subname, const mpz_t valu
 	}
 	return;	// NOT REACHED
     }
+#endif
 
     /*
      * write hex variable suffix
@@ -755,6 +907,11 @@ write_calc_prime_stats_ptr(FILE *stream, char *basename, struct prime_stats *ptr
      */
     write_calc_timeval(stream, basename, "wall_clock", &ptr->wall_clock);
 
+    /*
+     * write wall clock time slept to keep to a CPU budget
+     */
+    write_calc_timeval(stream, basename, "throttled", &ptr->throttled);
+
     /*
      * write maximum resident set size used in kilobytes
      */
@@ -951,6 +1108,12 @@ update_stats(void)
     current.wall_clock = diff;
     timeradd(&restored.wall_clock, &diff, &total.wall_clock);
 
+    /*
+     * update wall clock time slept to keep to a CPU budget
+     */
+    timersub(&current.throttled, &beginrun.throttled, &diff);
+    timeradd(&restored.throttled, &diff, &total.throttled);
+
     /*
      * update maximum resident set size used in kilobytes
      */
@@ -995,6 +1158,33 @@ update_stats(void)
 }
 
 
+/*
+ * add_throttled_stats - account time slept to keep to a CPU budget
+ *
+ * given:
+ *      slept - wall clock time slept
+ *
+ * This function does not return on error.
+ */
+void
+add_throttled_stats(const struct timeval *slept)
+{
+    /*
+     * paranoia
+     */
+    if (slept == NULL) {
+	err(89, __func__, "slept is NULL");
+	return;	// NOT REACHED
+    }
+
+    /*
+     * add to the time slept since we started
+     */
+    timeradd(&throttled, slept, &throttled);
+    return;
+}
+
+
 /*
  * initialize_checkpoint - setup checkpoint system
  *
@@ -1064,13 +1254,13 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	 * if result.prime.pt exists, exit showing we found a prime unless forcing
 	 */
 	errno = 0;
-	f_ret = access(RESULT_PRIME_FILE, F_OK);
+	f_ret = faccessat(chkpt.dirfd, RESULT_PRIME_FILE, F_OK, 0);
 	if (f_ret == 0) {
 	    /* RESULT_PRIME_FILE exists */
 	    if (force) {
 		dbg(DBG_LOW, "rm -f %s", RESULT_PRIME_FILE);
 		errno = 0;
-		f_ret = unlink(RESULT_PRIME_FILE);
+		f_ret = unlinkat(chkpt.dirfd, RESULT_PRIME_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", RESULT_PRIME_FILE);
 		    // exit(4);
@@ -1087,13 +1277,13 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	 * if result.composite.pt exists, exit showing we found a composite
 	 */
 	errno = 0;
-	f_ret = access(RESULT_COMPOSITE_FILE, F_OK);
+	f_ret = faccessat(chkpt.dirfd, RESULT_COMPOSITE_FILE, F_OK, 0);
 	if (f_ret == 0) {
 	    /* RESULT_COMPOSITE_FILE exists */
 	    if (force) {
 		dbg(DBG_LOW, "rm -f %s", RESULT_COMPOSITE_FILE);
 		errno = 0;
-		f_ret = unlink(RESULT_COMPOSITE_FILE);
+		f_ret = unlinkat(chkpt.dirfd, RESULT_COMPOSITE_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", RESULT_COMPOSITE_FILE);
 		    // exit(4);
@@ -1110,13 +1300,13 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	 * if result.error.pt exists, exit showing there was a fatal error preventing testing
 	 */
 	errno = 0;
-	f_ret = access(RESULT_ERROR_FILE, F_OK);
+	f_ret = faccessat(chkpt.dirfd, RESULT_ERROR_FILE, F_OK, 0);
 	if (f_ret == 0) {
 	    /* RESULT_ERROR_FILE exists */
 	    if (force) {
 		dbg(DBG_LOW, "rm -f %s", RESULT_ERROR_FILE);
 		errno = 0;
-		f_ret = unlink(RESULT_ERROR_FILE);
+		f_ret = unlinkat(chkpt.dirfd, RESULT_ERROR_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", RESULT_ERROR_FILE);
 		    // exit(4);
@@ -1133,13 +1323,13 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	 * if sav.end.pt exists, but no result.*.pt file, we have an error
 	 */
 	errno = 0;
-	f_ret = access(SAVE_END_FILE, F_OK);
+	f_ret = faccessat(chkpt.dirfd, SAVE_END_FILE, F_OK, 0);
 	if (f_ret == 0) {
 	    /* SAVE_END_FILE exists */
 	    if (force) {
 		dbg(DBG_LOW, "rm -f %s", SAVE_END_FILE);
 		errno = 0;
-		f_ret = unlink(SAVE_END_FILE);
+		f_ret = unlinkat(chkpt.dirfd, SAVE_END_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", SAVE_END_FILE);
 		    // exit(4);
@@ -1162,12 +1352,12 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	     * force remove SAVE_FIRST_FILE if it exists
 	     */
 	    errno = 0;
-	    f_ret = access(SAVE_FIRST_FILE, F_OK);
+	    f_ret = faccessat(chkpt.dirfd, SAVE_FIRST_FILE, F_OK, 0);
 	    if (f_ret == 0) {
 		/* SAVE_FIRST_FILE exists */
 		dbg(DBG_LOW, "rm -f %s", SAVE_FIRST_FILE);
 		errno = 0;
-		f_ret = unlink(SAVE_FIRST_FILE);
+		f_ret = unlinkat(chkpt.dirfd, SAVE_FIRST_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", SAVE_FIRST_FILE);
 		    // exit(4);
@@ -1179,12 +1369,12 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	     * force remove CHKPT_CUR_FILE if it exists
 	     */
 	    errno = 0;
-	    f_ret = access(CHKPT_CUR_FILE, F_OK);
+	    f_ret = faccessat(chkpt.dirfd, CHKPT_CUR_FILE, F_OK, 0);
 	    if (f_ret == 0) {
 		/* CHKPT_CUR_FILE exists */
 		dbg(DBG_LOW, "rm -f %s", CHKPT_CUR_FILE);
 		errno = 0;
-		f_ret = unlink(CHKPT_CUR_FILE);
+		f_ret = unlinkat(chkpt.dirfd, CHKPT_CUR_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", CHKPT_CUR_FILE);
 		    // exit(4);
@@ -1196,12 +1386,12 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	     * force remove CHKPT_PREV0_FILE if it exists
 	     */
 	    errno = 0;
-	    f_ret = access(CHKPT_PREV0_FILE, F_OK);
+	    f_ret = faccessat(chkpt.dirfd, CHKPT_PREV0_FILE, F_OK, 0);
 	    if (f_ret == 0) {
 		/* CHKPT_CUR_FILE exists */
 		dbg(DBG_LOW, "rm -f %s", CHKPT_PREV0_FILE);
 		errno = 0;
-		f_ret = unlink(CHKPT_PREV0_FILE);
+		f_ret = unlinkat(chkpt.dirfd, CHKPT_PREV0_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", CHKPT_PREV0_FILE);
 		    // exit(4);
@@ -1213,12 +1403,12 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	     * force remove CHKPT_PREV1_FILE if it exists
 	     */
 	    errno = 0;
-	    f_ret = access(CHKPT_PREV1_FILE, F_OK);
+	    f_ret = faccessat(chkpt.dirfd, CHKPT_PREV1_FILE, F_OK, 0);
 	    if (f_ret == 0) {
 		/* CHKPT_PREV1_FILE exists */
 		dbg(DBG_LOW, "rm -f %s", CHKPT_PREV1_FILE);
 		errno = 0;
-		f_ret = unlink(CHKPT_PREV1_FILE);
+		f_ret = unlinkat(chkpt.dirfd, CHKPT_PREV1_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", CHKPT_PREV1_FILE);
 		    // exit(4);
@@ -1230,12 +1420,12 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	     * force remove CHKPT_PREV2_FILE if it exists
 	     */
 	    errno = 0;
-	    f_ret = access(CHKPT_PREV2_FILE, F_OK);
+	    f_ret = faccessat(chkpt.dirfd, CHKPT_PREV2_FILE, F_OK, 0);
 	    if (f_ret == 0) {
 		/* CHKPT_PREV2_FILE exists */
 		dbg(DBG_LOW, "rm -f %s", CHKPT_PREV2_FILE);
 		errno = 0;
-		f_ret = unlink(CHKPT_PREV2_FILE);
+		f_ret = unlinkat(chkpt.dirfd, CHKPT_PREV2_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", CHKPT_PREV2_FILE);
 		    // exit(4);
@@ -1247,12 +1437,12 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	     * force remove SAVE_NEAR_FILE if it exists
 	     */
 	    errno = 0;
-	    f_ret = access(SAVE_NEAR_FILE, F_OK);
+	    f_ret = faccessat(chkpt.dirfd, SAVE_NEAR_FILE, F_OK, 0);
 	    if (f_ret == 0) {
 		/* SAVE_NEAR_FILE exists */
 		dbg(DBG_LOW, "rm -f %s", SAVE_NEAR_FILE);
 		errno = 0;
-		f_ret = unlink(SAVE_NEAR_FILE);
+		f_ret = unlinkat(chkpt.dirfd, SAVE_NEAR_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", SAVE_NEAR_FILE);
 		    // exit(4);
@@ -1264,12 +1454,12 @@ initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h
 	     * force remove SAVE_N1_FILE if it exists
 	     */
 	    errno = 0;
-	    f_ret = access(SAVE_N1_FILE, F_OK);
+	    f_ret = faccessat(chkpt.dirfd, SAVE_N1_FILE, F_OK, 0);
 	    if (f_ret == 0) {
 		/* SAVE_N1_FILE exists */
 		dbg(DBG_LOW, "rm -f %s", SAVE_N1_FILE);
 		errno = 0;
-		f_ret = unlink(SAVE_N1_FILE);
+		f_ret = unlinkat(chkpt.dirfd, SAVE_N1_FILE, 0);
 		if (f_ret < 0) {
 		    err(EXIT_CHKPT_ACCESS, __func__, "cannot remove %s", SAVE_N1_FILE);
 		    // exit(4);
@@ -1393,21 +1583,23 @@ mkdirp(char *path_arg, int mode, int duplicate)
  *      checkpoint_secs       checkpoint every checkpoint_secs seconds, 0 ==> every term,
  *                          	<0 ==> do not checkpoint periodically (only on demand)
  *
- * This function will create (if needed) and lock the LOCK_FILE lock file.
+ * This function will open the checkpoint directory, and create (if needed)
+ * and lock the LOCK_FILE lock file in it, letting go of the checkpoint
+ * directory of an earlier test.
  * This function will also set the pid and ppid values.
- * This function will also set the cwd[] and hostname[] strings.
+ * This function will also set the chkpt.path[] and hostname[] strings.
  *
  * This function does not return on error.
  */
 static void
-setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
+setup_checkpoint(const char *checkpoint_dir, int checkpoint_secs)
 {
     FILE *stream;		// opened lock file
     struct sigaction psa;	/* sigaction info for signal handler setup */
-    struct itimerval timer;	/* checkpoint internal */
+    int dirfd;			/* open checkpoint directory */
     int fd;			/* open lock file */
     int ret;			/* return value */
-    char *cwd_ret;		/* return from getcwd() */
+    char *path_ret;		/* return from realpath() */
 
     /*
      * firewall
@@ -1416,6 +1608,7 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
 	err(85, __func__, "checkpoint_dir is NULL");
 	return;	// NOT REACHED
     }
+    checkpoint_close();
 
     /*
      * ensure that the checkpoint directory exists that is readable, writable and searchable
@@ -1423,7 +1616,7 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
      * NOTE: This will verfiy that the checkpoint directory exits, or if it does
      *       not initially exist, attempt to create the checkpoint directory.
      */
-    ret = mkdirp(checkpoint_dir, DEF_DIR_MODE, 1);
+    ret = mkdirp((char *)checkpoint_dir, DEF_DIR_MODE, 1);	/* mkdirp() changes a duplicate */
     if (ret != 0) {
 	err(EXIT_CHKPT_ACCESS, __func__, "invalid checkpoint directory: %s", checkpoint_dir);
 	// exit(4);
@@ -1474,36 +1667,36 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
     }
 
     /*
-     * move to the checkpoint directory
+     * open the checkpoint directory
      */
     errno = 0;
-    ret = chdir(checkpoint_dir);
-    if (ret != 0) {
-	errp(EXIT_CHKPT_ACCESS, __func__, "cannot cd %s, errno: %d", checkpoint_dir, errno);
+    dirfd = open(checkpoint_dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (dirfd < 0) {
+	errp(EXIT_CHKPT_ACCESS, __func__, "cannot open directory %s, errno: %d", checkpoint_dir, errno);
 	// exit(4);
 	exit(EXIT_CHKPT_ACCESS);	// NOT REACHED
 	return;	// NOT REACHED
     }
 
     /*
-     * determine the current working directory
+     * determine the real path of the checkpoint directory
      */
-    memset(cwd, 0, sizeof(cwd));
+    memset(chkpt.path, 0, sizeof(chkpt.path));
     errno = 0;
-    cwd_ret = getcwd(cwd, PATH_MAX);
-    if (cwd_ret == NULL) {
-	errp(EXIT_CHKPT_ACCESS, __func__, "error tring to determine the current working directory");
+    path_ret = realpath(checkpoint_dir, chkpt.path);
+    if (path_ret == NULL) {
+	errp(EXIT_CHKPT_ACCESS, __func__, "error tring to determine the real path of: %s", checkpoint_dir);
 	// exit(4);
 	exit(EXIT_CHKPT_ACCESS);	// NOT REACHED
 	return;	// NOT REACHED
     }
-    cwd[PATH_MAX] = '\0'; // paranoia
+    chkpt.path[PATH_MAX] = '\0'; // paranoia
 
     /*
      * open lock file, creating as needed
      */
     errno = 0;
-    fd = open(LOCK_FILE, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP);
+    fd = openat(dirfd, LOCK_FILE, O_CREAT|O_WRONLY|O_TRUNC|O_CLOEXEC, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP);
     if (fd < 0) {
 	errp(EXIT_CHKPT_ACCESS, __func__, "cannot open %s/%s, errno: %d", checkpoint_dir, LOCK_FILE, errno);
 	// exit(4);
@@ -1537,6 +1730,8 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
 	}
 	return;	// NOT REACHED
     }
+    chkpt.dirfd = dirfd;
+    chkpt.lock = stream;
 
     /*
      * determine our hostname
@@ -1569,8 +1764,7 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
     write_calc_str(stream, NULL, "version", version_string);
     hostname[HOST_NAME_MAX] = '\0'; // paranoia
     write_calc_str(stream, NULL, "hostname", hostname);
-    cwd[HOST_NAME_MAX] = '\0'; // paranoia
-    write_calc_str(stream, NULL, "cwd", cwd);
+    write_calc_str(stream, NULL, "cwd", chkpt.path);
     write_calc_str(stream, NULL, "checkpoint_dir", checkpoint_dir);
     write_calc_uint64_t(stream, NULL, "pid", pid);
     write_calc_uint64_t(stream, NULL, "ppid", ppid);
@@ -1581,13 +1775,17 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
 
     /*
      * setup SIGALRM handler
+     *
+     * The handlers only record the signal, so a write blocked on a full
+     * pipe (such as the -c calc code to a slow reader, or to the -z writer
+     * thread) is restarted rather than failed.
      */
     checkpoint_alarm = 0;
     psa.sa_handler = record_sigalarm;
     sigemptyset(&psa.sa_mask);
-    psa.sa_flags = 0;
+    psa.sa_flags = SA_RESTART;
     errno = 0;
-    ret = sigaction(SIGALRM, &psa, NULL);
+    ret = sigaction(SIGALRM, &psa, &chkpt.saved[0]);
     if (ret != 0) {
 	errp(85, __func__, "cannot sigaction SIGALRM, errno: %d", errno);
 	return;	// NOT REACHED
@@ -1598,9 +1796,9 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
      */
     psa.sa_handler = record_sigalarm;
     sigemptyset(&psa.sa_mask);
-    psa.sa_flags = 0;
+    psa.sa_flags = SA_RESTART;
     errno = 0;
-    ret = sigaction(SIGVTALRM, &psa, NULL);
+    ret = sigaction(SIGVTALRM, &psa, &chkpt.saved[1]);
     if (ret != 0) {
 	errp(85, __func__, "cannot sigaction SIGVTALRM, errno: %d", errno);
 	return;	// NOT REACHED
@@ -1612,9 +1810,9 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
     checkpoint_and_end = 0;
     psa.sa_handler = record_signal_and_exit;
     sigemptyset(&psa.sa_mask);
-    psa.sa_flags = 0;
+    psa.sa_flags = SA_RESTART;
     errno = 0;
-    ret = sigaction(SIGHUP, &psa, NULL);
+    ret = sigaction(SIGHUP, &psa, &chkpt.saved[2]);
     if (ret != 0) {
 	errp(85, __func__, "cannot sigaction SIGHUP, errno: %d", errno);
 	return;	// NOT REACHED
@@ -1626,9 +1824,9 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
     checkpoint_and_end = 0;
     psa.sa_handler = record_signal_and_exit;
     sigemptyset(&psa.sa_mask);
-    psa.sa_flags = 0;
+    psa.sa_flags = SA_RESTART;
     errno = 0;
-    ret = sigaction(SIGINT, &psa, NULL);
+    ret = sigaction(SIGINT, &psa, &chkpt.saved[3]);
     if (ret != 0) {
 	errp(85, __func__, "cannot sigaction SIGINT, errno: %d", errno);
 	return;	// NOT REACHED
@@ -1640,9 +1838,9 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
     checkpoint_and_end = 0;
     psa.sa_handler = record_signal_and_exit;
     sigemptyset(&psa.sa_mask);
-    psa.sa_flags = 0;
+    psa.sa_flags = SA_RESTART;
     errno = 0;
-    ret = sigaction(SIGQUIT, &psa, NULL);
+    ret = sigaction(SIGQUIT, &psa, &chkpt.saved[4]);
     if (ret != 0) {
 	errp(85, __func__, "cannot sigaction SIGQUIT, errno: %d", errno);
 	return;	// NOT REACHED
@@ -1654,9 +1852,9 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
     checkpoint_and_end = 0;
     psa.sa_handler = record_signal_and_exit;
     sigemptyset(&psa.sa_mask);
-    psa.sa_flags = 0;
+    psa.sa_flags = SA_RESTART;
     errno = 0;
-    ret = sigaction(SIGPIPE, &psa, NULL);
+    ret = sigaction(SIGPIPE, &psa, &chkpt.saved[5]);
     if (ret != 0) {
 	errp(85, __func__, "cannot sigaction SIGPIPE, errno: %d", errno);
 	return;	// NOT REACHED
@@ -1666,16 +1864,7 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
      * setup checkpoint interval alarm if checkpoint_secs > 0
      */
     if (checkpoint_secs > 0) {
-	errno = 0;
-	timer.it_interval.tv_sec = checkpoint_secs;
-	timer.it_interval.tv_usec = 0;
-	timer.it_value.tv_sec = checkpoint_secs;
-	timer.it_value.tv_usec = 0;
-	ret = setitimer(ITIMER_VIRTUAL, &timer, NULL);
-	if (ret != 0) {
-	    errp(85, __func__, "cannot setitimer ITIMER_VIRTUAL, errno: %d", errno);
-	    return;	// NOT REACHED
-	}
+	checkpoint_interval(checkpoint_secs);
     }
 
     /*
@@ -1685,6 +1874,226 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
 }
 
 
+/*
+ * checkpoint_interval - change the checkpoint interval
+ *
+ * given:
+ *      checkpoint_secs       checkpoint every checkpoint_secs seconds of CPU time,
+ *                          	<= 0 ==> stop checkpointing periodically (only on demand)
+ *
+ * The interval starts over from now.
+ *
+ * The interval is kept by a housekeeping task (see housekeep.c) rather than
+ * by an ITIMER_VIRTUAL timer, so the squaring thread is not interrupted by
+ * a SIGVTALRM: the task sets checkpoint_alarm once the process has used
+ * checkpoint_secs of CPU time since the interval started.
+ *
+ * This function does not return on error.
+ */
+void
+checkpoint_interval(int checkpoint_secs)
+{
+    /*
+     * stop the task so that it is not running while we change the interval
+     */
+    housekeep_remove(interval_task);
+    interval_task = -1;
+    if (checkpoint_secs < 0) {
+	checkpoint_secs = 0;
+    }
+
+    /*
+     * start the interval from now
+     */
+    interval_secs = checkpoint_secs;
+    if (interval_secs > 0) {
+	interval_cpu = process_cpu_secs();
+	interval_wall = process_wall_secs();
+	interval_task = housekeep_add("checkpoint interval", checkpoint_tick, NULL,
+				      (interval_secs < CHECKPOINT_TICK_MAX ? interval_secs : CHECKPOINT_TICK_MAX));
+    }
+    dbg(DBG_MED, "checkpoint interval: %d seconds", checkpoint_secs);
+    return;
+}
+
+
+/*
+ * checkpoint_tick - housekeeping task that sets checkpoint_alarm when a checkpoint interval has passed
+ *
+ * given:
+ *      arg     unused
+ *
+ * returns:
+ *      seconds until the CPU time used reaches the end of the interval, as
+ *      estimated from the CPU time used per second so far, at most CHECKPOINT_TICK_MAX
+ */
+static double
+checkpoint_tick(void *arg)
+{
+    double cpu;			/* CPU seconds used in this interval */
+    double wall;		/* wall clock seconds of this interval */
+    double rate;		/* CPU seconds used per wall clock second */
+    double next;		/* seconds until the interval is estimated to end */
+
+    (void) arg;
+    cpu = process_cpu_secs() - interval_cpu;
+    wall = process_wall_secs() - interval_wall;
+
+    /*
+     * start the next interval when this one has passed
+     */
+    if (cpu >= (double)interval_secs) {
+	++checkpoint_alarm;
+	interval_cpu += cpu;
+	interval_wall += wall;
+	cpu = 0.0;
+	wall = 0.0;
+    }
+
+    /*
+     * estimate when the interval ends, checking at least every CHECKPOINT_TICK_MAX
+     * seconds in case the test is paused or runs on more or fewer threads
+     */
+    rate = (wall > 0.0 && cpu > 0.0) ? cpu / wall : 1.0;
+    next = ((double)interval_secs - cpu) / rate;
+    if (next > CHECKPOINT_TICK_MAX) {
+	next = CHECKPOINT_TICK_MAX;
+    }
+    return next;
+}
+
+
+/*
+ * process_cpu_secs - CPU seconds used by all threads of the process
+ */
+static double
+process_cpu_secs(void)
+{
+    struct timespec ts;		/* CPU time */
+
+    (void) clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+
+/*
+ * process_wall_secs - seconds on the monotonic clock
+ */
+static double
+process_wall_secs(void)
+{
+    struct timespec ts;		/* current time */
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+
+/*
+ * checkpoint_close - let go of the checkpoint directory of the test
+ *
+ * This function stops the checkpoint interval, puts back the signal actions
+ * that setup_checkpoint() replaced, unlocks and closes the LOCK_FILE and
+ * closes the checkpoint directory, so that the process may go on to set up
+ * the checkpoint directory of another test.  It does nothing when no
+ * checkpoint directory is set up.
+ */
+void
+checkpoint_close(void)
+{
+    int i;
+
+    if (chkpt.lock == NULL) {
+	return;
+    }
+    checkpoint_interval(0);
+    for (i = 0; i < CHKPT_SIGNALS; ++i) {
+	if (sigaction(chkpt_signals[i], &chkpt.saved[i], NULL) != 0) {
+	    warnp(__func__, "cannot restore the action of signal: %d", chkpt_signals[i]);
+	}
+    }
+    checkpoint_alarm = 0;
+    checkpoint_and_end = 0;
+    history_begun = false;
+    history_first = true;
+
+    /*
+     * closing the lock file releases its lock
+     */
+    if (fclose(chkpt.lock) != 0) {
+	warnp(__func__, "error closing: %s/%s", chkpt.path, LOCK_FILE);
+    }
+    (void) close(chkpt.dirfd);
+    dbg(DBG_MED, "let go of checkpoint directory: %s", chkpt.path);
+    chkpt.lock = NULL;
+    chkpt.dirfd = AT_FDCWD;
+    chkpt.path[0] = '\0';
+    return;
+}
+
+
+/*
+ * checkpoint_dirfd - open descriptor of the checkpoint directory of the test
+ *
+ * returns:
+ *      descriptor for the *at() calls, AT_FDCWD ==> no checkpoint directory set up
+ */
+int
+checkpoint_dirfd(void)
+{
+    return chkpt.dirfd;
+}
+
+
+/*
+ * chkpt_fopen - open a file of the checkpoint directory as a stream
+ *
+ * given:
+ *      name    name of the file within the checkpoint directory
+ *      flags   open(2) flags
+ *      mode    fdopen(3) mode matching flags
+ *
+ * returns:
+ *      open stream, NULL ==> error, errno set
+ */
+static FILE *
+chkpt_fopen(const char *name, int flags, const char *mode)
+{
+    FILE *stream;		/* opened stream */
+    int fd;			/* opened file */
+    int saved_errno;		/* errno of fdopen() */
+
+    fd = openat(chkpt.dirfd, name, flags|O_CLOEXEC, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH);
+    if (fd < 0) {
+	return NULL;
+    }
+    stream = fdopen(fd, mode);
+    if (stream == NULL) {
+	saved_errno = errno;
+	(void) close(fd);
+	errno = saved_errno;
+    }
+    return stream;
+}
+
+
+/*
+ * checkpoint_base - set the base of the candidate being tested
+ *
+ * given:
+ *      b               base: 2 for h*2^n-1, or b of k*b^n-1 (see prp.c)
+ *
+ * Checkpoints of k*b^n-1 record b, and are only restored when testing the same base.
+ * This must be called before initialize_checkpoint() or restore_checkpoint().
+ */
+void
+checkpoint_base(unsigned long b)
+{
+    base = b;
+    return;
+}
+
+
 /*
  * checkpoint_needed - determine if a checkpoint is needed given the Lucas sequence number
  *
@@ -1706,7 +2115,7 @@ setup_checkpoint(char *checkpoint_dir, int checkpoint_secs)
  * 	 is treated as a condition that requires a checkpoint.
  *
  * A checkpoint is needed:
- * 	a SIGALRM or SIGVTALRM signal was received
+ * 	the checkpoint interval passed, or a SIGALRM or SIGVTALRM signal was received
  * 	a SIGHUP, SIGINT, SIGQUIT, SIGPIPE signal was received
  * 	when h is a bogus value
  * 	when n is a bogus value
@@ -1811,7 +2220,7 @@ setup_chkpt_links(unsigned long h, unsigned long n, unsigned long i, mpz_t u_ter
      * If CHKPT_CUR_FILE does not exist, nothing to do, no files to link
      */
     errno = 0;
-    f_ret = access(CHKPT_CUR_FILE, F_OK);
+    f_ret = faccessat(chkpt.dirfd, CHKPT_CUR_FILE, F_OK, 0);
     if (f_ret != 0) {
 	dbg(DBG_MED, "no current checkpoint file: %s", CHKPT_CUR_FILE);
 	return;
@@ -1838,7 +2247,7 @@ setup_chkpt_links(unsigned long h, unsigned long n, unsigned long i, mpz_t u_ter
 	     */
 	    warn(__func__, "i: %ld >= n %ld with u_term as NULL", i, n);
 	    dbg(DBG_LOW, "ln %s %s", CHKPT_CUR_FILE, RESULT_ERROR_FILE);
-	    f_ret = link(CHKPT_CUR_FILE, RESULT_ERROR_FILE);
+	    f_ret = linkat(chkpt.dirfd, CHKPT_CUR_FILE, chkpt.dirfd, RESULT_ERROR_FILE, 0);
 	    if (f_ret != 0) {
 		errp(86, __func__, "ln %s %s failed, returned: %d, errno: %d", CHKPT_CUR_FILE, RESULT_ERROR_FILE, f_ret, errno);
 		return;	// NOT REACHED
@@ -1859,7 +2268,7 @@ setup_chkpt_links(unsigned long h, unsigned long n, unsigned long i, mpz_t u_ter
 	     * link CHKPT_CUR_FILE to RESULT_PRIME_FILE
 	     */
 	    dbg(DBG_LOW, "ln %s %s", CHKPT_CUR_FILE, RESULT_PRIME_FILE);
-	    f_ret = link(CHKPT_CUR_FILE, RESULT_PRIME_FILE);
+	    f_ret = linkat(chkpt.dirfd, CHKPT_CUR_FILE, chkpt.dirfd, RESULT_PRIME_FILE, 0);
 	    if (f_ret != 0) {
 		errp(86, __func__, "ln %s %s failed, returned: %d, errno: %d", CHKPT_CUR_FILE, RESULT_PRIME_FILE, f_ret, errno);
 		return;	// NOT REACHED
@@ -1876,7 +2285,7 @@ setup_chkpt_links(unsigned long h, unsigned long n, unsigned long i, mpz_t u_ter
 	     * link CHKPT_CUR_FILE to RESULT_COMPOSITE_FILE
 	     */
 	    dbg(DBG_LOW, "ln %s %s", CHKPT_CUR_FILE, RESULT_COMPOSITE_FILE);
-	    f_ret = link(CHKPT_CUR_FILE, RESULT_COMPOSITE_FILE);
+	    f_ret = linkat(chkpt.dirfd, CHKPT_CUR_FILE, chkpt.dirfd, RESULT_COMPOSITE_FILE, 0);
 	    if (f_ret != 0) {
 		errp(86, __func__, "ln %s %s failed, returned: %d, errno: %d", CHKPT_CUR_FILE, RESULT_COMPOSITE_FILE, f_ret, errno);
 		return;	// NOT REACHED
@@ -1889,7 +2298,7 @@ setup_chkpt_links(unsigned long h, unsigned long n, unsigned long i, mpz_t u_ter
 	 * This marks the end of the test
 	 */
 	dbg(DBG_LOW, "ln %s %s", CHKPT_CUR_FILE, SAVE_END_FILE);
-	f_ret = link(CHKPT_CUR_FILE, SAVE_END_FILE);
+	f_ret = linkat(chkpt.dirfd, CHKPT_CUR_FILE, chkpt.dirfd, SAVE_END_FILE, 0);
 	if (f_ret != 0) {
 	    errp(86, __func__, "ln %s %s failed, returned: %d, errno: %d", CHKPT_CUR_FILE, SAVE_END_FILE, f_ret, errno);
 	    return;	// NOT REACHED
@@ -1906,7 +2315,7 @@ setup_chkpt_links(unsigned long h, unsigned long n, unsigned long i, mpz_t u_ter
 	 * link CHKPT_CUR_FILE to SAVE_N1_FILE
 	 */
 	dbg(DBG_LOW, "ln %s %s", CHKPT_CUR_FILE, SAVE_N1_FILE);
-	f_ret = link(CHKPT_CUR_FILE, SAVE_N1_FILE);
+	f_ret = linkat(chkpt.dirfd, CHKPT_CUR_FILE, chkpt.dirfd, SAVE_N1_FILE, 0);
 	if (f_ret != 0) {
 	    errp(86, __func__, "ln %s %s failed, returned: %d, errno: %d", CHKPT_CUR_FILE, SAVE_N1_FILE, f_ret, errno);
 	    return;	// NOT REACHED
@@ -1923,7 +2332,7 @@ setup_chkpt_links(unsigned long h, unsigned long n, unsigned long i, mpz_t u_ter
 	 * link CHKPT_CUR_FILE to SAVE_NEAR_FILE
 	 */
 	dbg(DBG_LOW, "ln %s %s", CHKPT_CUR_FILE, SAVE_NEAR_FILE);
-	f_ret = link(CHKPT_CUR_FILE, SAVE_NEAR_FILE);
+	f_ret = linkat(chkpt.dirfd, CHKPT_CUR_FILE, chkpt.dirfd, SAVE_NEAR_FILE, 0);
 	if (f_ret != 0) {
 	    errp(86, __func__, "ln %s %s failed, returned: %d, errno: %d", CHKPT_CUR_FILE, SAVE_NEAR_FILE, f_ret, errno);
 	    return;	// NOT REACHED
@@ -1938,7 +2347,7 @@ setup_chkpt_links(unsigned long h, unsigned long n, unsigned long i, mpz_t u_ter
 	 * save first lucas term
 	 */
 	dbg(DBG_LOW, "ln %s %s", CHKPT_CUR_FILE, SAVE_FIRST_FILE);
-	f_ret = link(CHKPT_CUR_FILE, SAVE_FIRST_FILE);
+	f_ret = linkat(chkpt.dirfd, CHKPT_CUR_FILE, chkpt.dirfd, SAVE_FIRST_FILE, 0);
 	if (f_ret != 0) {
 	    errp(86, __func__, "ln %s %s failed, returned: %d, errno: %d", CHKPT_CUR_FILE, SAVE_FIRST_FILE, f_ret, errno);
 	    return;	// NOT REACHED
@@ -1973,6 +2382,7 @@ checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigne
 {
     FILE *stream;	// opened checkpoint file
     int f_ret;		// function return value
+    struct timeval began;	// when the checkpoint began
 
     /*
      * firewall
@@ -2018,15 +2428,29 @@ checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigne
 	err(87, __func__, "u_term is NULL");
 	return;	// NOT REACHED
     }
+    if (gettimeofday(&began, NULL) < 0) {
+	errp(87, __func__, "gettimeofday error");
+	return;	// NOT REACHED
+    }
+
+    /*
+     * be sure checkpoint directory exits and is locked
+     *
+     * A test settled by the firewalls of lucas_test() is checkpointed
+     * without initialize_checkpoint() having been called.
+     */
+    if (chkpt.lock == NULL) {
+	setup_checkpoint(checkpoint_dir, -1);
+    }
 
     /*
      * If CHKPT_PREV1_FILE exists, make CHKPT_PREV1_FILE the new CHKPT_PREV2_FILE.
      */
     errno = 0;
-    f_ret = access(CHKPT_PREV1_FILE, F_OK);
+    f_ret = faccessat(chkpt.dirfd, CHKPT_PREV1_FILE, F_OK, 0);
     if (f_ret == 0) {
 	errno = 0;
-	f_ret = rename(CHKPT_PREV1_FILE, CHKPT_PREV2_FILE);
+	f_ret = renameat(chkpt.dirfd, CHKPT_PREV1_FILE, chkpt.dirfd, CHKPT_PREV2_FILE);
 	if (f_ret < 0) {
 	    errp(EXIT_CHKPT_ACCESS, __func__,"cannot mv -f %s %s, errno: %d, retunded: %d",
 	    			    CHKPT_PREV1_FILE, CHKPT_PREV2_FILE, errno, f_ret);
@@ -2040,10 +2464,10 @@ checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigne
      * If CHKPT_PREV0_FILE exists, make CHKPT_PREV0_FILE the new CHKPT_PREV1_FILE.
      */
     errno = 0;
-    f_ret = access(CHKPT_PREV0_FILE, F_OK);
+    f_ret = faccessat(chkpt.dirfd, CHKPT_PREV0_FILE, F_OK, 0);
     if (f_ret == 0) {
 	errno = 0;
-	f_ret = rename(CHKPT_PREV0_FILE, CHKPT_PREV1_FILE);
+	f_ret = renameat(chkpt.dirfd, CHKPT_PREV0_FILE, chkpt.dirfd, CHKPT_PREV1_FILE);
 	if (f_ret < 0) {
 	    errp(EXIT_CHKPT_ACCESS, __func__, "cannot mv -f %s %s, errno: %d, retunded: %d",
 	    			    CHKPT_PREV0_FILE, CHKPT_PREV1_FILE, errno, f_ret);
@@ -2057,10 +2481,10 @@ checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigne
      * If CHKPT_CUR_FILE exists, make CHKPT_CUR_FILE the new CHKPT_PREV0_FILE.
      */
     errno = 0;
-    f_ret = access(CHKPT_CUR_FILE, F_OK);
+    f_ret = faccessat(chkpt.dirfd, CHKPT_CUR_FILE, F_OK, 0);
     if (f_ret == 0) {
 	errno = 0;
-	f_ret = rename(CHKPT_CUR_FILE, CHKPT_PREV0_FILE);
+	f_ret = renameat(chkpt.dirfd, CHKPT_CUR_FILE, chkpt.dirfd, CHKPT_PREV0_FILE);
 	if (f_ret < 0) {
 	    errp(EXIT_CHKPT_ACCESS, __func__, "cannot mv -f %s %s, errno: %d, retunded: %d",
 	    			    CHKPT_CUR_FILE, CHKPT_PREV0_FILE, errno, f_ret);
@@ -2074,7 +2498,7 @@ checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigne
      * open the checkpoint file
      */
     errno = 0;
-    f_ret = open(CHKPT_CUR_FILE, O_WRONLY|O_CREAT|O_EXCL, CHKPT_FILE_MODE);
+    f_ret = openat(chkpt.dirfd, CHKPT_CUR_FILE, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, CHKPT_FILE_MODE);
     if (f_ret < 0) {
 	errp(EXIT_CHKPT_ACCESS, __func__, "cannot exclusively creat for writing, errno: %d: %s", errno, CHKPT_CUR_FILE);
 	// exit(4);
@@ -2117,10 +2541,12 @@ checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigne
     write_calc_str(stream, NULL, "hostname", hostname);
 
     /*
-     * write current working directory
+     * write the real path of the checkpoint directory
+     *
+     * It is still written as cwd: it was the current working directory
+     * when the test moved into the checkpoint directory.
      */
-    cwd[HOST_NAME_MAX] = '\0'; // paranoia
-    write_calc_str(stream, NULL, "cwd", cwd);
+    write_calc_str(stream, NULL, "cwd", chkpt.path);
     write_calc_str(stream, NULL, "checkpoint_dir", checkpoint_dir);
 
     /*
@@ -2139,6 +2565,13 @@ checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigne
      */
     write_calc_uint64_t(stream, NULL, "h", h);
 
+    /*
+     * write the base, unless testing h*2^n-1, so that format 2 checkpoints of h*2^n-1 are unchanged
+     */
+    if (base != 2) {
+	write_calc_uint64_t(stream, NULL, "b", base);
+    }
+
     /*
      * write i
      */
@@ -2193,6 +2626,13 @@ checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigne
      */
     setup_chkpt_links(h, n, i, u_term);
 
+    /*
+     * record the checkpoint in the history of the test
+     */
+    if (valid_test) {
+	checkpoint_history(n, i, &began);
+    }
+
     /*
      * now that we have checkpointed, clear the checkpoint alarm flag if set
      */
@@ -2217,6 +2657,327 @@ checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigne
 }
 
 
+/*
+ * checkpoint_history_begin - note the start of a run in the history of the test
+ *
+ * given:
+ *      engine          name of the engine computing the terms of this run
+ *      i               Lucas sequence index the run starts from
+ *
+ * Until this is called, checkpoints are not recorded in the history.
+ */
+void
+checkpoint_history_begin(const char *engine, unsigned long i)
+{
+    history_engine = (engine != NULL ? engine : "gmp");
+    memset(&history_uts, 0, sizeof(history_uts));
+    if (uname(&history_uts) < 0) {
+	warnp(__func__, "uname error, kernel release will be recorded as unknown");
+	strcpy(history_uts.release, "unknown");
+    }
+    history_i = i;
+    load_prime_stats(&history_prev);
+    history_first = true;
+    history_begun = true;
+    return;
+}
+
+
+/*
+ * checkpoint_history - append a record of a checkpoint to the history of the test
+ *
+ * given:
+ *      n               power of 2
+ *      i               Lucas sequence index just checkpointed
+ *      began           when the checkpoint began
+ *
+ * The history file, HISTORY_FILE in the checkpoint directory, is only ever
+ * appended, so it follows the test across restores, hosts and engines.
+ * A line is written at the first checkpoint of a run, the last term, a
+ * checkpoint before exiting on a signal, and otherwise at most every
+ * HISTORY_SECS seconds:
+ *
+ *      date pid i terms wall cpu throttled rate host kernel engine latency
+ *
+ * where terms, wall (seconds), cpu (user + system seconds, all threads) and
+ * throttled (seconds slept to keep to a CPU budget) are since the previous
+ * line of this run, or since the run began, rate is terms per wall second,
+ * and latency is the seconds taken to checkpoint.
+ *
+ * The history is only a record, so a failure to write it is a warning.
+ */
+void
+checkpoint_history(unsigned long n, unsigned long i, const struct timeval *began)
+{
+    struct prime_stats now;	// prime stats as of now
+    struct timeval wall;	// wall clock time since the previous record
+    struct timeval cpu;		// CPU time since the previous record
+    struct timeval prev_cpu;	// CPU time as of the previous record
+    struct timeval slept;	// time throttled since the previous record
+    struct timeval latency;	// time taken to checkpoint
+    struct tm *tm_time;		// broken-down time now
+    char date[sizeof("YYYY-MM-DDThh:mm:ssZ")];	// time now as a string
+    struct stat buf;		// status of the history file
+    FILE *stream;		// history file
+    double secs;		// wall seconds since the previous record
+    int ret;			// function return value
+
+    if (!history_begun || began == NULL) {
+	return;
+    }
+
+    /*
+     * write at most every HISTORY_SECS, but for the first and last of a run
+     */
+    load_prime_stats(&now);
+    timersub(&now.now, &history_prev.now, &wall);
+    secs = timeval_secs(&wall);
+    if (!history_first && i < n && checkpoint_and_end == 0 && secs < (double)HISTORY_SECS) {
+	return;
+    }
+    timeradd(&history_prev.ru_utime, &history_prev.ru_stime, &prev_cpu);
+    timeradd(&now.ru_utime, &now.ru_stime, &cpu);
+    timersub(&cpu, &prev_cpu, &cpu);
+    timersub(&now.throttled, &history_prev.throttled, &slept);
+    timersub(&now.now, began, &latency);
+    tm_time = gmtime(&now.now.tv_sec);
+    if (tm_time == NULL || strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", tm_time) == 0) {
+	strcpy(date, "unknown");
+    }
+
+    /*
+     * append the record, starting a new history with a header
+     */
+    errno = 0;
+    stream = chkpt_fopen(HISTORY_FILE, O_WRONLY|O_CREAT|O_APPEND, "a");
+    if (stream == NULL) {
+	warnp(__func__, "cannot open for appending: %s", HISTORY_FILE);
+	return;
+    }
+    if (fstat(fileno(stream), &buf) == 0 && buf.st_size == 0) {
+	fprintf(stream, "# date pid i terms wall cpu throttled rate host kernel engine latency\n");
+    }
+    hostname[HOST_NAME_MAX] = '\0'; // paranoia
+    fprintf(stream, "%s %ld %lu %lu %.3f %.3f %.3f %.3f %s %s %s %.3f\n",
+	    date, (long)pid, i, i - history_i, secs, timeval_secs(&cpu), timeval_secs(&slept),
+	    (secs > 0.0 ? (double)(i - history_i) / secs : 0.0), hostname, history_uts.release, history_engine,
+	    timeval_secs(&latency));
+    errno = 0;
+    ret = fclose(stream);
+    if (ret != 0) {
+	warnp(__func__, "error writing: %s", HISTORY_FILE);
+    }
+    dbg(DBG_HIGH, "recorded u[%lu] in: %s", i, HISTORY_FILE);
+
+    /*
+     * the next record is since this one
+     */
+    history_i = i;
+    history_prev = now;
+    history_first = false;
+    return;
+}
+
+/*
+ * checkpoint_history_rate - best rate of an engine on this host in the history of the test
+ *
+ * given:
+ *      engine          engine name
+ *
+ * returns:
+ *      most terms per second, not counting time throttled, of a record of
+ *      this host and engine over at least HISTORY_RATE_SECS, 0.0 ==> none
+ *
+ * The history is that of the checkpoint directory set up by
+ * initialize_checkpoint().
+ */
+double
+checkpoint_history_rate(const char *engine)
+{
+    char line[BUFSIZ + 1];	// history record
+    char host[BUFSIZ + 1];	// host of the record
+    char eng[BUFSIZ + 1];	// engine of the record
+    unsigned long terms;	// terms since the previous record
+    double wall;		// wall seconds since the previous record
+    double slept;		// seconds throttled since the previous record
+    double rate;		// terms per second of the record
+    double best = 0.0;		// best rate so far
+    FILE *stream;		// history file
+
+    if (engine == NULL) {
+	return 0.0;
+    }
+    stream = chkpt_fopen(HISTORY_FILE, O_RDONLY, "r");
+    if (stream == NULL) {
+	return 0.0;
+    }
+    hostname[HOST_NAME_MAX] = '\0'; // paranoia
+    while (fgets(line, BUFSIZ, stream) != NULL) {
+	if (line[0] == '#' ||
+	    sscanf(line, "%*s %*d %*u %lu %lf %*f %lf %*f %1024s %*s %1024s", &terms, &wall, &slept, host, eng) != 5) {
+	    continue;
+	}
+	if (wall - slept < HISTORY_RATE_SECS || strcmp(host, hostname) != 0 || strcmp(eng, engine) != 0) {
+	    continue;
+	}
+	rate = (double)terms / (wall - slept);
+	if (rate > best) {
+	    best = rate;
+	}
+    }
+    (void) fclose(stream);
+    dbg(DBG_MED, "best rate of engine: %s on: %s in %s: %.3f terms/sec", engine, hostname, HISTORY_FILE, best);
+    return best;
+}
+
+
+/*
+ * timeval_secs - a struct timeval as seconds
+ *
+ * given:
+ *      value_ptr - pointer to a struct timeval
+ *
+ * returns:
+ *      seconds
+ */
+static double
+timeval_secs(const struct timeval *value_ptr)
+{
+    return (double)value_ptr->tv_sec + (double)value_ptr->tv_usec / 1000000.0;
+}
+
+
+/*
+ * find_calc_value - find the value of a calc variable in a checkpoint
+ *
+ * given:
+ *      buf - NUL terminated checkpoint file contents
+ *      name - variable name
+ *
+ * returns:
+ *      start of the value that follows "name = " at the start of a line, NULL ==> not found
+ */
+static const char *
+find_calc_value(const char *buf, const char *name)
+{
+    const char *p;		/* start of a line */
+    size_t len;			/* length of name */
+
+    len = strlen(name);
+    p = buf;
+    while (p != NULL && *p != '\0') {
+	if (strncmp(p, name, len) == 0 && strncmp(p + len, " = ", 3) == 0) {
+	    return p + len + 3;
+	}
+	p = strchr(p, '\n');
+	if (p != NULL) {
+	    ++p;
+	}
+    }
+    return NULL;
+}
+
+
+/*
+ * read_calc_uint64_t - read a uint64_t value written by write_calc_uint64_t()
+ *
+ * given:
+ *      buf - NUL terminated checkpoint file contents
+ *      name - variable name
+ *
+ * This function does not return on error.
+ */
+static uint64_t
+read_calc_uint64_t(const char *buf, const char *name)
+{
+    const char *p;		/* value */
+    char *end;			/* end of value */
+    unsigned long long value;
+
+    p = find_calc_value(buf, name);
+    if (p == NULL || !isdigit((unsigned char)*p)) {
+	err(EXIT_CANNOT_RESTORE, __func__, "%s has no valid %s", CHKPT_CUR_FILE, name);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+    errno = 0;
+    value = strtoull(p, &end, 10);
+    if (errno != 0 || strncmp(end, " ;\n", 3) != 0) {
+	err(EXIT_CANNOT_RESTORE, __func__, "%s has a malformed %s", CHKPT_CUR_FILE, name);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+    return (uint64_t)value;
+}
+
+
+/*
+ * read_calc_mpz_hex - read an mpz value written by write_calc_mpz_hex()
+ *
+ * given:
+ *      buf - NUL terminated checkpoint file contents
+ *      name - variable name
+ *      value - where to store the value
+ *
+ * This function does not return on error.
+ */
+static void
+read_calc_mpz_hex(const char *buf, const char *name, mpz_t value)
+{
+    const char *p;		/* value */
+    bool negative = false;	/* true ==> value is < 0 */
+    size_t len;			/* hex digits */
+    bool ok;			/* true ==> all digits were hex */
+
+    p = find_calc_value(buf, name);
+    if (p == NULL || strncmp(p, "0x", 2) != 0) {
+	err(EXIT_CANNOT_RESTORE, __func__, "%s has no valid %s", CHKPT_CUR_FILE, name);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+    p += 2;
+    if (*p == '-') {
+	negative = true;
+	++p;
+    }
+    len = strcspn(p, " ;\n");
+    if (len == 0 || strncmp(p + len, " ;\n", 3) != 0) {
+	err(EXIT_CANNOT_RESTORE, __func__, "%s has a malformed %s", CHKPT_CUR_FILE, name);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+
+    /*
+     * decode the digits into the limbs of value
+     */
+#if GMP_NUMB_BITS == 64
+    ok = hex_decode((uint64_t *)mpz_limbs_write(value, (mp_size_t)((len + HEX_LIMB_CHARS - 1) / HEX_LIMB_CHARS)), p, len);
+    mpz_limbs_finish(value, (mp_size_t)((len + HEX_LIMB_CHARS - 1) / HEX_LIMB_CHARS));
+#else
+    {
+	char *digits;		/* NUL terminated copy of the digits */
+
+	digits = strndup(p, len);
+	if (digits == NULL) {
+	    errp(88, __func__, "strndup of %zu digits failed", len);
+	    return;	// NOT REACHED
+	}
+	ok = (mpz_set_str(value, digits, 16) == 0);
+	free(digits);
+    }
+#endif
+    if (!ok) {
+	err(EXIT_CANNOT_RESTORE, __func__, "%s has a %s that is not hex", CHKPT_CUR_FILE, name);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+    if (negative) {
+	mpz_neg(value, value);
+    }
+    return;
+}
+
+
 /*
  * restore_checkpoint - restore state from a checkpoint directory
  *
@@ -2228,13 +2989,105 @@ checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigne
  *      v1		pointer to value of v(1) used for the given h and n (v1 must be >= 3)
  *      u_term          pointer to Lucas sequence value
  *
+ * The state is read from the CHKPT_CUR_FILE of checkpoint_dir, which must
+ * start with the current format and end with complete = "true".
+ *
  * This function does not return on error.
  */
 void
 restore_checkpoint(const char *checkpoint_dir, unsigned long *h, unsigned long *n, unsigned long *i,
 		   unsigned long *v1, mpz_t u_term)
 {
-    // XXX - write this code
-    err(88, __func__, "restore state from a checkpoint directory - code not yet written");
-    return;	// NOT REACHED
+    char format[ULONG_MAX_DIGITS + sizeof("format =  ;\n")];	/* expected first line */
+    struct stat buf;		/* CHKPT_CUR_FILE status */
+    char *contents;		/* CHKPT_CUR_FILE contents */
+    size_t len;			/* bytes read so far */
+    ssize_t ret;		/* read() return */
+    int dirfd;			/* open checkpoint directory */
+    int fd;			/* open CHKPT_CUR_FILE */
+    unsigned long b;		/* base of the checkpointed test */
+
+    /*
+     * firewall
+     */
+    if (checkpoint_dir == NULL || h == NULL || n == NULL || i == NULL || v1 == NULL || u_term == NULL) {
+	err(88, __func__, "called with NULL arg(s)");
+	return;	// NOT REACHED
+    }
+
+    /*
+     * read the current checkpoint file
+     */
+    errno = 0;
+    dirfd = open(checkpoint_dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (dirfd < 0) {
+	errp(EXIT_CANNOT_RESTORE, __func__, "cannot open directory: %s", checkpoint_dir);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+    errno = 0;
+    fd = openat(dirfd, CHKPT_CUR_FILE, O_RDONLY|O_CLOEXEC);
+    (void) close(dirfd);
+    if (fd < 0 || fstat(fd, &buf) < 0) {
+	errp(EXIT_CANNOT_RESTORE, __func__, "cannot read: %s/%s", checkpoint_dir, CHKPT_CUR_FILE);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+    contents = malloc((size_t)buf.st_size + 1);
+    if (contents == NULL) {
+	errp(88, __func__, "malloc of %lld bytes failed", (long long)buf.st_size);
+	return;	// NOT REACHED
+    }
+    for (len = 0; len < (size_t)buf.st_size; len += (size_t)ret) {
+	ret = read(fd, contents + len, (size_t)buf.st_size - len);
+	if (ret <= 0) {
+	    errp(EXIT_CANNOT_RESTORE, __func__, "read of %s/%s failed", checkpoint_dir, CHKPT_CUR_FILE);
+	    // exit(6);
+	    exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+	}
+    }
+    contents[len] = '\0';
+    (void) close(fd);
+
+    /*
+     * the checkpoint must be of our format and complete
+     */
+    snprintf(format, sizeof(format), "format = %d ;\n", CHECKPOINT_FMT_VERSION);
+    if (strncmp(contents, format, strlen(format)) != 0) {
+	err(EXIT_CANNOT_RESTORE, __func__, "%s/%s is not a format %d checkpoint", checkpoint_dir, CHKPT_CUR_FILE,
+	    CHECKPOINT_FMT_VERSION);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+    if (len < sizeof("complete = \"true\" ;\n") ||
+        strcmp(contents + len - (sizeof("complete = \"true\" ;\n") - 1), "complete = \"true\" ;\n") != 0) {
+	err(EXIT_CANNOT_RESTORE, __func__, "%s/%s is incomplete", checkpoint_dir, CHKPT_CUR_FILE);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+
+    /*
+     * restore h, n, i, v1, and u_term
+     */
+    *n = read_calc_uint64_t(contents, "n");
+    *h = read_calc_uint64_t(contents, "h");
+    *i = read_calc_uint64_t(contents, "i");
+    *v1 = read_calc_uint64_t(contents, "v1");
+    b = (find_calc_value(contents, "b") != NULL ? read_calc_uint64_t(contents, "b") : 2);
+    read_calc_mpz_hex(contents, "u_term", u_term);
+    if (b != base) {
+	err(EXIT_CANNOT_RESTORE, __func__, "%s/%s is a test of base: %lu, not base: %lu (see --base)",
+	    checkpoint_dir, CHKPT_CUR_FILE, b, base);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+    if (*h < 1 || *n < 2 || *i < FIRST_TERM_INDEX || *i > *n || *v1 < 3) {
+	err(EXIT_CANNOT_RESTORE, __func__, "%s/%s has invalid h: %lu n: %lu i: %lu v1: %lu",
+	    checkpoint_dir, CHKPT_CUR_FILE, *h, *n, *i, *v1);
+	// exit(6);
+	exit(EXIT_CANNOT_RESTORE);	// NOT REACHED
+    }
+    dbg(DBG_MED, "restored %lu*2^%lu-1 at u[%lu] from: %s/%s", *h, *n, *i, checkpoint_dir, CHKPT_CUR_FILE);
+    free(contents);
+    return;
 }
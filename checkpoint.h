@@ -44,8 +44,12 @@
 #define CHKPT_FILE_MODE			(S_IRUSR|S_IRGRP)	// default checkpoint file mode is 0440
 #define ULONG_MAX_DIGITS		(20)	// 2^64-1 as an unsigned long is 20 decimal digits long
 #define CHECKPOINT_PREVIEW		(1024)	// checkpoint U(N-CHECKPOINT_PREVIEW)
+#define HISTORY_SECS			(60)	// least seconds between history records, but for the first and last of a run
+#define HISTORY_RATE_SECS		(1.0)	// least seconds of a record used by checkpoint_history_rate()
+#define CHECKPOINT_TICK_MAX		(60.0)	// most seconds between checks of the CPU time used in an interval
 /**/
 #define LOCK_FILE			"run.lock"	// lock file name in checkpoint directory
+#define HISTORY_FILE			"history.txt"	// a line per checkpoint of each run: the rate, host and engine
 /**/
 #define CHKPT_CUR_FILE			"chk.cur.pt"	// current checkpoint file
 #define CHKPT_PREV0_FILE		"chk.prev-0.pt"	// previous checkpoint file
@@ -88,6 +92,7 @@ struct prime_stats {
     struct timeval ru_utime;	/* user CPU time used */
     struct timeval ru_stime;	/* system CPU time used */
     struct timeval wall_clock;	/* wall clock time used */
+    struct timeval throttled;	/* wall clock time slept to keep to a CPU budget (see throttle.c) */
     long ru_maxrss;		/* maximum resident set size used in kilobytes */
     long ru_minflt;		/* page reclaims (soft page faults) */
     long ru_majflt;		/* page faults (hard page faults) */
@@ -100,7 +105,7 @@ struct prime_stats {
 /*
  * checkpoint flags
  */
-extern uint64_t checkpoint_alarm;	/* != 0 ==> a SIGALRM or SIGVTALRM went off, checkpoint and continue */
+extern _Atomic uint64_t checkpoint_alarm;	/* != 0 ==> interval, SIGALRM or SIGVTALRM went off, checkpoint and continue */
 extern uint64_t checkpoint_and_end;	/* != 0 ==> a SIGINT went off, checkpoint and exit */
 
 
@@ -113,11 +118,19 @@ extern void write_calc_uint64_t(FILE *stream, char *basename, char *subname, con
 extern void write_calc_str(FILE *stream, char *basename, char *subname, const char *value);
 extern void write_calc_prime_stats(FILE *stream, bool extended);
 extern void initialize_checkpoint(char *checkpoint_dir, int checkpoint_secs, unsigned long h, unsigned long n, bool force);
+extern void checkpoint_interval(int checkpoint_secs);
+extern void checkpoint_close(void);
+extern int checkpoint_dirfd(void);
+extern void checkpoint_base(unsigned long b);
 extern void initialize_beginrun_stats(void);
 extern void update_stats(void);
+extern void add_throttled_stats(const struct timeval *slept);
 extern bool checkpoint_needed(unsigned long h, unsigned long n, unsigned long i, unsigned long multiple);
 extern void checkpoint(const char *checkpoint_dir, bool valid_test, unsigned long h, unsigned long n, unsigned long i,
 		       unsigned long v1, mpz_t u_term);
+extern void checkpoint_history_begin(const char *engine, unsigned long i);
+extern void checkpoint_history(unsigned long n, unsigned long i, const struct timeval *began);
+extern double checkpoint_history_rate(const char *engine);
 extern void restore_checkpoint(const char *checkpoint_dir, unsigned long *h, unsigned long *n, unsigned long *i,
 			       unsigned long *v1, mpz_t u_term);
 
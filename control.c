@@ -0,0 +1,551 @@
+/*
+ * control - control socket of a checkpointed test
+ *
+ * A test that checkpoints (-d checkpoint_dir) listens on CONTROL_FILE,
+ * a Unix domain socket next to the LOCK_FILE of the checkpoint directory.
+ * A client connects, sends one command line and reads one reply line:
+ *
+ *      status                  ok h h n n i i threads t interval secs cpu percent running|pausing|paused
+ *      checkpoint-now          checkpoint at the next block of terms and continue
+ *      set-interval secs       checkpoint every secs seconds of CPU time, 0 ==> only on demand
+ *      pause                   stop squaring at the next block of terms
+ *      resume                  continue squaring
+ *      set-threads t           square with t threads, 1 <= t <= PARSQR_MAX_THREADS
+ *      set-cpu percent         CPU budget while the host is busy, THROTTLE_MIN_CPU <= percent <= THROTTLE_MAX_CPU
+ *
+ * A failed command is answered with a line that starts with "error".
+ * The commands are served by a thread of their own, which only records
+ * them: the test applies them when it next calls control_poll(), which
+ * lucas_test() does every LUCAS_BLOCK terms.  A checkpoint-now while
+ * paused runs one more block of terms so that it has a term to checkpoint.
+ *
+ * The CPU budget is kept by throttle_block() (see throttle.c).
+ *
+ * "gmprime -d checkpoint_dir --control command" sends a command and prints
+ * the reply (see control_send()).
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 220-229	control.c - reserved for internal errors */
+
+#define _DEFAULT_SOURCE		/* for nanosleep() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "gmprime.h"
+#include "debug.h"
+#include "parsqr.h"
+#include "checkpoint.h"
+#include "throttle.h"
+#include "control.h"
+
+/*
+ * control socket of a running test
+ */
+struct control {
+    unsigned long h;		/* multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+    volatile int *threads;	/* squaring threads of the test, NULL ==> fixed */
+    struct throttle *th;	/* CPU budget of the test */
+    int fd;			/* listening socket */
+    pthread_t tid;		/* service thread */
+    atomic_bool quit;		/* true ==> service thread must return */
+
+    pthread_mutex_t lock;	/* guards the rest */
+    bool want_checkpoint;	/* true ==> checkpoint-now not yet applied */
+    bool want_interval;		/* true ==> set-interval not yet applied */
+    int want_threads;		/* set-threads not yet applied, 0 ==> none */
+    bool want_cpu;		/* true ==> set-cpu not yet applied */
+    bool paused;		/* true ==> pause, false ==> resume */
+    int cpu;			/* CPU budget in percent */
+    int interval;		/* checkpoint interval in seconds, <= 0 ==> only on demand */
+    unsigned long i;		/* Lucas sequence index at the last control_poll() */
+    bool stopped;		/* true ==> the test is waiting to resume */
+};
+
+/*
+ * static variables
+ */
+static bool listening = false;	/* true ==> CONTROL_FILE is ours to remove at exit */
+static bool atexit_set = false;	/* true ==> control_atexit() was registered */
+
+/*
+ * static functions
+ */
+static void control_atexit(void);
+static void *control_serve(void *arg);
+static void control_command(struct control *ctl, char *line, char *reply);
+static bool control_number(const char *arg, long min, long max, long *value);
+
+
+/*
+ * control_start - listen on the control socket of the checkpoint directory
+ *
+ * given:
+ *      h               multiplier of 2
+ *      n               power of 2
+ *      checkpoint_secs checkpoint interval the test started with
+ *      threads         squaring threads of the test, NULL ==> fixed
+ *      th              CPU budget of the test
+ *
+ * returns:
+ *      control socket, or NULL if the socket could not be made
+ *
+ * NOTE: The checkpoint directory must be set up, with its LOCK_FILE
+ *       locked, so a socket left by an earlier run can be replaced.
+ *       The socket is bound through /proc/self/fd, as bind() has no
+ *       directory descriptor relative form.
+ *
+ * This function does not return on error.
+ */
+struct control *
+control_start(unsigned long h, unsigned long n, int checkpoint_secs, volatile int *threads, struct throttle *th)
+{
+    struct control *ctl;	/* control socket */
+    struct sockaddr_un addr;	/* socket address */
+    sigset_t all;		/* every signal */
+    sigset_t old;		/* signals blocked by the caller */
+    int fd;			/* listening socket */
+    int ret;			/* return value */
+
+    /*
+     * replace any socket left by an earlier run
+     */
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    (void) snprintf(addr.sun_path, sizeof(addr.sun_path), "/proc/self/fd/%d/%s", checkpoint_dirfd(), CONTROL_FILE);
+    (void) unlinkat(checkpoint_dirfd(), CONTROL_FILE, 0);
+    errno = 0;
+    fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+	warnp(__func__, "cannot create control socket, errno: %d", errno);
+	return NULL;
+    }
+    errno = 0;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+	warnp(__func__, "cannot listen on %s, errno: %d", CONTROL_FILE, errno);
+	(void) close(fd);
+	return NULL;
+    }
+
+    /*
+     * allocate the control state
+     */
+    errno = 0;
+    ctl = calloc(1, sizeof(struct control));
+    if (ctl == NULL) {
+	errp(220, __func__, "calloc of control failed, errno: %d", errno);
+	return NULL;	// NOT REACHED
+    }
+    ctl->h = h;
+    ctl->n = n;
+    ctl->threads = threads;
+    ctl->th = th;
+    ctl->fd = fd;
+    atomic_init(&ctl->quit, false);
+    ctl->cpu = throttle_percent(th);
+    ctl->interval = checkpoint_secs;
+    ret = pthread_mutex_init(&ctl->lock, NULL);
+    if (ret != 0) {
+	err(221, __func__, "pthread_mutex_init returned: %d", ret);
+	return NULL;	// NOT REACHED
+    }
+
+    /*
+     * start the service thread with every signal blocked, so that signals
+     * are still taken by the test thread
+     */
+    sigfillset(&all);
+    (void) pthread_sigmask(SIG_SETMASK, &all, &old);
+    ret = pthread_create(&ctl->tid, NULL, control_serve, ctl);
+    (void) pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+	err(221, __func__, "pthread_create of service thread returned: %d", ret);
+	return NULL;	// NOT REACHED
+    }
+
+    /*
+     * remove the socket should the test exit without control_stop(), say after a signal
+     */
+    listening = true;
+    if (!atexit_set) {
+	atexit_set = (atexit(control_atexit) == 0);
+    }
+    dbg(DBG_MED, "listening on control socket: %s", CONTROL_FILE);
+    return ctl;
+}
+
+
+/*
+ * control_poll - apply the commands received since the last call
+ *
+ * given:
+ *      ctl     control socket, or NULL
+ *      i       Lucas sequence index of the current term
+ *
+ * This function returns when the test may compute more terms: at once
+ * unless paused.
+ */
+void
+control_poll(struct control *ctl, unsigned long i)
+{
+    struct timespec ts;		/* how long to sleep */
+    bool want_checkpoint;	/* true ==> checkpoint at the next block */
+    bool want_interval;		/* true ==> change the checkpoint interval */
+    int want_threads;		/* != 0 ==> change the squaring threads */
+    bool want_cpu;		/* true ==> change the CPU budget */
+    int interval;		/* new checkpoint interval */
+    int cpu;			/* new CPU budget */
+    bool paused;		/* true ==> wait to resume */
+
+    if (ctl == NULL) {
+	return;
+    }
+
+    /*
+     * apply the commands, waiting while paused
+     */
+    (void) pthread_mutex_lock(&ctl->lock);
+    ctl->i = i;
+    for (;;) {
+	want_checkpoint = ctl->want_checkpoint;
+	want_interval = ctl->want_interval;
+	want_threads = ctl->want_threads;
+	want_cpu = ctl->want_cpu;
+	interval = ctl->interval;
+	cpu = ctl->cpu;
+	paused = ctl->paused;
+	ctl->want_checkpoint = false;
+	ctl->want_interval = false;
+	ctl->want_threads = 0;
+	ctl->want_cpu = false;
+	ctl->stopped = paused;
+	(void) pthread_mutex_unlock(&ctl->lock);
+
+	if (want_checkpoint) {
+	    dbg(DBG_LOW, "control: checkpoint-now at u[%lu]", i);
+	    ++checkpoint_alarm;
+	}
+	if (want_interval) {
+	    checkpoint_interval(interval);
+	}
+	if (want_threads > 0) {
+	    dbg(DBG_LOW, "control: set-threads %d", want_threads);
+	    *ctl->threads = want_threads;
+	}
+	if (want_cpu) {
+	    throttle_set(ctl->th, cpu);
+	}
+	if (!paused || checkpoint_alarm != 0 || checkpoint_and_end != 0) {
+	    break;
+	}
+	ts.tv_sec = 0;
+	ts.tv_nsec = CONTROL_PAUSE_NS;
+	(void) nanosleep(&ts, NULL);
+	(void) pthread_mutex_lock(&ctl->lock);
+    }
+    (void) pthread_mutex_lock(&ctl->lock);
+    ctl->stopped = false;
+    (void) pthread_mutex_unlock(&ctl->lock);
+    return;
+}
+
+
+/*
+ * control_stop - stop listening and remove the control socket
+ *
+ * given:
+ *      ctl     control socket, or NULL
+ */
+void
+control_stop(struct control *ctl)
+{
+    if (ctl == NULL) {
+	return;
+    }
+    atomic_store(&ctl->quit, true);
+    (void) pthread_join(ctl->tid, NULL);
+    (void) close(ctl->fd);
+    (void) unlinkat(checkpoint_dirfd(), CONTROL_FILE, 0);
+    listening = false;
+    (void) pthread_mutex_destroy(&ctl->lock);
+    free(ctl);
+    return;
+}
+
+
+/*
+ * control_send - send a command to the test running in a checkpoint directory
+ *
+ * given:
+ *      checkpoint_dir  checkpoint directory of the test
+ *      command         command line, without the newline
+ *
+ * returns:
+ *      EXIT_IS_PRIME (0) if the test accepted the command, EXIT_USAGE if not
+ *
+ * The reply of the test is printed on stdout.
+ *
+ * This function does not return on error.
+ */
+int
+control_send(const char *checkpoint_dir, const char *command)
+{
+    struct sockaddr_un addr;	/* socket address */
+    char line[CONTROL_LINE + 1];	/* command, then reply */
+    size_t len;			/* bytes in line */
+    ssize_t got;		/* bytes read */
+    int fd;			/* connected socket */
+    int ret;			/* return value */
+
+    /*
+     * firewall
+     */
+    if (checkpoint_dir == NULL || command == NULL) {
+	err(222, __func__, "called with NULL arg(s)");
+	return EXIT_USAGE;	// NOT REACHED
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    ret = snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s", checkpoint_dir, CONTROL_FILE);
+    if (ret < 0 || (size_t)ret >= sizeof(addr.sun_path)) {
+	err(EXIT_USAGE, __func__, "checkpoint directory name too long for a socket: %s", checkpoint_dir);
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    len = strlen(command);
+    if (len == 0 || len >= CONTROL_LINE - 1 || strchr(command, '\n') != NULL) {
+	err(EXIT_USAGE, __func__, "command must be a single line of 1 to %d characters", CONTROL_LINE - 2);
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+
+    /*
+     * connect to the test
+     */
+    errno = 0;
+    fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+	errp(223, __func__, "cannot create socket, errno: %d", errno);
+	return EXIT_USAGE;	// NOT REACHED
+    }
+    errno = 0;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	errp(EXIT_CHKPT_ACCESS, __func__, "no test is listening on %s, errno: %d", addr.sun_path, errno);
+	// exit(4);
+	exit(EXIT_CHKPT_ACCESS); // NOT REACHED
+    }
+
+    /*
+     * send the command and print the reply
+     */
+    snprintf(line, sizeof(line), "%s\n", command);
+    errno = 0;
+    if (write(fd, line, len + 1) != (ssize_t)(len + 1)) {
+	errp(223, __func__, "cannot send command to %s, errno: %d", addr.sun_path, errno);
+	return EXIT_USAGE;	// NOT REACHED
+    }
+    (void) shutdown(fd, SHUT_WR);
+    len = 0;
+    while (len < CONTROL_LINE && (got = read(fd, line + len, CONTROL_LINE - len)) > 0) {
+	len += (size_t)got;
+    }
+    (void) close(fd);
+    line[len] = '\0';
+    fputs(line, stdout);
+    fflush(stdout);
+    return (strncmp(line, "ok", 2) == 0) ? EXIT_IS_PRIME : EXIT_USAGE;
+}
+
+
+/*
+ * control_atexit - remove the control socket of a test that exits while listening
+ */
+static void
+control_atexit(void)
+{
+    if (listening) {
+	(void) unlinkat(checkpoint_dirfd(), CONTROL_FILE, 0);
+	listening = false;
+    }
+    return;
+}
+
+
+/*
+ * control_serve - service thread: answer one command per connection
+ *
+ * given:
+ *      arg     control socket
+ */
+static void *
+control_serve(void *arg)
+{
+    struct control *ctl = (struct control *)arg;	/* control socket */
+    struct pollfd pfd;		/* wait for a connection */
+    struct timeval tv;		/* how long a client may take */
+    char line[CONTROL_LINE + 1];	/* command */
+    char reply[CONTROL_LINE + 1];	/* reply */
+    size_t len;			/* bytes in line */
+    ssize_t got;		/* bytes read */
+    int fd;			/* connected socket */
+
+    pfd.fd = ctl->fd;
+    pfd.events = POLLIN;
+    while (!atomic_load(&ctl->quit)) {
+	if (poll(&pfd, 1, CONTROL_POLL_MS) <= 0) {
+	    continue;
+	}
+	fd = accept(ctl->fd, NULL, NULL);
+	if (fd < 0) {
+	    continue;
+	}
+	tv.tv_sec = CONTROL_TIMEOUT_SECS;
+	tv.tv_usec = 0;
+	(void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	(void) setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	/*
+	 * read up to the end of the first line
+	 */
+	len = 0;
+	while (len < CONTROL_LINE && memchr(line, '\n', len) == NULL &&
+	       (got = read(fd, line + len, CONTROL_LINE - len)) > 0) {
+	    len += (size_t)got;
+	}
+	line[len] = '\0';
+	line[strcspn(line, "\r\n")] = '\0';
+	control_command(ctl, line, reply);
+	(void) write(fd, reply, strlen(reply));
+	(void) close(fd);
+    }
+    return NULL;
+}
+
+
+/*
+ * control_command - record a command and form its reply
+ *
+ * given:
+ *      ctl     control socket
+ *      line    command line, without the newline
+ *      reply   where to form the reply line, CONTROL_LINE+1 bytes
+ */
+static void
+control_command(struct control *ctl, char *line, char *reply)
+{
+    char *cmd;			/* command word */
+    char *arg;			/* argument, or NULL */
+    char *extra;		/* anything after the argument */
+    char *save;			/* strtok_r() state */
+    long value = 0;		/* numeric argument */
+
+    cmd = strtok_r(line, " \t", &save);
+    arg = (cmd == NULL) ? NULL : strtok_r(NULL, " \t", &save);
+    extra = (arg == NULL) ? NULL : strtok_r(NULL, " \t", &save);
+    if (cmd == NULL || extra != NULL) {
+	snprintf(reply, CONTROL_LINE + 1, "error: expected a command and at most one argument\n");
+	return;
+    }
+    dbg(DBG_MED, "control command: %s%s%s", cmd, (arg == NULL ? "" : " "), (arg == NULL ? "" : arg));
+
+    (void) pthread_mutex_lock(&ctl->lock);
+    if (strcmp(cmd, "status") == 0 && arg == NULL) {
+	snprintf(reply, CONTROL_LINE + 1, "ok h %lu n %lu i %lu threads %d interval %d cpu %d %s\n",
+		 ctl->h, ctl->n, ctl->i, (ctl->threads == NULL ? 1 : *ctl->threads), ctl->interval, ctl->cpu,
+		 (ctl->stopped ? "paused" : (ctl->paused ? "pausing" : "running")));
+    } else if (strcmp(cmd, "checkpoint-now") == 0 && arg == NULL) {
+	ctl->want_checkpoint = true;
+	snprintf(reply, CONTROL_LINE + 1, "ok\n");
+    } else if (strcmp(cmd, "set-interval") == 0 && control_number(arg, 0, INT32_MAX, &value)) {
+	ctl->want_interval = true;
+	ctl->interval = (int)value;
+	snprintf(reply, CONTROL_LINE + 1, "ok\n");
+    } else if (strcmp(cmd, "pause") == 0 && arg == NULL) {
+	ctl->paused = true;
+	snprintf(reply, CONTROL_LINE + 1, "ok\n");
+    } else if (strcmp(cmd, "resume") == 0 && arg == NULL) {
+	ctl->paused = false;
+	snprintf(reply, CONTROL_LINE + 1, "ok\n");
+    } else if (strcmp(cmd, "set-threads") == 0 && control_number(arg, 1, PARSQR_MAX_THREADS, &value)) {
+	if (ctl->threads == NULL) {
+	    snprintf(reply, CONTROL_LINE + 1, "error: squaring threads of this test are fixed\n");
+	} else {
+	    ctl->want_threads = (int)value;
+	    snprintf(reply, CONTROL_LINE + 1, "ok\n");
+	}
+    } else if (strcmp(cmd, "set-cpu") == 0 && control_number(arg, THROTTLE_MIN_CPU, THROTTLE_MAX_CPU, &value)) {
+	ctl->want_cpu = true;
+	ctl->cpu = (int)value;
+	snprintf(reply, CONTROL_LINE + 1, "ok\n");
+    } else {
+	snprintf(reply, CONTROL_LINE + 1, "error: unknown command or bad argument: %s "
+		 "(status, checkpoint-now, set-interval secs, pause, resume, set-threads %d..%d, set-cpu %d..%d)\n",
+		 cmd, 1, PARSQR_MAX_THREADS, THROTTLE_MIN_CPU, THROTTLE_MAX_CPU);
+    }
+    (void) pthread_mutex_unlock(&ctl->lock);
+    return;
+}
+
+
+/*
+ * control_number - parse a decimal command argument
+ *
+ * given:
+ *      arg     argument, or NULL
+ *      min     smallest allowed value
+ *      max     largest allowed value
+ *      value   where to store the value
+ *
+ * returns:
+ *      true ==> arg is a number from min to max, false ==> it is not
+ */
+static bool
+control_number(const char *arg, long min, long max, long *value)
+{
+    char *end;			/* first character not parsed */
+
+    if (arg == NULL) {
+	return false;
+    }
+    errno = 0;
+    *value = strtol(arg, &end, 10);
+    return errno == 0 && end != arg && *end == '\0' && *value >= min && *value <= max;
+}
@@ -0,0 +1,59 @@
+/*
+ * control - control socket of a checkpointed test
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_CONTROL_H)
+#define INCLUDE_CONTROL_H
+
+#include <stdbool.h>
+
+#include "throttle.h"
+
+/*
+ * control constants
+ */
+#define CONTROL_FILE		"control.sock"	// control socket name in the checkpoint directory
+#define CONTROL_LINE		(256)		// longest command or reply, including the newline
+#define CONTROL_POLL_MS		(250)		// milliseconds the service thread waits for a connection
+#define CONTROL_TIMEOUT_SECS	(2)		// seconds a connection may take to send its command
+#define CONTROL_PAUSE_NS	(100000000)	// nanoseconds between looks at the commands while paused
+
+/*
+ * control socket of a running test - opaque outside of control.c
+ */
+struct control;
+
+/*
+ * external functions
+ */
+extern struct control *control_start(unsigned long h, unsigned long n, int checkpoint_secs, volatile int *threads, struct throttle *th);
+extern void control_poll(struct control *ctl, unsigned long i);
+extern void control_stop(struct control *ctl);
+extern int control_send(const char *checkpoint_dir, const char *command);
+
+#endif				/* INCLUDE_CONTROL_H */
@@ -1,6 +1,23 @@
 /*
  * debug - debug, warning and error reporting facility
  *
+ * Messages from msg(), dbg(), warn() and warnp() do not write to stderr
+ * in the calling thread.  Each line, tagged with the time and its kind
+ * (msg, dbgN for a debug level N, Warning), is copied into a ring of
+ * DEBUG_RING_BYTES owned by the calling thread and drained to stderr by
+ * a writer thread every DEBUG_DRAIN_NS.  A ring has one producer, its
+ * thread, and one consumer, whoever holds the drain lock, so a message
+ * takes no lock.  At most DEBUG_RINGS threads have a ring at once; a ring
+ * is handed on once its thread exits and the ring is drained.
+ *
+ * A message is written in the calling thread, after draining the rings,
+ * when its ring is full, when the thread has no ring, when a signal
+ * handler interrupts a message, and at -v DBG_HIGH or more, where the
+ * Lucas terms are written straight to stderr between messages.
+ *
+ * err(), errp(), usage_err(), usage_errp(), debug_flush(), exit() and
+ * fork() drain the rings first, so no message is lost or written twice.
+ *
  * Copyright (c) 2019-2020 by Landon Curt Noll.  All Rights Reserved.
  *
  * Permission to use, copy, modify, and distribute this software and
@@ -30,17 +47,71 @@
 /* NUMERIC EXIT CODES: 255	debug.c - FORCED_EXIT */
 // NOTE: Other code calls err() and errp() with various exit codes that may result in zero or non-zero exits
 
+#define _DEFAULT_SOURCE		/* for nanosleep() and localtime_r() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "debug.h"		// debug, warning, error and usag macros
 
 
 #ifndef DEBUG_LINT
 
+/*
+ * ring states
+ */
+#define RING_FREE	(0)	// not owned by a thread
+#define RING_OWNED	(1)	// written by its thread
+#define RING_RETIRED	(2)	// its thread exited, free once drained
+
+/*
+ * a ring of message bytes, written by one thread and drained by the writer
+ */
+struct debug_ring {
+    atomic_int state;		/* RING_FREE, RING_OWNED or RING_RETIRED */
+    atomic_size_t head;		/* bytes ever written, advanced by the owner */
+    atomic_size_t tail;		/* bytes ever drained, advanced under the drain lock */
+    char *buf;			/* DEBUG_RING_BYTES, allocated when first owned */
+};
+
+/*
+ * static variables
+ */
+static struct debug_ring ring[DEBUG_RINGS];	/* rings of the threads */
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;	/* held while draining */
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;	/* held while starting the writer */
+static atomic_bool writer_running = false;	/* true ==> the writer thread drains the rings */
+static bool hooks_set = false;		/* true ==> atexit(), pthread_atfork() and the ring key are set */
+static pthread_key_t ring_key;		/* retires the ring of an exiting thread */
+static _Thread_local struct debug_ring *my_ring = NULL;	/* ring of this thread, NULL ==> none yet */
+static _Thread_local bool no_ring = false;	/* true ==> no ring was free for this thread */
+static _Thread_local volatile sig_atomic_t in_debug = 0;	/* != 0 ==> this thread is writing a message */
+
+/*
+ * static functions
+ */
+static void debug_log(const char *tag, const char *name, int saved_errno, const char *fmt, va_list ap);
+static void debug_emit(const char *line, size_t len);
+static struct debug_ring *debug_ring(void);
+static void debug_start(void);
+static void *debug_writer(void *arg);
+static void debug_drain(void);
+static void debug_write(const char *buf, size_t len);
+static void debug_retire(void *arg);
+static void debug_atexit(void);
+static void debug_prefork(void);
+static void debug_postfork(void);
+static void debug_postfork_child(void);
+
 /*
  * msg - print a generic message
  *
@@ -57,7 +128,6 @@ void
 msg(const char *fmt, ...)
 {
     va_list ap;			/* argument pointer */
-    int ret;			/* return code holder */
 
     /*
      * Start the var arg setup and fetch our first arg
@@ -75,11 +145,7 @@ msg(const char *fmt, ...)
     /*
      * Print the message
      */
-    ret = vfprintf(stderr, fmt, ap);
-    if (ret <= 0) {
-	fprintf(stderr, "[%s vfprintf returned error: %d]", __func__, ret);
-    }
-    fputc('\n', stderr);
+    debug_log("msg", NULL, 0, fmt, ap);
 
     /*
      * Clean up stdarg stuff
@@ -106,7 +172,7 @@ void
 dbg(int level, const char *fmt, ...)
 {
     va_list ap;			/* argument pointer */
-    int ret;			/* return code holder */
+    char tag[sizeof("dbg") + 3*sizeof(int)];	/* dbg and the level */
 
     /*
      * Start the var arg setup and fetch our first arg
@@ -125,11 +191,8 @@ dbg(int level, const char *fmt, ...)
      * Print the debug message (if verbosity level is enough)
      */
     if (level <= debuglevel) {
-	ret = vfprintf(stderr, fmt, ap);
-	if (ret <= 0) {
-	    fprintf(stderr, "[%s vfprintf returned error: %d]", __func__, ret);
-	}
-	fputc('\n', stderr);
+	snprintf(tag, sizeof(tag), "dbg%d", level);
+	debug_log(tag, NULL, 0, fmt, ap);
     }
 
     /*
@@ -156,7 +219,6 @@ void
 warn(const char *name, const char *fmt, ...)
 {
     va_list ap;			/* argument pointer */
-    int ret;			/* return code holder */
 
     /*
      * Start the var arg setup and fetch our first arg
@@ -178,12 +240,7 @@ warn(const char *name, const char *fmt, ...)
     /*
      * Issue the warning
      */
-    fprintf(stderr, "Warning: %s: ", name);
-    ret = vfprintf(stderr, fmt, ap);
-    if (ret <= 0) {
-	fprintf(stderr, "[%s vfprintf returned error: %d]", __func__, ret);
-    }
-    fputc('\n', stderr);
+    debug_log("Warning", name, 0, fmt, ap);
 
     /*
      * Clean up stdarg stuff
@@ -211,7 +268,6 @@ void
 warnp(const char *name, const char *fmt, ...)
 {
     va_list ap;			/* argument pointer */
-    int ret;			/* return code holder */
     int saved_errno;		/* errno at function start */
 
     /*
@@ -235,13 +291,7 @@ warnp(const char *name, const char *fmt, ...)
     /*
      * Issue the warning
      */
-    fprintf(stderr, "Warning: %s: ", name);
-    ret = vfprintf(stderr, fmt, ap);
-    if (ret <= 0) {
-	fprintf(stderr, "[%s vfprintf returned error: %d]", __func__, ret);
-    }
-    fputc('\n', stderr);
-    fprintf(stderr, "errno[%d]: %s\n", saved_errno, strerror(saved_errno));
+    debug_log("Warning", name, saved_errno, fmt, ap);
 
     /*
      * Clean up stdarg stuff
@@ -270,7 +320,6 @@ void
 err(int exitcode, const char *name, const char *fmt, ...)
 {
     va_list ap;			/* argument pointer */
-    int ret;			/* return code holder */
 
     /*
      * Start the var arg setup and fetch our first arg
@@ -300,14 +349,10 @@ err(int exitcode, const char *name, const char *fmt, ...)
     }
 
     /*
-     * Issue the fatal error
+     * Issue the fatal error, after the messages before it
      */
-    fprintf(stderr, "FATAL: %s: ", name);
-    ret = vfprintf(stderr, fmt, ap);
-    if (ret <= 0) {
-	fprintf(stderr, "[%s vfprintf returned error: %d]", __func__, ret);
-    }
-    fputc('\n', stderr);
+    debug_flush();
+    debug_log("FATAL", name, 0, fmt, ap);
 
     /*
      * Clean up stdarg stuff
@@ -341,7 +386,6 @@ void
 errp(int exitcode, const char *name, const char *fmt, ...)
 {
     va_list ap;			/* argument pointer */
-    int ret;			/* return code holder */
     int saved_errno;		/* errno at function start */
 
     /*
@@ -373,17 +417,10 @@ errp(int exitcode, const char *name, const char *fmt, ...)
     }
 
     /*
-     * Issue the fatal error
+     * Issue the fatal error, after the messages before it
      */
-    fprintf(stderr, "FATAL: %s: ", name);
-    ret = vfprintf(stderr, fmt, ap);
-    if (ret <= 0) {
-	fprintf(stderr, "[%s vfprintf returned error: %d]", __func__, ret);
-    }
-    fputc('\n', stderr);
-    if (errno != 0) {
-	fprintf(stderr, "errno[%d]: %s\n", saved_errno, strerror(saved_errno));
-    }
+    debug_flush();
+    debug_log("FATAL", name, saved_errno, fmt, ap);
 
     /*
      * Clean up stdarg stuff
@@ -442,8 +479,9 @@ usage_err(int exitcode, const char *name, const char *fmt, ...)
     }
 
     /*
-     * Issue the fatal error
+     * Issue the fatal error, after the messages before it
      */
+    debug_flush();
     if (exitcode > 0) {
 	fprintf(stderr, "FATAL: %s: ", name);
 	ret = vfprintf(stderr, fmt, ap);
@@ -523,8 +561,9 @@ usage_errp(int exitcode, const char *name, const char *fmt, ...)
     }
 
     /*
-     * Issue the fatal error
+     * Issue the fatal error, after the messages before it
      */
+    debug_flush();
     if (exitcode > 0) {
 	fprintf(stderr, "FATAL: %s: ", name);
 	ret = vfprintf(stderr, fmt, ap);
@@ -556,4 +595,401 @@ usage_errp(int exitcode, const char *name, const char *fmt, ...)
     exit(exitcode);
 }
 
+
+/*
+ * debug_flush - write every message so far to stderr
+ *
+ * Messages written by a thread before this call are on stderr when it returns.
+ */
+void
+debug_flush(void)
+{
+    /*
+     * a signal handler that interrupted a message must not wait for the drain lock
+     */
+    if (in_debug) {
+	fflush(stderr);
+	return;
+    }
+    in_debug = 1;
+    (void) pthread_mutex_lock(&drain_lock);
+    debug_drain();
+    (void) pthread_mutex_unlock(&drain_lock);
+    in_debug = 0;
+    fflush(stderr);
+    return;
+}
+
+
+/*
+ * debug_log - form a tagged message line and emit it
+ *
+ * given:
+ *      tag             kind of message
+ *      name            name of the function issuing the message, NULL ==> none
+ *      saved_errno     errno to explain on a second line, 0 ==> none
+ *      fmt             printf format
+ *      ap              format args
+ */
+static void
+debug_log(const char *tag, const char *name, int saved_errno, const char *fmt, va_list ap)
+{
+    char line[DEBUG_LINE_MAX];	/* message line */
+    struct timespec ts;		/* time of the message */
+    struct tm tm;		/* local time of the message */
+    size_t len;			/* bytes in line */
+    int ret;			/* return code holder */
+
+    /*
+     * time and kind of message
+     */
+    (void) clock_gettime(CLOCK_REALTIME, &ts);
+    (void) localtime_r(&ts.tv_sec, &tm);
+    len = strftime(line, sizeof(line), "%Y-%m-%d %H:%M:%S", &tm);
+    ret = snprintf(line + len, sizeof(line) - len, ".%06ld %s: ", ts.tv_nsec / 1000, tag);
+    len += (ret > 0) ? (size_t)ret : 0;
+    if (name != NULL && len < sizeof(line)) {
+	ret = snprintf(line + len, sizeof(line) - len, "%s: ", name);
+	len += (ret > 0) ? (size_t)ret : 0;
+    }
+
+    /*
+     * the message, cut short if need be so that it ends in a newline
+     */
+    if (len < sizeof(line)) {
+	ret = vsnprintf(line + len, sizeof(line) - len, fmt, ap);
+	if (ret < 0) {
+	    ret = snprintf(line + len, sizeof(line) - len, "[%s vsnprintf returned error: %d]", __func__, ret);
+	}
+	len += (ret > 0) ? (size_t)ret : 0;
+    }
+    if (saved_errno != 0 && len < sizeof(line)) {
+	ret = snprintf(line + len, sizeof(line) - len, "\nerrno[%d]: %s", saved_errno, strerror(saved_errno));
+	len += (ret > 0) ? (size_t)ret : 0;
+    }
+    if (len > sizeof(line) - 2) {
+	len = sizeof(line) - 2;
+    }
+    line[len++] = '\n';
+    line[len] = '\0';
+    debug_emit(line, len);
+    return;
+}
+
+
+/*
+ * debug_emit - add a message line to the ring of this thread, or write it now
+ *
+ * given:
+ *      line    message line, ending in a newline
+ *      len     bytes in line
+ */
+static void
+debug_emit(const char *line, size_t len)
+{
+    struct debug_ring *r;	/* ring of this thread */
+    size_t head;		/* bytes ever written to the ring */
+    size_t pos;			/* where in the ring the line starts */
+    size_t first;		/* bytes of the line before the end of the ring */
+
+    /*
+     * a signal handler that interrupted a message writes at once
+     */
+    if (in_debug) {
+	debug_write(line, len);
+	return;
+    }
+    in_debug = 1;
+
+    /*
+     * add the line to the ring, unless it must be written now
+     */
+    r = (debuglevel >= DBG_HIGH) ? NULL : debug_ring();
+    if (r != NULL) {
+	head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	if (DEBUG_RING_BYTES - (head - atomic_load_explicit(&r->tail, memory_order_acquire)) >= len) {
+	    pos = head % DEBUG_RING_BYTES;
+	    first = DEBUG_RING_BYTES - pos;
+	    if (first >= len) {
+		memcpy(r->buf + pos, line, len);
+	    } else {
+		memcpy(r->buf + pos, line, first);
+		memcpy(r->buf, line + first, len - first);
+	    }
+	    atomic_store_explicit(&r->head, head + len, memory_order_release);
+	    in_debug = 0;
+	    return;
+	}
+    }
+
+    /*
+     * write the line now, after the lines before it
+     */
+    (void) pthread_mutex_lock(&drain_lock);
+    debug_drain();
+    debug_write(line, len);
+    (void) pthread_mutex_unlock(&drain_lock);
+    in_debug = 0;
+    return;
+}
+
+
+/*
+ * debug_ring - the ring of this thread
+ *
+ * returns:
+ *      ring of this thread, or NULL if no ring is free
+ */
+static struct debug_ring *
+debug_ring(void)
+{
+    int expect;			/* RING_FREE */
+    int i;
+
+    if (!atomic_load(&writer_running)) {
+	debug_start();
+	if (!atomic_load(&writer_running)) {
+	    return NULL;
+	}
+    }
+    if (my_ring != NULL || no_ring) {
+	return my_ring;
+    }
+
+    /*
+     * claim a free ring
+     */
+    for (i = 0; i < DEBUG_RINGS; ++i) {
+	expect = RING_FREE;
+	if (atomic_compare_exchange_strong(&ring[i].state, &expect, RING_OWNED)) {
+	    if (ring[i].buf == NULL) {
+		ring[i].buf = malloc(DEBUG_RING_BYTES);
+		if (ring[i].buf == NULL) {
+		    atomic_store(&ring[i].state, RING_FREE);
+		    break;
+		}
+	    }
+	    my_ring = &ring[i];
+	    (void) pthread_setspecific(ring_key, my_ring);
+	    return my_ring;
+	}
+    }
+    no_ring = true;
+    return NULL;
+}
+
+
+/*
+ * debug_start - start the writer thread
+ */
+static void
+debug_start(void)
+{
+    pthread_t tid;		/* writer thread */
+    pthread_attr_t attr;	/* detached */
+    sigset_t all;		/* every signal */
+    sigset_t old;		/* signals blocked by the caller */
+
+    (void) pthread_mutex_lock(&start_lock);
+    if (!hooks_set) {
+	if (pthread_key_create(&ring_key, debug_retire) != 0 ||
+	    pthread_atfork(debug_prefork, debug_postfork, debug_postfork_child) != 0 ||
+	    atexit(debug_atexit) != 0) {
+	    (void) pthread_mutex_unlock(&start_lock);
+	    return;
+	}
+	hooks_set = true;
+    }
+    if (!atomic_load(&writer_running)) {
+
+	/*
+	 * start the writer with every signal blocked, so that signals are
+	 * still taken by the threads that compute
+	 */
+	sigfillset(&all);
+	(void) pthread_sigmask(SIG_SETMASK, &all, &old);
+	(void) pthread_attr_init(&attr);
+	(void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&tid, &attr, debug_writer, NULL) == 0) {
+	    atomic_store(&writer_running, true);
+	}
+	(void) pthread_attr_destroy(&attr);
+	(void) pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+    (void) pthread_mutex_unlock(&start_lock);
+    return;
+}
+
+
+/*
+ * debug_writer - writer thread: drain the rings now and then
+ *
+ * given:
+ *      arg     unused
+ */
+static void *
+debug_writer(void *arg)
+{
+    struct timespec ts;		/* time between drains */
+
+    (void) arg;
+    for (;;) {
+	ts.tv_sec = 0;
+	ts.tv_nsec = DEBUG_DRAIN_NS;
+	(void) nanosleep(&ts, NULL);
+	(void) pthread_mutex_lock(&drain_lock);
+	debug_drain();
+	(void) pthread_mutex_unlock(&drain_lock);
+    }
+    return NULL;	// NOT REACHED
+}
+
+
+/*
+ * debug_drain - write what is in each ring to stderr
+ *
+ * NOTE: The caller must hold drain_lock.
+ */
+static void
+debug_drain(void)
+{
+    struct debug_ring *r;	/* ring to drain */
+    size_t head;		/* bytes ever written to the ring */
+    size_t tail;		/* bytes ever drained from the ring */
+    size_t pos;			/* where in the ring the bytes start */
+    size_t len;			/* bytes to drain */
+    size_t first;		/* bytes before the end of the ring */
+    int i;
+
+    for (i = 0; i < DEBUG_RINGS; ++i) {
+	r = &ring[i];
+	if (r->buf == NULL) {
+	    continue;
+	}
+	head = atomic_load_explicit(&r->head, memory_order_acquire);
+	tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	len = head - tail;
+	if (len > 0) {
+	    pos = tail % DEBUG_RING_BYTES;
+	    first = DEBUG_RING_BYTES - pos;
+	    if (first >= len) {
+		debug_write(r->buf + pos, len);
+	    } else {
+		debug_write(r->buf + pos, first);
+		debug_write(r->buf, len - first);
+	    }
+	    atomic_store_explicit(&r->tail, head, memory_order_release);
+	}
+	if (atomic_load(&r->state) == RING_RETIRED && atomic_load(&r->head) == head) {
+	    atomic_store(&r->state, RING_FREE);
+	}
+    }
+    return;
+}
+
+
+/*
+ * debug_write - write bytes to stderr
+ *
+ * given:
+ *      buf     bytes to write
+ *      len     number of bytes
+ */
+static void
+debug_write(const char *buf, size_t len)
+{
+    ssize_t ret;		/* bytes written */
+
+    fflush(stderr);
+    while (len > 0) {
+	ret = write(STDERR_FILENO, buf, len);
+	if (ret < 0 && errno == EINTR) {
+	    continue;
+	} else if (ret <= 0) {
+	    break;
+	}
+	buf += ret;
+	len -= (size_t)ret;
+    }
+    return;
+}
+
+
+/*
+ * debug_retire - hand on the ring of an exiting thread once it is drained
+ *
+ * given:
+ *      arg     ring of the exiting thread
+ */
+static void
+debug_retire(void *arg)
+{
+    struct debug_ring *r = (struct debug_ring *)arg;	/* ring of the exiting thread */
+
+    if (r != NULL) {
+	atomic_store(&r->state, RING_RETIRED);
+    }
+    my_ring = NULL;
+    return;
+}
+
+
+/*
+ * debug_atexit - drain the rings as the process exits
+ */
+static void
+debug_atexit(void)
+{
+    debug_flush();
+    return;
+}
+
+
+/*
+ * debug_prefork - drain the rings before a fork, and keep them drained
+ */
+static void
+debug_prefork(void)
+{
+    (void) pthread_mutex_lock(&drain_lock);
+    debug_drain();
+    fflush(stderr);
+    return;
+}
+
+
+/*
+ * debug_postfork - let the parent drain again after a fork
+ */
+static void
+debug_postfork(void)
+{
+    (void) pthread_mutex_unlock(&drain_lock);
+    return;
+}
+
+
+/*
+ * debug_postfork_child - the child of a fork only has the thread that forked
+ *
+ * Lines added after debug_prefork() are the parent's to write, and the
+ * other threads, along with the writer, are gone.
+ */
+static void
+debug_postfork_child(void)
+{
+    int i;
+
+    for (i = 0; i < DEBUG_RINGS; ++i) {
+	atomic_store(&ring[i].tail, atomic_load(&ring[i].head));
+	if (&ring[i] != my_ring) {
+	    atomic_store(&ring[i].state, RING_FREE);
+	}
+    }
+    atomic_store(&writer_running, false);
+    (void) pthread_mutex_init(&drain_lock, NULL);
+    (void) pthread_mutex_init(&start_lock, NULL);
+    return;
+}
+
 #endif				// DEBUG_LINT
@@ -110,6 +110,7 @@ extern int debuglevel;			// print debug messages <= debuglevel
 #        define usage_err(exitcode, name, ...) (fprintf(stderr, "%s: ", (name)), \
 					       fprintf(stderr, __VA_ARGS__), \
 					       exit(exitcode))
+#        define debug_flush() fflush(stderr)
 #        define usage_errp(exitcode, name, ...) (fprintf(stderr, "%s: ", (name)), \
 						fprintf(stderr, __VA_ARGS__), \
 						fputc('\n', stderr), perror(__FUNCTION__), \
@@ -125,6 +126,7 @@ extern void err(int exitcode, const char *name, const char *fmt, ...);
 extern void errp(int exitcode, const char *name, const char *fmt, ...);
 extern void usage_err(int exitcode, const char *name, const char *fmt, ...);
 extern void usage_errp(int exitcode, const char *name, const char *fmt, ...);
+extern void debug_flush(void);
 
 #    endif			// DEBUG_LINT && __STDC_VERSION__ >= 199901L
 
@@ -136,4 +138,9 @@ extern void usage_errp(int exitcode, const char *name, const char *fmt, ...);
 #    define DBG_VVHIGH (9)	// very very verbose debugging
 #    define FORCED_EXIT (255)	// exit(255) on bad exit code
 
+#    define DEBUG_RINGS (64)		// most threads with a message ring at once
+#    define DEBUG_RING_BYTES (65536)	// bytes of messages a thread may have waiting to be written
+#    define DEBUG_LINE_MAX (4096)	// longest message line, longer lines are cut short
+#    define DEBUG_DRAIN_NS (20000000)	// nanoseconds between drains of the message rings
+
 #endif				/* INCLUDE_DEBUG_H */
@@ -0,0 +1,213 @@
+/*
+ * engine - alternate implementations of the Lucas sequence inner loop
+ *
+ * The GMP code in lucas.c is the reference implementation.  An engine
+ * replaces its inner loop for the h*2^n-1 candidates it supports, on the
+ * hosts where it can run.  Each engine must produce U(i) values that are
+ * congruent to the values computed by the GMP code.  An engine that fails
+ * its self-test on a host is not used there (see selftest.c).
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 140-149	engine.c - reserved for internal errors */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "debug.h"
+#include "engine.h"
+
+/*
+ * engines in the order that ENGINE_AUTO tries them
+ */
+static const struct engine *const engines[] = {
+    &ifma_engine,
+    &jit_engine,
+    &ooc_engine,
+#if defined(GMPRIME_MPI)
+    &mpi_engine,		/* only in gmprime-mpi */
+#endif
+
+    NULL			/* MUST BE THE LAST ENTRY! */
+};
+#define ENGINE_COUNT (sizeof(engines) / sizeof(engines[0]) - 1)
+
+/*
+ * engines turned off by the tuning profile (see selftest.c)
+ */
+static bool disabled[ENGINE_COUNT];
+
+
+/*
+ * engine_valid - determine if an engine name is known
+ *
+ * given:
+ *      name    engine name
+ *
+ * returns:
+ *      true ==> name is ENGINE_GMP, ENGINE_AUTO or the name of an engine
+ */
+bool
+engine_valid(const char *name)
+{
+    int e;		/* engine index */
+
+    if (name == NULL) {
+	return false;
+    }
+    if (strcmp(name, ENGINE_GMP) == 0 || strcmp(name, ENGINE_AUTO) == 0) {
+	return true;
+    }
+    for (e = 0; engines[e] != NULL; ++e) {
+	if (strcmp(name, engines[e]->name) == 0) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+
+/*
+ * engine_select - select the engine that will test h*2^n-1
+ *
+ * given:
+ *      name    engine name, ENGINE_AUTO or ENGINE_GMP
+ *      h       multiplier of 2 (must be odd)
+ *      n       power of 2
+ *
+ * returns:
+ *      engine to use, NULL ==> use the GMP code in lucas.c
+ *
+ * When the named engine cannot test h*2^n-1 on this host, or has been
+ * disabled, we fall back to the GMP code.
+ */
+const struct engine *
+engine_select(const char *name, unsigned long h, unsigned long n)
+{
+    int e;		/* engine index */
+
+    /*
+     * firewall
+     */
+    if (name == NULL || strcmp(name, ENGINE_GMP) == 0) {
+	return NULL;
+    }
+
+    /*
+     * find the first usable engine that matches
+     */
+    for (e = 0; engines[e] != NULL; ++e) {
+	if (strcmp(name, ENGINE_AUTO) == 0) {
+	    if (n < engines[e]->auto_min_n || n > engines[e]->auto_max_n) {
+		continue;
+	    }
+	} else if (strcmp(name, engines[e]->name) != 0) {
+	    continue;
+	}
+	if (disabled[e]) {
+	    if (strcmp(name, ENGINE_AUTO) != 0) {
+		dbg(DBG_LOW, "engine: %s failed its self-test on this host, using: %s", name, ENGINE_GMP);
+	    }
+	    continue;
+	}
+	if (engines[e]->usable(h, n)) {
+	    dbg(DBG_LOW, "using engine: %s for %lu*2^%lu-1", engines[e]->name, h, n);
+	    return engines[e];
+	}
+	if (strcmp(name, ENGINE_AUTO) != 0) {
+	    dbg(DBG_LOW, "engine: %s cannot test %lu*2^%lu-1 on this host, using: %s", name, h, n, ENGINE_GMP);
+	}
+    }
+    return NULL;
+}
+
+
+/*
+ * engine_names - return the engine names for a usage message
+ *
+ * returns:
+ *      space separated list of engine names
+ */
+const char *
+engine_names(void)
+{
+    static char names[BUFSIZ + 1];	/* engine names */
+    int e;				/* engine index */
+
+    if (names[0] == '\0') {
+	snprintf(names, BUFSIZ, "%s %s", ENGINE_AUTO, ENGINE_GMP);
+	for (e = 0; engines[e] != NULL; ++e) {
+	    strncat(names, " ", BUFSIZ - strlen(names));
+	    strncat(names, engines[e]->name, BUFSIZ - strlen(names));
+	}
+    }
+    return names;
+}
+
+
+/*
+ * engine_nth - return an engine by position
+ *
+ * given:
+ *      e       engine index, starting at 0
+ *
+ * returns:
+ *      engine e, or NULL if there are no more engines
+ */
+const struct engine *
+engine_nth(int e)
+{
+    if (e < 0 || (size_t)e >= ENGINE_COUNT) {
+	return NULL;
+    }
+    return engines[e];
+}
+
+
+/*
+ * engine_disable - keep an engine from being selected
+ *
+ * given:
+ *      name    engine name
+ *
+ * An engine name that is not known is ignored.
+ */
+void
+engine_disable(const char *name)
+{
+    int e;		/* engine index */
+
+    if (name == NULL) {
+	return;
+    }
+    for (e = 0; engines[e] != NULL; ++e) {
+	if (strcmp(name, engines[e]->name) == 0) {
+	    dbg(DBG_MED, "engine: %s disabled", name);
+	    disabled[e] = true;
+	}
+    }
+    return;
+}
@@ -0,0 +1,81 @@
+/*
+ * engine - alternate implementations of the Lucas sequence inner loop
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_ENGINE_H)
+#define INCLUDE_ENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <gmp.h>
+
+/*
+ * engine names
+ */
+#define ENGINE_GMP	"gmp"		// the GMP code in lucas.c, always usable
+#define ENGINE_AUTO	"auto"		// fastest usable engine for h and n
+
+/*
+ * an engine computes u(i+1) = u(i)^2 - 2 mod h*2^n-1 in its own representation
+ *
+ * The u term is converted to and from an mpz_t only by import and export,
+ * which lucas_test() calls at the start, at checkpoints and at the end of a test.
+ */
+struct engine {
+    const char *name;		/* engine name as given to -e */
+    unsigned long auto_min_n;	/* ENGINE_AUTO only selects this engine for n >= auto_min_n */
+    unsigned long auto_max_n;	/* ENGINE_AUTO only selects this engine for n <= auto_max_n */
+    bool (*usable)(unsigned long h, unsigned long n);	/* true ==> host and h*2^n-1 supported */
+    size_t (*footprint)(unsigned long h, unsigned long n);	/* bytes setup allocates for h*2^n-1 */
+    void *(*setup)(unsigned long h, unsigned long n);	/* allocate state for h*2^n-1, NULL ==> use GMP code */
+    void (*import)(void *state, const mpz_t u_term);	/* load U(i) */
+    void (*step)(void *state, unsigned long count);	/* advance count terms */
+    void (*export)(void *state, mpz_t u_term);		/* store U(i) */
+    void (*cleanup)(void *state);			/* free state */
+};
+
+/*
+ * engines
+ */
+extern const struct engine ifma_engine;
+extern const struct engine jit_engine;
+extern const struct engine ooc_engine;
+#if defined(GMPRIME_MPI)
+extern const struct engine mpi_engine;
+#endif
+
+/*
+ * external functions
+ */
+extern bool engine_valid(const char *name);
+extern const struct engine *engine_select(const char *name, unsigned long h, unsigned long n);
+extern const char *engine_names(void);
+extern const struct engine *engine_nth(int e);
+extern void engine_disable(const char *name);
+
+#endif				/* INCLUDE_ENGINE_H */
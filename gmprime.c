@@ -3,7 +3,16 @@
  *
  * usage:
  *
- *      gmprime [-v level] [-q] [-c] [-t] [-T] [-d checkpoint_dir [-i] [-s secs] [-m multiple]] [-h] [h n]
+ *      gmprime [-v level] [-q] [-c] [-t] [-T] [-d checkpoint_dir [-i] [-s secs] [-m multiple] [-l] [--supervise] [--watchdog action]] [-p threads] [-e engine] [--verify]
+ *              [-C percent] [--idle] [--base b] [-h] [h n]
+ *      gmprime [-v level] [-q] [-p threads] [-e engine] [--verify] [-C percent] [--idle] -b list [-j cores] [-M megabytes]
+ *              [-d checkpoint_dir [-s secs] [-m multiple]] [-U urgent_list [-P policy]]
+ *      gmprime [-v level] [-q] [-p threads] [-e engine] [-C percent] [--idle] [-j cores] -S n_max h n
+ *      gmprime [-v level] -b list -B binfile
+ *      gmprime [-v level] [-q] [-e engine] --selftest
+ *      gmprime [-v level] -d checkpoint_dir --control command
+ *
+ *      mpirun -np ranks gmprime-mpi [-e mpi] [the same args as gmprime]
  *
  * See the usage message for details.
  *
@@ -49,7 +58,7 @@
  * Share and enjoy! :-)
  */
 
-/* NUMERIC EXIT CODES: 10-39	gmprime.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 10-19	gmprime.c - reserved for internal errors */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -58,17 +67,39 @@
 #include <unistd.h>
 #include <gmp.h>
 #include <ctype.h>
+#include <limits.h>
 #include <getopt.h>
 
 #include "gmprime.h"
 #include "riesel.h"
 #include "debug.h"
 #include "checkpoint.h"
+#include "parsqr.h"
+#include "engine.h"
+#include "lucas.h"
+#include "hnlist.h"
+#include "batch.h"
+#include "selftest.h"
+#include "throttle.h"
+#include "control.h"
+#include "zcalc.h"
+#include "supervise.h"
+#include "prp.h"
+#include "watchdog.h"
+#if defined(GMPRIME_MPI)
+#include "mpisqr.h"
+#endif
 
 /*
- * constants
+ * long options, with values beyond those of the single character options
  */
-#define MAX_H_N_LEN BUFSIZ	/* more than enougn for h and n that we care about */
+#define OPT_SELFTEST (256)	// --selftest
+#define OPT_VERIFY (257)	// --verify
+#define OPT_CONTROL (258)	// --control command
+#define OPT_IDLE (259)		// --idle
+#define OPT_SUPERVISE (260)	// --supervise
+#define OPT_BASE (261)		// --base b
+#define OPT_WATCHDOG (262)	// --watchdog action
 
 /*
  * globals
@@ -76,20 +107,44 @@
 const char *program = NULL;	/* our name */
 const char version_string[] = "gmprime-3.1.2";	/* package name and version */
 int debuglevel = DBG_NONE;	/* if > 0 then be verbose */
-static const char *usage = "[-v level] [-q] [-c] [-t] [-T] [-d checkpoint_dir [-i] [-s secs] [-m multiple]] [-h] [h n]\n"
+static const struct option long_options[] = {
+    { "selftest", no_argument, NULL, OPT_SELFTEST },
+    { "verify", no_argument, NULL, OPT_VERIFY },
+    { "control", required_argument, NULL, OPT_CONTROL },
+    { "idle", no_argument, NULL, OPT_IDLE },
+    { "supervise", no_argument, NULL, OPT_SUPERVISE },
+    { "base", required_argument, NULL, OPT_BASE },
+    { "watchdog", required_argument, NULL, OPT_WATCHDOG },
+
+    { NULL, 0, NULL, 0 }	/* MUST BE THE LAST ENTRY! */
+};
+static const char *usage = "[-v level] [-q] [-c [-z]] [-t] [-T] [-d checkpoint_dir [-i] [-s secs] [-m multiple] [-l] [--supervise]\n"
+    "		[--watchdog action]] [-p threads] [-e engine] [--verify]\n"
+    "		[-C percent] [--idle] [--base b] [-h] [h n]\n"
+    "   or: [-v level] [-q] [-p threads] [-e engine] [--verify] [-C percent] [--idle] -b list [-j cores] [-M megabytes]\n"
+    "		[-d checkpoint_dir [-s secs] [-m multiple]] [-U urgent_list [-P policy]]\n"
+    "   or: [-v level] [-q] [-p threads] [-e engine] [-C percent] [--idle] [-j cores] -S n_max h n\n"
+    "   or: [-v level] -b list -B binfile\n"
+    "   or: [-v level] [-q] [-e engine] --selftest\n"
+    "   or: [-v level] -d checkpoint_dir --control command\n"
     "\n"
     "	-v level	verbosity level, debug msgs go to stderr (def: output only the test result to stdout)\n"
+    "			    NOTE: msgs are tagged with the time and level, and written by a background thread\n"
     "\n"
     "	-q		quite mode, do not announce if the number if prime or composite (def: do)\n"
     "	-c		output to stdout, calc code that may be used to verify partial results\n"
     "			    NOTE: example: gmprime -c 15 31 | calc -p\n"
     "			    NOTE: For info on calc, see: http://www.isthe.com/chongo/tech/comp/calc/index.html\n"
+    "	-z		gzip the calc code on a background thread, (requires -c, def: do not)\n"
+    "			    NOTE: example: gmprime -c -z 15 31 | gzip -dc | calc -p\n"
     "\n"
     "	-t		output total prime test times to stderr, (def: do not)\n"
+    "			    NOTE: with -b list or -S n_max, output a line of the resources each test used\n"
     "	-T		output extended prime test times to stderr, (def: do not)\n"
     "			    NOTE: -T implies -t\n"
     "\n"
     "	-d checkpoint_dir	checkpoint files are in directory checkpoint_dir (def: do not checkpoint)\n"
+    "			    NOTE: each checkpoint appends its term rate, host and engine to checkpoint_dir/history.txt\n"
     "	-i		force checkpoint directory to be initialized (requires -d checkpoint_dir, def: do not reinitialize)\n"
     "			    NOTE: -i requires -d checkpoint_dir\n"
     "	-s secs		checkpoint about every secs seconds (def: 3600 seconds)\n"
@@ -97,16 +152,90 @@ static const char *usage = "[-v level] [-q] [-c] [-t] [-T] [-d checkpoint_dir [-
     "			    NOTE: secs must be >= 0, secs == 0 ==> checkpoint every term\n"
     "	-m multiple	checkpoint when Lucas sequence index is a multiple (def: no index multiple checkpointng)\n"
     "			    NOTE: -u u_terms requires -d checkpoint_dir\n"
+    "	-l		keep the working term in checkpoint_dir/live.residue, checkpoints just sync it (def: do not)\n"
+    "			    NOTE: -l requires -d checkpoint_dir, h and n\n"
+    "			    NOTE: with -l, running the same h n again resumes the test, losing at most 64 terms\n"
+    "	--supervise	run the test in a child, restarting it from its checkpoint should it crash (def: do not)\n"
+    "			    NOTE: --supervise requires -d checkpoint_dir, and does not allow -c\n"
+    "			    NOTE: the test is restarted after an exit code >= 10 or a signal, waiting 2, 4, 8, ... secs\n"
+    "			    NOTE: after 2 crashes without progress the gmp engine and 1 thread are used, after 5 we give up\n"
+    "	--watchdog action[:secs]	act when the test stays 4 times slower than expected (def: do not watch)\n"
+    "			    NOTE: the rate is measured over windows of secs of squaring (def: 60)\n"
+    "			    NOTE: expected is the best rate in history.txt of the engine on this host, or so far\n"
+    "			    NOTE: action warn: warn, and checkpoint after 3 slow windows in a row\n"
+    "			    NOTE: action restart: also exit 60, --supervise restarts the test, then falls back to gmp\n"
+    "			    NOTE: --watchdog requires -d checkpoint_dir\n"
+    "\n";
+static const char *usage_test =
+    "	-p threads	most threads used to square a single large term (def: 1, or up to -j cores with -b list)\n"
+    "			    NOTE: threads must be >= 1 and <= 10, threads are only used when h*2^n-1 is large\n"
+    "	-e engine	compute the Lucas sequence with engine: auto, gmp, ifma, jit, ooc or mpi (def: auto)\n"
+    "			    NOTE: auto uses the fastest engine that can test h*2^n-1 on this host\n"
+    "			    NOTE: ifma requires AVX-512 IFMA, h < 2^32 and 2000 <= n <= 100000 (auto: n <= 60000)\n"
+    "			    NOTE: jit compiles a kernel for h*2^n-1 with cc, it requires h < 2^32 and is never used by auto\n"
+    "			    NOTE: ooc keeps its terms in files under $GMPRIME_OOC_DIR (def: /var/tmp), for when gmp runs out of memory\n"
+    "			    NOTE: ooc requires h < 2^32 and is never used by auto\n"
+    "			    NOTE: mpi squares over MPI ranks, it requires gmprime-mpi under mpirun (auto: n >= 100000000)\n"
+    "			    NOTE: -c and -v 5 or more always use gmp\n"
+    "	--verify	test h*2^n-1 even when it is a known prime of test/h-n.small.txt or test/h-n.med.txt\n"
+    "			    NOTE: without --verify, those primes are announced without a test (-c always tests)\n"
+    "\n"
+    "	-C percent	while the host is busy, hold each test to percent of a CPU (def: 100, no budget)\n"
+    "			    NOTE: percent must be >= 1 and <= 100, time slept is reported as throttled by -t\n"
+    "			    NOTE: the host is idle when no task waits for a CPU (or the load average is low)\n"
+    "	--idle		run tests under SCHED_IDLE, only using CPU that no other task wants (def: do not)\n"
+    "\n"
+    "	--base b	test h*b^n-1 instead of h*2^n-1 (def: 2)\n"
+    "			    NOTE: b must be >= 2 and <= 65536, a power of 2 b is tested as h*2^(n*log2(b))-1\n"
+    "			    NOTE: other b use a base 3 Fermat test, exit 0 means h*b^n-1 is a probable prime\n"
+    "			    NOTE: --base b does not allow -b list or -S n_max, other b also do not allow -c or -l\n"
+    "			    NOTE: -d checkpoint_dir without h n restores only with the same --base b\n";
+static const char *usage_batch =
+    "	-b list		test each h n line found in the list file (def: test a single h n)\n"
+    "			    NOTE: list may also be a binary list as written by -B binfile\n"
+    "			    NOTE: -b list does not allow h n args, -i, -l, -c or -T\n"
+    "			    NOTE: with -b list, tests with n >= 100000 checkpoint under checkpoint_dir/h-n\n"
+    "			    NOTE: results are printed as each test completes, not in list order\n"
+    "	-j cores	test up to cores candidates at once (requires -b list or -S n_max, def: number of online cpus)\n"
+    "			    NOTE: once the list is drained, idle cores help square the large tests still running\n"
+    "	-M megabytes	only start a test when the memory predicted for the running tests fits in megabytes\n"
+    "			    NOTE: -M megabytes requires -b list (def: no memory budget)\n"
+    "			    NOTE: much smaller tests later in the list backfill cores while a large test waits\n"
+    "	-U urgent_list	test the h n lines of urgent_list ahead of -b list (def: no urgent candidates)\n"
+    "			    NOTE: lines appended to urgent_list while the batch runs are tested next\n"
+    "	-P policy	when no core is idle, an urgent candidate preempts: largest, newest or none (def: largest)\n"
+    "			    NOTE: -P policy requires -U urgent_list, preemption requires -d checkpoint_dir\n"
+    "			    NOTE: a preempted test checkpoints and resumes once the urgent work has started\n"
+    "	-S n_max	find the smallest m, n < m <= n_max, for which h*2^m-1 is prime (def: test h*2^n-1)\n"
+    "			    NOTE: -S n_max does not allow -b list, -d checkpoint_dir, -c or -T\n"
+    "			    NOTE: m for which h*2^m-1, with h made odd, has h >= 2^m are skipped with a warning\n"
+    "			    NOTE: m with a factor < 4096 are skipped, the next m are tested in parallel\n"
+    "			    NOTE: results are printed in order of m, larger m are cancelled once a prime is found\n"
+    "	-B binfile	write -b list as a binary list to binfile and exit 0 (def: test the list)\n"
+    "\n"
+    "	--selftest	check each engine (or -e engine) against gmp and record the outcome in the tuning profile\n"
+    "			    NOTE: the profile is $GMPRIME_PROFILE (def: $HOME/.gmprime/hostname.profile)\n"
+    "			    NOTE: engines that failed in the profile are not used, exits 0 if all passed, else 3\n"
+    "\n"
+    "	--control command	send command to the test checkpointing in checkpoint_dir, print its reply\n"
+    "			    NOTE: command is one of: status, checkpoint-now, set-interval secs, pause, resume,\n"
+    "			    NOTE:     set-threads threads or set-cpu percent (as -C percent), applied every 64 terms\n"
+    "			    NOTE: a test started with -d checkpoint_dir listens on checkpoint_dir/control.sock\n"
+    "			    NOTE: exits 0 if the test accepted the command, 9 if it did not\n"
     "\n"
     "	-h		print this help message and exit 8\n"
     "\n"
     "	h		power of 2 multuplier (as in h*2^n-1) must be > 0 and < 2^n (def: restored from checkpoint_dir)\n"
     "	n		power of 2 (as in h*2^n-1) must be > 0 (def: restored from checkpoint_dir)\n"
-    "\n"
+    "			    NOTE: with --base b, h and n are those of h*b^n-1\n";
+static const char *usage_exit_codes = "\n"
     "	Exit codes:\n"
     "\n"
     "	0	h*2^n-1 is prime (also prints 'prime' to stdout)\n"
     "	1	h*2^n-1 is not prime (also prints 'composite' to stdout)\n"
+    "		    NOTE: with -b list: 0 if all are prime, 1 if all were tested and some are composite,\n"
+    "		    NOTE: otherwise the largest exit code of a candidate that could not be tested\n"
+    "		    NOTE: with -S n_max: 0 if a prime was found, 1 if every m was composite\n"
     "\n"
     "	2	h*2^n-1 is not a number for which the Riesel test applies (e.g., h > 2^n)\n"
     "\n"
@@ -121,25 +250,6 @@ static const char *usage = "[-v level] [-q] [-c] [-t] [-T] [-d checkpoint_dir [-
     "\n"
     "	10-255	some interal fatal error occurred\n";
 
-/*
- * list of very small verified Riesel primes that we special case
- */
-struct h_n {
-    unsigned long h;		/* multiplier of 2 */
-    unsigned long n;		/* power of 2 */
-};
-static const struct h_n small_h_n[] = {
-    {1, 2},			/* 1 * 2 ^ 2 - 1 = 3 is prime */
-
-    {0, 0}			/* MUST BE THE LAST ENTRY! */
-};
-static const struct h_n composite_h_n[] = {
-    {1, 1},			/* 1 * 2 ^ 1 - 1 = 1 is not prime */
-
-    {0, 0}			/* MUST BE THE LAST ENTRY! */
-};
-
-
 /*
  * test h*2^n-1 for primality
  */
@@ -148,46 +258,33 @@ main(int argc, char *argv[])
 {
     char *h_arg = NULL;		/* h as a string */
     char *n_arg = NULL;		/* n as a string */
-    mpz_t pow_2;		/* 2^n */
-    mpz_t h_pow_2;		/* h*(2^n) */
-    mpz_t riesel_cand;		/* Riesel candidate to test - n*(2^n)-1 */
-    mpz_t u_term;		/* Lucas sequence value - U(i) */
-    mpz_t u_term_sq;		/* square of prev term */
-    mpz_t u_term_sq_2;		/* square - 2 of prev term */
-    mpz_t J;			/* used in mod calculation - u_term_sq_2 / (2^n) */
-    mpz_t K;			/* used in mod calculation - u_term_sq_2 mod (2^n) */
-    mpz_t J_div_h;		/* used in mod calculation - int(J/h) */
-    mpz_t J_mod_h;		/* used in mod calculation - J mod h then (J mod h)*(2^n) */
-    mpz_t zero;			/* 0 as a mp value */
-    mpz_t non_zero;		/* non-0 as a mp value */
     int c;			/* option */
-    unsigned long i = FIRST_TERM_INDEX;	/* u term index */
-    /*
-     * For Mersenne numbers, U(FIRST_TERM_INDEX) == 4
-     * For Riesel numbers, U(FIRST_TERM_INDEX) == v(h)
-     */
-    unsigned long h;			/* multiplier of 2 */
-    unsigned long n;			/* power of 2 */
-    unsigned long orig_h;		/* original value of h */
-    unsigned long orig_n;		/* original value of n */
-    unsigned long v1;			/* v(1) for h and n */
-    char h_str[MAX_H_N_LEN + 1];	/* h as a string */
-    char n_str[MAX_H_N_LEN + 1];	/* h as a string */
-    int h_len;				/* length of string in h_str */
-    int n_len;				/* length of string in n_str */
-    const struct h_n *h_n_p;		/* pointer into small_h_n */
-    int calc_mode = 0;			/* output calc code so calc can verify partial results */
-    int write_stats = 0;		/* output total prime stats to stderr */
-    int write_extended_stats = 0;	/* output extended prime stats to stderr */
-    char *checkpoint_dir = NULL;	/* form checkpoint files under checkpoint_dir */
-    int checkpoint_secs = DEF_CHKPT_SECS;	/* checkpoint every checkpoint_secs seconds */
-    unsigned long multiple = 0;			/* checkpoint when i is a multiple, 0 ==> do not */
-    bool force = false;			/* -i to force checkpoint_dir to be re-initialzed */
-    bool restore = false;		/* true --> we need to restore state from checkpoint_dir */
-    bool quiet = false;			/* if we saw a -q */
+    unsigned long h = 0;		/* multiplier of 2 */
+    unsigned long n = 0;		/* power of 2 */
+    struct lucas_opts opts;		/* how h*2^n-1 is to be tested */
+    char *batch_list = NULL;		/* -b list of h n candidates to test */
+    char *binfile = NULL;		/* -B binary list to write */
+    long cores;				/* -j cores to use in batch mode */
+    unsigned long budget = 0;		/* -M memory budget in megabytes, 0 ==> no budget */
+    struct batch_opts bopts;		/* how the -b list is to be tested */
+    int max_threads = 1;		/* -p most squaring threads per test */
+    static volatile int threads = 1;	/* squaring threads for a single test */
     bool have_s = false;		/* if we saw a -s secs */
     bool have_i = false;		/* if we saw an -i */
     bool have_m = false;		/* if we saw a -m multiple */
+    bool have_j = false;		/* if we saw a -j cores */
+    bool have_p = false;		/* if we saw a -p threads */
+    bool have_M = false;		/* if we saw a -M megabytes */
+    bool have_P = false;		/* if we saw a -P policy */
+    bool have_S = false;		/* if we saw a -S n_max */
+    bool have_z = false;		/* if we saw a -z */
+    bool selftest = false;		/* if we saw a --selftest */
+    bool supervise = false;		/* if we saw a --supervise */
+    unsigned long base = 2;		/* --base b of h*b^n-1 */
+    char *watchdog = NULL;		/* --watchdog action */
+    unsigned long log2_base;		/* log2(b) when b is a power of 2 */
+    char *control = NULL;		/* --control command to send */
+    unsigned long search_max = 0;	/* -S largest n to search */
     extern int optind;			/* argv index of the next arg */
     extern char *optarg;		/* optional argument */
 
@@ -195,35 +292,53 @@ main(int argc, char *argv[])
      * parse args
      */
     program = argv[0];
-    while ((c = getopt(argc, argv, "v:qctTd:is:m:h")) != -1) {
+#if defined(GMPRIME_MPI)
+    if (mpisqr_start(&argc, &argv) != 0) {
+	exit(mpisqr_serve());	/* ranks other than 0 only help square */
+    }
+#endif
+    memset(&opts, 0, sizeof(opts));
+    memset(&bopts, 0, sizeof(bopts));
+    bopts.preempt = BATCH_PREEMPT_LARGEST;
+    opts.checkpoint_secs = DEF_CHKPT_SECS;
+    opts.engine = ENGINE_AUTO;
+    errno = 0;
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) {
+	cores = 1;
+    }
+    while ((c = getopt_long(argc, argv, "v:qcztTd:is:m:lb:B:j:M:U:P:S:p:e:C:h", long_options, NULL)) != -1) {
 	switch (c) {
 	case 'v':
 	    debuglevel = strtol(optarg, NULL, 0);
 	    break;
 	case 'q':
-	    quiet = 1;
+	    opts.quiet = true;
 	    break;
 	case 'c':
-	    calc_mode = 1;
+	    opts.calc_mode = true;
+	    break;
+	case 'z':
+	    have_z = true;
 	    break;
 	case 't':
-	    write_stats = 1;
+	    opts.write_stats = true;
 	    break;
 	case 'T':
-	    write_stats = 1;
-	    write_extended_stats = 1;
+	    opts.write_stats = true;
+	    opts.write_extended_stats = true;
 	    break;
 	case 'd':
-	    checkpoint_dir = optarg;
+	    opts.checkpoint_dir = optarg;
 	    break;
 	case 'i':
-	    force = true;
+	    opts.force = true;
 	    have_i = true;
 	    break;
 	case 's':
 	    errno = 0;
-	    checkpoint_secs = strtol(optarg, NULL, 0);
-	    if (errno != 0 || strchr(optarg, '-') != NULL || checkpoint_secs < 0) {
+	    opts.checkpoint_secs = strtol(optarg, NULL, 0);
+	    if (errno != 0 || strchr(optarg, '-') != NULL || opts.checkpoint_secs < 0) {
 		usage_err(EXIT_USAGE, __func__, "invalid argument to -s, must be a number >= 0: %s", optarg);
 		// exit(9);
 		exit(EXIT_USAGE); // NOT REACHED
@@ -232,7 +347,7 @@ main(int argc, char *argv[])
 	    break;
 	case 'm':
 	    errno = 0;
-	    multiple = strtoul(optarg, NULL, 0);
+	    opts.multiple = strtoul(optarg, NULL, 0);
 	    if (errno != 0 || strchr(optarg, '-') != NULL || !isdigit(optarg[0])) {
 		usage_err(EXIT_USAGE, __func__, "invalid argument to -m, must be a number >= 0: %s", optarg);
 		// exit(9);
@@ -240,8 +355,123 @@ main(int argc, char *argv[])
 	    }
 	    have_m = true;
 	    break;
+	case 'l':
+	    opts.live = true;
+	    break;
+	case 'b':
+	    batch_list = optarg;
+	    break;
+	case 'B':
+	    binfile = optarg;
+	    break;
+	case 'j':
+	    errno = 0;
+	    cores = strtol(optarg, NULL, 0);
+	    if (errno != 0 || strchr(optarg, '-') != NULL || cores < 1) {
+		usage_err(EXIT_USAGE, __func__, "invalid argument to -j, must be a number >= 1: %s", optarg);
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
+	    }
+	    have_j = true;
+	    break;
+	case 'M':
+	    errno = 0;
+	    budget = strtoul(optarg, NULL, 0);
+	    if (errno != 0 || strchr(optarg, '-') != NULL || !isdigit(optarg[0]) || budget < 1) {
+		usage_err(EXIT_USAGE, __func__, "invalid argument to -M, must be a number >= 1: %s", optarg);
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
+	    }
+	    have_M = true;
+	    break;
+	case 'U':
+	    bopts.urgent = optarg;
+	    break;
+	case 'P':
+	    bopts.preempt = batch_policy(optarg);
+	    if (bopts.preempt < 0) {
+		usage_err(EXIT_USAGE, __func__, "invalid argument to -P, must be largest, newest or none: %s", optarg);
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
+	    }
+	    have_P = true;
+	    break;
+	case 'S':
+	    errno = 0;
+	    search_max = strtoul(optarg, NULL, 0);
+	    if (errno != 0 || strchr(optarg, '-') != NULL || !isdigit(optarg[0]) || search_max < 1) {
+		usage_err(EXIT_USAGE, __func__, "invalid argument to -S, must be a number >= 1: %s", optarg);
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
+	    }
+	    have_S = true;
+	    break;
+	case 'p':
+	    errno = 0;
+	    max_threads = strtol(optarg, NULL, 0);
+	    if (errno != 0 || strchr(optarg, '-') != NULL || max_threads < 1 || max_threads > PARSQR_MAX_THREADS) {
+		usage_err(EXIT_USAGE, __func__, "invalid argument to -p, must be a number >= 1 and <= %d: %s",
+			  PARSQR_MAX_THREADS, optarg);
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
+	    }
+	    have_p = true;
+	    break;
+	case 'e':
+	    if (!engine_valid(optarg)) {
+		usage_err(EXIT_USAGE, __func__, "invalid argument to -e, must be one of: %s", engine_names());
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
+	    }
+	    opts.engine = optarg;
+	    break;
+	case OPT_SELFTEST:
+	    selftest = true;
+	    break;
+	case OPT_VERIFY:
+	    opts.verify = true;
+	    break;
+	case 'C':
+	    errno = 0;
+	    opts.cpu = strtol(optarg, NULL, 0);
+	    if (errno != 0 || strchr(optarg, '-') != NULL || opts.cpu < THROTTLE_MIN_CPU || opts.cpu > THROTTLE_MAX_CPU) {
+		usage_err(EXIT_USAGE, __func__, "invalid argument to -C, must be a number >= %d and <= %d: %s",
+			  THROTTLE_MIN_CPU, THROTTLE_MAX_CPU, optarg);
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
+	    }
+	    break;
+	case OPT_IDLE:
+	    opts.idle = true;
+	    break;
+	case OPT_SUPERVISE:
+	    supervise = true;
+	    break;
+	case OPT_WATCHDOG:
+	    watchdog = optarg;
+	    opts.watchdog = watchdog_action(optarg, &opts.watchdog_secs);
+	    if (opts.watchdog < 0) {
+		usage_err(EXIT_USAGE, __func__, "invalid argument to --watchdog, must be warn or restart, optionally :secs: %s",
+			  optarg);
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
+	    }
+	    break;
+	case OPT_BASE:
+	    errno = 0;
+	    base = strtoul(optarg, NULL, 0);
+	    if (errno != 0 || strchr(optarg, '-') != NULL || base < 2 || base > PRP_MAX_BASE) {
+		usage_err(EXIT_USAGE, __func__, "invalid argument to --base, must be a number >= 2 and <= %d: %s",
+			  PRP_MAX_BASE, optarg);
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
+	    }
+	    break;
+	case OPT_CONTROL:
+	    control = optarg;
+	    break;
 	case 'h':
-	    fprintf(stderr, "usage: %s %s", program, usage);
+	    fprintf(stderr, "usage: %s %s\n%s%s%s", program, usage, usage_test, usage_batch, usage_exit_codes);
 	    exit(EXIT_HELP); // exit(8);
 	    break;
 	case ':':
@@ -250,6 +480,11 @@ main(int argc, char *argv[])
 	    exit(EXIT_USAGE); // NOT REACHED
 	    break;
 	case '?':
+	    if (optopt == 0) {
+		usage_err(EXIT_USAGE, __func__, "unknown option: %s", argv[optind - 1]);
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
+	    }
 	    usage_err(EXIT_USAGE, __func__, "unknown option: -%c", optopt);
 	    // exit(9);
 	    exit(EXIT_USAGE); // NOT REACHED
@@ -263,19 +498,134 @@ main(int argc, char *argv[])
     }
     argv += (optind - 1);
     argc -= (optind - 1);
+    if (selftest) {
+	if (argc != 1 || batch_list != NULL || have_S || opts.checkpoint_dir != NULL) {
+	    usage_err(EXIT_USAGE, __func__, "use of --selftest does not allow h n args, -b list, -S n_max or -d checkpoint_dir");
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+	exit(selftest_run(opts.engine, opts.quiet));
+    }
+    if (control != NULL) {
+	if (argc != 1 || opts.checkpoint_dir == NULL || batch_list != NULL || have_S) {
+	    usage_err(EXIT_USAGE, __func__, "use of --control requires -d checkpoint_dir and does not allow h n args, -b list or -S n_max");
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+	exit(control_send(opts.checkpoint_dir, control));
+    }
+    if (have_z && !opts.calc_mode) {
+	usage_err(EXIT_USAGE, __func__, "use of -z requires -c");
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    if (supervise && (opts.checkpoint_dir == NULL || opts.calc_mode || batch_list != NULL || have_S)) {
+	usage_err(EXIT_USAGE, __func__, "use of --supervise requires -d checkpoint_dir and does not allow -c, -b list or -S n_max");
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    if (watchdog != NULL && (opts.checkpoint_dir == NULL || batch_list != NULL || have_S)) {
+	usage_err(EXIT_USAGE, __func__, "use of --watchdog requires -d checkpoint_dir and does not allow -b list or -S n_max");
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    if (base != 2 && (batch_list != NULL || have_S)) {
+	usage_err(EXIT_USAGE, __func__, "use of --base b does not allow -b list or -S n_max");
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    if ((base & (base - 1)) != 0 && (opts.calc_mode || opts.live)) {
+	usage_err(EXIT_USAGE, __func__, "use of --base b, when b is not a power of 2, does not allow -c or -l");
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    selftest_load();
+    /* check -b list dependicies */
+    if (binfile != NULL) {
+	if (batch_list == NULL || argc != 1) {
+	    usage_err(EXIT_USAGE, __func__, "use of -B binfile requires -b list and does not allow h n args");
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+
+	/*
+	 * convert the list to a binary list
+	 */
+	(void) hnlist_convert(batch_list, binfile);
+	exit(EXIT_IS_PRIME); // exit(0);
+    }
+    if (batch_list != NULL) {
+	if (have_S) {
+	    usage_err(EXIT_USAGE, __func__, "use of -b list does not allow -S n_max");
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+	if (argc != 1) {
+	    usage_err(EXIT_USAGE, __func__, "use of -b list does not allow h n args");
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+	if (have_i || opts.live || opts.calc_mode || opts.write_extended_stats) {
+	    usage_err(EXIT_USAGE, __func__, "use of -b list does not allow -i, -l, -c or -T");
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+	if (opts.checkpoint_dir == NULL && (have_s || have_m)) {
+	    usage_err(EXIT_USAGE, __func__, "use of -s secs or -m multiple requires -d checkpoint_dir");
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+	if (have_P && bopts.urgent == NULL) {
+	    usage_err(EXIT_USAGE, __func__, "use of -P policy requires -U urgent_list");
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+	if (!have_p) {
+	    max_threads = (cores < PARSQR_MAX_THREADS) ? (int)cores : PARSQR_MAX_THREADS;
+	}
+
+	/*
+	 * test the list of candidates
+	 */
+	bopts.list = batch_list;
+	bopts.cores = (int)cores;
+	bopts.max_threads = max_threads;
+	bopts.budget = (size_t)budget * 1024 * 1024;
+	exit(batch_run(&bopts, &opts));
+    }
+    if (have_j && !have_S) {
+	usage_err(EXIT_USAGE, __func__, "use of -j cores requires -b list or -S n_max");
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    if (have_M) {
+	usage_err(EXIT_USAGE, __func__, "use of -M megabytes requires -b list");
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    if (bopts.urgent != NULL || have_P) {
+	usage_err(EXIT_USAGE, __func__, "use of -U urgent_list or -P policy requires -b list");
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
     /* determine if must restore (if h and n were not given as args */
     switch (argc) {
-    case 3: restore = false;	// h and n given
+    case 3: opts.restore = false;	// h and n given
     	    break;
-    case 1: restore = true;	// h and n not given, must restore
+    case 1: opts.restore = true;	// h and n not given, must restore
     	    break;
     default:
 	usage_err(EXIT_USAGE, __func__, "expected 0 or 2 args");
 	// exit(9);
 	exit(EXIT_USAGE); // NOT REACHED
     }
+    if (opts.live && opts.restore) {
+	usage_err(EXIT_USAGE, __func__, "use of -l requires h and n");
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
     /* check for -d checkpoint_dir dependicies */
-    if (checkpoint_dir == NULL) {
+    if (opts.checkpoint_dir == NULL) {
 	if (have_s) {
 	    usage_err(EXIT_USAGE, __func__, "use of -s secs requires -d checkpoint_dir");
 	    // exit(9);
@@ -291,50 +641,22 @@ main(int argc, char *argv[])
 	    // exit(9);
 	    exit(EXIT_USAGE); // NOT REACHED
 	}
-	if (restore) {
+	if (opts.live) {
+	    usage_err(EXIT_USAGE, __func__, "use of -l requires -d checkpoint_dir");
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+	if (opts.restore) {
 	    usage_err(EXIT_USAGE, __func__, "FATAL: if h and n are not given, must restore using -d checkpoint_dir");
 	    // exit(9);
 	    exit(EXIT_USAGE); // NOT REACHED
 	}
     }
 
-    /*
-     * initialize mp elements
-     *
-     * we need to initialize my elements early in case we are restoring
-     */
-    mpz_init(pow_2);
-    mpz_init(h_pow_2);
-    mpz_init(riesel_cand);
-    mpz_init(u_term);
-    mpz_init(u_term_sq);
-    mpz_init(u_term_sq_2);
-    mpz_init(J);
-    mpz_init(K);
-    mpz_init(J_div_h);
-    mpz_init(J_mod_h);
-    mpz_init(zero);
-    mpz_set_ui(zero, 0);
-    mpz_init(non_zero);
-    mpz_set_ui(non_zero, 1);
-
-    /*
-     * case: no h and n given, must obtain by restoring from the checkpoint_dir
-     */
-    if (restore) {
-
-	/*
-	 * restore h, n, i, v1, and u_term from checkpoint_dir
-	 *
-	 * NOTE: If we cannot restore from checkpoint_dir, this function will not return.
-	 */
-	dbg(DBG_LOW, "restoring from: %s", checkpoint_dir);
-	restore_checkpoint(checkpoint_dir, &h, &n, &i, &v1, u_term);
-
     /*
      * case: we were given an h and n to start testing
      */
-    } else {
+    if (!opts.restore) {
 
 	/*
 	 * parse h argument
@@ -362,495 +684,60 @@ main(int argc, char *argv[])
     }
 
     /*
-     * convert even h into odd h by increasing n
-     */
-    /*
-     * save our argument values for debugging and final reporting
-     */
-    orig_h = h;
-    orig_n = n;
-    /*
-     * force h to become odd
-     */
-    if (h % 2 == 0) {
-	dbg(DBG_MED, "converting even h: %ld into odd by increasing n: %ld", orig_h, orig_n);
-	while (h % 2 == 0 && h > 0) {
-	    h >>= 1;
-	    ++n;
-	}
-	dbg(DBG_MED, "new equivalent h: %lu and new equivalent n: %ld", h, n);
-	if (h <= 0) {
-	    err(EXIT_CANNOT_TEST, __func__, "new equivalent h: %lu <= 0", h);
-	    // exit(2);
-	    exit(EXIT_CANNOT_TEST); // NOT REACHED
-	}
-    }
-    dbg(DBG_MED, "h: %lu", h);
-    dbg(DBG_MED, "n: %lu", n);
-
-    /*
-     * form string based on possibly modified h
-     */
-    memset(h_str, 0, sizeof(h_str));
-    errno = 0;
-    h_len = snprintf(h_str, MAX_H_N_LEN, "%lu", h);
-    if (h_len < 0 || h_len >= MAX_H_N_LEN) {
-	usage_errp(EXIT_USAGE, __func__, "converting h: %lu to string via snprintf returned: %d", h, h_len);
-	// exit(9);
-	exit(EXIT_USAGE); // NOT REACHED
-    }
-    h_str[h_len] = '\0';	// paranoia
-    dbg(DBG_VHIGH, "h_len string: %s", h_str);
-
-    /*
-     * form string based on possibly modified n
-     */
-    memset(n_str, 0, sizeof(n_str));
-    errno = 0;
-    n_len = snprintf(n_str, MAX_H_N_LEN, "%lu", n);
-    if (n_len < 0 || n_len >= MAX_H_N_LEN) {
-	usage_errp(EXIT_USAGE, __func__, "converting n: %lu to string via snprintf returned: %d", n, n_len);
-	// exit(9);
-	exit(EXIT_USAGE); // NOT REACHED
-    }
-    n_str[n_len] = '\0';	// paranoia
-    dbg(DBG_VHIGH, "n_len string: %s", n_str);
-
-    /*
-     * firewall - catch the special cases for small primes
-     *
-     * NOTE: This case normally fails the standard Riesel test because n is too small.
-     */
-    for (h_n_p = small_h_n; h_n_p->h > 0 && h_n_p->n > 0; ++h_n_p) {
-	if (h == h_n_p->h && n == h_n_p->n) {
-	    if (calc_mode) {
-		printf("read lucas;\n");
-		printf("print \"lucas( %ld , %lu )\",;", h, n);
-		printf("ret = lucas(%ld , %ld);\n", h, n);
-		printf("if (ret == 1) { print \"returned prime\"; } else { print \"failed returning\", ret; };\n");
-		printf("print \"%s: origianl test: %ld * 2 ^ %ld - 1 =\", (%ld * 2 ^ %ld - 1);\n",
-		       program, orig_h, orig_n, orig_h, orig_n);
-		printf("print \"%s: %lu * 2 ^ %lu - 1 =\", (%lu * 2 ^ %lu - 1), \"is prime\";\n", program, h, n, h, n);
-	    } else if (!quiet) {
-		printf("%ld * 2 ^ %ld - 1 is prime\n", orig_h, orig_n);
-	    }
-	    /* if checkpointing, set checkpoint state to prime */
-	    if (checkpoint_dir != NULL) {
-		dbg(DBG_MED, "checkpoint state set to prime in: %s", checkpoint_dir);
-		checkpoint(checkpoint_dir, false, h, n, n, 0, zero);
-	    }
-	    dbg(DBG_LOW, "exit prime");
-	    exit(EXIT_IS_PRIME); // exit(0);
-	}
-    }
-
-    /*
-     * firewall - catch the special cases for small composites
-     *
-     * NOTE: This case normally fails the standard Riesel test because n is too small.
-     */
-    for (h_n_p = composite_h_n; h_n_p->h > 0 && h_n_p->n > 0; ++h_n_p) {
-	if (h == h_n_p->h && n == h_n_p->n) {
-	    if (calc_mode) {
-		printf("read lucas;\n");
-		printf("print \"lucas( %ld , %lu )\",;", h, n);
-		printf("ret = lucas(%ld , %ld);\n", h, n);
-		printf("if (ret == 0) { print \"returned composite\"; } else { print \"failed returning\", ret; };\n");
-		printf("print \"%s: origianl test: %ld * 2 ^ %ld - 1 =\", (%ld * 2 ^ %ld - 1);\n",
-		       program, orig_h, orig_n, orig_h, orig_n);
-		printf("print \"%s: %ld * 2 ^ %ld - 1 is composite\";\n", program, orig_h, orig_n);
-	    } else if (!quiet) {
-		printf("%ld * 2 ^ %ld - 1 is composite\n", orig_h, orig_n);
-	    }
-	    if (checkpoint_dir != NULL) {
-		dbg(DBG_MED, "checkpoint state set to composite in: %s", checkpoint_dir);
-		checkpoint(checkpoint_dir, false, h, n, n, 0, non_zero);
-	    }
-	    dbg(DBG_LOW, "exit composite");
-	    exit(EXIT_IS_COMPOSITE); // exit(1);
-	}
-    }
-
-    /*
-     * firewall - h*2^n-1 is not a multiple of 3
-     *
-     * We can check this quickly by looking at h and n.
-     * The value h*2^n-1 is multiple of 3 when:
-     *
-     *          h = 1 mod 3 AND n is even
-     * or when:
-     *          h = 2 mod 3 AND n is odd
-     *
-     * If either of those cases is true, don't test for
-     * primality because the value is a multiple of 3.
-     * We also know that h*2^n-1 is not 3 because the
-     * 'catch the special cases for small primes' code
-     * would have exited above if h*2^n-1 == 3.
-     */
-    if (((h % 3 == 1) && (n % 2 == 0)) || ((h % 3 == 2) && (n % 2 == 1))) {
-	if (calc_mode) {
-	    printf("print \"%s: %ld * 2 ^ %ld - 1 is a multiple of 3 > 3\";\n", program, orig_h, orig_n);
-	    printf("mod3 = ((%ld * 2 ^ %ld - 1) %% 3);\n", orig_h, orig_n);
-	    printf("if (mod3 == 0) { print \"value mod 3:\", mod3; } else { print \"failed: mod 3 != 0:\", mod3 };\n");
-	    printf("print \"%s: %ld * 2 ^ %ld - 1 is composite\";\n", program, orig_h, orig_n);
-	} else if (!quiet) {
-	    printf("%ld * 2 ^ %ld - 1 is composite\n", orig_h, orig_n);
-	}
-	if (checkpoint_dir != NULL) {
-	    dbg(DBG_MED, "checkpoint state set to composite in: %s", checkpoint_dir);
-	    checkpoint(checkpoint_dir, false, h, n, n, 0, non_zero);
-	}
-	dbg(DBG_LOW, "exit composite");
-	exit(EXIT_IS_COMPOSITE); // exit(1);
-    }
-
-    /*
-     * NOTE: the values of h and n have been established and will not change thruout the test
-     */
-    fflush(stdout); // paranoia
-    fflush(stderr); // paranoia
-    dbg(DBG_LOW, "testing %lu*2^%lu-1", h, n);
-    fflush(stderr); // paranoia
-
-    /*
-     * initialize prime stats for this run
-     *
-     * NOTE: This does not initialize prime stats for the total run.
-     *	     The prime stats for the total run is setup when we either
-     *	     restore from a checkpoint or determine the test is just starting.
-     */
-    initialize_beginrun_stats();
-
-    /*
-     * initialize checkpoint system
-     *
-     * This does not perform a restore from q checkpoint file.
-     * This just initializes internal data structures, sets up
-     * the checkpoint timer and creates the checkpoint directory
-     * if it it needed and does not exist.
-     *
-     * This call will also initialize prime stats for the start of this primality test.
-     *
-     * If we are checkpointing, a lock for the checkpoint directroy will be obtained.
-     * If the lock is busy, this function will exit and not return.
+     * h*(2^a)^n-1 is h*2^(a*n)-1, which the Riesel test applies to
      *
-     * If the checkpoint directory exists and contains a checkpoint, we will
-     * restore based on that checkpoint.
+     * A checkpoint of such a test was made with the converted n, so only n given as an arg is converted.
      */
-    if (!restore) {
-	initialize_checkpoint(checkpoint_dir, checkpoint_secs, h, n, force);
-    }
-
-    /*
-     * compute h*2^n-1 - our test candidate
-     */
-    mpz_ui_pow_ui(pow_2, 2, n);
-    mpz_mul_ui(h_pow_2, pow_2, h);
-    mpz_sub_ui(riesel_cand, h_pow_2, 1);
-    if (debuglevel >= DBG_MED) {
-	dbg(DBG_MED, "origianl test %lu*2^%lu-1", orig_h, orig_n);
-	if (debuglevel >= DBG_HIGH) {
-	    write_calc_mpz_hex(stderr, NULL, "riesel_cand", riesel_cand);
-	}
-	fflush(stderr); // paranoia
-    }
-    if (calc_mode) {
-	printf("print \"original test %ld * 2 ^ %ld - 1\";\n", orig_h, orig_n);
-	printf("print \"about to test %ld * 2 ^ %ld - 1\";\n", h, n);
-	printf("riesel_cand = %ld * 2 ^ %ld - 1;\n", h, n);
-	fflush(stdout); // paranoia
-    }
-
-    /*
-     * firewall - h < 2^n
-     */
-    if (mpz_cmp_ui(pow_2, h) < 0) {
-	err(EXIT_CANNOT_TEST, __func__, "h: %lu must be < 2^n: 2^%lu", h, n);
-	// exit(2);
-	exit(EXIT_CANNOT_TEST); // NOT REACHED
-    }
-
-    /*
-     * set initial u(FIRST_TERM_INDEX) value, unless we restored
-     */
-    if (!restore) {
-	i = FIRST_TERM_INDEX; // we call the first Lucas term, U(2)
-	v1 = gen_u2(h, n, riesel_cand, u_term);
-	if (debuglevel >= DBG_MED) {
-	    dbg(DBG_MED, "v[1] = %lu ;", v1);
-	    if (debuglevel >= DBG_HIGH) {
-		write_calc_mpz_hex(stderr, NULL, "u[2]", u_term);
+    if (base > 2 && (base & (base - 1)) == 0) {
+	log2_base = (unsigned long)__builtin_ctzl(base);
+	if (!opts.restore) {
+	    if (n > ULONG_MAX / log2_base) {
+		usage_err(EXIT_USAGE, __func__, "FATAL: n: %lu is too large for --base %lu", n, base);
+		// exit(9);
+		exit(EXIT_USAGE); // NOT REACHED
 	    }
-	    fflush(stderr); // paranoia
-	}
-	if (calc_mode) {
-	    printf("print \"read lucas;\"\n");
-	    printf("read lucas;\n");
-	    printf("print \"v1 = gen_v1(%s, %s);\";\n", h_str, n_str);
-	    printf("v1 = gen_v1(%s, %s);\n", h_str, n_str);
-	    printf("print \"gmprime_v1 = %lu;\"\n", v1);
-	    printf("gmprime_v1 = %lu;\n", v1);
-	    printf("if (v1 == gmprime_v1) {\n");
-	    printf("  print \"v[1] value set correctly\";\n");
-	    printf("} else {\n");
-	    printf("  print \"# ERR: v1 != gmprime_v1\";\n");
-	    printf("  print \"v1 = \", v1;\n");
-	    printf("  print \"gmprime_v1 = \", gmprime_v1;\n");
-	    printf("  quit \"v[1] value not correctly set\";\n");
-	    printf("}\n");
-	    printf("v1 = gen_v1(%s, %s);\n", h_str, n_str);
-	    printf("print \"u_term = gen_u2(%s, %s, v1);\";\n", h_str, n_str);
-	    printf("u_term = gen_u2(%s, %s, v1);\n", h_str, n_str);
-	    write_calc_mpz_hex(stdout, NULL, "gmprime_u_term", u_term);
-	    printf("if (u_term == gmprime_u_term) {\n");
-	    printf("  print \"u[2] value set correctly\";\n");
-	    printf("} else {\n");
-	    printf("  print \"# ERR: u_term != gmprime_u_term for u[2]\";\n");
-	    printf("  print \"u_term = \", u_term;\n");
-	    printf("  print \"gmprime_u_term = \", gmprime_u_term;\n");
-	    printf("  quit \"u[2] value not correctly set\";\n");
-	    printf("}\n");
-	    fflush(stdout); // paranoia
-	}
-
-	/*
-	 * if checkpointing, perform an initial checkpoint for U(2)
-	 */
-	if (checkpoint_dir != NULL) {
-	    dbg(DBG_MED, "checkpointing for u(2): %s", checkpoint_dir);
-	    checkpoint(checkpoint_dir, true, h, n, i, v1, u_term);
+	    dbg(DBG_MED, "testing %lu*%lu^%lu-1 as %lu*2^%lu-1", h, base, n, h, n * log2_base);
+	    n *= log2_base;
 	}
+	base = 2;
     }
+    opts.base = base;
 
     /*
-     * compute u(n)
-     *
-     * u(i+1) = u(i)^2 - 2 mod 2^n-1
+     * case: search for the smallest m, n < m <= n_max, such that h*2^m-1 is prime
      */
-    while (i < n) {
-
-	/*
-	 * note the Lucas term index we are computing
-	 */
-	++i;
-
-	/*
-	 * setup for next loop
-	 */
-	if (calc_mode) {
-	    printf("print \"starting to compute u[%ld]\";\n", i);
-	    write_calc_int64_t(stdout, NULL, "i", i);
-	    fflush(stdout); // paranoia
-	}
-
-	/*
-	 * square
-	 */
-	mpz_mul(u_term_sq, u_term, u_term);
-	if (debuglevel >= DBG_VHIGH) {
-	    write_calc_mpz_hex(stderr, NULL, "u_term_sq", u_term_sq);
-	    fflush(stderr); // paranoia
-	}
-	if (calc_mode) {
-	    printf("u_term_sq = u_term^2;\n");
-	    write_calc_mpz_hex(stdout, NULL, "gmprime_u_term_sq", u_term_sq);
-	    printf("if (u_term_sq == gmprime_u_term_sq) {\n");
-	    printf("  print \"gmprime_u_term_sq appears to be correct\";\n");
-	    printf("} else {\n");
-	    printf("  print \"# ERR: u_term_sq != gmprime_u_term_sq for u[%ld]\";\n", i);
-	    printf("  print \"u_term_sq = \", u_term_sq;\n");
-	    printf("  print \"gmprime_u_term_sq = \", gmprime_u_term_sq;\n");
-	    printf("  quit \"bad square calculation\";\n");
-	    printf("}\n");
-	    fflush(stdout); // paranoia
-	}
-
-	/*
-	 * -2
-	 */
-	mpz_sub_ui(u_term_sq_2, u_term_sq, (unsigned long int) 2);
-	if (debuglevel >= DBG_VHIGH) {
-	    write_calc_mpz_hex(stderr, NULL, "u_term_sq_2", u_term_sq_2);
-	    fflush(stderr); // paranoia
-	}
-	if (calc_mode) {
-	    printf("u_term_sq_2 = u_term_sq - 2;\n");
-	    write_calc_mpz_hex(stdout, NULL, "gmprime_u_term_sq_2", u_term_sq_2);
-	    printf("if (u_term_sq_2 == gmprime_u_term_sq_2) {\n");
-	    printf("  print \"gmprime_u_term_sq_2 appears to be correct\";\n");
-	    printf("} else {\n");
-	    printf("  print \"# ERR: u_term_sq_2 != gmprime_u_term_sq_2 for u[%ld]\";\n", i);
-	    printf("  print \"u_term_sq_2 = \", u_term_sq_2;\n");
-	    printf("  print \"gmprime_u_term_sq_2 = \", gmprime_u_term_sq_2;\n");
-	    printf("  quit \"bad -2 calculation\";\n");
-	    printf("}\n");
-	    fflush(stdout); // paranoia
-	}
-
-	/*
-	 * mod h*2^n-1 via modified "shift and add"
-	 *
-	 * See http://www.isthe.com/chongo/tech/math/prime/prime-tutorial.pdf
-	 * for the page entitled "Calculating mod h*2n-1".
-	 *
-	 * Executive summary:
-	 *
-	 *      u_term = u_term_sq_2 mod h*2^n-1 = int(J/h) + (J mod h)*(2^n) + K
-	 *
-	 * Where:
-	 *
-	 *      J = int(u_term_sq_2 / 2^n)      // u_term_sq_2 right shifted by n bits
-	 *      K = u_term_sq_2 mod 2^n         // the bottom n bits of u_term_sq_2
-	 *
-	 * NOTE: We use 2^n above to mean 2 raised to the power of n, not xor.
-	 */
-	mpz_fdiv_q_2exp(J, u_term_sq_2, n);	// J = int(u_term_sq_2 / 2^n)
-	if (debuglevel >= DBG_VVHIGH) {
-	    write_calc_mpz_hex(stderr, NULL, "J", J);
-	    fflush(stderr); // paranoia
-	}
-	mpz_tdiv_qr_ui(J_div_h, J_mod_h, J, h);	// compute both int(J/h) and (J mod h)
-	if (debuglevel >= DBG_VVHIGH) {
-	    write_calc_mpz_hex(stderr, NULL, "J_div_h", J_div_h);
-	    write_calc_mpz_hex(stderr, NULL, "J_mod_h", J_mod_h);
-	    fflush(stderr); // paranoia
-	}
-	mpz_mul_2exp(J_mod_h, J_mod_h, n);	// (J mod h)*(2^n)
-	if (debuglevel >= DBG_VVHIGH) {
-	    write_calc_mpz_hex(stderr, NULL, "J_mod_h_shifted", J_mod_h);
-	    fflush(stderr); // paranoia
-	}
-	mpz_fdiv_r_2exp(K, u_term_sq_2, n);	// K = bottom n bits of u_term_sq_2
-	if (debuglevel >= DBG_VVHIGH) {
-	    write_calc_mpz_hex(stderr, NULL, "K", K);
-	    fflush(stderr); // paranoia
-	}
-	mpz_add(u_term, J_mod_h, K);	// int(J/h) + (J mod h)*(2^n)
-	if (debuglevel >= DBG_VVHIGH) {
-	    write_calc_mpz_hex(stderr, NULL, "u_term_partial", u_term);
-	    fflush(stderr); // paranoia
-	}
-	mpz_add(u_term, u_term, J_div_h);	// u_term = u_term_sq_2 mod h*2^n-1
-	if (debuglevel >= DBG_VHIGH) {
-	    write_calc_mpz_hex(stderr, NULL, "u_term_mod_final", u_term);
-	    fflush(stderr); // paranoia
-	}
-
-	/*
-	 * While the above modified "shift and add" does compute u_term_sq_2 mod h*2^n-1
-	 * it can produce a value that is >= h*2^n-1 in some extreme cases.  When that
-	 * happens, the value will be slightly larger than h*2^n-1.  In particular it
-	 * will be bounded under an upper bound that we derive below.
-	 *
-	 * Assume:
-	 *
-	 *      hb = the number of bits in h, which for this C code is 64 bits
-	 *
-	 * We know that:
-	 *      rb = the number of bits in h*2^n-1 (our riesel_cand), for this C code is hb + n
-	 *      u2b = the number of bits in (h*2^n-1)^2, for this C code is 2*rb = 2*hb + 2*n
-	 *
-	 * Now:
-	 *
-	 *      u_term = u_term_sq_2 mod h*2^n-1 = int(J/h) + (J mod h)*(2^n) + K
-	 *
-	 * Where:
-	 *
-	 *      J = int(u_term_sq_2 / 2^n)      // u_term_sq_2 right shifted by n bits
-	 *      K = u_term_sq_2 mod 2^n         // the bottom n bits of u_term_sq_2
-	 *
-	 * We need to determine the sizes of the terms used to compute the new u_term.
-	 * It is easy to show that:
-	 *
-	 *      jb = the number of bits in J = (2*hb + 2*n) - n = 2*hb + n
-	 *      jdhb = the number of bits in int(J/h) = jb - hb = 2*hb + n - hb = hb + n
-	 *      jmhb = the number of bits in (J mod h)*(2^n) = hb + n
-	 *
-	 *      kb = the number of bits in K = n
-	 *
-	 * Then it is easy to show that the size of the new u_term in bits is as most:
-	 *
-	 *      max(max(jdhb, jmhb)+1, n) = max(max(hb + n, hb + n)+1, n) = max(hb + n + 1, n) = hb + n + 1
-	 *
-	 *        (The reason for the + 1 in the above expression is due to a potential carry bit.)
-	 *
-	 * Therefore the new u_term in bits is at most twice h*2^n-1, our riesel_cand.  So we
-	 * when the new u_term > riesel_cand, we expect to subtract riesel_cand at most one time.
-	 */
-	while (mpz_cmp(u_term, riesel_cand) >= 0) {
-	    mpz_sub(u_term, u_term, riesel_cand);
-	    if (debuglevel >= DBG_VHIGH) {
-		write_calc_mpz_hex(stderr, NULL, "u_term_subtract", u_term);
-		fflush(stderr); // paranoia
-	    }
+    if (have_S) {
+	if (opts.checkpoint_dir != NULL || opts.calc_mode || opts.write_extended_stats) {
+	    usage_err(EXIT_USAGE, __func__, "use of -S n_max does not allow -d checkpoint_dir, -c or -T");
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
 	}
-	if (debuglevel >= DBG_HIGH) {
-	    fprintf(stderr, "u[%ld", i);
-	    write_calc_mpz_hex(stderr, NULL, "]", u_term);
-	    fflush(stderr); // paranoia
+	if (search_max <= n) {
+	    usage_err(EXIT_USAGE, __func__, "-S n_max: %lu must be > n: %lu", search_max, n);
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
 	}
-	if (calc_mode) {
-	    printf("u_term = u_term_sq_2 %% riesel_cand;\n");
-	    write_calc_mpz_hex(stdout, NULL, "gmprime_u_term", u_term);
-	    printf("if (u_term == gmprime_u_term) {\n");
-	    printf("  print \"gmprime_u_term appears to be correct\";\n");
-	    printf("} else {\n");
-	    printf("  print \"# ERR: u_term_sq_2 != gmprime_u_term for u[%ld]\";\n", i);
-	    printf("  print \"u_term = \", u_term;\n");
-	    printf("  print \"gmprime_u_term = \", gmprime_u_term;\n");
-	    printf("  quit \"bad mod calculation\";\n");
-	    printf("}\n");
-	    fflush(stdout); // paranoia
-	}
-
-	/*
-	 * checkpoint if checkpointing and needed
-	 */
-	if (checkpoint_dir != NULL && checkpoint_needed(h, n, i, multiple)) {
-	    dbg(DBG_MED, "checkpointing for u[%ld]: %s", i, checkpoint_dir);
-	    checkpoint(checkpoint_dir, true, h, n, i, v1, u_term);
+	if (!have_p) {
+	    max_threads = (cores < PARSQR_MAX_THREADS) ? (int)cores : PARSQR_MAX_THREADS;
 	}
+	bopts.search_h = h;
+	bopts.search_n = n;
+	bopts.search_max = search_max;
+	bopts.cores = (int)cores;
+	bopts.max_threads = max_threads;
+	exit(batch_run(&bopts, &opts));
     }
-    dbg(DBG_LOW, "finished testing %lu*2^%lu-1", h, n);
-    fflush(stderr); // paranoia
 
     /*
-     * print final prime stats according to -t and/or -T
+     * test h*2^n-1, squaring with -p threads
      */
-    if (write_stats) {
-	update_stats();
-	write_calc_prime_stats(stderr, write_extended_stats);
+    threads = max_threads;
+    opts.threads = &threads;
+    if (have_z) {
+	zcalc_start();
     }
-
-    /*
-     * h*2^n-1 is prime if and only if u(n) == 0
-     */
-    if (calc_mode) {
-	printf("print \"%s: u[%ld] =\", u_term;\n", program, i);
-	printf("print \"%s: original test: %ld * 2 ^ %ld - 1;\"\n", program, orig_h, orig_n);
-	printf("print \"%s: actual test: %ld * 2 ^ %ld - 1;\"\n", program, h, n);
-    }
-    if (mpz_sgn(u_term) == 0) {
-	if (calc_mode) {
-	    printf("if (u_term == 0) { print \"u[%ld] == 0\"; } else { print \"ERROR: u[%ld] != 0\"; }\n", i, i);
-	    printf("print \"%s: %ld * 2 ^ %ld - 1 is prime\";\n", program, orig_h, orig_n);
-	} else if (!quiet) {
-	    printf("%ld * 2 ^ %ld - 1 is prime\n", orig_h, orig_n);
-	}
-    } else {
-	if (calc_mode) {
-	    printf("if (u_term != 0) { print \"u[%ld] != 0\"; } else { print \"ERROR: u[%ld] != 0\"; }\n", i, i);
-	    printf("print \"%s: %ld * 2 ^ %ld - 1 is composite\";\n", program, orig_h, orig_n);
-	} else if (!quiet) {
-	    printf("%ld * 2 ^ %ld - 1 is composite\n", orig_h, orig_n);
-	}
-	dbg(DBG_LOW, "exit composite");
-	exit(EXIT_IS_COMPOSITE); // exit(1);
+    if (supervise) {
+	exit(supervise_test(h, n, &opts));
     }
-
-    /*
-     * All Done!! -- Jessica Noll, Age 2
-     */
-    dbg(DBG_LOW, "exit prime");
-    exit(EXIT_IS_PRIME); // exit(0);
+    exit(lucas_test(h, n, &opts));
 }
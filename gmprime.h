@@ -53,10 +53,28 @@
 /*
  * internal error code ranges - numerical exit codes used
  */
-/* NUMERIC EXIT CODES: 10-39	gmprime.c - reserved for internal errors */
-/* NUMERIC EXIT CODES: 40-69	riesel.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 10-19	gmprime.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 20-29	prp.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 30-39	supervise.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 40-49	riesel.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 50-59	housekeep.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 60-69	watchdog.c - reserved for internal errors */
 /* NUMERIC EXIT CODES: 70-99	checkpoint.c - reserved for internal errors */
-/* NUMERIC EXIT CODES: 100-249	reserved for furure use */
+/* NUMERIC EXIT CODES: 100-109	lucas.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 110-119	parsqr.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 120-129	batch.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 130-139	hnlist.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 140-149	engine.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 150-159	ifma.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 160-169	jit.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 170-179	mpisqr.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 180-189	ooc.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 190-199	live.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 200-209	stage.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 210-219	selftest.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 220-229	control.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 230-239	throttle.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 240-249	zcalc.c - reserved for internal errors */
 /* NUMERIC EXIT CODES: 250-254	debug.c - reserved for internal errors */
 /* NUMERIC EXIT CODES: 255	debug.c - FORCED_EXIT */
 
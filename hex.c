@@ -0,0 +1,333 @@
+/*
+ * hex - hex codec for calc format values
+ *
+ * Checkpoints, -c and the higher debug levels write each u term as calc
+ * hex, which for a large n is several megabytes of digits.  Rather than
+ * converting them one digit at a time, hex_encode() turns 16 or 32 bytes
+ * of limbs into hex with a byte shuffle that looks each nibble up in a
+ * table of digits, and hex_decode() validates and converts 16 or 32 digits
+ * at a time, packing pairs of nibbles with a multiply add.  An AVX2 or
+ * SSSE3 kernel is used when the host has one, otherwise a table per byte.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "hex.h"
+
+static const char hex_digit[16] = "0123456789abcdef";
+
+/*
+ * static functions
+ */
+#if defined(__x86_64__)
+static size_t hex_encode_ssse3(char *dst, const uint64_t *limbs, size_t count) __attribute__((target("ssse3")));
+static size_t hex_encode_avx2(char *dst, const uint64_t *limbs, size_t count) __attribute__((target("avx2")));
+static size_t hex_decode_ssse3(uint64_t *limbs, const char *src, size_t count) __attribute__((target("ssse3")));
+static size_t hex_decode_avx2(uint64_t *limbs, const char *src, size_t count) __attribute__((target("avx2")));
+#endif
+
+
+/*
+ * hex_nibble - value of a hex digit
+ *
+ * returns:
+ *      0 thru 15, or -1 ==> not a hex digit
+ */
+static int
+hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') {
+	return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+	return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+	return c - 'A' + 10;
+    }
+    return -1;
+}
+
+
+/*
+ * hex_encode_limb - write the 16 hex digits of one limb, most significant first
+ */
+static void
+hex_encode_limb(char *dst, uint64_t limb)
+{
+    int k;
+
+    for (k = HEX_LIMB_CHARS - 1; k >= 0; --k) {
+	dst[k] = hex_digit[limb & 0xf];
+	limb >>= 4;
+    }
+    return;
+}
+
+
+#if defined(__x86_64__)
+
+/*
+ * hex_encode_ssse3 - encode pairs of limbs, returning the limbs encoded
+ */
+static size_t
+hex_encode_ssse3(char *dst, const uint64_t *limbs, size_t count)
+{
+    const __m128i digits = _mm_loadu_si128((const __m128i *)hex_digit);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i x;			/* big endian bytes of two limbs */
+    __m128i hi;			/* high nibbles */
+    __m128i lo;			/* low nibbles */
+    size_t done;
+
+    for (done = 0; done + 2 <= count; done += 2) {
+	x = _mm_loadu_si128((const __m128i *)(limbs + count - done - 2));
+	x = _mm_shuffle_epi8(x, reverse);
+	hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+	lo = _mm_and_si128(x, mask);
+	_mm_storeu_si128((__m128i *)(dst), _mm_shuffle_epi8(digits, _mm_unpacklo_epi8(hi, lo)));
+	_mm_storeu_si128((__m128i *)(dst + 16), _mm_shuffle_epi8(digits, _mm_unpackhi_epi8(hi, lo)));
+	dst += 2 * HEX_LIMB_CHARS;
+    }
+    return done;
+}
+
+
+/*
+ * hex_encode_avx2 - encode groups of 4 limbs, returning the limbs encoded
+ */
+static size_t
+hex_encode_avx2(char *dst, const uint64_t *limbs, size_t count)
+{
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hex_digit));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    const __m256i bswap = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+					  8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i x;			/* big endian bytes of four limbs */
+    __m256i hi;			/* high nibbles */
+    __m256i lo;			/* low nibbles */
+    __m256i a;			/* digits of bytes 0-7 and 16-23 */
+    __m256i b;			/* digits of bytes 8-15 and 24-31 */
+    size_t done;
+
+    for (done = 0; done + 4 <= count; done += 4) {
+	x = _mm256_loadu_si256((const __m256i *)(limbs + count - done - 4));
+	x = _mm256_shuffle_epi8(_mm256_permute4x64_epi64(x, 0x1b), bswap);
+	hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), mask);
+	lo = _mm256_and_si256(x, mask);
+	a = _mm256_shuffle_epi8(digits, _mm256_unpacklo_epi8(hi, lo));
+	b = _mm256_shuffle_epi8(digits, _mm256_unpackhi_epi8(hi, lo));
+	_mm256_storeu_si256((__m256i *)(dst), _mm256_permute2x128_si256(a, b, 0x20));
+	_mm256_storeu_si256((__m256i *)(dst + 32), _mm256_permute2x128_si256(a, b, 0x31));
+	dst += 4 * HEX_LIMB_CHARS;
+    }
+    return done;
+}
+
+
+/*
+ * hex_decode_ssse3 - decode limbs from 16 digits each, returning the limbs decoded
+ *
+ * given:
+ *      limbs   where to store count limbs, least significant first
+ *      src     16*count hex digits, most significant first
+ *      count   limbs to decode
+ *
+ * Decoding stops before the first limb with a digit that is not hex.
+ */
+static size_t
+hex_decode_ssse3(uint64_t *limbs, const char *src, size_t count)
+{
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i ten = _mm_set1_epi8(10);
+    const __m128i six = _mm_set1_epi8(6);
+    const __m128i a = _mm_set1_epi8('a');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i pair = _mm_set1_epi16(0x0110);
+    __m128i c;			/* 16 digits */
+    __m128i d;			/* value of 0-9 */
+    __m128i l;			/* value of a-f less 10 */
+    __m128i is_d;		/* 0-9 */
+    __m128i is_l;		/* a-f or A-F */
+    __m128i v;			/* nibbles */
+    size_t done;
+
+    for (done = 0; done < count; ++done) {
+	c = _mm_loadu_si128((const __m128i *)(src + done * HEX_LIMB_CHARS));
+	d = _mm_sub_epi8(c, zero);
+	l = _mm_sub_epi8(_mm_or_si128(c, lower), a);
+	is_d = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_set1_epi8(-1)), _mm_cmplt_epi8(d, ten));
+	is_l = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8(-1)), _mm_cmplt_epi8(l, six));
+	if (_mm_movemask_epi8(_mm_or_si128(is_d, is_l)) != 0xffff) {
+	    break;
+	}
+	v = _mm_or_si128(_mm_and_si128(is_d, d), _mm_and_si128(is_l, _mm_add_epi8(l, ten)));
+	v = _mm_packus_epi16(_mm_maddubs_epi16(v, pair), v);
+	limbs[count - 1 - done] = __builtin_bswap64((uint64_t)_mm_cvtsi128_si64(v));
+    }
+    return done;
+}
+
+
+/*
+ * hex_decode_avx2 - decode pairs of limbs from 32 digits each, returning the limbs decoded
+ */
+static size_t
+hex_decode_avx2(uint64_t *limbs, const char *src, size_t count)
+{
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i ten = _mm256_set1_epi8(10);
+    const __m256i six = _mm256_set1_epi8(6);
+    const __m256i a = _mm256_set1_epi8('a');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i none = _mm256_set1_epi8(-1);
+    const __m256i pair = _mm256_set1_epi16(0x0110);
+    __m256i c;			/* 32 digits */
+    __m256i d;			/* value of 0-9 */
+    __m256i l;			/* value of a-f less 10 */
+    __m256i is_d;		/* 0-9 */
+    __m256i is_l;		/* a-f or A-F */
+    __m256i v;			/* nibbles */
+    size_t done;
+
+    for (done = 0; done + 2 <= count; done += 2) {
+	c = _mm256_loadu_si256((const __m256i *)(src + done * HEX_LIMB_CHARS));
+	d = _mm256_sub_epi8(c, zero);
+	l = _mm256_sub_epi8(_mm256_or_si256(c, lower), a);
+	is_d = _mm256_and_si256(_mm256_cmpgt_epi8(d, none), _mm256_cmpgt_epi8(ten, d));
+	is_l = _mm256_and_si256(_mm256_cmpgt_epi8(l, none), _mm256_cmpgt_epi8(six, l));
+	if ((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(is_d, is_l)) != 0xffffffff) {
+	    break;
+	}
+	v = _mm256_or_si256(_mm256_and_si256(is_d, d), _mm256_and_si256(is_l, _mm256_add_epi8(l, ten)));
+	v = _mm256_maddubs_epi16(v, pair);
+	v = _mm256_packus_epi16(v, v);
+	limbs[count - 1 - done] = __builtin_bswap64((uint64_t)_mm256_extract_epi64(v, 0));
+	limbs[count - 2 - done] = __builtin_bswap64((uint64_t)_mm256_extract_epi64(v, 2));
+    }
+    return done;
+}
+
+#endif				/* __x86_64__ */
+
+
+/*
+ * hex_encode - write limbs as hex digits
+ *
+ * given:
+ *      dst     where to write 16*count hex digits, most significant first
+ *      limbs   count limbs, least significant first
+ *      count   limbs to encode
+ *
+ * Leading zero digits are written, and no NUL is added.
+ */
+void
+hex_encode(char *dst, const uint64_t *limbs, size_t count)
+{
+    size_t done = 0;		/* limbs encoded */
+
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+	done = hex_encode_avx2(dst, limbs, count);
+    } else if (__builtin_cpu_supports("ssse3")) {
+	done = hex_encode_ssse3(dst, limbs, count);
+    }
+#endif
+    for (; done < count; ++done) {
+	hex_encode_limb(dst + done * HEX_LIMB_CHARS, limbs[count - 1 - done]);
+    }
+    return;
+}
+
+
+/*
+ * hex_decode - convert hex digits into limbs
+ *
+ * given:
+ *      limbs   where to store (len+15)/16 limbs, least significant first
+ *      src     len hex digits, most significant first, in either case
+ *      len     hex digits to decode
+ *
+ * returns:
+ *      true ==> all len digits were hex, false ==> some digit was not
+ */
+bool
+hex_decode(uint64_t *limbs, const char *src, size_t len)
+{
+    size_t count;		/* limbs in the whole limbs of digits */
+    size_t head;		/* digits of the most significant limb */
+    size_t done = 0;		/* limbs decoded */
+    uint64_t limb;
+    int v;
+    size_t k;
+
+    /*
+     * the most significant limb may have fewer than 16 digits
+     */
+    count = len / HEX_LIMB_CHARS;
+    head = len % HEX_LIMB_CHARS;
+    if (head > 0) {
+	limb = 0;
+	for (k = 0; k < head; ++k) {
+	    v = hex_nibble(src[k]);
+	    if (v < 0) {
+		return false;
+	    }
+	    limb = (limb << 4) | (uint64_t)v;
+	}
+	limbs[count] = limb;
+	src += head;
+    }
+
+    /*
+     * the rest have 16 digits each
+     */
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+	done = hex_decode_avx2(limbs, src, count);
+    } else if (__builtin_cpu_supports("ssse3")) {
+	done = hex_decode_ssse3(limbs, src, count);
+    }
+#endif
+    for (; done < count; ++done) {
+	limb = 0;
+	for (k = 0; k < HEX_LIMB_CHARS; ++k) {
+	    v = hex_nibble(src[done * HEX_LIMB_CHARS + k]);
+	    if (v < 0) {
+		return false;
+	    }
+	    limb = (limb << 4) | (uint64_t)v;
+	}
+	limbs[count - 1 - done] = limb;
+    }
+    return true;
+}
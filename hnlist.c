@@ -0,0 +1,561 @@
+/*
+ * hnlist - memory mapped list of h n candidates
+ *
+ * A list is either text, one "h n" candidate per line (as in the test
+ * sub-directory), or binary (see HNLIST_MAGIC in hnlist.h).  The list is
+ * mapped, not read, and candidates are parsed one at a time straight from
+ * the mapping as the batch scheduler asks for them.  A multi-million line
+ * list is never loaded or copied, and the first candidate can be dispatched
+ * as soon as the list is opened.
+ *
+ * Text lists are parsed 8 digits at a time: an 8 byte word is loaded from
+ * the mapping, the leading run of digits is found with a few word wide
+ * operations, and the digits are combined into a value using 3 multiplies
+ * (SWAR: SIMD within a register).  Bytes within 8 of the end of the mapping
+ * are parsed one at a time so that we never read beyond the mapping.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 130-139	hnlist.c - reserved for internal errors */
+
+#define _DEFAULT_SOURCE		/* for madvise() and le64toh() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "gmprime.h"
+#include "debug.h"
+#include "hnlist.h"
+
+/*
+ * SWAR constants
+ */
+#define ONES	(0x0101010101010101ULL)	// 0x01 in every byte
+#define HIGHS	(0xF0F0F0F0F0F0F0F0ULL)	// high nibble of every byte
+
+/*
+ * static functions
+ */
+static bool parse_ulong(struct hnlist *l, unsigned long *val);
+static void skip_blank(struct hnlist *l);
+
+
+/*
+ * hnlist_open - map a list of h n candidates
+ *
+ * given:
+ *      l       list to setup
+ *      path    list filename
+ *
+ * This function does not return on error.
+ */
+void
+hnlist_open(struct hnlist *l, const char *path)
+{
+    struct stat buf;		/* list file status */
+    int fd;			/* open list file */
+    void *map;			/* mmap return */
+
+    /*
+     * firewall
+     */
+    if (l == NULL || path == NULL) {
+	err(130, __func__, "called with NULL arg(s)");
+	return;	// NOT REACHED
+    }
+    memset(l, 0, sizeof(*l));
+    l->path = path;
+    l->lineno = 1;
+
+    /*
+     * open the list
+     */
+    errno = 0;
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+	usage_errp(EXIT_USAGE, __func__, "cannot open list: %s", path);
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    errno = 0;
+    if (fstat(fd, &buf) < 0) {
+	errp(131, __func__, "cannot fstat list: %s", path);
+	return;	// NOT REACHED
+    }
+    if (buf.st_size == 0) {
+	(void) close(fd);
+	return;	// empty list
+    }
+
+    /*
+     * map the list, we will read it once from front to back
+     */
+    errno = 0;
+    map = mmap(NULL, (size_t)buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+	errp(132, __func__, "cannot mmap list: %s", path);
+	return;	// NOT REACHED
+    }
+    (void) close(fd);
+    (void) madvise(map, (size_t)buf.st_size, MADV_SEQUENTIAL);
+    l->map = map;
+    l->len = (size_t)buf.st_size;
+
+    /*
+     * determine the list format
+     */
+    if (l->len >= HNLIST_MAGIC_LEN && memcmp(l->map, HNLIST_MAGIC, HNLIST_MAGIC_LEN) == 0) {
+	l->binary = true;
+	l->pos = HNLIST_MAGIC_LEN;
+	if ((l->len - HNLIST_MAGIC_LEN) % HNLIST_PAIR_LEN != 0) {
+	    usage_err(EXIT_USAGE, __func__, "binary list: %s length: %zu is not a whole number of h n pairs",
+		      path, l->len);
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+    }
+    dbg(DBG_MED, "mapped %s list: %s of %zu bytes", (l->binary ? "binary" : "text"), path, l->len);
+    return;
+}
+
+
+/*
+ * hnlist_watch - map the whole candidates of a list that may still be appended to
+ *
+ * given:
+ *      l       list to setup
+ *      path    list filename
+ *
+ * Unlike hnlist_open(), a line or pair still being appended is not mapped,
+ * just as with hnlist_refresh(), which maps it once it is whole.
+ *
+ * This function does not return on error.
+ */
+void
+hnlist_watch(struct hnlist *l, const char *path)
+{
+    int fd;			/* open list file */
+
+    /*
+     * firewall
+     */
+    if (l == NULL || path == NULL) {
+	err(130, __func__, "called with NULL arg(s)");
+	return;	// NOT REACHED
+    }
+    memset(l, 0, sizeof(*l));
+    l->path = path;
+    l->lineno = 1;
+
+    /*
+     * be sure the list can be opened, then map what is whole of it
+     */
+    errno = 0;
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+	usage_errp(EXIT_USAGE, __func__, "cannot open list: %s", path);
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    (void) close(fd);
+    (void) hnlist_refresh(l);
+    return;
+}
+/*
+ * hnlist_next - parse the next h n candidate
+ *
+ * given:
+ *      l       open list
+ *      h       where to store the multiplier of 2
+ *      n       where to store the power of 2
+ *
+ * returns:
+ *      true ==> *h and *n were set, false ==> end of the list
+ *
+ * This function does not return on a malformed list.
+ */
+bool
+hnlist_next(struct hnlist *l, unsigned long *h, unsigned long *n)
+{
+    uint64_t pair[2];		/* binary h n pair */
+
+    /*
+     * firewall
+     */
+    if (l == NULL || h == NULL || n == NULL) {
+	err(133, __func__, "called with NULL arg(s)");
+	return false;	// NOT REACHED
+    }
+
+    /*
+     * case: binary list
+     */
+    if (l->binary) {
+	if (l->pos >= l->len) {
+	    return false;
+	}
+	memcpy(pair, l->map + l->pos, sizeof(pair));
+	l->pos += HNLIST_PAIR_LEN;
+	*h = (unsigned long)le64toh(pair[0]);
+	*n = (unsigned long)le64toh(pair[1]);
+	if (*h <= 0 || *n <= 0) {
+	    usage_err(EXIT_USAGE, __func__, "binary list: %s pair at offset %zu: expected h > 0 and n > 0",
+		      l->path, l->pos - HNLIST_PAIR_LEN);
+	    // exit(9);
+	    exit(EXIT_USAGE); // NOT REACHED
+	}
+	return true;
+    }
+
+    /*
+     * case: text list - skip blank lines
+     */
+    for (;;) {
+	skip_blank(l);
+	if (l->pos >= l->len) {
+	    return false;
+	}
+	if (l->map[l->pos] != '\n') {
+	    break;
+	}
+	++l->pos;
+	++l->lineno;
+    }
+
+    /*
+     * parse h n and the end of the line
+     */
+    if (!parse_ulong(l, h)) {
+	goto malformed;
+    }
+    skip_blank(l);
+    if (!parse_ulong(l, n)) {
+	goto malformed;
+    }
+    skip_blank(l);
+    if (l->pos < l->len) {
+	if (l->map[l->pos] != '\n') {
+	    goto malformed;
+	}
+	++l->pos;
+	++l->lineno;
+    }
+    if (*h <= 0 || *n <= 0) {
+	goto malformed;
+    }
+    return true;
+
+malformed:
+    usage_err(EXIT_USAGE, __func__, "%s line %lu: expected h > 0 and n > 0", l->path, l->lineno);
+    // exit(9);
+    exit(EXIT_USAGE); // NOT REACHED
+}
+
+
+/*
+ * hnlist_refresh - map the part of a list appended since it was mapped
+ *
+ * given:
+ *      l       open list
+ *
+ * returns:
+ *      true ==> more of the list was mapped, false ==> the list has not grown
+ *
+ * Only whole lines of a text list, or whole pairs of a binary list, are
+ * mapped, so a candidate still being appended is left for a later call.
+ * Candidates already parsed are not parsed again.
+ *
+ * This function does not return on error.
+ */
+bool
+hnlist_refresh(struct hnlist *l)
+{
+    struct stat buf;		/* list file status */
+    const unsigned char *map;	/* new mapping */
+    size_t len;			/* whole candidates in the new mapping */
+    int fd;			/* open list file */
+
+    /*
+     * firewall
+     */
+    if (l == NULL || l->path == NULL) {
+	err(136, __func__, "called with NULL arg(s)");
+	return false;	// NOT REACHED
+    }
+
+    /*
+     * nothing to do unless the list grew
+     */
+    errno = 0;
+    fd = open(l->path, O_RDONLY);
+    if (fd < 0) {
+	errp(136, __func__, "cannot open list: %s", l->path);
+	return false;	// NOT REACHED
+    }
+    errno = 0;
+    if (fstat(fd, &buf) < 0) {
+	errp(136, __func__, "cannot fstat list: %s", l->path);
+	return false;	// NOT REACHED
+    }
+    if ((size_t)buf.st_size <= l->len) {
+	(void) close(fd);
+	return false;
+    }
+    errno = 0;
+    map = mmap(NULL, (size_t)buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+	errp(136, __func__, "cannot mmap list: %s", l->path);
+	return false;	// NOT REACHED
+    }
+
+    /*
+     * a list that was empty may turn out to be binary
+     */
+    if (l->map == NULL && !l->binary && (size_t)buf.st_size >= HNLIST_MAGIC_LEN &&
+	memcmp(map, HNLIST_MAGIC, HNLIST_MAGIC_LEN) == 0) {
+	l->binary = true;
+	l->pos = HNLIST_MAGIC_LEN;
+    }
+
+    /*
+     * map only whole candidates
+     */
+    if (l->binary) {
+	len = (size_t)buf.st_size - ((size_t)buf.st_size - HNLIST_MAGIC_LEN) % HNLIST_PAIR_LEN;
+    } else {
+	for (len = (size_t)buf.st_size; len > 0 && map[len - 1] != '\n'; --len) {
+	}
+    }
+    (void) munmap((void *)map, (size_t)buf.st_size);
+    if (len <= l->len) {
+	(void) close(fd);
+	return false;
+    }
+    errno = 0;
+    map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+	errp(136, __func__, "cannot mmap list: %s", l->path);
+	return false;	// NOT REACHED
+    }
+    (void) close(fd);
+    if (l->map != NULL) {
+	(void) munmap((void *)l->map, l->len);
+    }
+    l->map = map;
+    l->len = len;
+    dbg(DBG_MED, "list: %s grew to %zu bytes", l->path, l->len);
+    return true;
+}
+
+
+/*
+ * hnlist_close - unmap a list
+ *
+ * given:
+ *      l       open list
+ */
+void
+hnlist_close(struct hnlist *l)
+{
+    if (l != NULL && l->map != NULL) {
+	(void) munmap((void *)l->map, l->len);
+	l->map = NULL;
+	l->len = 0;
+	l->pos = 0;
+    }
+    return;
+}
+
+
+/*
+ * hnlist_convert - write a list in the binary list format
+ *
+ * given:
+ *      list            text or binary list to convert
+ *      binfile         binary list to write
+ *
+ * returns:
+ *      number of h n pairs written
+ *
+ * This function does not return on error.
+ */
+unsigned long
+hnlist_convert(const char *list, const char *binfile)
+{
+    struct hnlist l;		/* list being converted */
+    FILE *stream;		/* open binfile */
+    unsigned long h;		/* multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+    uint64_t pair[2];		/* binary h n pair */
+    unsigned long count = 0;	/* pairs written */
+
+    /*
+     * firewall
+     */
+    if (list == NULL || binfile == NULL) {
+	err(134, __func__, "called with NULL arg(s)");
+	return 0;	// NOT REACHED
+    }
+
+    /*
+     * write the magic and then each pair
+     */
+    hnlist_open(&l, list);
+    errno = 0;
+    stream = fopen(binfile, "w");
+    if (stream == NULL) {
+	usage_errp(EXIT_USAGE, __func__, "cannot open binary list for writing: %s", binfile);
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    if (fwrite(HNLIST_MAGIC, HNLIST_MAGIC_LEN, 1, stream) != 1) {
+	errp(135, __func__, "error writing magic to: %s", binfile);
+	return 0;	// NOT REACHED
+    }
+    while (hnlist_next(&l, &h, &n)) {
+	pair[0] = htole64((uint64_t)h);
+	pair[1] = htole64((uint64_t)n);
+	if (fwrite(pair, sizeof(pair), 1, stream) != 1) {
+	    errp(135, __func__, "error writing pair %lu to: %s", count, binfile);
+	    return 0;	// NOT REACHED
+	}
+	++count;
+    }
+    errno = 0;
+    if (fclose(stream) != 0) {
+	errp(135, __func__, "error closing: %s", binfile);
+	return 0;	// NOT REACHED
+    }
+    hnlist_close(&l);
+    dbg(DBG_LOW, "wrote %lu h n pairs from %s to %s", count, list, binfile);
+    return count;
+}
+
+
+/*
+ * skip_blank - skip spaces, tabs and carriage returns, but not newlines
+ *
+ * given:
+ *      l       open text list
+ */
+static void
+skip_blank(struct hnlist *l)
+{
+    while (l->pos < l->len &&
+	   (l->map[l->pos] == ' ' || l->map[l->pos] == '\t' || l->map[l->pos] == '\r')) {
+	++l->pos;
+    }
+    return;
+}
+
+
+/*
+ * parse_ulong - parse a decimal unsigned long from a text list
+ *
+ * given:
+ *      l       open text list, pos at the first digit
+ *      val     where to store the value
+ *
+ * returns:
+ *      true ==> *val was set, false ==> no digits or overflow
+ */
+static bool
+parse_ulong(struct hnlist *l, unsigned long *val)
+{
+    static const unsigned long pow10[] = {
+	1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL, 100000000UL
+    };
+    unsigned long v = 0;	/* value being formed */
+    size_t start = l->pos;	/* first digit */
+    uint64_t word;		/* 8 bytes from the list */
+    uint64_t bad;		/* non-zero bytes are non-digits */
+    int k;			/* leading digits in word */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    /*
+     * 8 digits at a time while 8 bytes remain in the mapping
+     */
+    while (l->pos + sizeof(word) <= l->len) {
+	memcpy(&word, l->map + l->pos, sizeof(word));
+
+	/*
+	 * a byte is a digit when its high nibble is 3 both before and after adding 6
+	 *
+	 * A carry out of a byte only comes from a non-digit, and only spoils the
+	 * bytes after it, which we ignore.
+	 */
+	bad = ((word & HIGHS) ^ (ONES * 0x30)) | (((word + ONES * 0x06) & HIGHS) ^ (ONES * 0x30));
+	k = (bad == 0) ? 8 : (__builtin_ctzll(bad) / 8);
+	if (k == 0) {
+	    break;
+	}
+
+	/*
+	 * move the k digits to the top of the word: the bytes below become leading zeros
+	 */
+	if (k < 8) {
+	    word <<= 8 * (8 - k);
+	}
+	word &= ONES * 0x0F;
+	word = (word * 10 + (word >> 8)) & 0x00FF00FF00FF00FFULL;
+	word = (word * 100 + (word >> 16)) & 0x0000FFFF0000FFFFULL;
+	word = (word * 10000 + (word >> 32)) & 0x00000000FFFFFFFFULL;
+	if (__builtin_mul_overflow(v, pow10[k], &v) || __builtin_add_overflow(v, (unsigned long)word, &v)) {
+	    return false;
+	}
+	l->pos += k;
+	if (k < 8) {
+	    *val = v;
+	    return true;
+	}
+    }
+#endif
+
+    /*
+     * one digit at a time near the end of the mapping
+     */
+    while (l->pos < l->len && l->map[l->pos] >= '0' && l->map[l->pos] <= '9') {
+	if (__builtin_mul_overflow(v, 10UL, &v) ||
+	    __builtin_add_overflow(v, (unsigned long)(l->map[l->pos] - '0'), &v)) {
+	    return false;
+	}
+	++l->pos;
+    }
+    if (l->pos == start) {
+	return false;
+    }
+    *val = v;
+    return true;
+}
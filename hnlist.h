@@ -0,0 +1,68 @@
+/*
+ * hnlist - memory mapped list of h n candidates
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_HNLIST_H)
+#define INCLUDE_HNLIST_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * binary list format
+ *
+ * A binary list starts with the HNLIST_MAGIC bytes, followed by
+ * h and n pairs, each as a little endian 64-bit unsigned value.
+ */
+#define HNLIST_MAGIC		"gmprhn1\n"	// first bytes of a binary h n list
+#define HNLIST_MAGIC_LEN	(8)		// length of HNLIST_MAGIC
+#define HNLIST_PAIR_LEN		(16)		// length of a binary h n pair
+
+/*
+ * a memory mapped list being parsed
+ */
+struct hnlist {
+    const char *path;		/* list filename */
+    const unsigned char *map;	/* list contents, NULL ==> empty list */
+    size_t len;			/* length of map */
+    size_t pos;			/* next byte to parse */
+    bool binary;		/* true ==> binary list, false ==> "h n" lines */
+    unsigned long lineno;	/* line number being parsed in a text list */
+};
+
+/*
+ * external functions
+ */
+extern void hnlist_open(struct hnlist *l, const char *path);
+extern void hnlist_watch(struct hnlist *l, const char *path);
+extern bool hnlist_next(struct hnlist *l, unsigned long *h, unsigned long *n);
+extern bool hnlist_refresh(struct hnlist *l);
+extern void hnlist_close(struct hnlist *l);
+extern unsigned long hnlist_convert(const char *list, const char *binfile);
+
+#endif				/* INCLUDE_HNLIST_H */
@@ -0,0 +1,411 @@
+/*
+ * housekeep - run the periodic tasks of a test on a timer thread of its own
+ *
+ * The routine work that a test does every so often, such as starting a
+ * checkpoint interval, sampling whether the host is idle or measuring the
+ * rate of the test for the watchdog, used to be driven by interval timer
+ * signals or by a thread per task.  A signal interrupts the squaring thread,
+ * and any system call it was blocked in, for work that need not run there.
+ *
+ * Instead, each of these periodic tasks is a function run by a single
+ * housekeeping thread, which has every signal blocked and sleeps in
+ * epoll_wait() on a timerfd armed for the task due next.  A task only
+ * records what it found, say by setting checkpoint_alarm or an atomic flag,
+ * and the test acts on it at its next block of terms.
+ *
+ * A task function is given its arg and returns the seconds until it is next
+ * due, or < 0.0 when it is done.  Task functions run with the task table
+ * locked, so that housekeep_remove() returns only once the task is not
+ * running: they must be quick and must not call the housekeep_*() functions.
+ *
+ * The thread is started by the first housekeep_add().  It does not survive
+ * fork(), so the child of a fork starts with no tasks.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 50-59	housekeep.c - reserved for internal errors */
+
+#define _DEFAULT_SOURCE		/* for the timerfd_*() and epoll_*() declarations */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "gmprime.h"
+#include "debug.h"
+#include "housekeep.h"
+
+/*
+ * periodic tasks
+ */
+static struct housekeep_task {
+    const char *name;		/* task name, for debugging */
+    double (*fn)(void *arg);	/* task function, NULL ==> unused slot */
+    void *arg;			/* task function arg */
+    double due;			/* when the task is next due, monotonic seconds */
+} tasks[HOUSEKEEP_TASKS];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;	/* held while using tasks[] or running a task */
+static bool started = false;	/* true ==> the housekeeping thread is running */
+static bool atfork_set = false;	/* true ==> pthread_atfork() handlers are set */
+static int timer_fd = -1;	/* timerfd armed for the task due next */
+static int epoll_fd = -1;	/* epoll instance the thread waits in */
+
+/*
+ * static functions
+ */
+static void housekeep_start(void);
+static void housekeep_arm(void);
+static double housekeep_now(void);
+static void *housekeep_thread(void *arg);
+static void housekeep_prefork(void);
+static void housekeep_postfork(void);
+static void housekeep_postfork_child(void);
+
+
+/*
+ * housekeep_add - add a periodic task
+ *
+ * given:
+ *      name            task name, for debugging
+ *      fn              task function, returns the seconds until it is next due, < 0.0 ==> done
+ *      arg             task function arg
+ *      secs            seconds until the task is first due
+ *
+ * returns:
+ *      task number, for housekeep_wake() and housekeep_remove()
+ *
+ * This function does not return on error.
+ */
+int
+housekeep_add(const char *name, double (*fn)(void *arg), void *arg, double secs)
+{
+    int task;			/* task number */
+
+    /*
+     * firewall
+     */
+    if (name == NULL || fn == NULL) {
+	err(50, __func__, "called with NULL arg");
+	return -1;	// NOT REACHED
+    }
+
+    /*
+     * find a free slot, starting the thread if needed
+     */
+    (void) pthread_mutex_lock(&lock);
+    if (!started) {
+	housekeep_start();
+    }
+    for (task = 0; task < HOUSEKEEP_TASKS && tasks[task].fn != NULL; ++task) {
+    }
+    if (task >= HOUSEKEEP_TASKS) {
+	(void) pthread_mutex_unlock(&lock);
+	err(51, __func__, "more than %d periodic tasks, cannot add: %s", HOUSEKEEP_TASKS, name);
+	return -1;	// NOT REACHED
+    }
+    tasks[task].name = name;
+    tasks[task].fn = fn;
+    tasks[task].arg = arg;
+    tasks[task].due = housekeep_now() + (secs > 0.0 ? secs : 0.0);
+    housekeep_arm();
+    (void) pthread_mutex_unlock(&lock);
+    dbg(DBG_HIGH, "housekeeping task %d: %s first due in %.3f secs", task, name, secs);
+    return task;
+}
+
+
+/*
+ * housekeep_wake - change when a periodic task is next due
+ *
+ * given:
+ *      task            task number from housekeep_add()
+ *      secs            seconds until the task is due, 0.0 ==> now
+ */
+void
+housekeep_wake(int task, double secs)
+{
+    if (task < 0 || task >= HOUSEKEEP_TASKS) {
+	return;
+    }
+    (void) pthread_mutex_lock(&lock);
+    if (tasks[task].fn != NULL) {
+	tasks[task].due = housekeep_now() + (secs > 0.0 ? secs : 0.0);
+	housekeep_arm();
+    }
+    (void) pthread_mutex_unlock(&lock);
+    return;
+}
+
+
+/*
+ * housekeep_remove - remove a periodic task
+ *
+ * given:
+ *      task            task number from housekeep_add(), < 0 ==> none
+ *
+ * Once this function returns, the task function is not running and will not run again.
+ */
+void
+housekeep_remove(int task)
+{
+    if (task < 0 || task >= HOUSEKEEP_TASKS) {
+	return;
+    }
+    (void) pthread_mutex_lock(&lock);
+    if (tasks[task].fn != NULL) {
+	dbg(DBG_HIGH, "housekeeping task %d: %s removed", task, tasks[task].name);
+    }
+    memset(&tasks[task], 0, sizeof(tasks[task]));
+    housekeep_arm();
+    (void) pthread_mutex_unlock(&lock);
+    return;
+}
+
+
+/*
+ * housekeep_start - start the housekeeping thread
+ *
+ * The task table must be locked.
+ *
+ * This function does not return on error.
+ */
+static void
+housekeep_start(void)
+{
+    struct epoll_event ev;	/* timerfd event */
+    pthread_attr_t attr;	/* detached */
+    pthread_t tid;		/* housekeeping thread */
+    sigset_t all;		/* every signal */
+    sigset_t old;		/* signals blocked by the caller */
+    int ret;			/* return value */
+
+    /*
+     * the thread waits for the timer in epoll_wait()
+     */
+    errno = 0;
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if (timer_fd < 0) {
+	errp(52, __func__, "timerfd_create failed, errno: %d", errno);
+	return;	// NOT REACHED
+    }
+    errno = 0;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+	errp(52, __func__, "epoll_create1 failed, errno: %d", errno);
+	return;	// NOT REACHED
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = timer_fd;
+    errno = 0;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) < 0) {
+	errp(52, __func__, "epoll_ctl of the timerfd failed, errno: %d", errno);
+	return;	// NOT REACHED
+    }
+
+    /*
+     * a fork leaves the child without the thread, so the child starts over
+     */
+    if (!atfork_set) {
+	ret = pthread_atfork(housekeep_prefork, housekeep_postfork, housekeep_postfork_child);
+	if (ret != 0) {
+	    err(53, __func__, "pthread_atfork returned: %d", ret);
+	    return;	// NOT REACHED
+	}
+	atfork_set = true;
+    }
+
+    /*
+     * start the thread with every signal blocked, so that signals are still taken by the test thread
+     */
+    sigfillset(&all);
+    (void) pthread_sigmask(SIG_SETMASK, &all, &old);
+    (void) pthread_attr_init(&attr);
+    (void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&tid, &attr, housekeep_thread, NULL);
+    (void) pthread_attr_destroy(&attr);
+    (void) pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+	err(54, __func__, "pthread_create of housekeeping thread returned: %d", ret);
+	return;	// NOT REACHED
+    }
+    started = true;
+    dbg(DBG_MED, "started housekeeping thread");
+    return;
+}
+
+
+/*
+ * housekeep_arm - arm the timer for the task due next, or disarm it if there are none
+ *
+ * The task table must be locked.
+ */
+static void
+housekeep_arm(void)
+{
+    struct itimerspec its;	/* when the timer expires */
+    double due = -1.0;		/* when the next task is due, < 0.0 ==> no task */
+    int task;
+
+    for (task = 0; task < HOUSEKEEP_TASKS; ++task) {
+	if (tasks[task].fn != NULL && (due < 0.0 || tasks[task].due < due)) {
+	    due = tasks[task].due;
+	}
+    }
+    memset(&its, 0, sizeof(its));
+    if (due >= 0.0) {
+	its.it_value.tv_sec = (time_t)due;
+	its.it_value.tv_nsec = (long)((due - (double)its.it_value.tv_sec) * 1.0e9);
+	if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+	    its.it_value.tv_nsec = 1;	/* zero would disarm the timer */
+	}
+    }
+    if (timer_fd >= 0 && timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+	warnp(__func__, "timerfd_settime failed, errno: %d", errno);
+    }
+    return;
+}
+
+
+/*
+ * housekeep_now - seconds on the monotonic clock
+ */
+static double
+housekeep_now(void)
+{
+    struct timespec ts;		/* current time */
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+
+/*
+ * housekeep_thread - run each periodic task when it is due
+ *
+ * given:
+ *      arg     unused
+ *
+ * returns:
+ *      NULL, it never returns
+ */
+static void *
+housekeep_thread(void *arg)
+{
+    struct epoll_event ev;	/* ready event */
+    uint64_t expirations;	/* timer expirations */
+    double now;			/* time now */
+    double next;		/* seconds until the task is next due */
+    int task;
+
+    (void) arg;
+    for (;;) {
+
+	/*
+	 * wait for the timer
+	 */
+	if (epoll_wait(epoll_fd, &ev, 1, -1) < 0) {
+	    if (errno != EINTR) {
+		warnp(__func__, "epoll_wait failed, errno: %d", errno);
+		return NULL;
+	    }
+	    continue;
+	}
+	(void) read(timer_fd, &expirations, sizeof(expirations));
+
+	/*
+	 * run the tasks that are due
+	 */
+	(void) pthread_mutex_lock(&lock);
+	now = housekeep_now();
+	for (task = 0; task < HOUSEKEEP_TASKS; ++task) {
+	    if (tasks[task].fn == NULL || tasks[task].due > now) {
+		continue;
+	    }
+	    next = tasks[task].fn(tasks[task].arg);
+	    if (next < 0.0) {
+		dbg(DBG_HIGH, "housekeeping task %d: %s done", task, tasks[task].name);
+		memset(&tasks[task], 0, sizeof(tasks[task]));
+	    } else {
+		tasks[task].due = now + next;
+	    }
+	}
+	housekeep_arm();
+	(void) pthread_mutex_unlock(&lock);
+    }
+    return NULL;	// NOT REACHED
+}
+
+
+/*
+ * housekeep_prefork - hold the task table across a fork
+ */
+static void
+housekeep_prefork(void)
+{
+    (void) pthread_mutex_lock(&lock);
+    return;
+}
+
+
+/*
+ * housekeep_postfork - release the task table in the parent after a fork
+ */
+static void
+housekeep_postfork(void)
+{
+    (void) pthread_mutex_unlock(&lock);
+    return;
+}
+
+
+/*
+ * housekeep_postfork_child - start over without tasks in the child of a fork
+ */
+static void
+housekeep_postfork_child(void)
+{
+    memset(tasks, 0, sizeof(tasks));
+    if (timer_fd >= 0) {
+	(void) close(timer_fd);
+	timer_fd = -1;
+    }
+    if (epoll_fd >= 0) {
+	(void) close(epoll_fd);
+	epoll_fd = -1;
+    }
+    started = false;
+    (void) pthread_mutex_unlock(&lock);
+    return;
+}
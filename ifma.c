@@ -0,0 +1,556 @@
+/*
+ * ifma - AVX-512 IFMA radix 2^52 engine for medium sized h*2^n-1
+ *
+ * The u term is kept as L limbs of 52 bits, each in a 64-bit word.  The
+ * square is formed 8 columns at a time using the VPMADD52LUQ and VPMADD52HUQ
+ * instructions, which add the low and high 52 bits of a 52x52 bit product to
+ * a 64-bit accumulator.  Only the products a[i]*a[j] with i < j are formed:
+ * their sum is doubled and the squares a[i]*a[i] are added afterwards.
+ *
+ * A column accumulator receives at most L low halves and L high halves of
+ * (doubled) products, each < 2^52, so L must stay below 2^11 for the 64-bit
+ * accumulators not to overflow.  That is why IFMA_MAX_N is 100000.
+ * As the square is formed by the schoolbook method, GMP's sub-quadratic
+ * squaring catches up as n grows, so ENGINE_AUTO only selects this engine
+ * up to IFMA_AUTO_MAX_N.
+ *
+ * After the carries are propagated, the square is reduced mod h*2^n-1 in the
+ * same way as the GMP code in lucas.c:
+ *
+ *      u_term = u_term_sq_2 mod h*2^n-1 = int(J/h) + (J mod h)*(2^n) + K
+ *
+ * J is divided by h (< 2^32) 26 bits at a time using a multiply by a
+ * pre-computed reciprocal of h, followed by at most one correction.
+ *
+ * The u term is converted to and from GMP limbs only on import and export
+ * (see engine.h).
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 150-159	ifma.c - reserved for internal errors */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <gmp.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "debug.h"
+#include "engine.h"
+#include "ifma.h"
+
+#if defined(__x86_64__)
+
+__extension__ typedef unsigned __int128 ifma_u128;	/* 64x64 bit product */
+
+/*
+ * IFMA engine state
+ */
+struct ifma {
+    unsigned long h;		/* multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+    long L;			/* limbs in h*2^n-1 */
+    long q0;			/* limb holding bit n */
+    int s;			/* bit n within limb q0 */
+    uint64_t recip;		/* floor((2^64-1)/h) */
+    uint64_t *a_base;		/* allocated u term with zero padding */
+    uint64_t *a;		/* u term, L limbs, IFMA_PAD zero limbs before and after */
+    uint64_t *t_lo;		/* column sums of low product halves */
+    uint64_t *t_hi;		/* column sums of high product halves (belonging to the next column) */
+    uint64_t *p;		/* square, 2L+1 limbs */
+    uint64_t *q;		/* int(J/h), 2L+2 limbs */
+    uint64_t *r;		/* reduced value, L+2 limbs */
+    uint64_t *cand;		/* h*2^n-1, L+2 limbs */
+};
+
+/*
+ * static functions
+ */
+static void ifma_square(struct ifma *st) __attribute__((target("avx512f,avx512ifma")));
+static void ifma_reduce(struct ifma *st);
+static bool ifma_ge_cand(const struct ifma *st);
+static void ifma_to_limbs(const mpz_t z, uint64_t *x, long len);
+
+
+/*
+ * ifma_usable - determine if we can test h*2^n-1 on this host
+ */
+static bool
+ifma_usable(unsigned long h, unsigned long n)
+{
+    if (n < IFMA_MIN_N || n > IFMA_MAX_N || h >= (1UL << 32) || (h & 1) == 0) {
+	return false;
+    }
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma");
+}
+
+
+/*
+ * ifma_footprint - bytes ifma_setup() allocates for h*2^n-1
+ */
+static size_t
+ifma_footprint(unsigned long h, unsigned long n)
+{
+    size_t L;			/* limbs in h*2^n-1 */
+
+    L = (n + (unsigned long)(64 - __builtin_clzl(h)) + IFMA_BITS - 1) / IFMA_BITS;
+    return sizeof(struct ifma) + (11 * L + 4 * IFMA_PAD + 4 * IFMA_LANES + 8) * sizeof(uint64_t);
+}
+
+
+/*
+ * ifma_setup - allocate IFMA state for h*2^n-1
+ */
+static void *
+ifma_setup(unsigned long h, unsigned long n)
+{
+    struct ifma *st;		/* IFMA engine state */
+    mpz_t cand;			/* h*2^n-1 */
+    long cols;			/* square columns, rounded up to a multiple of IFMA_LANES */
+    long alen;			/* u term limbs with padding, rounded up to a multiple of IFMA_LANES */
+
+    errno = 0;
+    st = calloc(1, sizeof(struct ifma));
+    if (st == NULL) {
+	errp(150, __func__, "calloc of IFMA state failed");
+	return NULL;	// NOT REACHED
+    }
+    st->h = h;
+    st->n = n;
+    mpz_init(cand);
+    mpz_ui_pow_ui(cand, 2, n);
+    mpz_mul_ui(cand, cand, h);
+    mpz_sub_ui(cand, cand, 1);
+    st->L = (long)((mpz_sizeinbase(cand, 2) + IFMA_BITS - 1) / IFMA_BITS);
+    st->q0 = (long)(n / IFMA_BITS);
+    st->s = (int)(n % IFMA_BITS);
+    st->recip = UINT64_MAX / h;
+
+    /*
+     * allocate limb arrays
+     */
+    cols = ((2 * st->L + 1) + IFMA_LANES - 1) / IFMA_LANES * IFMA_LANES;
+    alen = (st->L + 4 * IFMA_PAD + IFMA_LANES - 1) / IFMA_LANES * IFMA_LANES;
+    errno = 0;
+    st->a_base = aligned_alloc(64, alen * sizeof(uint64_t));
+    st->t_lo = aligned_alloc(64, (cols + IFMA_PAD) * sizeof(uint64_t));
+    st->t_hi = aligned_alloc(64, (cols + IFMA_PAD) * sizeof(uint64_t));
+    st->p = calloc(cols + IFMA_PAD, sizeof(uint64_t));
+    st->q = calloc(2 * st->L + 2, sizeof(uint64_t));
+    st->r = calloc(st->L + 2, sizeof(uint64_t));
+    st->cand = calloc(st->L + 2, sizeof(uint64_t));
+    if (st->a_base == NULL || st->t_lo == NULL || st->t_hi == NULL ||
+	st->p == NULL || st->q == NULL || st->r == NULL || st->cand == NULL) {
+	errp(151, __func__, "allocation of IFMA limbs for L: %ld failed", st->L);
+	return NULL;	// NOT REACHED
+    }
+    memset(st->a_base, 0, alen * sizeof(uint64_t));
+    memset(st->t_lo, 0, (cols + IFMA_PAD) * sizeof(uint64_t));
+    memset(st->t_hi, 0, (cols + IFMA_PAD) * sizeof(uint64_t));
+    st->a = st->a_base + IFMA_PAD;
+    ifma_to_limbs(cand, st->cand, st->L + 2);
+    mpz_clear(cand);
+    dbg(DBG_MED, "IFMA setup for %lu*2^%lu-1: %ld limbs of %d bits", h, n, st->L, IFMA_BITS);
+    return st;
+}
+
+
+/*
+ * ifma_import - load U(i)
+ *
+ * A negative U(i) (as the GMP code can leave after U(i) of 0 or 1) is replaced by U(i) + h*2^n-1.
+ */
+static void
+ifma_import(void *state, const mpz_t u_term)
+{
+    struct ifma *st = state;	/* IFMA engine state */
+    mpz_t u;			/* U(i) mod h*2^n-1 */
+    mpz_t cand;			/* h*2^n-1 */
+
+    mpz_init(u);
+    mpz_init(cand);
+    mpz_ui_pow_ui(cand, 2, st->n);
+    mpz_mul_ui(cand, cand, st->h);
+    mpz_sub_ui(cand, cand, 1);
+    mpz_mod(u, u_term, cand);
+    memset(st->a, 0, st->L * sizeof(uint64_t));
+    ifma_to_limbs(u, st->a, st->L);
+    mpz_clear(u);
+    mpz_clear(cand);
+    return;
+}
+
+
+/*
+ * ifma_step - advance count terms
+ */
+static void
+ifma_step(void *state, unsigned long count)
+{
+    struct ifma *st = state;	/* IFMA engine state */
+    unsigned long k;		/* term count */
+
+    for (k = 0; k < count; ++k) {
+	ifma_square(st);
+	ifma_reduce(st);
+    }
+    return;
+}
+
+
+/*
+ * ifma_export - store U(i)
+ */
+static void
+ifma_export(void *state, mpz_t u_term)
+{
+    struct ifma *st = state;	/* IFMA engine state */
+
+    mpz_import(u_term, st->L, -1, sizeof(uint64_t), 0, 64 - IFMA_BITS, st->a);
+    return;
+}
+
+
+/*
+ * ifma_cleanup - free IFMA state
+ */
+static void
+ifma_cleanup(void *state)
+{
+    struct ifma *st = state;	/* IFMA engine state */
+
+    if (st != NULL) {
+	free(st->a_base);
+	free(st->t_lo);
+	free(st->t_hi);
+	free(st->p);
+	free(st->q);
+	free(st->r);
+	free(st->cand);
+	free(st);
+    }
+    return;
+}
+
+
+/*
+ * ifma_square - form p = a^2 as 2L+1 normalized limbs
+ */
+static void
+ifma_square(struct ifma *st)
+{
+    const uint64_t *a = st->a;	/* u term */
+    long L = st->L;		/* limbs in u */
+    long k0;			/* first column of a block */
+    long i;			/* row */
+    long i_lo;			/* first row with a product in this block */
+    long i_mid;			/* first row that needs a lane mask */
+    long i_hi;			/* last row with a cross product in this block */
+    long c;			/* column */
+    uint64_t carry;		/* carry into column c */
+    uint64_t sum;		/* column sum */
+    uint64_t hi;		/* high halves from column c-1 */
+
+    /*
+     * form the column sums 8 columns at a time
+     */
+    for (k0 = 0; k0 < 2 * L; k0 += IFMA_LANES) {
+	__m512i lo0 = _mm512_setzero_si512();
+	__m512i lo1 = _mm512_setzero_si512();
+	__m512i lo2 = _mm512_setzero_si512();
+	__m512i lo3 = _mm512_setzero_si512();
+	__m512i hi0 = _mm512_setzero_si512();
+	__m512i hi1 = _mm512_setzero_si512();
+	__m512i hi2 = _mm512_setzero_si512();
+	__m512i hi3 = _mm512_setzero_si512();
+	__m512i d;
+
+	/*
+	 * rows i with a[i]*a[j] in this block, i < j for every lane, four at a time
+	 *
+	 * Separate accumulators hide the latency of the multiply-add.
+	 */
+	i_lo = (k0 - L + 1 > 0) ? k0 - L + 1 : 0;
+	i_mid = (k0 + 1) / 2;
+	for (i = i_lo; i + 3 < i_mid; i += 4) {
+	    __m512i b0 = _mm512_set1_epi64((long long)a[i]);
+	    __m512i v0 = _mm512_loadu_si512((const void *)(a + k0 - i));
+	    __m512i b1 = _mm512_set1_epi64((long long)a[i + 1]);
+	    __m512i v1 = _mm512_loadu_si512((const void *)(a + k0 - i - 1));
+	    __m512i b2 = _mm512_set1_epi64((long long)a[i + 2]);
+	    __m512i v2 = _mm512_loadu_si512((const void *)(a + k0 - i - 2));
+	    __m512i b3 = _mm512_set1_epi64((long long)a[i + 3]);
+	    __m512i v3 = _mm512_loadu_si512((const void *)(a + k0 - i - 3));
+	    lo0 = _mm512_madd52lo_epu64(lo0, b0, v0);
+	    hi0 = _mm512_madd52hi_epu64(hi0, b0, v0);
+	    lo1 = _mm512_madd52lo_epu64(lo1, b1, v1);
+	    hi1 = _mm512_madd52hi_epu64(hi1, b1, v1);
+	    lo2 = _mm512_madd52lo_epu64(lo2, b2, v2);
+	    hi2 = _mm512_madd52hi_epu64(hi2, b2, v2);
+	    lo3 = _mm512_madd52lo_epu64(lo3, b3, v3);
+	    hi3 = _mm512_madd52hi_epu64(hi3, b3, v3);
+	}
+	for (; i < i_mid; ++i) {
+	    __m512i b0 = _mm512_set1_epi64((long long)a[i]);
+	    __m512i v0 = _mm512_loadu_si512((const void *)(a + k0 - i));
+	    lo0 = _mm512_madd52lo_epu64(lo0, b0, v0);
+	    hi0 = _mm512_madd52hi_epu64(hi0, b0, v0);
+	}
+
+	/*
+	 * rows near the diagonal: lane t only takes a[i]*a[k0+t-i] when 2*i < k0+t
+	 */
+	i_hi = (k0 + IFMA_LANES - 2) / 2;
+	for (i = (i_mid > i_lo) ? i_mid : i_lo; i <= i_hi; ++i) {
+	    __mmask8 m = (__mmask8)(0xff << (2 * i - k0 + 1));
+	    __m512i b0 = _mm512_set1_epi64((long long)a[i]);
+	    __m512i v0 = _mm512_loadu_si512((const void *)(a + k0 - i));
+	    lo0 = _mm512_mask_madd52lo_epu64(lo0, m, b0, v0);
+	    hi0 = _mm512_mask_madd52hi_epu64(hi0, m, b0, v0);
+	}
+
+	/*
+	 * double the cross products and add the squares on the diagonal (even lanes)
+	 */
+	lo0 = _mm512_add_epi64(_mm512_add_epi64(lo0, lo1), _mm512_add_epi64(lo2, lo3));
+	hi0 = _mm512_add_epi64(_mm512_add_epi64(hi0, hi1), _mm512_add_epi64(hi2, hi3));
+	lo0 = _mm512_add_epi64(lo0, lo0);
+	hi0 = _mm512_add_epi64(hi0, hi0);
+	d = _mm512_maskz_expandloadu_epi64(0x55, (const void *)(a + k0 / 2));
+	lo0 = _mm512_madd52lo_epu64(lo0, d, d);
+	hi0 = _mm512_madd52hi_epu64(hi0, d, d);
+	_mm512_store_si512((void *)(st->t_lo + k0), lo0);
+	_mm512_store_si512((void *)(st->t_hi + k0), hi0);
+    }
+
+    /*
+     * propagate carries: column c is t_lo[c] + t_hi[c-1]
+     */
+    carry = 0;
+    hi = 0;
+    for (c = 0; c <= 2 * L; ++c) {
+	uint64_t lo = (c < 2 * L) ? st->t_lo[c] : 0;
+	sum = (lo & IFMA_MASK) + (hi & IFMA_MASK) + carry;
+	st->p[c] = sum & IFMA_MASK;
+	carry = (sum >> IFMA_BITS) + (lo >> IFMA_BITS) + (hi >> IFMA_BITS);
+	hi = (c < 2 * L) ? st->t_hi[c] : 0;
+    }
+    return;
+}
+
+
+/*
+ * ifma_reduce - a = (p - 2) mod h*2^n-1
+ */
+static void
+ifma_reduce(struct ifma *st)
+{
+    uint64_t *p = st->p;	/* square */
+    uint64_t *q = st->q;	/* int(J/h) as 26 bit digit pairs */
+    uint64_t *r = st->r;	/* reduced value */
+    long L = st->L;		/* limbs in h*2^n-1 */
+    long q0 = st->q0;		/* limb holding bit n */
+    int s = st->s;		/* bit n within limb q0 */
+    uint64_t h = st->h;		/* multiplier of 2 */
+    uint64_t recip = st->recip;	/* floor((2^64-1)/h) */
+    uint64_t rem;		/* J mod h, possibly + h */
+    uint64_t x;			/* partial dividend */
+    uint64_t d0;		/* high 26 bit quotient digit */
+    uint64_t d1;		/* low 26 bit quotient digit */
+    uint64_t j;			/* limb of J */
+    uint64_t carry;		/* carry or borrow */
+    uint64_t t;			/* temporary */
+    long jlen;			/* limbs in J */
+    long c;			/* limb index */
+
+    /*
+     * p -= 2, unless U(i) is 0 or 1 where (U(i)^2 - 2) mod h*2^n-1 is h*2^n-1 - 2 or - 1
+     */
+    if (p[0] < 2) {
+	for (c = 1; c <= 2 * L && p[c] == 0; ++c) {
+	}
+	if (c > 2 * L) {
+	    /* n >= IFMA_MIN_N so the low limb of h*2^n-1 is all 1 bits */
+	    memcpy(st->a, st->cand, L * sizeof(uint64_t));
+	    st->a[0] -= 2 - p[0];
+	    return;
+	}
+    }
+    t = p[0] - 2;
+    p[0] = t & IFMA_MASK;
+    for (c = 1; (t >> 63) != 0; ++c) {
+	t = p[c] - 1;
+	p[c] = t & IFMA_MASK;
+    }
+
+    /*
+     * J = p >> n, divided by h from the top, 26 bits at a time
+     *
+     * The remainder is only corrected at the end: while it is < 2*h, each
+     * estimated digit is < 2^27 and the estimate is never above the quotient.
+     */
+    jlen = 2 * L + 1 - q0;
+    rem = 0;
+    if (h == 1) {
+	for (c = 0; c < jlen; ++c) {
+	    q[c] = (p[q0 + c] >> s) | ((p[q0 + c + 1] << (IFMA_BITS - s)) & IFMA_MASK);
+	}
+    } else {
+	for (c = jlen - 1; c >= 0; --c) {
+	    j = (p[q0 + c] >> s) | ((p[q0 + c + 1] << (IFMA_BITS - s)) & IFMA_MASK);
+	    x = (rem << 26) | (j >> 26);
+	    d0 = (uint64_t)(((ifma_u128)x * recip) >> 64);
+	    rem = x - d0 * h;
+	    x = (rem << 26) | (j & ((1ULL << 26) - 1));
+	    d1 = (uint64_t)(((ifma_u128)x * recip) >> 64);
+	    rem = x - d1 * h;
+	    q[c] = (d0 << 26) + d1;
+	}
+	while (rem >= h) {
+	    rem -= h;
+	    ++q[0];
+	}
+    }
+
+    /*
+     * r = K + int(J/h) + (J mod h)*(2^n)
+     *
+     * int(J/h) < 2*(h*2^n-1) so only its limbs below L+1 are non-zero.
+     */
+    carry = 0;
+    for (c = 0; c < q0; ++c) {
+	carry += p[c] + q[c];
+	r[c] = carry & IFMA_MASK;
+	carry >>= IFMA_BITS;
+    }
+    carry += (p[q0] & ((1ULL << s) - 1)) + q[q0] + ((rem << s) & IFMA_MASK);
+    r[q0] = carry & IFMA_MASK;
+    carry >>= IFMA_BITS;
+    carry += rem >> (IFMA_BITS - s);	// (J mod h)*(2^n) may spill into the next limb
+    for (c = q0 + 1; c < L + 2; ++c) {
+	carry += (c < jlen) ? q[c] : 0;
+	r[c] = carry & IFMA_MASK;
+	carry >>= IFMA_BITS;
+    }
+
+    /*
+     * subtract h*2^n-1 while r >= h*2^n-1
+     */
+    while (ifma_ge_cand(st)) {
+	carry = 0;
+	for (c = 0; c < L + 2; ++c) {
+	    t = r[c] - st->cand[c] - carry;
+	    r[c] = t & IFMA_MASK;
+	    carry = t >> 63;
+	}
+    }
+    memcpy(st->a, r, L * sizeof(uint64_t));
+    return;
+}
+
+
+/*
+ * ifma_ge_cand - determine if r >= h*2^n-1
+ */
+static bool
+ifma_ge_cand(const struct ifma *st)
+{
+    long c;		/* limb index */
+
+    for (c = st->L + 1; c >= 0; --c) {
+	if (st->r[c] != st->cand[c]) {
+	    return st->r[c] > st->cand[c];
+	}
+    }
+    return true;
+}
+
+
+/*
+ * ifma_to_limbs - convert a non-negative mpz_t into 52-bit limbs
+ */
+static void
+ifma_to_limbs(const mpz_t z, uint64_t *x, long len)
+{
+    size_t count = 0;	/* limbs written */
+
+    if ((long)((mpz_sizeinbase(z, 2) + IFMA_BITS - 1) / IFMA_BITS) > len) {
+	err(152, __func__, "value does not fit in %ld limbs", len);
+	return;	// NOT REACHED
+    }
+    memset(x, 0, len * sizeof(uint64_t));
+    mpz_export(x, &count, -1, sizeof(uint64_t), 0, 64 - IFMA_BITS, z);
+    return;
+}
+
+#else				/* __x86_64__ */
+
+static bool
+ifma_usable(unsigned long h, unsigned long n)
+{
+    return false;
+}
+
+static size_t
+ifma_footprint(unsigned long h, unsigned long n)
+{
+    return 0;
+}
+
+static void *
+ifma_setup(unsigned long h, unsigned long n)
+{
+    err(153, __func__, "IFMA engine is not supported on this architecture");
+    return NULL;	// NOT REACHED
+}
+
+static void ifma_import(void *state, const mpz_t u_term) { }
+static void ifma_step(void *state, unsigned long count) { }
+static void ifma_export(void *state, mpz_t u_term) { }
+static void ifma_cleanup(void *state) { }
+
+#endif				/* __x86_64__ */
+
+/*
+ * IFMA engine
+ */
+const struct engine ifma_engine = {
+    "ifma",
+    IFMA_MIN_N,
+    IFMA_AUTO_MAX_N,
+    ifma_usable,
+    ifma_footprint,
+    ifma_setup,
+    ifma_import,
+    ifma_step,
+    ifma_export,
+    ifma_cleanup
+};
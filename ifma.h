@@ -0,0 +1,44 @@
+/*
+ * ifma - AVX-512 IFMA radix 2^52 engine for medium sized h*2^n-1
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_IFMA_H)
+#define INCLUDE_IFMA_H
+
+/*
+ * IFMA constants
+ */
+#define IFMA_BITS	(52)			// bits per limb
+#define IFMA_MASK	((1ULL << IFMA_BITS) - 1)	// limb mask
+#define IFMA_LANES	(8)			// 64-bit lanes in a 512-bit vector
+#define IFMA_PAD	(8)			// zero limbs on either side of the u term
+#define IFMA_MIN_N	(2000)			// below this size, GMP is as fast
+#define IFMA_AUTO_MAX_N	(60000)			// above this size, GMP sub-quadratic squaring is usually faster
+#define IFMA_MAX_N	(100000)		// above this size, column sums could overflow
+
+#endif				/* INCLUDE_IFMA_H */
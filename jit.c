@@ -0,0 +1,452 @@
+/*
+ * jit - engine compiled at runtime for a single h*2^n-1
+ *
+ * A test runs one fixed h and n for n-2 terms.  The GMP code in lucas.c
+ * treats h and n as runtime values and each mpz_t call re-checks sizes,
+ * signs and allocations.  This engine writes C source for a kernel in
+ * which h, the limb count of h*2^n-1, the limb and bit offset of n, and the
+ * limbs of h*2^n-1 itself are constants.  The compiler then turns the
+ * division by h into a multiply by its reciprocal, and the fixed length
+ * copies and carry chains into straight line code.
+ *
+ * The kernel is compiled with the host compiler (see JIT_CC_ENV and
+ * JIT_CFLAGS in jit.h) into a shared object that is loaded with dlopen().
+ * The source and the object are removed once they are loaded.  If the
+ * kernel cannot be built or loaded, we fall back to the GMP code.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 160-169	jit.c - reserved for internal errors */
+
+#define _DEFAULT_SOURCE		/* for mkdtemp() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <gmp.h>
+
+#include "debug.h"
+#include "engine.h"
+#include "jit.h"
+
+/*
+ * the kernel source
+ *
+ * jit_write_source() defines H, HINV (1/h mod 2^64), B1 to B4 (2^64 to 2^256 mod h),
+ * N, LN (limbs in h*2^n-1), Q0 (limb holding bit n), S (bit n within limb Q0) and
+ * cand[] (h*2^n-1) ahead of this text.
+ */
+static const char *kernel =
+    "#include <string.h>\n"
+    "#include <gmp.h>\n"
+    "\n"
+    "#define JLEN (2 * LN - Q0)	/* limbs in J */\n"
+    "#if S > 0\n"
+    "#define J(c) ((p[Q0 + (c)] >> S) | (p[Q0 + (c) + 1] << (64 - S)))	/* limb c of J = p >> n */\n"
+    "#else\n"
+    "#define J(c) (p[Q0 + (c)])\n"
+    "#endif\n"
+    "\n"
+    "/*\n"
+    " * jit_step - advance count terms: u = (u^2 - 2) mod h*2^n-1\n"
+    " *\n"
+    " * scratch must have room for 3*LN + 2 limbs.\n"
+    " */\n"
+    "void\n"
+    "jit_step(mp_limb_t *u, mp_limb_t *scratch, unsigned long count)\n"
+    "{\n"
+    "    mp_limb_t *p = scratch;		/* square, 2*LN limbs and a 0 limb */\n"
+    "    mp_limb_t *r = p + 2 * LN + 1;	/* reduced value, LN + 1 limbs */\n"
+    "    mp_limb_t rem;			/* J mod h */\n"
+    "    mp_limb_t q;			/* limb of int(J/h) */\n"
+    "    mp_limb_t bw;			/* borrow of the exact division */\n"
+    "    unsigned __int128 sum;		/* limb sum and carry */\n"
+    "    unsigned long k;\n"
+    "    long c;\n"
+    "\n"
+    "    p[2 * LN] = 0;\n"
+    "    for (k = 0; k < count; ++k) {\n"
+    "\n"
+    "	/* u^2 - 2, where u of 0 or 1 gives h*2^n-1 - 2 or - 1 */\n"
+    "	mpn_sqr(p, u, LN);\n"
+    "	if (mpn_sub_1(p, p, 2 * LN, 2) != 0) {\n"
+    "	    mpn_sub_1(u, cand, LN, (mp_limb_t)(0 - p[0]));\n"
+    "	    continue;\n"
+    "	}\n"
+    "\n"
+    "	/* r = K, the bottom n bits */\n"
+    "	memcpy(r, p, (Q0 + 1) * sizeof(mp_limb_t));\n"
+    "	r[Q0] &= (((mp_limb_t)1) << S) - 1;\n"
+    "	memset(r + Q0 + 1, 0, (LN - Q0) * sizeof(mp_limb_t));\n"
+    "\n"
+    "#if H > 1\n"
+    "	/* J mod h: four independent Horner chains in 2^256, the compiler turns % H into multiplies */\n"
+    "	{\n"
+    "	    mp_limb_t acc[4] = {0, 0, 0, 0};\n"
+    "	    for (c = JLEN - 1; c >= JLEN - (JLEN % 4); --c) {\n"
+    "		acc[c % 4] = J(c) % H;\n"
+    "	    }\n"
+    "	    for (c = (JLEN / 4 - 1) * 4; c >= 0; c -= 4) {\n"
+    "		acc[0] = (acc[0] * B4 + J(c) % H) % H;\n"
+    "		acc[1] = (acc[1] * B4 + J(c + 1) % H) % H;\n"
+    "		acc[2] = (acc[2] * B4 + J(c + 2) % H) % H;\n"
+    "		acc[3] = (acc[3] * B4 + J(c + 3) % H) % H;\n"
+    "	    }\n"
+    "	    rem = (acc[0] + acc[1] * B1 % H + acc[2] * B2 % H + acc[3] * B3 % H) % H;\n"
+    "	}\n"
+    "#else\n"
+    "	rem = 0;\n"
+    "#endif\n"
+    "\n"
+    "	/* r += int(J/h), exact division of J - J mod h by multiplying with 1/h mod 2^64 */\n"
+    "	bw = rem;\n"
+    "	sum = 0;\n"
+    "	for (c = 0; c <= LN; ++c) {\n"
+    "#if H > 1\n"
+    "	    mp_limb_t j = J(c);\n"
+    "	    q = (j - bw) * HINV;\n"
+    "	    bw = (mp_limb_t)(((unsigned __int128)q * H) >> 64) + (j < bw);\n"
+    "#else\n"
+    "	    q = J(c);\n"
+    "#endif\n"
+    "	    sum += (unsigned __int128)r[c] + q;\n"
+    "	    r[c] = (mp_limb_t)sum;\n"
+    "	    sum >>= 64;\n"
+    "	}\n"
+    "\n"
+    "	/* r += (J mod h)*(2^n), int(J/h) < 2*(h*2^n-1) */\n"
+    "	mpn_add_1(r + Q0, r + Q0, LN + 1 - Q0, rem << S);\n"
+    "#if S > 32\n"
+    "	mpn_add_1(r + Q0 + 1, r + Q0 + 1, LN - Q0, rem >> (64 - S));\n"
+    "#endif\n"
+    "\n"
+    "	/* subtract h*2^n-1 while r >= h*2^n-1 */\n"
+    "	while (r[LN] != 0 || mpn_cmp(r, cand, LN) >= 0) {\n"
+    "	    r[LN] -= mpn_sub_n(r, r, cand, LN);\n"
+    "	}\n"
+    "	memcpy(u, r, LN * sizeof(mp_limb_t));\n"
+    "    }\n"
+    "}\n";
+
+/*
+ * kernel function
+ */
+typedef void (*jit_step_t)(mp_limb_t *u, mp_limb_t *scratch, unsigned long count);
+
+/*
+ * JIT engine state
+ */
+struct jit {
+    unsigned long h;		/* multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+    mp_size_t ln;		/* limbs in h*2^n-1 */
+    mpz_t cand;			/* h*2^n-1 */
+    mp_limb_t *u;		/* u term, ln limbs */
+    mp_limb_t *scratch;		/* kernel scratch, 3*ln + 2 limbs */
+    void *handle;		/* dlopen() handle */
+    jit_step_t step;		/* compiled kernel */
+};
+
+/*
+ * static functions
+ */
+static bool jit_write_source(const char *path, struct jit *st);
+
+
+/*
+ * jit_usable - determine if we can test h*2^n-1 on this host
+ *
+ * The kernel uses 64-bit limbs and divides 32 bits at a time, so h must be < 2^32.
+ */
+static bool
+jit_usable(unsigned long h, unsigned long n)
+{
+    return GMP_NUMB_BITS == 64 && h < (1UL << 32) && (h & 1) == 1 && n >= 64;
+}
+
+
+/*
+ * jit_footprint - bytes jit_setup() allocates for h*2^n-1, including the limbs baked into the kernel
+ */
+static size_t
+jit_footprint(unsigned long h, unsigned long n)
+{
+    size_t ln;			/* limbs in h*2^n-1 */
+
+    ln = (n + (unsigned long)(64 - __builtin_clzl(h)) + 63) / 64;
+    return sizeof(struct jit) + (6 * ln + 2) * sizeof(mp_limb_t);
+}
+
+
+/*
+ * jit_setup - compile and load a kernel for h*2^n-1
+ *
+ * returns:
+ *      JIT engine state, NULL ==> kernel could not be built, use the GMP code
+ */
+static void *
+jit_setup(unsigned long h, unsigned long n)
+{
+    struct jit *st;			/* JIT engine state */
+    char dir[] = "/tmp/gmprime-jit.XXXXXX";	/* where the kernel is built */
+    char src[sizeof(dir) + BUFSIZ];	/* kernel source */
+    char obj[sizeof(dir) + BUFSIZ];	/* kernel shared object */
+    char cmd[3 * BUFSIZ];		/* compile command */
+    const char *cc;			/* compiler */
+    int ret;				/* system() return */
+
+    /*
+     * setup state
+     */
+    errno = 0;
+    st = calloc(1, sizeof(struct jit));
+    if (st == NULL) {
+	errp(160, __func__, "calloc of JIT state failed");
+	return NULL;	// NOT REACHED
+    }
+    st->h = h;
+    st->n = n;
+    mpz_init(st->cand);
+    mpz_ui_pow_ui(st->cand, 2, n);
+    mpz_mul_ui(st->cand, st->cand, h);
+    mpz_sub_ui(st->cand, st->cand, 1);
+    st->ln = mpz_size(st->cand);
+    errno = 0;
+    st->u = calloc(st->ln, sizeof(mp_limb_t));
+    st->scratch = calloc(3 * st->ln + 2, sizeof(mp_limb_t));
+    if (st->u == NULL || st->scratch == NULL) {
+	errp(161, __func__, "calloc of JIT limbs for %ld limbs failed", (long)st->ln);
+	return NULL;	// NOT REACHED
+    }
+
+    /*
+     * write and compile the kernel
+     */
+    if (mkdtemp(dir) == NULL) {
+	warnp(__func__, "cannot create JIT directory");
+	goto fallback;
+    }
+    snprintf(src, sizeof(src), "%s/kernel.c", dir);
+    snprintf(obj, sizeof(obj), "%s/kernel.so", dir);
+    if (!jit_write_source(src, st)) {
+	goto remove;
+    }
+    cc = getenv(JIT_CC_ENV);
+    if (cc == NULL || cc[0] == '\0') {
+	cc = JIT_DEF_CC;
+    }
+    snprintf(cmd, sizeof(cmd), "%s %s -o '%s' '%s' -lgmp%s", cc, JIT_CFLAGS, obj, src,
+	     (debuglevel >= DBG_MED) ? "" : " >/dev/null 2>&1");
+    dbg(DBG_MED, "compiling JIT kernel: %s", cmd);
+    fflush(stdout);
+    debug_flush();
+    ret = system(cmd);
+    if (ret != 0) {
+	warn(__func__, "JIT kernel compile failed, status: %d", ret);
+	goto remove;
+    }
+
+    /*
+     * load the kernel
+     */
+    st->handle = dlopen(obj, RTLD_NOW | RTLD_LOCAL);
+    if (st->handle == NULL) {
+	warn(__func__, "cannot load JIT kernel: %s", dlerror());
+	goto remove;
+    }
+    *(void **)(&st->step) = dlsym(st->handle, JIT_STEP_SYM);	// POSIX dlsym() idiom for function pointers
+    if (st->step == NULL) {
+	warn(__func__, "JIT kernel has no %s", JIT_STEP_SYM);
+	goto remove;
+    }
+    (void) unlink(src);
+    (void) unlink(obj);
+    (void) rmdir(dir);
+    dbg(DBG_LOW, "JIT kernel for %lu*2^%lu-1 loaded", h, n);
+    return st;
+
+    /*
+     * we cannot use a kernel
+     */
+remove:
+    (void) unlink(src);
+    (void) unlink(obj);
+    (void) rmdir(dir);
+fallback:
+    if (st->handle != NULL) {
+	(void) dlclose(st->handle);
+    }
+    mpz_clear(st->cand);
+    free(st->u);
+    free(st->scratch);
+    free(st);
+    return NULL;
+}
+
+
+/*
+ * jit_import - load U(i)
+ *
+ * A negative U(i) (as the GMP code can leave after U(i) of 0 or 1) is replaced by U(i) + h*2^n-1.
+ */
+static void
+jit_import(void *state, const mpz_t u_term)
+{
+    struct jit *st = state;	/* JIT engine state */
+    mpz_t u;			/* U(i) mod h*2^n-1 */
+
+    mpz_init(u);
+    mpz_mod(u, u_term, st->cand);
+    memset(st->u, 0, st->ln * sizeof(mp_limb_t));
+    mpz_export(st->u, NULL, -1, sizeof(mp_limb_t), 0, 0, u);
+    mpz_clear(u);
+    return;
+}
+
+
+/*
+ * jit_step - advance count terms
+ */
+static void
+jit_step(void *state, unsigned long count)
+{
+    struct jit *st = state;	/* JIT engine state */
+
+    st->step(st->u, st->scratch, count);
+    return;
+}
+
+
+/*
+ * jit_export - store U(i)
+ */
+static void
+jit_export(void *state, mpz_t u_term)
+{
+    struct jit *st = state;	/* JIT engine state */
+
+    mpz_import(u_term, st->ln, -1, sizeof(mp_limb_t), 0, 0, st->u);
+    return;
+}
+
+
+/*
+ * jit_cleanup - unload the kernel and free JIT state
+ */
+static void
+jit_cleanup(void *state)
+{
+    struct jit *st = state;	/* JIT engine state */
+
+    if (st != NULL) {
+	(void) dlclose(st->handle);
+	mpz_clear(st->cand);
+	free(st->u);
+	free(st->scratch);
+	free(st);
+    }
+    return;
+}
+
+
+/*
+ * jit_write_source - write the kernel source for h*2^n-1
+ *
+ * given:
+ *      path    where to write the source
+ *      st      JIT engine state
+ *
+ * returns:
+ *      true ==> source written, false ==> write failed
+ */
+static bool
+jit_write_source(const char *path, struct jit *st)
+{
+    FILE *stream;		/* open kernel source */
+    mp_size_t c;		/* limb index */
+    unsigned long hinv;		/* 1/h mod 2^64 */
+    unsigned long b1;		/* 2^64 mod h */
+    int i;
+
+    /*
+     * 1/h mod 2^64 by Newton iteration, each iteration doubles the correct low bits
+     */
+    hinv = st->h;
+    for (i = 0; i < 5; ++i) {
+	hinv *= 2 - st->h * hinv;
+    }
+    b1 = (ULONG_MAX % st->h + 1) % st->h;
+
+    errno = 0;
+    stream = fopen(path, "w");
+    if (stream == NULL) {
+	warnp(__func__, "cannot create JIT source: %s", path);
+	return false;
+    }
+    fprintf(stream, "/* gmprime kernel for %lu*2^%lu-1 */\n", st->h, st->n);
+    fprintf(stream, "#define H %luUL\n", st->h);
+    fprintf(stream, "#define HINV 0x%016lxUL\n", hinv);
+    fprintf(stream, "#define B1 %luUL\n", b1);
+    fprintf(stream, "#define B2 %luUL\n", b1 * b1 % st->h);
+    fprintf(stream, "#define B3 %luUL\n", b1 * b1 % st->h * b1 % st->h);
+    fprintf(stream, "#define B4 %luUL\n", b1 * b1 % st->h * b1 % st->h * b1 % st->h);
+    fprintf(stream, "#define N %luUL\n", st->n);
+    fprintf(stream, "#define LN %ld\n", (long)st->ln);
+    fprintf(stream, "#define Q0 %lu\n", st->n / GMP_NUMB_BITS);
+    fprintf(stream, "#define S %lu\n", st->n % GMP_NUMB_BITS);
+    fprintf(stream, "#include <gmp.h>\n");
+    fprintf(stream, "static const mp_limb_t cand[LN] = {\n");
+    for (c = 0; c < st->ln; ++c) {
+	fprintf(stream, "    0x%016lxUL,\n", (unsigned long)mpz_getlimbn(st->cand, c));
+    }
+    fprintf(stream, "};\n\n");
+    fputs(kernel, stream);
+    if (ferror(stream) || fclose(stream) != 0) {
+	warnp(__func__, "error writing JIT source: %s", path);
+	return false;
+    }
+    return true;
+}
+
+
+/*
+ * JIT engine
+ */
+const struct engine jit_engine = {
+    "jit",
+    ULONG_MAX,		/* ENGINE_AUTO never selects: squaring dominates, the kernel saves little more than its compile time */
+    ULONG_MAX,
+    jit_usable,
+    jit_footprint,
+    jit_setup,
+    jit_import,
+    jit_step,
+    jit_export,
+    jit_cleanup
+};
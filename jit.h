@@ -0,0 +1,41 @@
+/*
+ * jit - engine compiled at runtime for a single h*2^n-1
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_JIT_H)
+#define INCLUDE_JIT_H
+
+/*
+ * jit constants
+ */
+#define JIT_CC_ENV	"GMPRIME_JIT_CC"	// environment variable naming the compiler to use
+#define JIT_DEF_CC	"cc"			// default compiler
+#define JIT_CFLAGS	"-std=gnu11 -O3 -march=native -fPIC -shared"	// how the kernel is compiled
+#define JIT_STEP_SYM	"jit_step"		// kernel function in the compiled object
+
+#endif				/* INCLUDE_JIT_H */
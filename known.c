@@ -0,0 +1,120 @@
+/*
+ * known - look up the verified primes h*2^n-1 of the test lists
+ *
+ * The primes listed in test/h-n.small.txt and test/h-n.med.txt, all those
+ * with n < 10000, are compiled into known_table.h when gmprime is built.
+ * Each prime is reduced to odd h, as lucas_test() does, and becomes the
+ * key h*2^KNOWN_N_BITS+n.  Keys with h < KNOWN_SMALL_H, most of the
+ * primes, fit in 32 bits and go in known_small[], the rest in
+ * known_large[].  Both are sorted, so a lookup is a binary search.
+ *
+ * The lists are not complete: some primes with small h and n are missing.
+ * So a candidate found in the table is prime, but one that is not found
+ * must still be tested.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "known.h"
+#include "known_table.h"
+
+/*
+ * static functions
+ */
+static bool known_search32(const uint32_t *tab, size_t len, uint32_t key);
+static bool known_search64(const uint64_t *tab, size_t len, uint64_t key);
+
+
+/*
+ * known_prime - determine if h*2^n-1 is a verified prime of the test lists
+ *
+ * given:
+ *      h       odd multiplier of 2
+ *      n       power of 2
+ *
+ * returns:
+ *      true ==> h*2^n-1 is prime, false ==> not in the table, must be tested
+ */
+bool
+known_prime(unsigned long h, unsigned long n)
+{
+    if (n >= (1UL << KNOWN_N_BITS) || h >= (1UL << (64 - KNOWN_N_BITS))) {
+	return false;
+    }
+    if (h < KNOWN_SMALL_H) {
+	return known_search32(known_small, sizeof(known_small) / sizeof(known_small[0]),
+			      (uint32_t)((h << KNOWN_N_BITS) | n));
+    }
+    return known_search64(known_large, sizeof(known_large) / sizeof(known_large[0]),
+			  ((uint64_t)h << KNOWN_N_BITS) | n);
+}
+
+
+/*
+ * known_search32 - binary search of a sorted table of 32-bit keys
+ */
+static bool
+known_search32(const uint32_t *tab, size_t len, uint32_t key)
+{
+    size_t lo = 0;		/* first index that may hold key */
+    size_t hi = len;		/* past the last index that may hold key */
+    size_t mid;			/* index to probe */
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (tab[mid] < key) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    return lo < len && tab[lo] == key;
+}
+
+
+/*
+ * known_search64 - binary search of a sorted table of 64-bit keys
+ */
+static bool
+known_search64(const uint64_t *tab, size_t len, uint64_t key)
+{
+    size_t lo = 0;		/* first index that may hold key */
+    size_t hi = len;		/* past the last index that may hold key */
+    size_t mid;			/* index to probe */
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (tab[mid] < key) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    return lo < len && tab[lo] == key;
+}
@@ -0,0 +1,434 @@
+/*
+ * live - working residue kept in a mapped file under the checkpoint directory
+ *
+ * A checkpoint file formats the u term as calc hex, which on a large n
+ * costs far more than the squarings between checkpoints.  With -l, the
+ * u term is also copied every LUCAS_BLOCK terms into LIVE_FILE, a
+ * MAP_SHARED file in the checkpoint directory.  The file holds a header
+ * page and LIVE_SLOTS slots that are written in turn, each described in
+ * the header by its index, size, check sum and an update number that is
+ * cleared while the slot is being written.  A checkpoint is then just an
+ * msync() of the dirty pages followed by a commit of the header.
+ *
+ * Should the process die, the pages it wrote are still in the page cache,
+ * so a new run with the same h and n resumes from the newest whole slot,
+ * having lost at most one block of terms.  Should the host die, the newest
+ * slot that reached the disk is used.  The checkpoints that save or result
+ * links (see setup_chkpt_links() in checkpoint.c) are still written in full.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 190-199	live.c - reserved for internal errors */
+
+#define _DEFAULT_SOURCE		/* for ftruncate() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <gmp.h>
+
+#include "gmprime.h"
+#include "riesel.h"
+#include "debug.h"
+#include "checkpoint.h"
+#include "live.h"
+
+#define LIVE_SUM_MUL	((uint64_t)0x9e3779b97f4a7c15)	/* check sum multiplier, odd */
+
+/*
+ * live residue state
+ */
+struct live {
+    int fd;			/* open LIVE_FILE */
+    size_t bytes;		/* mapped bytes */
+    size_t slot_bytes;		/* bytes in each slot, a multiple of LIVE_HDR_BYTES */
+    struct live_hdr *hdr;	/* mapped header */
+    unsigned char *map;		/* start of the mapping */
+    uint64_t seq;		/* number of the newest update */
+    int newest;			/* slot holding the newest update, -1 ==> none */
+};
+
+
+/*
+ * live_sum - check sum of a slot
+ */
+static uint64_t
+live_sum(uint64_t i, uint64_t size, const mp_limb_t *limbs)
+{
+    uint64_t sum;
+    uint64_t k;
+
+    sum = (i * LIVE_SUM_MUL) ^ size;
+    for (k = 0; k < size; ++k) {
+	sum = (sum ^ (uint64_t)limbs[k]) * LIVE_SUM_MUL;
+    }
+    return sum;
+}
+
+
+/*
+ * live_limbs - the limbs of a slot
+ */
+static mp_limb_t *
+live_limbs(const struct live *lv, int slot)
+{
+    return (mp_limb_t *)(lv->map + LIVE_HDR_BYTES + (size_t)slot * lv->slot_bytes);
+}
+
+
+/*
+ * live_open - open or create the live residue file in the checkpoint directory
+ *
+ * given:
+ *      h               multiplier of 2
+ *      n               power of 2
+ *      riesel_cand     h*2^n-1, the u term is always smaller
+ *      force           true ==> discard any live residue already in the file
+ *
+ * The file is opened relative to checkpoint_dirfd(), so the checkpoint
+ * directory must already be set up by initialize_checkpoint().  A file
+ * left by another h or n is started afresh.
+ *
+ * This function does not return on error.
+ */
+struct live *
+live_open(unsigned long h, unsigned long n, const mpz_t riesel_cand, bool force)
+{
+    struct live *lv;		/* live residue state */
+    struct stat buf;		/* status of an existing file */
+    uint64_t limbs;		/* limbs in each slot */
+    bool fresh;			/* true ==> initialize the header */
+    int s;
+
+    /*
+     * firewall
+     */
+    if (riesel_cand == NULL) {
+	err(190, __func__, "riesel_cand is NULL");
+	return NULL; // NOT REACHED
+    }
+    lv = calloc(1, sizeof(*lv));
+    if (lv == NULL) {
+	errp(190, __func__, "calloc of live residue state failed");
+	return NULL; // NOT REACHED
+    }
+    limbs = mpz_size(riesel_cand);
+    lv->slot_bytes = (limbs * sizeof(mp_limb_t) + LIVE_HDR_BYTES - 1) / LIVE_HDR_BYTES * LIVE_HDR_BYTES;
+    lv->bytes = LIVE_HDR_BYTES + LIVE_SLOTS * lv->slot_bytes;
+    lv->newest = -1;
+
+    /*
+     * open the file, an existing file of the wrong size is started afresh
+     */
+    errno = 0;
+    lv->fd = openat(checkpoint_dirfd(), LIVE_FILE, O_RDWR|O_CREAT|O_CLOEXEC, LIVE_FILE_MODE);
+    if (lv->fd < 0) {
+	errp(EXIT_CHKPT_ACCESS, __func__, "cannot open for update, errno: %d: %s", errno, LIVE_FILE);
+	// exit(4);
+	exit(EXIT_CHKPT_ACCESS); // NOT REACHED
+    }
+    if (fstat(lv->fd, &buf) < 0) {
+	errp(191, __func__, "cannot fstat: %s", LIVE_FILE);
+	return NULL; // NOT REACHED
+    }
+    fresh = force || (size_t)buf.st_size != lv->bytes;
+    if (fresh && ftruncate(lv->fd, 0) < 0) {
+	errp(191, __func__, "cannot truncate: %s", LIVE_FILE);
+	return NULL; // NOT REACHED
+    }
+    if (ftruncate(lv->fd, (off_t)lv->bytes) < 0) {
+	errp(EXIT_CHKPT_ACCESS, __func__, "cannot extend %s to %zu bytes", LIVE_FILE, lv->bytes);
+	// exit(4);
+	exit(EXIT_CHKPT_ACCESS); // NOT REACHED
+    }
+    lv->map = mmap(NULL, lv->bytes, PROT_READ|PROT_WRITE, MAP_SHARED, lv->fd, 0);
+    if (lv->map == MAP_FAILED) {
+	errp(192, __func__, "cannot map %zu bytes of: %s", lv->bytes, LIVE_FILE);
+	return NULL; // NOT REACHED
+    }
+    lv->hdr = (struct live_hdr *)lv->map;
+
+    /*
+     * a file for another candidate is started afresh
+     */
+    if (!fresh && (memcmp(lv->hdr->magic, LIVE_MAGIC, sizeof(lv->hdr->magic)) != 0 ||
+		   lv->hdr->h != h || lv->hdr->n != n || lv->hdr->limbs != limbs)) {
+	dbg(DBG_LOW, "%s is not for %lu*2^%lu-1, starting it afresh", LIVE_FILE, h, n);
+	fresh = true;
+    }
+    if (fresh) {
+	memset(lv->hdr, 0, sizeof(*lv->hdr));
+	memcpy(lv->hdr->magic, LIVE_MAGIC, sizeof(lv->hdr->magic));
+	lv->hdr->h = h;
+	lv->hdr->n = n;
+	lv->hdr->limbs = limbs;
+    }
+
+    /*
+     * note the newest update so that the next goes into the other slot
+     */
+    for (s = 0; s < LIVE_SLOTS; ++s) {
+	if (lv->hdr->slot[s].seq > lv->seq) {
+	    lv->seq = lv->hdr->slot[s].seq;
+	}
+    }
+    dbg(DBG_MED, "live residue: %s slots of %zu bytes, %s", LIVE_FILE, lv->slot_bytes, fresh ? "fresh" : "existing");
+    return lv;
+}
+
+
+/*
+ * live_resume - restore the u term from the newest whole slot
+ *
+ * given:
+ *      lv              live residue state
+ *      i               pointer to Lucas sequence index
+ *      v1		pointer to value of v(1) used for the given h and n
+ *      u_term          Lucas sequence value
+ *
+ * returns:
+ *      true ==> i, v1 and u_term were restored, false ==> no whole slot was found
+ */
+bool
+live_resume(struct live *lv, unsigned long *i, unsigned long *v1, mpz_t u_term)
+{
+    struct live_slot *slot;	/* slot being examined */
+    int best = -1;		/* newest whole slot */
+    int s;
+
+    /*
+     * firewall
+     */
+    if (lv == NULL || i == NULL || v1 == NULL || u_term == NULL) {
+	err(193, __func__, "called with NULL arg(s)");
+	return false; // NOT REACHED
+    }
+    if (lv->hdr->v1 < 3) {
+	return false;
+    }
+
+    /*
+     * find the newest slot whose check sum is good
+     */
+    for (s = 0; s < LIVE_SLOTS; ++s) {
+	slot = &lv->hdr->slot[s];
+	if (slot->seq == 0 || slot->size > lv->hdr->limbs || slot->i < FIRST_TERM_INDEX || slot->i > lv->hdr->n) {
+	    continue;
+	}
+	if (live_sum(slot->i, slot->size, live_limbs(lv, s)) != slot->sum) {
+	    warn(__func__, "%s slot %d for u[%lu] has a bad check sum, ignored", LIVE_FILE, s, (unsigned long)slot->i);
+	    continue;
+	}
+	if (best < 0 || slot->seq > lv->hdr->slot[best].seq) {
+	    best = s;
+	}
+    }
+    if (best < 0) {
+	return false;
+    }
+
+    /*
+     * restore from it
+     */
+    slot = &lv->hdr->slot[best];
+    if (slot->size > 0) {
+	memcpy(mpz_limbs_write(u_term, (mp_size_t)slot->size), live_limbs(lv, best), slot->size * sizeof(mp_limb_t));
+    }
+    mpz_limbs_finish(u_term, (mp_size_t)slot->size);
+    *i = slot->i;
+    *v1 = lv->hdr->v1;
+    lv->newest = best;
+    dbg(DBG_LOW, "resuming from %s at u[%lu]%s", LIVE_FILE, *i,
+	slot->seq > lv->hdr->committed ? ", written after the last checkpoint" : "");
+    return true;
+}
+
+
+/*
+ * live_update - copy the u term into the older slot
+ *
+ * given:
+ *      lv              live residue state
+ *      i               Lucas sequence index
+ *      v1		value of v(1) used for the given h and n
+ *      u_term          Lucas sequence value U(i)
+ *
+ * Nothing is written to disk here, the kernel writes back the dirty pages
+ * in its own time and live_checkpoint() waits for them.
+ */
+void
+live_update(struct live *lv, unsigned long i, unsigned long v1, const mpz_t u_term)
+{
+    struct live_slot *slot;	/* slot being written */
+    uint64_t size;		/* limbs in u_term */
+    int s;
+
+    /*
+     * firewall
+     */
+    if (lv == NULL || u_term == NULL) {
+	err(194, __func__, "called with NULL arg(s)");
+	return; // NOT REACHED
+    }
+    size = mpz_size(u_term);
+    if (size > lv->hdr->limbs) {
+	err(194, __func__, "u[%lu] has %lu limbs, more than: %lu", i, (unsigned long)size, (unsigned long)lv->hdr->limbs);
+	return; // NOT REACHED
+    }
+    if (lv->newest >= 0 && lv->hdr->slot[lv->newest].i == i) {
+	return;
+    }
+
+    /*
+     * invalidate the older slot before writing it, so a torn slot is never used
+     */
+    s = (lv->newest + 1) % LIVE_SLOTS;
+    slot = &lv->hdr->slot[s];
+    slot->seq = 0;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (size > 0) {
+	memcpy(live_limbs(lv, s), mpz_limbs_read(u_term), size * sizeof(mp_limb_t));
+    }
+    slot->i = i;
+    slot->size = size;
+    slot->sum = live_sum(i, size, live_limbs(lv, s));
+    lv->hdr->v1 = v1;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->seq = ++lv->seq;
+    lv->newest = s;
+    return;
+}
+
+
+/*
+ * live_commit - wait for the dirty pages to reach the disk, then commit the header
+ */
+static void
+live_commit(struct live *lv)
+{
+    uint64_t seq = lv->seq;	/* newest update, now on disk */
+
+    errno = 0;
+    if (msync(lv->map, lv->bytes, MS_SYNC) < 0) {
+	errp(195, __func__, "msync of %s failed", LIVE_FILE);
+	return; // NOT REACHED
+    }
+    lv->hdr->committed = seq;
+    if (msync(lv->map, LIVE_HDR_BYTES, MS_SYNC) < 0) {
+	errp(195, __func__, "msync of %s header failed", LIVE_FILE);
+	return; // NOT REACHED
+    }
+    return;
+}
+
+
+/*
+ * live_checkpoint - checkpoint with the live residue
+ *
+ * given:
+ *      lv              live residue state
+ *      checkpoint_dir	directory under which checkpoint files will be created
+ *      h               multiplier of 2
+ *      n               power of 2
+ *      i               Lucas sequence index
+ *      v1		value of v(1) used for the given h and n
+ *      u_term          Lucas sequence value U(i)
+ *
+ * The u term is copied into a slot and committed.  At the terms that
+ * have save or result links a full checkpoint() is also written, and
+ * otherwise the checkpoint alarm is cleared and a signal to end obeyed
+ * here just as checkpoint() would.
+ *
+ * This function does not return on error.
+ */
+void
+live_checkpoint(struct live *lv, const char *checkpoint_dir, unsigned long h, unsigned long n,
+		unsigned long i, unsigned long v1, mpz_t u_term)
+{
+    struct timeval began;	/* when the checkpoint began */
+
+    /*
+     * update and commit the live residue
+     */
+    (void) gettimeofday(&began, NULL);
+    live_update(lv, i, v1, u_term);
+    live_commit(lv);
+
+    /*
+     * terms with save or result links still need a checkpoint file
+     */
+    if (i == FIRST_TERM_INDEX || i == n - CHECKPOINT_PREVIEW || i == n - 1 || i == n) {
+	checkpoint(checkpoint_dir, true, h, n, i, v1, u_term);
+	return;
+    }
+    dbg(DBG_MED, "committed live residue for u[%lu]: %s", i, checkpoint_dir);
+    checkpoint_history(n, i, &began);
+
+    /*
+     * now that we have checkpointed, clear the checkpoint alarm flag if set
+     */
+    if (checkpoint_alarm != 0) {
+	checkpoint_alarm = 0;
+    }
+
+    /*
+     * now that we have checkpointed, if we saw a signal requesting we quit, then time to exit
+     */
+    if (checkpoint_and_end != 0) {
+	err(EXIT_SIGNAL, __func__, "caught a signal, committed the live residue and gracefully exiting");
+	// exit(7);
+	exit(EXIT_SIGNAL);	// NOT REACHED
+    }
+    return;
+}
+
+
+/*
+ * live_close - unmap and close the live residue file
+ *
+ * given:
+ *      lv              live residue state
+ *      remove          true ==> remove the file as the test is over
+ */
+void
+live_close(struct live *lv, bool remove)
+{
+    if (lv == NULL) {
+	return;
+    }
+    (void) munmap(lv->map, lv->bytes);
+    (void) close(lv->fd);
+    if (remove && unlinkat(checkpoint_dirfd(), LIVE_FILE, 0) < 0) {
+	warnp(__func__, "cannot remove: %s", LIVE_FILE);
+    }
+    free(lv);
+    return;
+}
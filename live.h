@@ -0,0 +1,83 @@
+/*
+ * live - working residue kept in a mapped file under the checkpoint directory
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_LIVE_H)
+#define INCLUDE_LIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <gmp.h>
+
+/*
+ * live residue constants
+ */
+#define LIVE_FILE	"live.residue"		// live residue file name in checkpoint directory
+#define LIVE_FILE_MODE	(S_IRUSR|S_IWUSR|S_IRGRP)	// the live residue is rewritten in place, so 0640
+#define LIVE_MAGIC	"gmprlv1\n"		// first 8 bytes of a live residue file
+#define LIVE_HDR_BYTES	(4096)			// bytes before the first slot, a page
+#define LIVE_SLOTS	(2)			// slots written in turn, so one is always whole
+
+/*
+ * one slot of the live residue file
+ *
+ * A slot with a seq of 0 is being written, or has never been written.
+ */
+struct live_slot {
+    uint64_t seq;		/* update number, 0 ==> not valid */
+    uint64_t i;			/* Lucas sequence index of the u term in this slot */
+    uint64_t size;		/* limbs in the u term */
+    uint64_t sum;		/* check sum of i, size and the limbs */
+};
+
+/*
+ * header at the start of the live residue file
+ */
+struct live_hdr {
+    char magic[8];		/* LIVE_MAGIC */
+    uint64_t h;			/* multiplier of 2 */
+    uint64_t n;			/* power of 2 */
+    uint64_t v1;		/* v(1) used for h and n, 0 ==> not yet known */
+    uint64_t limbs;		/* limbs in each slot */
+    uint64_t committed;		/* seq of the newest slot known to be on disk */
+    struct live_slot slot[LIVE_SLOTS];	/* slot descriptions */
+};
+
+struct live;			/* live residue state, see live.c */
+
+/*
+ * external functions
+ */
+extern struct live *live_open(unsigned long h, unsigned long n, const mpz_t riesel_cand, bool force);
+extern bool live_resume(struct live *lv, unsigned long *i, unsigned long *v1, mpz_t u_term);
+extern void live_update(struct live *lv, unsigned long i, unsigned long v1, const mpz_t u_term);
+extern void live_checkpoint(struct live *lv, const char *checkpoint_dir, unsigned long h, unsigned long n,
+			    unsigned long i, unsigned long v1, mpz_t u_term);
+extern void live_close(struct live *lv, bool remove);
+
+#endif				/* INCLUDE_LIVE_H */
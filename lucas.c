@@ -0,0 +1,977 @@
+/*
+ * lucas - Lucas-Lehmer-Riesel test of a single h*2^n-1 candidate
+ *
+ * This is the test that gmprime performs on the h and n given on the command
+ * line.  It was moved out of main() so that the batch scheduler can run many
+ * candidates, one after another, within the same worker process.
+ *
+ * NOTE: Comments in this source use 2^n to mean 2 raised to the power of n, not xor.
+ *
+ * Copyright (c) 2013,2017-2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 100-109	lucas.c - reserved for internal errors */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <gmp.h>
+
+#include "gmprime.h"
+#include "riesel.h"
+#include "debug.h"
+#include "checkpoint.h"
+#include "parsqr.h"
+#include "engine.h"
+#include "live.h"
+#include "known.h"
+#include "throttle.h"
+#include "control.h"
+#include "zcalc.h"
+#include "prp.h"
+#include "watchdog.h"
+#include "lucas.h"
+
+/*
+ * constants
+ */
+#define MAX_H_N_LEN BUFSIZ	/* more than enougn for h and n that we care about */
+
+/*
+ * list of very small verified Riesel primes that we special case
+ */
+struct h_n {
+    unsigned long h;		/* multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+};
+static const struct h_n small_h_n[] = {
+    {1, 2},			/* 1 * 2 ^ 2 - 1 = 3 is prime */
+
+    {0, 0}			/* MUST BE THE LAST ENTRY! */
+};
+static const struct h_n composite_h_n[] = {
+    {1, 1},			/* 1 * 2 ^ 1 - 1 = 1 is not prime */
+
+    {0, 0}			/* MUST BE THE LAST ENTRY! */
+};
+
+
+/*
+ * lucas_init - initialize the mp elements of a Lucas sequence state
+ *
+ * given:
+ *      lp      pointer to Lucas sequence state
+ *
+ * This function does not return on error.
+ */
+void
+lucas_init(struct lucas *lp)
+{
+    /*
+     * firewall
+     */
+    if (lp == NULL) {
+	err(100, __func__, "lp is NULL");
+	return;	// NOT REACHED
+    }
+
+    /*
+     * initialize mp elements
+     */
+    memset(lp, 0, sizeof(struct lucas));
+    mpz_init(lp->pow_2);
+    mpz_init(lp->h_pow_2);
+    mpz_init(lp->riesel_cand);
+    mpz_init(lp->u_term);
+    mpz_init(lp->u_term_sq);
+    mpz_init(lp->u_term_sq_2);
+    mpz_init(lp->J);
+    mpz_init(lp->K);
+    mpz_init(lp->J_div_h);
+    mpz_init(lp->J_mod_h);
+    lp->squad = NULL;
+    return;
+}
+
+
+/*
+ * lucas_clear - free the mp elements and squaring helpers of a Lucas sequence state
+ *
+ * given:
+ *      lp      pointer to Lucas sequence state
+ *
+ * This function does not return on error.
+ */
+void
+lucas_clear(struct lucas *lp)
+{
+    /*
+     * firewall
+     */
+    if (lp == NULL) {
+	err(101, __func__, "lp is NULL");
+	return;	// NOT REACHED
+    }
+
+    /*
+     * free mp elements
+     */
+    mpz_clear(lp->pow_2);
+    mpz_clear(lp->h_pow_2);
+    mpz_clear(lp->riesel_cand);
+    mpz_clear(lp->u_term);
+    mpz_clear(lp->u_term_sq);
+    mpz_clear(lp->u_term_sq_2);
+    mpz_clear(lp->J);
+    mpz_clear(lp->K);
+    mpz_clear(lp->J_div_h);
+    mpz_clear(lp->J_mod_h);
+
+    /*
+     * stop any squaring helper threads
+     */
+    if (lp->squad != NULL) {
+	parsqr_free(lp->squad);
+	lp->squad = NULL;
+    }
+    return;
+}
+
+
+/*
+ * lucas_next_term - compute U(i+1) from U(i)
+ *
+ *      u(i+1) = u(i)^2 - 2 mod h*2^n-1
+ *
+ * given:
+ *      lp              pointer to Lucas sequence state, lp->u_term is U(i)
+ *      calc_mode       true ==> output to stdout, calc code to verify each sub-step
+ *
+ * On return, lp->i has been incremented and lp->u_term is the next Lucas term.
+ *
+ * This function does not return on error.
+ */
+void
+lucas_next_term(struct lucas *lp, bool calc_mode)
+{
+    unsigned long i;		/* u term index */
+    unsigned long n;		/* power of 2 */
+    unsigned long h;		/* multiplier of 2 */
+
+    /*
+     * firewall
+     */
+    if (lp == NULL) {
+	err(102, __func__, "lp is NULL");
+	return;	// NOT REACHED
+    }
+    h = lp->h;
+    n = lp->n;
+
+    /*
+     * note the Lucas term index we are computing
+     */
+    i = ++lp->i;
+
+    /*
+     * setup for next loop
+     */
+    if (calc_mode) {
+	printf("print \"starting to compute u[%ld]\";\n", i);
+	write_calc_int64_t(stdout, NULL, "i", i);
+	zcalc_flush(); // paranoia
+    }
+
+    /*
+     * square
+     *
+     * When we have squaring helper threads, the square is split between them.
+     */
+    if (lp->squad != NULL && parsqr_threads(lp->squad) > 1) {
+	parsqr(lp->squad, lp->u_term_sq, lp->u_term);
+    } else {
+	mpz_mul(lp->u_term_sq, lp->u_term, lp->u_term);
+    }
+    if (debuglevel >= DBG_VHIGH) {
+	write_calc_mpz_hex(stderr, NULL, "u_term_sq", lp->u_term_sq);
+	fflush(stderr); // paranoia
+    }
+    if (calc_mode) {
+	printf("u_term_sq = u_term^2;\n");
+	write_calc_mpz_hex(stdout, NULL, "gmprime_u_term_sq", lp->u_term_sq);
+	printf("if (u_term_sq == gmprime_u_term_sq) {\n");
+	printf("  print \"gmprime_u_term_sq appears to be correct\";\n");
+	printf("} else {\n");
+	printf("  print \"# ERR: u_term_sq != gmprime_u_term_sq for u[%ld]\";\n", i);
+	printf("  print \"u_term_sq = \", u_term_sq;\n");
+	printf("  print \"gmprime_u_term_sq = \", gmprime_u_term_sq;\n");
+	printf("  quit \"bad square calculation\";\n");
+	printf("}\n");
+	zcalc_flush(); // paranoia
+    }
+
+    /*
+     * -2
+     */
+    mpz_sub_ui(lp->u_term_sq_2, lp->u_term_sq, (unsigned long int) 2);
+    if (debuglevel >= DBG_VHIGH) {
+	write_calc_mpz_hex(stderr, NULL, "u_term_sq_2", lp->u_term_sq_2);
+	fflush(stderr); // paranoia
+    }
+    if (calc_mode) {
+	printf("u_term_sq_2 = u_term_sq - 2;\n");
+	write_calc_mpz_hex(stdout, NULL, "gmprime_u_term_sq_2", lp->u_term_sq_2);
+	printf("if (u_term_sq_2 == gmprime_u_term_sq_2) {\n");
+	printf("  print \"gmprime_u_term_sq_2 appears to be correct\";\n");
+	printf("} else {\n");
+	printf("  print \"# ERR: u_term_sq_2 != gmprime_u_term_sq_2 for u[%ld]\";\n", i);
+	printf("  print \"u_term_sq_2 = \", u_term_sq_2;\n");
+	printf("  print \"gmprime_u_term_sq_2 = \", gmprime_u_term_sq_2;\n");
+	printf("  quit \"bad -2 calculation\";\n");
+	printf("}\n");
+	zcalc_flush(); // paranoia
+    }
+
+    /*
+     * mod h*2^n-1 via modified "shift and add"
+     *
+     * See http://www.isthe.com/chongo/tech/math/prime/prime-tutorial.pdf
+     * for the page entitled "Calculating mod h*2n-1".
+     *
+     * Executive summary:
+     *
+     *      u_term = u_term_sq_2 mod h*2^n-1 = int(J/h) + (J mod h)*(2^n) + K
+     *
+     * Where:
+     *
+     *      J = int(u_term_sq_2 / 2^n)      // u_term_sq_2 right shifted by n bits
+     *      K = u_term_sq_2 mod 2^n         // the bottom n bits of u_term_sq_2
+     *
+     * NOTE: We use 2^n above to mean 2 raised to the power of n, not xor.
+     */
+    mpz_fdiv_q_2exp(lp->J, lp->u_term_sq_2, n);	// J = int(u_term_sq_2 / 2^n)
+    if (debuglevel >= DBG_VVHIGH) {
+	write_calc_mpz_hex(stderr, NULL, "J", lp->J);
+	fflush(stderr); // paranoia
+    }
+    mpz_tdiv_qr_ui(lp->J_div_h, lp->J_mod_h, lp->J, h);	// compute both int(J/h) and (J mod h)
+    if (debuglevel >= DBG_VVHIGH) {
+	write_calc_mpz_hex(stderr, NULL, "J_div_h", lp->J_div_h);
+	write_calc_mpz_hex(stderr, NULL, "J_mod_h", lp->J_mod_h);
+	fflush(stderr); // paranoia
+    }
+    mpz_mul_2exp(lp->J_mod_h, lp->J_mod_h, n);	// (J mod h)*(2^n)
+    if (debuglevel >= DBG_VVHIGH) {
+	write_calc_mpz_hex(stderr, NULL, "J_mod_h_shifted", lp->J_mod_h);
+	fflush(stderr); // paranoia
+    }
+    mpz_fdiv_r_2exp(lp->K, lp->u_term_sq_2, n);	// K = bottom n bits of u_term_sq_2
+    if (debuglevel >= DBG_VVHIGH) {
+	write_calc_mpz_hex(stderr, NULL, "K", lp->K);
+	fflush(stderr); // paranoia
+    }
+    mpz_add(lp->u_term, lp->J_mod_h, lp->K);	// int(J/h) + (J mod h)*(2^n)
+    if (debuglevel >= DBG_VVHIGH) {
+	write_calc_mpz_hex(stderr, NULL, "u_term_partial", lp->u_term);
+	fflush(stderr); // paranoia
+    }
+    mpz_add(lp->u_term, lp->u_term, lp->J_div_h);	// u_term = u_term_sq_2 mod h*2^n-1
+    if (debuglevel >= DBG_VHIGH) {
+	write_calc_mpz_hex(stderr, NULL, "u_term_mod_final", lp->u_term);
+	fflush(stderr); // paranoia
+    }
+
+    /*
+     * While the above modified "shift and add" does compute u_term_sq_2 mod h*2^n-1
+     * it can produce a value that is >= h*2^n-1 in some extreme cases.  When that
+     * happens, the value will be slightly larger than h*2^n-1.  In particular it
+     * will be bounded under an upper bound that we derive below.
+     *
+     * Assume:
+     *
+     *      hb = the number of bits in h, which for this C code is 64 bits
+     *
+     * We know that:
+     *      rb = the number of bits in h*2^n-1 (our riesel_cand), for this C code is hb + n
+     *      u2b = the number of bits in (h*2^n-1)^2, for this C code is 2*rb = 2*hb + 2*n
+     *
+     * Now:
+     *
+     *      u_term = u_term_sq_2 mod h*2^n-1 = int(J/h) + (J mod h)*(2^n) + K
+     *
+     * Where:
+     *
+     *      J = int(u_term_sq_2 / 2^n)      // u_term_sq_2 right shifted by n bits
+     *      K = u_term_sq_2 mod 2^n         // the bottom n bits of u_term_sq_2
+     *
+     * We need to determine the sizes of the terms used to compute the new u_term.
+     * It is easy to show that:
+     *
+     *      jb = the number of bits in J = (2*hb + 2*n) - n = 2*hb + n
+     *      jdhb = the number of bits in int(J/h) = jb - hb = 2*hb + n - hb = hb + n
+     *      jmhb = the number of bits in (J mod h)*(2^n) = hb + n
+     *
+     *      kb = the number of bits in K = n
+     *
+     * Then it is easy to show that the size of the new u_term in bits is as most:
+     *
+     *      max(max(jdhb, jmhb)+1, n) = max(max(hb + n, hb + n)+1, n) = max(hb + n + 1, n) = hb + n + 1
+     *
+     *        (The reason for the + 1 in the above expression is due to a potential carry bit.)
+     *
+     * Therefore the new u_term in bits is at most twice h*2^n-1, our riesel_cand.  So we
+     * when the new u_term > riesel_cand, we expect to subtract riesel_cand at most one time.
+     */
+    while (mpz_cmp(lp->u_term, lp->riesel_cand) >= 0) {
+	mpz_sub(lp->u_term, lp->u_term, lp->riesel_cand);
+	if (debuglevel >= DBG_VHIGH) {
+	    write_calc_mpz_hex(stderr, NULL, "u_term_subtract", lp->u_term);
+	    fflush(stderr); // paranoia
+	}
+    }
+    if (debuglevel >= DBG_HIGH) {
+	fprintf(stderr, "u[%ld", i);
+	write_calc_mpz_hex(stderr, NULL, "]", lp->u_term);
+	fflush(stderr); // paranoia
+    }
+    if (calc_mode) {
+	printf("u_term = u_term_sq_2 %% riesel_cand;\n");
+	write_calc_mpz_hex(stdout, NULL, "gmprime_u_term", lp->u_term);
+	printf("if (u_term == gmprime_u_term) {\n");
+	printf("  print \"gmprime_u_term appears to be correct\";\n");
+	printf("} else {\n");
+	printf("  print \"# ERR: u_term_sq_2 != gmprime_u_term for u[%ld]\";\n", i);
+	printf("  print \"u_term = \", u_term;\n");
+	printf("  print \"gmprime_u_term = \", gmprime_u_term;\n");
+	printf("  quit \"bad mod calculation\";\n");
+	printf("}\n");
+	zcalc_flush(); // paranoia
+    }
+    return;
+}
+
+
+/*
+ * lucas_footprint - predict the memory a test of h*2^n-1 uses
+ *
+ * given:
+ *      h               multiplier of 2
+ *      n               power of 2
+ *      engine          engine name (see engine.h), NULL ==> ENGINE_GMP
+ *
+ * returns:
+ *      bytes the test process is expected to use at most
+ *
+ * The GMP code holds LUCAS_GMP_COPIES n bit values at once, counting the
+ * square, its parts and the scratch space GMP uses to square.  With an
+ * engine, the GMP values are not squared, and the engine adds what its
+ * setup allocates.
+ */
+size_t
+lucas_footprint(unsigned long h, unsigned long n, const char *engine)
+{
+    const struct engine *eng;	/* engine that would be selected */
+    size_t bytes;		/* bytes in an n bit value */
+
+    bytes = (n + (unsigned long)(64 - __builtin_clzl(h)) + 7) / 8;
+    eng = engine_select(engine, h, n);
+    if (eng == NULL) {
+	return LUCAS_BASE_BYTES + LUCAS_GMP_COPIES * bytes;
+    }
+    return LUCAS_BASE_BYTES + LUCAS_ENGINE_COPIES * bytes + eng->footprint(h, n);
+}
+
+
+/*
+ * lucas_test - test h*2^n-1 for primality
+ *
+ * given:
+ *      h               multiplier of 2 (ignored if opts->restore)
+ *      n               power of 2 (ignored if opts->restore)
+ *      opts            how the candidate is to be tested
+ *
+ * returns:
+ *      EXIT_IS_PRIME           h*2^n-1 has been proven prime
+ *      EXIT_IS_COMPOSITE       h*2^n-1 has been proven to be composite
+ *
+ * This function does not return on error.  It also does not return if
+ * h*2^n-1 cannot be tested, or if a signal causes a checkpoint and exit.
+ */
+int
+lucas_test(unsigned long h, unsigned long n, struct lucas_opts *opts)
+{
+    struct lucas l;			/* Lucas sequence state */
+    mpz_t zero;				/* 0 as a mp value */
+    mpz_t non_zero;			/* non-0 as a mp value */
+    /*
+     * For Mersenne numbers, U(FIRST_TERM_INDEX) == 4
+     * For Riesel numbers, U(FIRST_TERM_INDEX) == v(h)
+     */
+    unsigned long orig_h;		/* original value of h */
+    unsigned long orig_n;		/* original value of n */
+    char h_str[MAX_H_N_LEN + 1];	/* h as a string */
+    char n_str[MAX_H_N_LEN + 1];	/* h as a string */
+    int h_len;				/* length of string in h_str */
+    int n_len;				/* length of string in n_str */
+    const struct h_n *h_n_p;		/* pointer into small_h_n */
+    bool known;				/* true ==> h*2^n-1 is a known prime */
+    bool calc_mode;			/* output calc code so calc can verify partial results */
+    bool quiet;				/* if we saw a -q */
+    char *checkpoint_dir;		/* form checkpoint files under checkpoint_dir */
+    int threads;			/* squaring threads to use */
+    const struct engine *eng;		/* engine computing the Lucas sequence, NULL ==> GMP code */
+    void *eng_state;			/* engine state */
+    unsigned long count;		/* terms for the engine to compute */
+    struct live *live;			/* live residue, NULL ==> not kept */
+    bool resumed;			/* true ==> resumed from the live residue */
+    struct throttle *th;		/* CPU budget */
+    struct control *ctl;		/* control socket, NULL ==> not checkpointing */
+    struct watchdog *wd;		/* watchdog of the test, NULL ==> none */
+
+    /*
+     * firewall
+     */
+    if (opts == NULL) {
+	err(103, __func__, "opts is NULL");
+	return EXIT_CANNOT_TEST; // NOT REACHED
+    }
+    calc_mode = opts->calc_mode;
+    quiet = opts->quiet;
+    checkpoint_dir = opts->checkpoint_dir;
+
+    /*
+     * the Riesel test only applies to h*2^n-1, other bases get a Fermat test
+     */
+    if (opts->base > 2) {
+	return prp_test(h, n, opts);
+    }
+
+    /*
+     * initialize mp elements
+     *
+     * we need to initialize my elements early in case we are restoring
+     */
+    lucas_init(&l);
+    mpz_init(zero);
+    mpz_set_ui(zero, 0);
+    mpz_init(non_zero);
+    mpz_set_ui(non_zero, 1);
+
+    /*
+     * case: no h and n given, must obtain by restoring from the checkpoint_dir
+     */
+    l.i = FIRST_TERM_INDEX;
+    if (opts->restore) {
+
+	/*
+	 * restore h, n, i, v1, and u_term from checkpoint_dir
+	 *
+	 * NOTE: If we cannot restore from checkpoint_dir, this function will not return.
+	 */
+	dbg(DBG_LOW, "restoring from: %s", checkpoint_dir);
+	restore_checkpoint(checkpoint_dir, &h, &n, &l.i, &l.v1, l.u_term);
+    }
+
+    /*
+     * convert even h into odd h by increasing n
+     */
+    /*
+     * save our argument values for debugging and final reporting
+     */
+    orig_h = h;
+    orig_n = n;
+    /*
+     * force h to become odd
+     */
+    if (h % 2 == 0) {
+	dbg(DBG_MED, "converting even h: %ld into odd by increasing n: %ld", orig_h, orig_n);
+	while (h % 2 == 0 && h > 0) {
+	    h >>= 1;
+	    ++n;
+	}
+	dbg(DBG_MED, "new equivalent h: %lu and new equivalent n: %ld", h, n);
+	if (h <= 0) {
+	    err(EXIT_CANNOT_TEST, __func__, "new equivalent h: %lu <= 0", h);
+	    // exit(2);
+	    exit(EXIT_CANNOT_TEST); // NOT REACHED
+	}
+    }
+    dbg(DBG_MED, "h: %lu", h);
+    dbg(DBG_MED, "n: %lu", n);
+    l.h = h;
+    l.n = n;
+
+    /*
+     * form string based on possibly modified h
+     */
+    memset(h_str, 0, sizeof(h_str));
+    errno = 0;
+    h_len = snprintf(h_str, MAX_H_N_LEN, "%lu", h);
+    if (h_len < 0 || h_len >= MAX_H_N_LEN) {
+	usage_errp(EXIT_USAGE, __func__, "converting h: %lu to string via snprintf returned: %d", h, h_len);
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    h_str[h_len] = '\0';	// paranoia
+    dbg(DBG_VHIGH, "h_len string: %s", h_str);
+
+    /*
+     * form string based on possibly modified n
+     */
+    memset(n_str, 0, sizeof(n_str));
+    errno = 0;
+    n_len = snprintf(n_str, MAX_H_N_LEN, "%lu", n);
+    if (n_len < 0 || n_len >= MAX_H_N_LEN) {
+	usage_errp(EXIT_USAGE, __func__, "converting n: %lu to string via snprintf returned: %d", n, n_len);
+	// exit(9);
+	exit(EXIT_USAGE); // NOT REACHED
+    }
+    n_str[n_len] = '\0';	// paranoia
+    dbg(DBG_VHIGH, "n_len string: %s", n_str);
+
+    /*
+     * firewall - catch the special cases for small primes, and the known primes
+     *
+     * NOTE: This case normally fails the standard Riesel test because n is too small.
+     *
+     * Unless verifying, or outputting calc code, a prime of the test lists
+     * is announced without testing it (see known.c).
+     */
+    known = false;
+    for (h_n_p = small_h_n; h_n_p->h > 0 && h_n_p->n > 0; ++h_n_p) {
+	if (h == h_n_p->h && n == h_n_p->n) {
+	    known = true;
+	}
+    }
+    if (!known && !opts->verify && !calc_mode && known_prime(h, n)) {
+	dbg(DBG_MED, "%lu*2^%lu-1 is a known prime", h, n);
+	known = true;
+    }
+    if (known) {
+	if (calc_mode) {
+	    printf("read lucas;\n");
+	    printf("print \"lucas( %ld , %lu )\",;", h, n);
+	    printf("ret = lucas(%ld , %ld);\n", h, n);
+	    printf("if (ret == 1) { print \"returned prime\"; } else { print \"failed returning\", ret; };\n");
+	    printf("print \"%s: origianl test: %ld * 2 ^ %ld - 1 =\", (%ld * 2 ^ %ld - 1);\n",
+		   program, orig_h, orig_n, orig_h, orig_n);
+	    printf("print \"%s: %lu * 2 ^ %lu - 1 =\", (%lu * 2 ^ %lu - 1), \"is prime\";\n", program, h, n, h, n);
+	} else if (!quiet) {
+	    printf("%ld * 2 ^ %ld - 1 is prime\n", orig_h, orig_n);
+	}
+	/* if checkpointing, set checkpoint state to prime */
+	if (checkpoint_dir != NULL) {
+	    dbg(DBG_MED, "checkpoint state set to prime in: %s", checkpoint_dir);
+	    checkpoint(checkpoint_dir, false, h, n, 0, 0, zero);
+	    checkpoint_close();
+	}
+	dbg(DBG_LOW, "exit prime");
+	mpz_clear(zero);
+	mpz_clear(non_zero);
+	lucas_clear(&l);
+	return EXIT_IS_PRIME;
+    }
+
+    /*
+     * firewall - catch the special cases for small composites
+     *
+     * NOTE: This case normally fails the standard Riesel test because n is too small.
+     */
+    for (h_n_p = composite_h_n; h_n_p->h > 0 && h_n_p->n > 0; ++h_n_p) {
+	if (h == h_n_p->h && n == h_n_p->n) {
+	    if (calc_mode) {
+		printf("read lucas;\n");
+		printf("print \"lucas( %ld , %lu )\",;", h, n);
+		printf("ret = lucas(%ld , %ld);\n", h, n);
+		printf("if (ret == 0) { print \"returned composite\"; } else { print \"failed returning\", ret; };\n");
+		printf("print \"%s: origianl test: %ld * 2 ^ %ld - 1 =\", (%ld * 2 ^ %ld - 1);\n",
+		       program, orig_h, orig_n, orig_h, orig_n);
+		printf("print \"%s: %ld * 2 ^ %ld - 1 is composite\";\n", program, orig_h, orig_n);
+	    } else if (!quiet) {
+		printf("%ld * 2 ^ %ld - 1 is composite\n", orig_h, orig_n);
+	    }
+	    if (checkpoint_dir != NULL) {
+		dbg(DBG_MED, "checkpoint state set to composite in: %s", checkpoint_dir);
+		checkpoint(checkpoint_dir, false, h, n, 0, 0, non_zero);
+		checkpoint_close();
+	    }
+	    dbg(DBG_LOW, "exit composite");
+	    mpz_clear(zero);
+	    mpz_clear(non_zero);
+	    lucas_clear(&l);
+	    return EXIT_IS_COMPOSITE;
+	}
+    }
+
+    /*
+     * firewall - h*2^n-1 is not a multiple of 3
+     *
+     * We can check this quickly by looking at h and n.
+     * The value h*2^n-1 is multiple of 3 when:
+     *
+     *          h = 1 mod 3 AND n is even
+     * or when:
+     *          h = 2 mod 3 AND n is odd
+     *
+     * If either of those cases is true, don't test for
+     * primality because the value is a multiple of 3.
+     * We also know that h*2^n-1 is not 3 because the
+     * 'catch the special cases for small primes' code
+     * would have exited above if h*2^n-1 == 3.
+     */
+    if (((h % 3 == 1) && (n % 2 == 0)) || ((h % 3 == 2) && (n % 2 == 1))) {
+	if (calc_mode) {
+	    printf("print \"%s: %ld * 2 ^ %ld - 1 is a multiple of 3 > 3\";\n", program, orig_h, orig_n);
+	    printf("mod3 = ((%ld * 2 ^ %ld - 1) %% 3);\n", orig_h, orig_n);
+	    printf("if (mod3 == 0) { print \"value mod 3:\", mod3; } else { print \"failed: mod 3 != 0:\", mod3 };\n");
+	    printf("print \"%s: %ld * 2 ^ %ld - 1 is composite\";\n", program, orig_h, orig_n);
+	} else if (!quiet) {
+	    printf("%ld * 2 ^ %ld - 1 is composite\n", orig_h, orig_n);
+	}
+	if (checkpoint_dir != NULL) {
+	    dbg(DBG_MED, "checkpoint state set to composite in: %s", checkpoint_dir);
+	    checkpoint(checkpoint_dir, false, h, n, 0, 0, non_zero);
+	    checkpoint_close();
+	}
+	dbg(DBG_LOW, "exit composite");
+	mpz_clear(zero);
+	mpz_clear(non_zero);
+	lucas_clear(&l);
+	return EXIT_IS_COMPOSITE;
+    }
+    mpz_clear(zero);
+    mpz_clear(non_zero);
+
+    /*
+     * NOTE: the values of h and n have been established and will not change thruout the test
+     */
+    zcalc_flush(); // paranoia
+    fflush(stderr); // paranoia
+    dbg(DBG_LOW, "testing %lu*2^%lu-1", h, n);
+    fflush(stderr); // paranoia
+
+    /*
+     * initialize prime stats for this run
+     *
+     * NOTE: This does not initialize prime stats for the total run.
+     *	     The prime stats for the total run is setup when we either
+     *	     restore from a checkpoint or determine the test is just starting.
+     */
+    initialize_beginrun_stats();
+
+    /*
+     * initialize checkpoint system
+     *
+     * This does not perform a restore from q checkpoint file.
+     * This just initializes internal data structures, sets up
+     * the checkpoint timer and creates the checkpoint directory
+     * if it it needed and does not exist.
+     *
+     * This call will also initialize prime stats for the start of this primality test.
+     *
+     * If we are checkpointing, a lock for the checkpoint directroy will be obtained.
+     * If the lock is busy, this function will exit and not return.
+     *
+     * If the checkpoint directory exists and contains a checkpoint, we will
+     * restore based on that checkpoint.
+     *
+     * When we restored, this locks and opens the checkpoint directory we
+     * restored from so that the test can continue to checkpoint there.
+     */
+    initialize_checkpoint(checkpoint_dir, opts->checkpoint_secs, h, n, opts->force);
+
+    /*
+     * compute h*2^n-1 - our test candidate
+     */
+    mpz_ui_pow_ui(l.pow_2, 2, n);
+    mpz_mul_ui(l.h_pow_2, l.pow_2, h);
+    mpz_sub_ui(l.riesel_cand, l.h_pow_2, 1);
+    if (debuglevel >= DBG_MED) {
+	dbg(DBG_MED, "origianl test %lu*2^%lu-1", orig_h, orig_n);
+	if (debuglevel >= DBG_HIGH) {
+	    write_calc_mpz_hex(stderr, NULL, "riesel_cand", l.riesel_cand);
+	}
+	fflush(stderr); // paranoia
+    }
+    if (calc_mode) {
+	printf("print \"original test %ld * 2 ^ %ld - 1\";\n", orig_h, orig_n);
+	printf("print \"about to test %ld * 2 ^ %ld - 1\";\n", h, n);
+	printf("riesel_cand = %ld * 2 ^ %ld - 1;\n", h, n);
+	zcalc_flush(); // paranoia
+    }
+
+    /*
+     * firewall - h < 2^n
+     */
+    if (mpz_cmp_ui(l.pow_2, h) < 0) {
+	err(EXIT_CANNOT_TEST, __func__, "h: %lu must be < 2^n: 2^%lu", h, n);
+	// exit(2);
+	exit(EXIT_CANNOT_TEST); // NOT REACHED
+    }
+
+    /*
+     * keep to the CPU budget, and when checkpointing, listen for commands on
+     * the control socket of the checkpoint directory
+     */
+    th = throttle_start((opts->cpu > 0 ? opts->cpu : THROTTLE_MAX_CPU), opts->idle);
+    ctl = NULL;
+    if (checkpoint_dir != NULL) {
+	ctl = control_start(h, n, opts->checkpoint_secs, opts->threads, th);
+    }
+
+    /*
+     * open the live residue, resuming from it if it holds a term of this test
+     */
+    live = NULL;
+    resumed = false;
+    if (opts->live && checkpoint_dir != NULL && !opts->restore) {
+	live = live_open(h, n, l.riesel_cand, opts->force);
+	resumed = live_resume(live, &l.i, &l.v1, l.u_term);
+    }
+
+    /*
+     * set initial u(FIRST_TERM_INDEX) value, unless we restored
+     */
+    if (!opts->restore && !resumed) {
+	l.i = FIRST_TERM_INDEX; // we call the first Lucas term, U(2)
+	l.v1 = gen_u2(h, n, l.riesel_cand, l.u_term);
+	if (debuglevel >= DBG_MED) {
+	    dbg(DBG_MED, "v[1] = %lu ;", l.v1);
+	    if (debuglevel >= DBG_HIGH) {
+		write_calc_mpz_hex(stderr, NULL, "u[2]", l.u_term);
+	    }
+	    fflush(stderr); // paranoia
+	}
+	if (calc_mode) {
+	    printf("print \"read lucas;\"\n");
+	    printf("read lucas;\n");
+	    printf("print \"v1 = gen_v1(%s, %s);\";\n", h_str, n_str);
+	    printf("v1 = gen_v1(%s, %s);\n", h_str, n_str);
+	    printf("print \"gmprime_v1 = %lu;\"\n", l.v1);
+	    printf("gmprime_v1 = %lu;\n", l.v1);
+	    printf("if (v1 == gmprime_v1) {\n");
+	    printf("  print \"v[1] value set correctly\";\n");
+	    printf("} else {\n");
+	    printf("  print \"# ERR: v1 != gmprime_v1\";\n");
+	    printf("  print \"v1 = \", v1;\n");
+	    printf("  print \"gmprime_v1 = \", gmprime_v1;\n");
+	    printf("  quit \"v[1] value not correctly set\";\n");
+	    printf("}\n");
+	    printf("v1 = gen_v1(%s, %s);\n", h_str, n_str);
+	    printf("print \"u_term = gen_u2(%s, %s, v1);\";\n", h_str, n_str);
+	    printf("u_term = gen_u2(%s, %s, v1);\n", h_str, n_str);
+	    write_calc_mpz_hex(stdout, NULL, "gmprime_u_term", l.u_term);
+	    printf("if (u_term == gmprime_u_term) {\n");
+	    printf("  print \"u[2] value set correctly\";\n");
+	    printf("} else {\n");
+	    printf("  print \"# ERR: u_term != gmprime_u_term for u[2]\";\n");
+	    printf("  print \"u_term = \", u_term;\n");
+	    printf("  print \"gmprime_u_term = \", gmprime_u_term;\n");
+	    printf("  quit \"u[2] value not correctly set\";\n");
+	    printf("}\n");
+	    zcalc_flush(); // paranoia
+	}
+
+	/*
+	 * if checkpointing, perform an initial checkpoint for U(2)
+	 */
+	if (live != NULL) {
+	    dbg(DBG_MED, "checkpointing for u(2): %s", checkpoint_dir);
+	    live_checkpoint(live, checkpoint_dir, h, n, l.i, l.v1, l.u_term);
+	} else if (checkpoint_dir != NULL) {
+	    dbg(DBG_MED, "checkpointing for u(2): %s", checkpoint_dir);
+	    checkpoint(checkpoint_dir, true, h, n, l.i, l.v1, l.u_term);
+	}
+    }
+
+    /*
+     * select an engine unless we must show each sub-step with the GMP code
+     */
+    eng = NULL;
+    eng_state = NULL;
+    if (!calc_mode && debuglevel < DBG_HIGH) {
+	eng = engine_select(opts->engine, h, n);
+    }
+    if (eng != NULL) {
+	eng_state = eng->setup(h, n);
+	if (eng_state == NULL) {
+	    dbg(DBG_LOW, "engine: %s setup failed, using: %s", eng->name, ENGINE_GMP);
+	    eng = NULL;
+	} else {
+	    eng->import(eng_state, l.u_term);
+	}
+    }
+
+    /*
+     * note the start of this run, and its engine, in the history of the test,
+     * and watch for the engine running far slower than it did before
+     */
+    wd = NULL;
+    if (checkpoint_dir != NULL) {
+	checkpoint_history_begin((eng != NULL ? eng->name : ENGINE_GMP), l.i);
+	wd = watchdog_start(opts->watchdog, opts->watchdog_secs, l.i, (eng != NULL ? eng->name : ENGINE_GMP),
+			    checkpoint_history_rate(eng != NULL ? eng->name : ENGINE_GMP));
+    }
+
+    /*
+     * compute u(n)
+     *
+     * u(i+1) = u(i)^2 - 2 mod 2^n-1
+     */
+    while (l.i < n) {
+
+	/*
+	 * case: an engine computes terms up to the next possible checkpoint
+	 */
+	if (eng != NULL) {
+	    watchdog_pause(wd);
+	    throttle_block(th);
+	    control_poll(ctl, l.i);
+	    watchdog_block(wd, l.i);
+	    count = n - l.i;
+	    if (count > LUCAS_BLOCK) {
+		count = LUCAS_BLOCK;
+	    }
+	    if (opts->multiple > 0 && count > opts->multiple - (l.i % opts->multiple)) {
+		count = opts->multiple - (l.i % opts->multiple);
+	    }
+	    if (checkpoint_dir != NULL && n > CHECKPOINT_PREVIEW && l.i < n - CHECKPOINT_PREVIEW &&
+		count > n - CHECKPOINT_PREVIEW - l.i) {
+		count = n - CHECKPOINT_PREVIEW - l.i;
+	    }
+	    if (checkpoint_dir != NULL && l.i < n - 1 && count > n - 1 - l.i) {
+		count = n - 1 - l.i;
+	    }
+	    eng->step(eng_state, count);
+	    l.i += count;
+	    if (checkpoint_dir != NULL && checkpoint_needed(h, n, l.i, opts->multiple)) {
+		eng->export(eng_state, l.u_term);
+		dbg(DBG_MED, "checkpointing for u[%ld]: %s", l.i, checkpoint_dir);
+		if (live != NULL) {
+		    live_checkpoint(live, checkpoint_dir, h, n, l.i, l.v1, l.u_term);
+		} else {
+		    checkpoint(checkpoint_dir, true, h, n, l.i, l.v1, l.u_term);
+		}
+	    } else if (live != NULL) {
+		eng->export(eng_state, l.u_term);
+		live_update(live, l.i, l.v1, l.u_term);
+	    }
+	    continue;
+	}
+
+	/*
+	 * every LUCAS_BLOCK terms, keep to the CPU budget, apply control commands,
+	 * note the progress for the watchdog and adjust the number of squaring threads if requested
+	 */
+	if ((l.i % LUCAS_BLOCK) == 0) {
+	    watchdog_pause(wd);
+	    throttle_block(th);
+	    control_poll(ctl, l.i);
+	    watchdog_block(wd, l.i);
+	}
+	if (opts->threads != NULL && (l.i % LUCAS_BLOCK) == 0) {
+	    threads = *opts->threads;
+	    if (threads > 1 && l.squad == NULL) {
+		l.squad = parsqr_alloc(threads);
+	    } else if (l.squad != NULL && threads != parsqr_threads(l.squad)) {
+		parsqr_set_threads(l.squad, threads);
+	    }
+	}
+
+	/*
+	 * u(i+1) = u(i)^2 - 2 mod h*2^n-1
+	 */
+	lucas_next_term(&l, calc_mode);
+
+	/*
+	 * checkpoint if checkpointing and needed, otherwise keep the live residue every LUCAS_BLOCK terms
+	 */
+	if (checkpoint_dir != NULL && checkpoint_needed(h, n, l.i, opts->multiple)) {
+	    dbg(DBG_MED, "checkpointing for u[%ld]: %s", l.i, checkpoint_dir);
+	    if (live != NULL) {
+		live_checkpoint(live, checkpoint_dir, h, n, l.i, l.v1, l.u_term);
+	    } else {
+		checkpoint(checkpoint_dir, true, h, n, l.i, l.v1, l.u_term);
+	    }
+	} else if (live != NULL && (l.i % LUCAS_BLOCK) == 0) {
+	    live_update(live, l.i, l.v1, l.u_term);
+	}
+    }
+    if (eng != NULL) {
+	eng->export(eng_state, l.u_term);
+	eng->cleanup(eng_state);
+    }
+    live_close(live, true);
+    watchdog_stop(wd);
+    control_stop(ctl);
+    throttle_stop(th);
+    checkpoint_close();		// unlock the checkpoint directory, so another test may use it
+    dbg(DBG_LOW, "finished testing %lu*2^%lu-1", h, n);
+    debug_flush(); // so the stats follow the messages before them
+
+    /*
+     * print final prime stats according to -t and/or -T
+     */
+    if (opts->write_stats) {
+	update_stats();
+	write_calc_prime_stats(stderr, opts->write_extended_stats);
+    }
+
+    /*
+     * h*2^n-1 is prime if and only if u(n) == 0
+     */
+    if (calc_mode) {
+	printf("print \"%s: u[%ld] =\", u_term;\n", program, l.i);
+	printf("print \"%s: original test: %ld * 2 ^ %ld - 1;\"\n", program, orig_h, orig_n);
+	printf("print \"%s: actual test: %ld * 2 ^ %ld - 1;\"\n", program, h, n);
+    }
+    if (mpz_sgn(l.u_term) == 0) {
+	if (calc_mode) {
+	    printf("if (u_term == 0) { print \"u[%ld] == 0\"; } else { print \"ERROR: u[%ld] != 0\"; }\n", l.i, l.i);
+	    printf("print \"%s: %ld * 2 ^ %ld - 1 is prime\";\n", program, orig_h, orig_n);
+	} else if (!quiet) {
+	    printf("%ld * 2 ^ %ld - 1 is prime\n", orig_h, orig_n);
+	}
+    } else {
+	if (calc_mode) {
+	    printf("if (u_term != 0) { print \"u[%ld] != 0\"; } else { print \"ERROR: u[%ld] != 0\"; }\n", l.i, l.i);
+	    printf("print \"%s: %ld * 2 ^ %ld - 1 is composite\";\n", program, orig_h, orig_n);
+	} else if (!quiet) {
+	    printf("%ld * 2 ^ %ld - 1 is composite\n", orig_h, orig_n);
+	}
+	dbg(DBG_LOW, "exit composite");
+	lucas_clear(&l);
+	return EXIT_IS_COMPOSITE;
+    }
+
+    /*
+     * All Done!! -- Jessica Noll, Age 2
+     */
+    dbg(DBG_LOW, "exit prime");
+    lucas_clear(&l);
+    return EXIT_IS_PRIME;
+}
@@ -0,0 +1,101 @@
+/*
+ * lucas - Lucas-Lehmer-Riesel test of a single h*2^n-1 candidate
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_LUCAS_H)
+#define INCLUDE_LUCAS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <gmp.h>
+
+#include "parsqr.h"
+
+/*
+ * lucas constants
+ */
+#define LUCAS_BLOCK	(64)	// re-read the requested squaring thread count every LUCAS_BLOCK terms
+#define LUCAS_BASE_BYTES (4*1024*1024)	// memory a test uses before allocating any terms
+#define LUCAS_GMP_COPIES (18)	// n bit values the GMP code holds at once, including squaring scratch
+#define LUCAS_ENGINE_COPIES (4)	// n bit values the GMP code holds at once when an engine squares
+
+/*
+ * how a single h*2^n-1 candidate is to be tested
+ */
+struct lucas_opts {
+    bool calc_mode;		/* output calc code so calc can verify partial results */
+    bool quiet;			/* do not announce if the number if prime or composite */
+    bool write_stats;		/* output total prime stats to stderr */
+    bool write_extended_stats;	/* output extended prime stats to stderr */
+    char *checkpoint_dir;	/* form checkpoint files under checkpoint_dir, NULL ==> do not checkpoint */
+    int checkpoint_secs;	/* checkpoint every checkpoint_secs seconds */
+    unsigned long multiple;	/* checkpoint when i is a multiple, 0 ==> do not */
+    bool force;			/* force checkpoint_dir to be re-initialzed */
+    bool restore;		/* true --> restore h and n state from checkpoint_dir */
+    bool live;			/* keep the u term in a mapped file under checkpoint_dir (see live.c) */
+    volatile int *threads;	/* squaring threads to use, NULL ==> 1, re-read every LUCAS_BLOCK terms */
+    const char *engine;		/* engine name (see engine.h), NULL ==> ENGINE_GMP */
+    bool verify;		/* test h*2^n-1 even if it is a known prime (see known.c) */
+    int cpu;			/* CPU budget in percent while the host is busy (see throttle.c), 0 ==> no budget */
+    bool idle;			/* run under SCHED_IDLE */
+    unsigned long base;		/* b of h*b^n-1 (see prp.c), 0 or 2 ==> h*2^n-1 */
+    int watchdog;		/* WATCHDOG_* action when the test is slow (see watchdog.c) */
+    int watchdog_secs;		/* seconds of squaring per watchdog window */
+};
+
+/*
+ * Lucas sequence state of a h*2^n-1 test
+ */
+struct lucas {
+    unsigned long h;		/* multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+    unsigned long i;		/* u term index */
+    unsigned long v1;		/* v(1) for h and n */
+    mpz_t pow_2;		/* 2^n */
+    mpz_t h_pow_2;		/* h*(2^n) */
+    mpz_t riesel_cand;		/* Riesel candidate to test - n*(2^n)-1 */
+    mpz_t u_term;		/* Lucas sequence value - U(i) */
+    mpz_t u_term_sq;		/* square of prev term */
+    mpz_t u_term_sq_2;		/* square - 2 of prev term */
+    mpz_t J;			/* used in mod calculation - u_term_sq_2 / (2^n) */
+    mpz_t K;			/* used in mod calculation - u_term_sq_2 mod (2^n) */
+    mpz_t J_div_h;		/* used in mod calculation - int(J/h) */
+    mpz_t J_mod_h;		/* used in mod calculation - J mod h then (J mod h)*(2^n) */
+    struct parsqr *squad;	/* squaring helper threads, NULL ==> square in this thread */
+};
+
+/*
+ * external functions
+ */
+extern void lucas_init(struct lucas *lp);
+extern void lucas_clear(struct lucas *lp);
+extern void lucas_next_term(struct lucas *lp, bool calc_mode);
+extern size_t lucas_footprint(unsigned long h, unsigned long n, const char *engine);
+extern int lucas_test(unsigned long h, unsigned long n, struct lucas_opts *opts);
+
+#endif				/* INCLUDE_LUCAS_H */
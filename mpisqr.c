@@ -0,0 +1,692 @@
+/*
+ * mpisqr - MPI distributed squaring engine for very large h*2^n-1
+ *
+ * For n beyond what the memory bandwidth of one host can serve, this engine
+ * spreads each squaring over the ranks of MPI_COMM_WORLD.  It is only
+ * built into gmprime-mpi, which is started under mpirun.  Rank 0 runs the
+ * usual gmprime code, including its loop and checkpoint logic.  All other
+ * ranks wait in mpisqr_serve() for rank 0 to broadcast commands.
+ *
+ * The u term is split into MPISQR_DIGIT_BITS bit digits and squared with a
+ * number theoretic transform modulo the prime 2^64-2^32+1 (see ntt.c).
+ * The transform of length len = n1*n2 is done in four steps over slabs:
+ *
+ *	each rank holds n1/ranks rows of n2 digits
+ *	all-to-all transpose, each rank holds n2/ranks columns of n1
+ *	length n1 transform of each column, multiply by twiddle factors
+ *	all-to-all transpose, each rank holds n1/ranks rows of n2
+ *	length n2 transform of each row, square, inverse transform
+ *
+ * and the inverse retraces these steps.  Carries are propagated within
+ * each slab and then passed from rank to rank until none remain.  Rank 0
+ * gathers the squared digits and reduces them mod h*2^n-1 with GMP.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 170-179	mpisqr.c - reserved for internal errors */
+
+#define _DEFAULT_SOURCE		/* for clock_gettime() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <mpi.h>
+#include <gmp.h>
+
+#include "debug.h"
+#include "engine.h"
+#include "mpisqr.h"
+#include "ntt.h"
+
+/*
+ * commands broadcast by rank 0
+ */
+enum mpisqr_cmd {
+    MPISQR_CMD_SETUP = 1,	/* setup for h*2^n-1 */
+    MPISQR_CMD_SQUARE,		/* square the scattered u term */
+    MPISQR_CMD_CLEANUP,		/* free setup */
+    MPISQR_CMD_QUIT		/* finalize MPI and exit */
+};
+
+/*
+ * distributed squaring state, one per rank
+ */
+struct mpisqr {
+    unsigned long h;		/* multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+    long len;			/* transform length, a power of 2 */
+    long n1;			/* column transform length */
+    long n2;			/* row transform length, len == n1*n2 */
+    long r1;			/* rows of n2 per rank */
+    long c2;			/* columns of n1 per rank */
+    long slab;			/* transform elements per rank */
+    uint64_t *a;		/* slab of transform elements */
+    uint64_t *b;		/* slab of transposed transform elements */
+    uint64_t *sendbuf;		/* all-to-all send buffer */
+    uint64_t *recvbuf;		/* all-to-all receive buffer */
+    uint64_t *tw1;		/* powers of the n1-th root of unity */
+    uint64_t *itw1;		/* powers of its inverse */
+    uint64_t *tw2;		/* powers of the n2-th root of unity */
+    uint64_t *itw2;		/* powers of its inverse */
+    uint64_t *pw;		/* twiddle factor powers for one column */
+    uint32_t *rev1;		/* bit reversal of column indexes */
+    uint64_t w;			/* len-th root of unity */
+    uint64_t iw;		/* its inverse */
+    uint64_t scale;		/* 1/len */
+    uint16_t *dig;		/* slab of digits */
+
+    /* rank 0 only */
+    uint16_t *all;		/* all len digits */
+    mpz_t cand;			/* h*2^n-1 */
+    mpz_t u;			/* u term */
+    mpz_t sq;			/* u term squared */
+    mpz_t j;			/* J = int(u^2-2 / 2^n) */
+    mpz_t q;			/* int(J/h) */
+    long terms;			/* terms computed */
+    double secs;		/* wall clock seconds spent computing them */
+};
+
+/*
+ * MPI state
+ */
+static int rank = 0;			/* our rank in MPI_COMM_WORLD */
+static int ranks = 1;			/* ranks in MPI_COMM_WORLD */
+static pid_t master = 0;		/* pid of rank 0, 0 ==> MPI not started */
+static volatile bool busy = false;	/* true ==> within a collective operation */
+
+/*
+ * static functions
+ */
+static void mpisqr_stop(void);
+static struct mpisqr *mpisqr_plan(unsigned long h, unsigned long n);
+static void mpisqr_free(struct mpisqr *st);
+static void mpisqr_square(struct mpisqr *st);
+static void mpisqr_transpose(struct mpisqr *st, uint64_t *in, uint64_t *out, long rows, long width);
+static void mpisqr_carry(struct mpisqr *st);
+static void mpisqr_reduce(struct mpisqr *st);
+static long mpisqr_len(unsigned long h, unsigned long n);
+
+
+/*
+ * mpisqr_start - initialize MPI
+ *
+ * given:
+ *      argc    pointer to argc from main
+ *      argv    pointer to argv from main
+ *
+ * returns:
+ *      our rank, 0 ==> run gmprime, else call mpisqr_serve()
+ */
+int
+mpisqr_start(int *argc, char ***argv)
+{
+    if (MPI_Init(argc, argv) != MPI_SUCCESS) {
+	err(170, __func__, "MPI_Init failed");
+	return -1;	// NOT REACHED
+    }
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    master = getpid();
+    if (atexit(mpisqr_stop) != 0) {
+	MPI_Abort(MPI_COMM_WORLD, 170);
+    }
+    return rank;
+}
+
+
+/*
+ * mpisqr_stop - tell the other ranks to exit and finalize MPI
+ *
+ * Called at exit.  If we exit within a collective operation, the other
+ * ranks cannot be told to exit, so we abort all of them.
+ */
+static void
+mpisqr_stop(void)
+{
+    uint64_t cmd[3] = {MPISQR_CMD_QUIT, 0, 0};	/* quit command */
+
+    if (master != getpid()) {	/* a forked batch worker */
+	return;
+    }
+    master = 0;
+    if (busy || rank != 0) {
+	MPI_Abort(MPI_COMM_WORLD, 171);
+    }
+    MPI_Bcast(cmd, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    MPI_Finalize();
+    return;
+}
+
+
+/*
+ * mpisqr_serve - perform the commands broadcast by rank 0
+ *
+ * returns:
+ *      0 once rank 0 exits
+ */
+int
+mpisqr_serve(void)
+{
+    uint64_t cmd[3];			/* command, h, n */
+    struct mpisqr *st = NULL;		/* distributed squaring state */
+
+    for (;;) {
+	MPI_Bcast(cmd, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+	busy = true;
+	switch (cmd[0]) {
+	case MPISQR_CMD_SETUP:
+	    mpisqr_free(st);
+	    st = mpisqr_plan((unsigned long)cmd[1], (unsigned long)cmd[2]);
+	    break;
+	case MPISQR_CMD_SQUARE:
+	    if (st == NULL) {
+		err(172, __func__, "square command before setup");
+		return 172;	// NOT REACHED
+	    }
+	    mpisqr_square(st);
+	    break;
+	case MPISQR_CMD_CLEANUP:
+	    mpisqr_free(st);
+	    st = NULL;
+	    break;
+	case MPISQR_CMD_QUIT:
+	    mpisqr_free(st);
+	    busy = false;
+	    master = 0;
+	    MPI_Finalize();
+	    return 0;
+	default:
+	    err(173, __func__, "unknown command: %llu", (unsigned long long)cmd[0]);
+	    return 173;	// NOT REACHED
+	}
+	busy = false;
+    }
+}
+
+
+/*
+ * mpisqr_len - transform length for h*2^n-1
+ *
+ * returns:
+ *      transform length, 0 ==> too large for this engine
+ */
+static long
+mpisqr_len(unsigned long h, unsigned long n)
+{
+    unsigned long digits;	/* digits in h*2^n-1 */
+    unsigned long len;		/* transform length */
+
+    digits = (n + (unsigned long)(64 - __builtin_clzl(h)) + MPISQR_DIGIT_BITS - 1) / MPISQR_DIGIT_BITS;
+    for (len = 4; len < 2 * digits || len < (unsigned long)ranks * (unsigned long)ranks; len <<= 1) {
+	if (len >= (1UL << GL_MAX_LOG)) {
+	    return 0;
+	}
+    }
+    if (len / (unsigned long)ranks > (unsigned long)INT_MAX) {
+	return 0;
+    }
+    return (long)len;
+}
+
+
+/*
+ * mpisqr_plan - allocate distributed squaring state for h*2^n-1
+ */
+static struct mpisqr *
+mpisqr_plan(unsigned long h, unsigned long n)
+{
+    struct mpisqr *st;		/* distributed squaring state */
+    int log_n1;			/* log2 of n1 */
+
+    errno = 0;
+    st = calloc(1, sizeof(struct mpisqr));
+    if (st == NULL) {
+	errp(174, __func__, "calloc of MPI state failed");
+	return NULL;	// NOT REACHED
+    }
+    st->h = h;
+    st->n = n;
+    st->len = mpisqr_len(h, n);
+    log_n1 = (__builtin_ctzl((unsigned long)st->len)) / 2;
+    st->n1 = 1L << log_n1;
+    st->n2 = st->len / st->n1;
+    st->r1 = st->n1 / ranks;
+    st->c2 = st->n2 / ranks;
+    st->slab = st->len / ranks;
+
+    /*
+     * allocate slabs and tables
+     */
+    errno = 0;
+    st->a = malloc(st->slab * sizeof(uint64_t));
+    st->b = malloc(st->slab * sizeof(uint64_t));
+    st->sendbuf = malloc(st->slab * sizeof(uint64_t));
+    st->recvbuf = malloc(st->slab * sizeof(uint64_t));
+    st->tw1 = malloc(st->n1 / 2 * sizeof(uint64_t));
+    st->itw1 = malloc(st->n1 / 2 * sizeof(uint64_t));
+    st->tw2 = malloc(st->n2 / 2 * sizeof(uint64_t));
+    st->itw2 = malloc(st->n2 / 2 * sizeof(uint64_t));
+    st->pw = malloc(st->n1 * sizeof(uint64_t));
+    st->rev1 = malloc(st->n1 * sizeof(uint32_t));
+    st->dig = malloc(st->slab * sizeof(uint16_t));
+    if (st->a == NULL || st->b == NULL || st->sendbuf == NULL || st->recvbuf == NULL ||
+	st->tw1 == NULL || st->itw1 == NULL || st->tw2 == NULL || st->itw2 == NULL ||
+	st->pw == NULL || st->rev1 == NULL || st->dig == NULL) {
+	errp(175, __func__, "allocation of MPI slabs of %ld elements failed", st->slab);
+	return NULL;	// NOT REACHED
+    }
+
+    /*
+     * roots of unity
+     */
+    st->w = gl_pow(GL_GEN, (GL_P - 1) / (uint64_t)st->len);
+    st->iw = gl_pow(st->w, GL_P - 2);
+    st->scale = gl_pow((uint64_t)st->len, GL_P - 2);
+    ntt_powers(st->tw1, st->n1 / 2, gl_pow(st->w, (uint64_t)st->n2));
+    ntt_powers(st->itw1, st->n1 / 2, gl_pow(st->iw, (uint64_t)st->n2));
+    ntt_powers(st->tw2, st->n2 / 2, gl_pow(st->w, (uint64_t)st->n1));
+    ntt_powers(st->itw2, st->n2 / 2, gl_pow(st->iw, (uint64_t)st->n1));
+    ntt_bitrev(st->rev1, st->n1);
+
+    /*
+     * rank 0 reduces the square
+     */
+    if (rank == 0) {
+	errno = 0;
+	st->all = calloc(st->len, sizeof(uint16_t));
+	if (st->all == NULL) {
+	    errp(176, __func__, "calloc of %ld digits failed", st->len);
+	    return NULL;	// NOT REACHED
+	}
+	mpz_init(st->cand);
+	mpz_ui_pow_ui(st->cand, 2, n);
+	mpz_mul_ui(st->cand, st->cand, h);
+	mpz_sub_ui(st->cand, st->cand, 1);
+	mpz_init(st->u);
+	mpz_init(st->sq);
+	mpz_init(st->j);
+	mpz_init(st->q);
+    }
+    dbg(DBG_MED, "MPI setup for %lu*2^%lu-1: %d ranks, transform length %ld = %ld x %ld",
+	h, n, ranks, st->len, st->n1, st->n2);
+    return st;
+}
+
+
+/*
+ * mpisqr_free - free distributed squaring state
+ */
+static void
+mpisqr_free(struct mpisqr *st)
+{
+    if (st == NULL) {
+	return;
+    }
+    free(st->a);
+    free(st->b);
+    free(st->sendbuf);
+    free(st->recvbuf);
+    free(st->tw1);
+    free(st->itw1);
+    free(st->tw2);
+    free(st->itw2);
+    free(st->pw);
+    free(st->rev1);
+    free(st->dig);
+    if (rank == 0) {
+	free(st->all);
+	mpz_clear(st->cand);
+	mpz_clear(st->u);
+	mpz_clear(st->sq);
+	mpz_clear(st->j);
+	mpz_clear(st->q);
+    }
+    free(st);
+    return;
+}
+
+
+/*
+ * mpisqr_square - square the digits in st->all on rank 0, leaving the square in st->all
+ *
+ * Every rank must call this function.
+ */
+static void
+mpisqr_square(struct mpisqr *st)
+{
+    long i;
+    long k;
+
+    /*
+     * each rank gets n1/ranks rows of n2 digits
+     */
+    MPI_Scatter(st->all, (int)st->slab, MPI_UINT16_T, st->dig, (int)st->slab, MPI_UINT16_T, 0, MPI_COMM_WORLD);
+    for (i = 0; i < st->slab; ++i) {
+	st->a[i] = st->dig[i];
+    }
+
+    /*
+     * transform columns, then rows, and square
+     */
+    mpisqr_transpose(st, st->a, st->b, st->r1, st->n2);
+    for (k = 0; k < st->c2; ++k) {
+	ntt_dif(st->b + k * st->n1, st->n1, st->tw1);
+	ntt_twiddle(st->b + k * st->n1, st->n1, st->rev1, st->pw, gl_pow(st->w, (uint64_t)(rank * st->c2 + k)));
+    }
+    mpisqr_transpose(st, st->b, st->a, st->c2, st->n1);
+    for (k = 0; k < st->r1; ++k) {
+	uint64_t *row = st->a + k * st->n2;
+	ntt_dif(row, st->n2, st->tw2);
+	for (i = 0; i < st->n2; ++i) {
+	    row[i] = gl_mul(row[i], row[i]);
+	}
+	ntt_dit(row, st->n2, st->itw2);
+    }
+
+    /*
+     * inverse transform columns
+     */
+    mpisqr_transpose(st, st->a, st->b, st->r1, st->n2);
+    for (k = 0; k < st->c2; ++k) {
+	ntt_twiddle(st->b + k * st->n1, st->n1, st->rev1, st->pw, gl_pow(st->iw, (uint64_t)(rank * st->c2 + k)));
+	ntt_dit(st->b + k * st->n1, st->n1, st->itw1);
+    }
+    mpisqr_transpose(st, st->b, st->a, st->c2, st->n1);
+
+    /*
+     * carry and collect the square on rank 0
+     */
+    mpisqr_carry(st);
+    MPI_Gather(st->dig, (int)st->slab, MPI_UINT16_T, st->all, (int)st->slab, MPI_UINT16_T, 0, MPI_COMM_WORLD);
+    return;
+}
+
+
+/*
+ * mpisqr_transpose - all-to-all transpose of a matrix distributed by rows
+ *
+ * given:
+ *      st      distributed squaring state
+ *      in      rows of this rank, each width elements
+ *      out     columns of this rank, each rows*ranks elements
+ *      rows    rows per rank
+ *      width   elements per row
+ */
+static void
+mpisqr_transpose(struct mpisqr *st, uint64_t *in, uint64_t *out, long rows, long width)
+{
+    long cols = width / ranks;		/* columns per rank */
+    long block = rows * cols;		/* elements sent to each rank */
+    long height = rows * ranks;		/* elements per column */
+    long t;
+    long r;
+    long c;
+
+    for (t = 0; t < ranks; ++t) {
+	for (r = 0; r < rows; ++r) {
+	    memcpy(st->sendbuf + t * block + r * cols, in + r * width + t * cols, cols * sizeof(uint64_t));
+	}
+    }
+    MPI_Alltoall(st->sendbuf, (int)block, MPI_UINT64_T, st->recvbuf, (int)block, MPI_UINT64_T, MPI_COMM_WORLD);
+    for (t = 0; t < ranks; ++t) {
+	for (r = 0; r < rows; ++r) {
+	    for (c = 0; c < cols; ++c) {
+		out[c * height + t * rows + r] = st->recvbuf[t * block + r * cols + c];
+	    }
+	}
+    }
+    return;
+}
+
+
+
+/*
+ * mpisqr_carry - scale and carry the inverse transform into digits
+ *
+ * Each rank carries within its slab, then passes its carry to the next
+ * rank, until no rank has a carry left.
+ */
+static void
+mpisqr_carry(struct mpisqr *st)
+{
+    ntt_u128 v;		/* digit plus carry */
+    uint64_t carry = 0;		/* carry out of our slab */
+    uint64_t cin;		/* carry into our slab */
+    uint64_t any;		/* non-zero ==> some rank has a carry left */
+    long i;
+
+    for (i = 0; i < st->slab; ++i) {
+	v = (ntt_u128)gl_mul(st->a[i], st->scale) + carry;
+	st->dig[i] = (uint16_t)v;
+	carry = (uint64_t)(v >> MPISQR_DIGIT_BITS);
+    }
+    for (;;) {
+	if (rank == ranks - 1 && carry != 0) {
+	    err(177, __func__, "square overflowed transform length: %ld", st->len);
+	    return;	// NOT REACHED
+	}
+	cin = 0;
+	MPI_Sendrecv(&carry, 1, MPI_UINT64_T, (rank + 1 < ranks) ? rank + 1 : MPI_PROC_NULL, 0,
+		     &cin, 1, MPI_UINT64_T, (rank > 0) ? rank - 1 : MPI_PROC_NULL, 0,
+		     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	for (i = 0; cin != 0 && i < st->slab; ++i) {
+	    v = (ntt_u128)st->dig[i] + cin;
+	    st->dig[i] = (uint16_t)v;
+	    cin = (uint64_t)(v >> MPISQR_DIGIT_BITS);
+	}
+	carry = cin;
+	MPI_Allreduce(&carry, &any, 1, MPI_UINT64_T, MPI_BOR, MPI_COMM_WORLD);
+	if (any == 0) {
+	    break;
+	}
+    }
+    return;
+}
+
+
+/*
+ * mpisqr_reduce - u = square - 2 mod h*2^n-1 on rank 0
+ *
+ * With J = int((u^2-2) / 2^n) and K = (u^2-2) mod 2^n:
+ *
+ *	u^2-2 == int(J/h) + (J mod h)*2^n + K mod h*2^n-1
+ */
+static void
+mpisqr_reduce(struct mpisqr *st)
+{
+    unsigned long rem;		/* J mod h */
+
+    mpz_import(st->sq, st->len, -1, sizeof(uint16_t), 0, 0, st->all);
+    mpz_sub_ui(st->sq, st->sq, 2);
+    if (mpz_sgn(st->sq) < 0) {
+	mpz_add(st->u, st->sq, st->cand);
+	return;
+    }
+    mpz_fdiv_q_2exp(st->j, st->sq, st->n);
+    mpz_fdiv_r_2exp(st->u, st->sq, st->n);
+    rem = mpz_tdiv_q_ui(st->q, st->j, st->h);
+    mpz_add(st->u, st->u, st->q);
+    mpz_set_ui(st->j, rem);
+    mpz_mul_2exp(st->j, st->j, st->n);
+    mpz_add(st->u, st->u, st->j);
+    while (mpz_cmp(st->u, st->cand) >= 0) {
+	mpz_sub(st->u, st->u, st->cand);
+    }
+    return;
+}
+
+
+
+/*
+ * mpi_usable - determine if we can test h*2^n-1 with the ranks we have
+ *
+ * Only rank 0 itself, not a forked batch worker, may use MPI.
+ */
+static bool
+mpi_usable(unsigned long h, unsigned long n)
+{
+    return master == getpid() && rank == 0 && (ranks & (ranks - 1)) == 0 &&
+	n >= MPISQR_MIN_N && h > 0 && mpisqr_len(h, n) > 0;
+}
+
+
+/*
+ * mpi_footprint - bytes mpisqr_plan() allocates on rank 0 for h*2^n-1
+ */
+static size_t
+mpi_footprint(unsigned long h, unsigned long n)
+{
+    long len;			/* transform length */
+    long n1;			/* rows */
+    long n2;			/* columns */
+    long slab;			/* elements on each rank */
+
+    len = mpisqr_len(h, n);
+    if (len == 0) {
+	return 0;
+    }
+    n1 = 1L << (__builtin_ctzl((unsigned long)len) / 2);
+    n2 = len / n1;
+    slab = len / ranks;
+    return sizeof(struct mpisqr) + (size_t)(4 * slab + n1 + n2 + n1) * sizeof(uint64_t) +
+	   (size_t)n1 * sizeof(uint32_t) + (size_t)(slab + len) * sizeof(uint16_t) + 6 * (n / 8 + 8);
+}
+
+
+/*
+ * mpi_setup - setup all ranks for h*2^n-1
+ */
+static void *
+mpi_setup(unsigned long h, unsigned long n)
+{
+    uint64_t cmd[3] = {MPISQR_CMD_SETUP, h, n};	/* setup command */
+    struct mpisqr *st;				/* distributed squaring state */
+
+    MPI_Bcast(cmd, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    st = mpisqr_plan(h, n);
+    return st;
+}
+
+
+/*
+ * mpi_import - load U(i)
+ */
+static void
+mpi_import(void *state, const mpz_t u_term)
+{
+    struct mpisqr *st = state;	/* distributed squaring state */
+
+    mpz_mod(st->u, u_term, st->cand);
+    return;
+}
+
+
+/*
+ * mpi_step - advance count terms
+ */
+static void
+mpi_step(void *state, unsigned long count)
+{
+    struct mpisqr *st = state;			/* distributed squaring state */
+    uint64_t cmd[3] = {MPISQR_CMD_SQUARE, 0, 0};	/* square command */
+    struct timespec start;			/* when we started */
+    struct timespec end;			/* when we finished */
+    unsigned long k;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < count; ++k) {
+	MPI_Bcast(cmd, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+	busy = true;
+	memset(st->all, 0, st->len * sizeof(uint16_t));
+	mpz_export(st->all, NULL, -1, sizeof(uint16_t), 0, 0, st->u);
+	mpisqr_square(st);
+	busy = false;
+	mpisqr_reduce(st);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    st->terms += (long)count;
+    st->secs += (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return;
+}
+
+
+/*
+ * mpi_export - store U(i)
+ */
+static void
+mpi_export(void *state, mpz_t u_term)
+{
+    struct mpisqr *st = state;	/* distributed squaring state */
+
+    mpz_set(u_term, st->u);
+    return;
+}
+
+
+/*
+ * mpi_cleanup - report timing and free the state of all ranks
+ *
+ * The time per term for each rank count gives the strong scaling efficiency
+ * (see the mpi_scaling rule in the Makefile).
+ */
+static void
+mpi_cleanup(void *state)
+{
+    struct mpisqr *st = state;	/* distributed squaring state */
+    uint64_t cmd[3] = {MPISQR_CMD_CLEANUP, 0, 0};	/* cleanup command */
+
+    if (st == NULL) {
+	return;
+    }
+    if (st->terms > 0) {
+	dbg(DBG_LOW, "MPI ranks: %d terms: %ld ms per term: %.3f",
+	    ranks, st->terms, st->secs * 1000.0 / (double)st->terms);
+    }
+    MPI_Bcast(cmd, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    mpisqr_free(st);
+    return;
+}
+
+
+/*
+ * MPI engine
+ */
+const struct engine mpi_engine = {
+    "mpi",
+    MPISQR_AUTO_MIN_N,
+    ULONG_MAX,
+    mpi_usable,
+    mpi_footprint,
+    mpi_setup,
+    mpi_import,
+    mpi_step,
+    mpi_export,
+    mpi_cleanup
+};
@@ -0,0 +1,46 @@
+/*
+ * mpisqr - MPI distributed squaring engine for very large h*2^n-1
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_MPISQR_H)
+#define INCLUDE_MPISQR_H
+
+/*
+ * mpisqr constants
+ */
+#define MPISQR_DIGIT_BITS	(16)		// bits per transform input digit
+#define MPISQR_MIN_N		(1000)		// below this size, the transform is too small to split
+#define MPISQR_AUTO_MIN_N	(100000000)	// below this size, one host squares faster than MPI ranks
+
+/*
+ * external functions
+ */
+extern int mpisqr_start(int *argc, char ***argv);
+extern int mpisqr_serve(void);
+
+#endif				/* INCLUDE_MPISQR_H */
@@ -0,0 +1,186 @@
+/*
+ * ntt - number theoretic transform modulo the prime 2^64-2^32+1
+ *
+ * The transforms used by the engines that square with a four step
+ * transform of length n1*n2: ntt_dif() and ntt_dit() transform rows or
+ * columns, and ntt_twiddle() multiplies a transformed column by its
+ * twiddle factors.  As the squares are taken pointwise, the forward
+ * transform leaves its result in bit reversed order and the inverse
+ * transform takes its input in that order.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+#include <stdint.h>
+
+#include "ntt.h"
+
+
+/*
+ * gl_pow - a^e mod GL_P
+ */
+uint64_t
+gl_pow(uint64_t a, uint64_t e)
+{
+    uint64_t r = 1;
+
+    while (e > 0) {
+	if (e & 1) {
+	    r = gl_mul(r, a);
+	}
+	a = gl_mul(a, a);
+	e >>= 1;
+    }
+    return r;
+}
+
+
+/*
+ * ntt_powers - tw[i] = root^i for 0 <= i < count
+ */
+void
+ntt_powers(uint64_t *tw, long count, uint64_t root)
+{
+    long i;
+
+    if (count > 0) {
+	tw[0] = 1;
+    }
+    for (i = 1; i < count; ++i) {
+	tw[i] = gl_mul(tw[i - 1], root);
+    }
+    return;
+}
+
+
+/*
+ * ntt_bitrev - rev[i] = i with its log2(m) bits reversed
+ */
+void
+ntt_bitrev(uint32_t *rev, long m)
+{
+    int bits = __builtin_ctzl((unsigned long)m);	/* log2(m) */
+    long i;
+    int b;
+
+    for (i = 0; i < m; ++i) {
+	rev[i] = 0;
+	for (b = 0; b < bits; ++b) {
+	    rev[i] |= (uint32_t)((i >> b) & 1) << (bits - 1 - b);
+	}
+    }
+    return;
+}
+
+
+/*
+ * ntt_dif - decimation in frequency transform, natural order in, bit reversed order out
+ *
+ * given:
+ *      x       m elements
+ *      m       transform length, a power of 2
+ *      tw      powers 0 .. m/2-1 of an m-th root of unity
+ */
+void
+ntt_dif(uint64_t *x, long m, const uint64_t *tw)
+{
+    long len;			/* butterfly span */
+    long stride;		/* twiddle index stride */
+    long start;
+    long j;
+    uint64_t u;
+    uint64_t v;
+
+    for (len = m / 2, stride = 1; len >= 1; len >>= 1, stride <<= 1) {
+	for (start = 0; start < m; start += 2 * len) {
+	    for (j = 0; j < len; ++j) {
+		u = x[start + j];
+		v = x[start + j + len];
+		x[start + j] = gl_add(u, v);
+		x[start + j + len] = gl_mul(gl_sub(u, v), tw[j * stride]);
+	    }
+	}
+    }
+    return;
+}
+
+
+/*
+ * ntt_dit - decimation in time inverse transform, bit reversed order in, natural order out
+ *
+ * given:
+ *      x       m elements
+ *      m       transform length, a power of 2
+ *      itw     powers 0 .. m/2-1 of the inverse of the root used by ntt_dif()
+ *
+ * The result is m times the inverse transform.
+ */
+void
+ntt_dit(uint64_t *x, long m, const uint64_t *itw)
+{
+    long len;			/* butterfly span */
+    long stride;		/* twiddle index stride */
+    long start;
+    long j;
+    uint64_t u;
+    uint64_t v;
+
+    for (len = 1, stride = m / 2; len < m; len <<= 1, stride >>= 1) {
+	for (start = 0; start < m; start += 2 * len) {
+	    for (j = 0; j < len; ++j) {
+		u = x[start + j];
+		v = gl_mul(x[start + j + len], itw[j * stride]);
+		x[start + j] = gl_add(u, v);
+		x[start + j + len] = gl_sub(u, v);
+	    }
+	}
+    }
+    return;
+}
+
+
+/*
+ * ntt_twiddle - multiply a transformed column by its twiddle factors
+ *
+ * given:
+ *      x       column of m elements, in bit reversed order
+ *      m       column length
+ *      rev     bit reversal table for m
+ *      pw      scratch for m powers
+ *      base    root^col where root is the n1*n2-th root of unity (or its inverse)
+ *
+ * Element k of column col is multiplied by root^(col*k).
+ */
+void
+ntt_twiddle(uint64_t *x, long m, const uint32_t *rev, uint64_t *pw, uint64_t base)
+{
+    long i;
+
+    ntt_powers(pw, m, base);
+    for (i = 0; i < m; ++i) {
+	x[i] = gl_mul(x[i], pw[rev[i]]);
+    }
+    return;
+}
@@ -0,0 +1,118 @@
+/*
+ * ntt - number theoretic transform modulo the prime 2^64-2^32+1
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_NTT_H)
+#define INCLUDE_NTT_H
+
+#include <stdint.h>
+
+/*
+ * arithmetic mod the prime 2^64-2^32+1
+ */
+#define GL_P	((uint64_t)0xffffffff00000001)	// the prime
+#define GL_EPS	((uint64_t)0xffffffff)		// 2^64 mod GL_P
+#define GL_GEN	((uint64_t)7)			// generator of the multiplicative group
+#define GL_MAX_LOG (32)				// 2^32 divides GL_P-1, the longest transform
+
+__extension__ typedef unsigned __int128 ntt_u128;	/* 64x64 bit product */
+
+
+/*
+ * gl_add - a + b mod GL_P
+ */
+static inline uint64_t
+gl_add(uint64_t a, uint64_t b)
+{
+    uint64_t s = a + b;
+
+    if (s < a) {
+	s += GL_EPS;
+    } else if (s >= GL_P) {
+	s -= GL_P;
+    }
+    return s;
+}
+
+
+/*
+ * gl_sub - a - b mod GL_P
+ */
+static inline uint64_t
+gl_sub(uint64_t a, uint64_t b)
+{
+    uint64_t d = a - b;
+
+    if (a < b) {
+	d -= GL_EPS;
+    }
+    return d;
+}
+
+
+/*
+ * gl_mul - a * b mod GL_P
+ *
+ * With x = lo + hi_lo*2^64 + hi_hi*2^96, 2^64 == 2^32-1 and 2^96 == -1 mod GL_P.
+ */
+static inline uint64_t
+gl_mul(uint64_t a, uint64_t b)
+{
+    ntt_u128 x = (ntt_u128)a * b;
+    uint64_t lo = (uint64_t)x;
+    uint64_t hi = (uint64_t)(x >> 64);
+    uint64_t t0;
+    uint64_t t1;
+    uint64_t t2;
+
+    t0 = lo - (hi >> 32);
+    if (lo < (hi >> 32)) {
+	t0 -= GL_EPS;
+    }
+    t1 = (hi & GL_EPS) * GL_EPS;
+    t2 = t0 + t1;
+    if (t2 < t1) {
+	t2 += GL_EPS;
+    }
+    if (t2 >= GL_P) {
+	t2 -= GL_P;
+    }
+    return t2;
+}
+
+/*
+ * external functions
+ */
+extern uint64_t gl_pow(uint64_t a, uint64_t e);
+extern void ntt_powers(uint64_t *tw, long count, uint64_t root);
+extern void ntt_bitrev(uint32_t *rev, long m);
+extern void ntt_dif(uint64_t *x, long m, const uint64_t *tw);
+extern void ntt_dit(uint64_t *x, long m, const uint64_t *itw);
+extern void ntt_twiddle(uint64_t *x, long m, const uint32_t *rev, uint64_t *pw, uint64_t base);
+
+#endif				/* INCLUDE_NTT_H */
@@ -0,0 +1,696 @@
+/*
+ * ooc - out-of-core squaring engine for h*2^n-1 too large for memory
+ *
+ * The GMP code in lucas.c needs the 2n bit square of the u term plus
+ * several n bit temporaries in memory.  This engine keeps the u term, the
+ * transform and the quotient in files under OOC_DIR_ENV (or OOC_DEF_DIR),
+ * that are mapped into memory and removed as soon as they are open.  The
+ * kernel writes dirty pages back to these files and drops them as memory
+ * runs short, so a host can test candidates whose square exceeds its RAM.
+ *
+ * The u term is split into OOC_DIGIT_BITS bit digits and squared with a
+ * four step number theoretic transform (see ntt.c) of len = n1*n2
+ * elements, stored as n1 rows of n2:
+ *
+ *	gather groups of columns into memory, a page or more of each row,
+ *	    transform them, multiply by twiddle factors and write them back
+ *	transform, square and inverse transform each row in turn
+ *	gather groups of columns again for the inverse column transforms
+ *	carry the result into digits
+ *
+ * The square is then reduced mod h*2^n-1 with a top down pass that
+ * divides by h, and a bottom up pass that adds the parts together.
+ * Every pass but the column passes is sequential, and madvise() prefetches
+ * the columns of the next group and the window ahead of the top down pass.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 180-189	ooc.c - reserved for internal errors */
+
+#define _DEFAULT_SOURCE		/* for mkstemp() and madvise() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <gmp.h>
+
+#include "debug.h"
+#include "engine.h"
+#include "ntt.h"
+#include "ooc.h"
+
+#define OOC_DIGIT_MASK	((uint64_t)((1 << OOC_DIGIT_BITS) - 1))	/* bits of one digit */
+
+/*
+ * out-of-core engine state
+ */
+struct ooc {
+    unsigned long h;		/* multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+    long digits;		/* digits in h*2^n-1 */
+    long d0;			/* digit holding bit n */
+    int s;			/* bit n within digit d0 */
+    uint64_t chigh;		/* h*2^s-1, the digits of h*2^n-1 from d0 up */
+    long len;			/* transform length, a power of 2 */
+    long n1;			/* rows, the column transform length */
+    long n2;			/* columns, the row transform length */
+    long group;			/* columns gathered into memory at once */
+    long jdigits;		/* digits in J = int(u^2-2 / 2^n) */
+    long qdigits;		/* digits in the quotient file */
+    uint64_t *t;		/* mapped transform, len elements */
+    uint16_t *u;		/* mapped u term, digits+1 digits */
+    uint16_t *q;		/* mapped int(J/h), qdigits digits */
+    uint64_t *col;		/* group columns of n1 elements */
+    uint64_t *tw1;		/* powers of the n1-th root of unity */
+    uint64_t *itw1;		/* powers of its inverse */
+    uint64_t *tw2;		/* powers of the n2-th root of unity */
+    uint64_t *itw2;		/* powers of its inverse */
+    uint64_t *pw;		/* twiddle factor powers for one column */
+    uint32_t *rev1;		/* bit reversal of column indexes */
+    uint64_t w;			/* len-th root of unity */
+    uint64_t iw;		/* its inverse */
+    uint64_t scale;		/* 1/len */
+};
+
+/*
+ * static functions
+ */
+static void *ooc_map(const char *dir, size_t bytes);
+static void ooc_prefetch(const void *addr, size_t bytes);
+static bool ooc_load(struct ooc *st);
+static void ooc_columns(struct ooc *st, bool inverse);
+static void ooc_rows(struct ooc *st);
+static void ooc_carry(struct ooc *st);
+static void ooc_reduce(struct ooc *st);
+static uint16_t ooc_cand_digit(const struct ooc *st, long i);
+static void ooc_free(struct ooc *st);
+
+
+/*
+ * ooc_len - transform length for h*2^n-1
+ *
+ * returns:
+ *      transform length, 0 ==> too large for this engine
+ */
+static long
+ooc_len(unsigned long h, unsigned long n)
+{
+    unsigned long digits;	/* digits in h*2^n-1 */
+    unsigned long len;		/* transform length */
+
+    digits = (n + (unsigned long)(64 - __builtin_clzl(h)) + OOC_DIGIT_BITS - 1) / OOC_DIGIT_BITS;
+    for (len = 4; len < 2 * digits; len <<= 1) {
+	if (len >= (1UL << GL_MAX_LOG)) {
+	    return 0;
+	}
+    }
+    return (long)len;
+}
+
+
+/*
+ * ooc_group - columns gathered into memory at once
+ *
+ * given:
+ *      n1      rows, the column transform length
+ *      n2      columns
+ *
+ * returns:
+ *      the largest power of 2 columns that fit in OOC_BUFFER, but at least OOC_MIN_GROUP and at most n2
+ */
+static long
+ooc_group(long n1, long n2)
+{
+    long fit;			/* columns that fit in OOC_BUFFER */
+    long group;			/* columns gathered at once */
+
+    fit = OOC_BUFFER / (n1 * (long)sizeof(uint64_t));
+    for (group = 1; group * 2 <= fit; group *= 2) {
+    }
+    if (group < OOC_MIN_GROUP) {
+	group = OOC_MIN_GROUP;
+    }
+    if (group > n2) {
+	group = n2;
+    }
+    return group;
+}
+
+
+/*
+ * ooc_footprint - bytes of memory ooc_setup() allocates for h*2^n-1
+ *
+ * The mapped files are not counted: their pages are written back to
+ * the files rather than to swap when memory runs short.
+ */
+static size_t
+ooc_footprint(unsigned long h, unsigned long n)
+{
+    long len;			/* transform length */
+    long n1;			/* rows */
+    long n2;			/* columns */
+
+    len = ooc_len(h, n);
+    if (len == 0) {
+	return 0;
+    }
+    n1 = 1L << (__builtin_ctzl((unsigned long)len) / 2);
+    n2 = len / n1;
+    return sizeof(struct ooc) + (size_t)(ooc_group(n1, n2) * n1 + 2 * n1 + n2) * sizeof(uint64_t) +
+	   (size_t)n1 * sizeof(uint32_t);
+}
+
+
+/*
+ * ooc_usable - determine if we can test h*2^n-1
+ *
+ * The top down pass divides 16 bits at a time by h, so h must be < 2^32.
+ */
+static bool
+ooc_usable(unsigned long h, unsigned long n)
+{
+    return h < (1UL << 32) && (h & 1) == 1 && n >= OOC_MIN_N && ooc_len(h, n) > 0;
+}
+
+
+/*
+ * ooc_setup - map files and allocate out-of-core state for h*2^n-1
+ *
+ * returns:
+ *      out-of-core state, NULL ==> files could not be mapped, use the GMP code
+ */
+static void *
+ooc_setup(unsigned long h, unsigned long n)
+{
+    struct ooc *st;		/* out-of-core state */
+    const char *dir;		/* where files are kept */
+
+    /*
+     * setup state
+     */
+    errno = 0;
+    st = calloc(1, sizeof(struct ooc));
+    if (st == NULL) {
+	errp(180, __func__, "calloc of out-of-core state failed");
+	return NULL;	// NOT REACHED
+    }
+    st->h = h;
+    st->n = n;
+    st->len = ooc_len(h, n);
+    st->digits = (long)((n + (unsigned long)(64 - __builtin_clzl(h)) + OOC_DIGIT_BITS - 1) / OOC_DIGIT_BITS);
+    st->d0 = (long)(n / OOC_DIGIT_BITS);
+    st->s = (int)(n % OOC_DIGIT_BITS);
+    st->chigh = ((uint64_t)h << st->s) - 1;
+    st->n1 = 1L << (__builtin_ctzl((unsigned long)st->len) / 2);
+    st->n2 = st->len / st->n1;
+    st->jdigits = 2 * st->digits - st->d0;
+    st->qdigits = (st->jdigits > st->digits + 1) ? st->jdigits : st->digits + 1;
+    st->group = ooc_group(st->n1, st->n2);
+
+    /*
+     * map the files
+     */
+    dir = getenv(OOC_DIR_ENV);
+    if (dir == NULL || dir[0] == '\0') {
+	dir = OOC_DEF_DIR;
+    }
+    st->t = ooc_map(dir, st->len * sizeof(uint64_t));
+    st->u = ooc_map(dir, (st->digits + 1) * sizeof(uint16_t));
+    st->q = ooc_map(dir, st->qdigits * sizeof(uint16_t));
+    if (st->t == NULL || st->u == NULL || st->q == NULL) {
+	ooc_free(st);
+	return NULL;
+    }
+
+    /*
+     * allocate the column buffer and tables
+     */
+    errno = 0;
+    st->col = malloc(st->group * st->n1 * sizeof(uint64_t));
+    st->tw1 = malloc(st->n1 / 2 * sizeof(uint64_t));
+    st->itw1 = malloc(st->n1 / 2 * sizeof(uint64_t));
+    st->tw2 = malloc(st->n2 / 2 * sizeof(uint64_t));
+    st->itw2 = malloc(st->n2 / 2 * sizeof(uint64_t));
+    st->pw = malloc(st->n1 * sizeof(uint64_t));
+    st->rev1 = malloc(st->n1 * sizeof(uint32_t));
+    if (st->col == NULL || st->tw1 == NULL || st->itw1 == NULL || st->tw2 == NULL ||
+	st->itw2 == NULL || st->pw == NULL || st->rev1 == NULL) {
+	errp(181, __func__, "allocation of %ld columns of %ld elements failed", st->group, st->n1);
+	return NULL;	// NOT REACHED
+    }
+    st->w = gl_pow(GL_GEN, (GL_P - 1) / (uint64_t)st->len);
+    st->iw = gl_pow(st->w, GL_P - 2);
+    st->scale = gl_pow((uint64_t)st->len, GL_P - 2);
+    ntt_powers(st->tw1, st->n1 / 2, gl_pow(st->w, (uint64_t)st->n2));
+    ntt_powers(st->itw1, st->n1 / 2, gl_pow(st->iw, (uint64_t)st->n2));
+    ntt_powers(st->tw2, st->n2 / 2, gl_pow(st->w, (uint64_t)st->n1));
+    ntt_powers(st->itw2, st->n2 / 2, gl_pow(st->iw, (uint64_t)st->n1));
+    ntt_bitrev(st->rev1, st->n1);
+    dbg(DBG_MED, "out-of-core setup for %lu*2^%lu-1 in %s: transform length %ld = %ld x %ld, %ld columns at once",
+	h, n, dir, st->len, st->n1, st->n2, st->group);
+    return st;
+}
+
+
+/*
+ * ooc_map - map a new zero filled file of bytes bytes
+ *
+ * The file is removed as soon as it is mapped.
+ *
+ * returns:
+ *      mapped file, NULL ==> cannot create or map the file
+ */
+static void *
+ooc_map(const char *dir, size_t bytes)
+{
+    char path[BUFSIZ + 1];	/* file to create */
+    int fd;			/* open file */
+    void *addr;			/* mapped file */
+
+    snprintf(path, BUFSIZ, "%s/gmprime-ooc.XXXXXX", dir);
+    errno = 0;
+    fd = mkstemp(path);
+    if (fd < 0) {
+	warnp(__func__, "cannot create out-of-core file in: %s", dir);
+	return NULL;
+    }
+    (void) unlink(path);
+    errno = 0;
+    if (ftruncate(fd, (off_t)bytes) < 0) {
+	warnp(__func__, "cannot extend out-of-core file to %zu bytes", bytes);
+	(void) close(fd);
+	return NULL;
+    }
+    errno = 0;
+    addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+	warnp(__func__, "cannot map out-of-core file of %zu bytes", bytes);
+	(void) close(fd);
+	return NULL;
+    }
+    (void) close(fd);
+    return addr;
+}
+
+
+/*
+ * ooc_prefetch - ask the kernel to start reading the pages holding addr .. addr+bytes-1
+ */
+static void
+ooc_prefetch(const void *addr, size_t bytes)
+{
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);	/* page size */
+    uintptr_t start = (uintptr_t)addr & ~(page - 1);	/* page holding addr */
+
+    (void) madvise((void *)start, (uintptr_t)addr + bytes - start, MADV_WILLNEED);
+    return;
+}
+
+
+/*
+ * ooc_import - load U(i)
+ *
+ * A negative U(i) (as the GMP code can leave after U(i) of 0 or 1) is replaced by U(i) + h*2^n-1.
+ */
+static void
+ooc_import(void *state, const mpz_t u_term)
+{
+    struct ooc *st = state;	/* out-of-core state */
+    mpz_t cand;			/* h*2^n-1 */
+    mpz_t u;			/* U(i) mod h*2^n-1 */
+
+    mpz_init(cand);
+    mpz_ui_pow_ui(cand, 2, st->n);
+    mpz_mul_ui(cand, cand, st->h);
+    mpz_sub_ui(cand, cand, 1);
+    mpz_init(u);
+    mpz_mod(u, u_term, cand);
+    memset(st->u, 0, (st->digits + 1) * sizeof(uint16_t));
+    mpz_export(st->u, NULL, -1, sizeof(uint16_t), 0, 0, u);
+    mpz_clear(u);
+    mpz_clear(cand);
+    return;
+}
+
+
+/*
+ * ooc_step - advance count terms
+ */
+static void
+ooc_step(void *state, unsigned long count)
+{
+    struct ooc *st = state;	/* out-of-core state */
+    unsigned long k;
+
+    for (k = 0; k < count; ++k) {
+	if (ooc_load(st)) {
+	    ooc_columns(st, false);
+	    ooc_rows(st);
+	    ooc_columns(st, true);
+	    ooc_carry(st);
+	    ooc_reduce(st);
+	}
+    }
+    return;
+}
+
+
+/*
+ * ooc_load - load the u term digits into the transform
+ *
+ * returns:
+ *      true ==> square the transform, false ==> u was 0 or 1 and is now u^2-2 mod h*2^n-1
+ */
+static bool
+ooc_load(struct ooc *st)
+{
+    bool big = false;		/* true ==> u > 1 */
+    uint16_t u0;		/* bottom digit of u */
+    long i;
+
+    (void) madvise(st->t, st->len * sizeof(uint64_t), MADV_SEQUENTIAL);
+    (void) madvise(st->u, (st->digits + 1) * sizeof(uint16_t), MADV_SEQUENTIAL);
+    for (i = 0; i < st->digits; ++i) {
+	st->t[i] = st->u[i];
+	if (i > 0 && st->u[i] != 0) {
+	    big = true;
+	}
+    }
+    memset(st->t + st->digits, 0, (st->len - st->digits) * sizeof(uint64_t));
+
+    /*
+     * u of 0 or 1 gives h*2^n-1 - 2 or - 1
+     */
+    if (!big && st->u[0] < 2) {
+	u0 = st->u[0];
+	for (i = 0; i <= st->digits; ++i) {
+	    st->u[i] = ooc_cand_digit(st, i);
+	}
+	st->u[0] -= (uint16_t)(2 - u0 * u0);
+	return false;
+    }
+    return true;
+}
+
+
+/*
+ * ooc_columns - transform each column, a group of columns at a time
+ *
+ * given:
+ *      st      out-of-core state
+ *      inverse false ==> transform then twiddle, true ==> twiddle then inverse transform
+ */
+static void
+ooc_columns(struct ooc *st, bool inverse)
+{
+    uint64_t *x;		/* column in memory */
+    long c0;			/* first column of the group */
+    long r;
+    long k;
+
+    (void) madvise(st->t, st->len * sizeof(uint64_t), MADV_NORMAL);
+    for (c0 = 0; c0 < st->n2; c0 += st->group) {
+
+	/*
+	 * start reading the next group while we work on this one
+	 */
+	if (c0 + st->group < st->n2) {
+	    for (r = 0; r < st->n1; ++r) {
+		ooc_prefetch(st->t + r * st->n2 + c0 + st->group, st->group * sizeof(uint64_t));
+	    }
+	}
+
+	/*
+	 * gather, transform and scatter the group
+	 */
+	for (r = 0; r < st->n1; ++r) {
+	    const uint64_t *row = st->t + r * st->n2 + c0;
+	    for (k = 0; k < st->group; ++k) {
+		st->col[k * st->n1 + r] = row[k];
+	    }
+	}
+	for (k = 0; k < st->group; ++k) {
+	    x = st->col + k * st->n1;
+	    if (inverse) {
+		ntt_twiddle(x, st->n1, st->rev1, st->pw, gl_pow(st->iw, (uint64_t)(c0 + k)));
+		ntt_dit(x, st->n1, st->itw1);
+	    } else {
+		ntt_dif(x, st->n1, st->tw1);
+		ntt_twiddle(x, st->n1, st->rev1, st->pw, gl_pow(st->w, (uint64_t)(c0 + k)));
+	    }
+	}
+	for (r = 0; r < st->n1; ++r) {
+	    uint64_t *row = st->t + r * st->n2 + c0;
+	    for (k = 0; k < st->group; ++k) {
+		row[k] = st->col[k * st->n1 + r];
+	    }
+	}
+    }
+    return;
+}
+
+
+/*
+ * ooc_rows - transform, square and inverse transform each row
+ */
+static void
+ooc_rows(struct ooc *st)
+{
+    uint64_t *row;		/* row in the mapped transform */
+    long r;
+    long i;
+
+    (void) madvise(st->t, st->len * sizeof(uint64_t), MADV_SEQUENTIAL);
+    for (r = 0; r < st->n1; ++r) {
+	row = st->t + r * st->n2;
+	ntt_dif(row, st->n2, st->tw2);
+	for (i = 0; i < st->n2; ++i) {
+	    row[i] = gl_mul(row[i], row[i]);
+	}
+	ntt_dit(row, st->n2, st->itw2);
+    }
+    return;
+}
+
+
+/*
+ * ooc_carry - scale and carry the inverse transform into digits of u^2-2
+ */
+static void
+ooc_carry(struct ooc *st)
+{
+    ntt_u128 v;			/* element plus carry */
+    uint64_t carry = 0;		/* carry into the next digit */
+    uint64_t borrow = 2;	/* subtract 2 */
+    long i;
+
+    for (i = 0; i < st->len; ++i) {
+	v = (ntt_u128)gl_mul(st->t[i], st->scale) + carry;
+	st->t[i] = (uint64_t)v & OOC_DIGIT_MASK;
+	carry = (uint64_t)(v >> OOC_DIGIT_BITS);
+    }
+    if (carry != 0) {
+	err(182, __func__, "square overflowed transform length: %ld", st->len);
+	return;	// NOT REACHED
+    }
+    for (i = 0; borrow != 0 && i < st->len; ++i) {
+	if (st->t[i] >= borrow) {
+	    st->t[i] -= borrow;
+	    borrow = 0;
+	} else {
+	    st->t[i] = st->t[i] + (OOC_DIGIT_MASK + 1) - borrow;
+	    borrow = 1;
+	}
+    }
+    return;
+}
+
+
+/*
+ * ooc_reduce - u = u^2-2 mod h*2^n-1, from the digits in the transform
+ *
+ * With J = int((u^2-2) / 2^n) and K = (u^2-2) mod 2^n:
+ *
+ *	u^2-2 == int(J/h) + (J mod h)*2^n + K mod h*2^n-1
+ */
+static void
+ooc_reduce(struct ooc *st)
+{
+    long window = OOC_PREFETCH / sizeof(uint64_t);	/* digits prefetched at once */
+    uint64_t rem = 0;		/* J mod h */
+    uint64_t remsh;		/* (J mod h) << s */
+    uint64_t x;			/* remainder and next digit of J */
+    uint64_t v;			/* digit sum and carry */
+    long j;
+    long i;
+
+    /*
+     * int(J/h) and J mod h, top down
+     */
+    for (j = st->jdigits - 1; j >= 0; --j) {
+	if ((j + 1) % window == 0 || j == st->jdigits - 1) {
+	    long lo = (j + 1 > window) ? j + 1 - window : 0;
+	    ooc_prefetch(st->t + st->d0 + lo, (j + 2 - lo) * sizeof(uint64_t));
+	}
+	x = st->t[st->d0 + j] >> st->s;
+	if (st->s > 0 && st->d0 + j + 1 < st->len) {
+	    x |= (st->t[st->d0 + j + 1] << (OOC_DIGIT_BITS - st->s)) & OOC_DIGIT_MASK;
+	}
+	x |= rem << OOC_DIGIT_BITS;
+	st->q[j] = (uint16_t)(x / st->h);
+	rem = x % st->h;
+    }
+
+    /*
+     * u = K + int(J/h) + (J mod h)*2^n, bottom up
+     */
+    (void) madvise(st->t, st->len * sizeof(uint64_t), MADV_SEQUENTIAL);
+    remsh = rem << st->s;
+    v = 0;
+    for (i = 0; i <= st->digits; ++i) {
+	if (i < st->jdigits) {
+	    v += st->q[i];
+	}
+	if (i < st->d0) {
+	    v += st->t[i];
+	} else if (i == st->d0) {
+	    v += st->t[i] & ((1U << st->s) - 1);
+	}
+	if (i >= st->d0 && i - st->d0 < 4) {
+	    v += (remsh >> (OOC_DIGIT_BITS * (i - st->d0))) & OOC_DIGIT_MASK;
+	}
+	st->u[i] = (uint16_t)v;
+	v >>= OOC_DIGIT_BITS;
+    }
+
+    /*
+     * subtract h*2^n-1 while u >= h*2^n-1
+     */
+    for (;;) {
+	for (i = st->digits; i >= 0 && st->u[i] == ooc_cand_digit(st, i); --i) {
+	}
+	if (i >= 0 && st->u[i] < ooc_cand_digit(st, i)) {
+	    break;
+	}
+	v = 0;
+	for (i = 0; i <= st->digits; ++i) {
+	    v = (uint64_t)st->u[i] - ooc_cand_digit(st, i) - v;
+	    st->u[i] = (uint16_t)v;
+	    v = (v >> OOC_DIGIT_BITS) & 1;
+	}
+    }
+    return;
+}
+
+
+/*
+ * ooc_cand_digit - digit i of h*2^n-1
+ */
+static uint16_t
+ooc_cand_digit(const struct ooc *st, long i)
+{
+    if (i < st->d0) {
+	return (uint16_t)OOC_DIGIT_MASK;
+    } else if (i - st->d0 < 4) {
+	return (uint16_t)(st->chigh >> (OOC_DIGIT_BITS * (i - st->d0)));
+    }
+    return 0;
+}
+
+
+/*
+ * ooc_export - store U(i)
+ */
+static void
+ooc_export(void *state, mpz_t u_term)
+{
+    struct ooc *st = state;	/* out-of-core state */
+
+    mpz_import(u_term, st->digits + 1, -1, sizeof(uint16_t), 0, 0, st->u);
+    return;
+}
+
+
+/*
+ * ooc_free - unmap the files and free out-of-core state
+ */
+static void
+ooc_free(struct ooc *st)
+{
+    if (st == NULL) {
+	return;
+    }
+    if (st->t != NULL) {
+	(void) munmap(st->t, st->len * sizeof(uint64_t));
+    }
+    if (st->u != NULL) {
+	(void) munmap(st->u, (st->digits + 1) * sizeof(uint16_t));
+    }
+    if (st->q != NULL) {
+	(void) munmap(st->q, st->qdigits * sizeof(uint16_t));
+    }
+    free(st->col);
+    free(st->tw1);
+    free(st->itw1);
+    free(st->tw2);
+    free(st->itw2);
+    free(st->pw);
+    free(st->rev1);
+    free(st);
+    return;
+}
+
+
+/*
+ * ooc_cleanup - free out-of-core state
+ */
+static void
+ooc_cleanup(void *state)
+{
+    ooc_free(state);
+    return;
+}
+
+
+/*
+ * out-of-core engine
+ */
+const struct engine ooc_engine = {
+    "ooc",
+    ULONG_MAX,		/* ENGINE_AUTO never selects: only use it when the gmp code would run out of memory */
+    ULONG_MAX,
+    ooc_usable,
+    ooc_footprint,
+    ooc_setup,
+    ooc_import,
+    ooc_step,
+    ooc_export,
+    ooc_cleanup
+};
@@ -0,0 +1,44 @@
+/*
+ * ooc - out-of-core squaring engine for h*2^n-1 too large for memory
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_OOC_H)
+#define INCLUDE_OOC_H
+
+/*
+ * ooc constants
+ */
+#define OOC_DIR_ENV	"GMPRIME_OOC_DIR"	// environment variable naming where files are kept
+#define OOC_DEF_DIR	"/var/tmp"		// default directory for files
+#define OOC_DIGIT_BITS	(16)			// bits per transform input digit
+#define OOC_MIN_N	(1000)			// below this size, the transform is too small to split
+#define OOC_BUFFER	(64*1024*1024)		// most bytes of columns gathered in memory at once
+#define OOC_MIN_GROUP	(512)			// fewest columns gathered at once, a page of each row
+#define OOC_PREFETCH	(4*1024*1024)		// bytes prefetched ahead of a backward scan
+
+#endif				/* INCLUDE_OOC_H */
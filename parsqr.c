@@ -0,0 +1,582 @@
+/*
+ * parsqr - square a large mpz_t using several threads
+ *
+ * GMP squares a value in a single thread.  To let a large test use more
+ * than one core, we split the value a into k pieces of B = 2^(piece_limbs*GMP_NUMB_BITS):
+ *
+ *      a = a[k-1]*B^(k-1) + ... + a[1]*B + a[0]
+ *
+ * and form the k*(k+1)/2 independent products:
+ *
+ *      a^2 = sum(a[i]^2 * B^(2*i)) + sum(2 * a[i]*a[j] * B^(i+j))     for i < j
+ *
+ * The products are handed out to a squad of helper threads (plus the calling
+ * thread), and the calling thread adds the shifted products back together.
+ * The pieces are read-only views into the limbs of a, so nothing is copied
+ * before the products are formed.
+ *
+ * The helper threads live as long as the squad does, so the only per-square
+ * cost is a condition variable hand-off.  For that reason a square below
+ * PARSQR_MIN_BITS is always performed by the calling thread alone.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 110-119	parsqr.c - reserved for internal errors */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#include "debug.h"
+#include "parsqr.h"
+
+/*
+ * The most pieces we split a value into is the smallest k where k*(k+1)/2 >= PARSQR_MAX_THREADS
+ */
+#define PARSQR_MAX_PIECES	(4)
+#define PARSQR_MAX_PROD		((PARSQR_MAX_PIECES * (PARSQR_MAX_PIECES + 1)) / 2)
+
+/*
+ * relative cost of a product: squaring a piece is about 2/3 the cost of multiplying two pieces
+ */
+#define PARSQR_SQUARE_COST	(2)
+#define PARSQR_CROSS_COST	(3)
+
+/*
+ * a product of two pieces of the value being squared
+ */
+struct parsqr_prod {
+    int i;			/* lower piece index */
+    int j;			/* upper piece index, i <= j */
+    int owner;			/* squad member that forms this product, 0 ==> calling thread */
+    mpz_t value;		/* a[i]*a[j] */
+};
+
+/*
+ * a helper thread
+ */
+struct parsqr_helper {
+    struct parsqr *ps;		/* squad that this helper belongs to */
+    int idx;			/* squad member index, 1 .. threads-1 */
+    unsigned long seen;		/* generation of the last square this helper worked on */
+    pthread_t tid;		/* thread ID */
+};
+
+/*
+ * squaring squad
+ */
+struct parsqr {
+    int threads;		/* threads, including the calling thread, used to square */
+    int pieces;			/* pieces that a value is split into */
+    int nprod;			/* products formed, pieces*(pieces+1)/2 */
+    struct parsqr_prod prod[PARSQR_MAX_PROD];	/* products to form */
+    struct parsqr_helper helper[PARSQR_MAX_THREADS];	/* helper threads, helper[0] is unused */
+    pthread_mutex_t lock;	/* protects the fields below */
+    pthread_cond_t work;	/* broadcast when a new square is posted or when quitting */
+    pthread_cond_t done;	/* signalled when the last helper finishes its products */
+    unsigned long posted;	/* generation of the most recently posted square */
+    int busy;			/* helpers still working on the posted square */
+    bool quit;			/* true ==> helpers must exit */
+    const mp_limb_t *limbs;	/* limbs of the value being squared */
+    mp_size_t nlimbs;		/* number of limbs in the value being squared */
+    mp_size_t piece_limbs;	/* number of limbs in a piece */
+    mpz_t tmp;			/* shifted product */
+};
+
+/*
+ * static functions
+ */
+static void *parsqr_helper(void *arg);
+static void parsqr_share(struct parsqr *ps, int idx);
+static void parsqr_plan(struct parsqr *ps, int threads);
+static void parsqr_start(struct parsqr *ps);
+static void parsqr_stop(struct parsqr *ps);
+
+
+/*
+ * parsqr_alloc - allocate a squaring squad
+ *
+ * given:
+ *      threads         threads, including the calling thread, to square with
+ *
+ * returns:
+ *      pointer to an allocated squad
+ *
+ * This function does not return on error.
+ */
+struct parsqr *
+parsqr_alloc(int threads)
+{
+    struct parsqr *ps;		/* allocated squad */
+    int k;			/* product index */
+    int ret;			/* pthread return value */
+
+    /*
+     * allocate and initialize the squad
+     */
+    errno = 0;
+    ps = calloc(1, sizeof(struct parsqr));
+    if (ps == NULL) {
+	errp(110, __func__, "calloc of struct parsqr failed, errno: %d", errno);
+	return NULL;	// NOT REACHED
+    }
+    for (k = 0; k < PARSQR_MAX_PROD; ++k) {
+	mpz_init(ps->prod[k].value);
+    }
+    mpz_init(ps->tmp);
+    ret = pthread_mutex_init(&ps->lock, NULL);
+    if (ret != 0) {
+	err(110, __func__, "pthread_mutex_init returned: %d", ret);
+	return NULL;	// NOT REACHED
+    }
+    ret = pthread_cond_init(&ps->work, NULL);
+    if (ret != 0) {
+	err(110, __func__, "pthread_cond_init of work returned: %d", ret);
+	return NULL;	// NOT REACHED
+    }
+    ret = pthread_cond_init(&ps->done, NULL);
+    if (ret != 0) {
+	err(110, __func__, "pthread_cond_init of done returned: %d", ret);
+	return NULL;	// NOT REACHED
+    }
+
+    /*
+     * plan the products and start the helpers
+     */
+    parsqr_plan(ps, threads);
+    parsqr_start(ps);
+    return ps;
+}
+
+
+/*
+ * parsqr_free - stop the helper threads of and free a squaring squad
+ *
+ * given:
+ *      ps      squad to free
+ *
+ * This function does not return on error.
+ */
+void
+parsqr_free(struct parsqr *ps)
+{
+    int k;			/* product index */
+
+    /*
+     * firewall
+     */
+    if (ps == NULL) {
+	err(111, __func__, "ps is NULL");
+	return;	// NOT REACHED
+    }
+
+    /*
+     * stop helpers and free the squad
+     */
+    parsqr_stop(ps);
+    for (k = 0; k < PARSQR_MAX_PROD; ++k) {
+	mpz_clear(ps->prod[k].value);
+    }
+    mpz_clear(ps->tmp);
+    (void) pthread_cond_destroy(&ps->done);
+    (void) pthread_cond_destroy(&ps->work);
+    (void) pthread_mutex_destroy(&ps->lock);
+    free(ps);
+    return;
+}
+
+
+/*
+ * parsqr_threads - return the number of threads that a squad squares with
+ *
+ * given:
+ *      ps      squad
+ *
+ * returns:
+ *      threads, including the calling thread, used to square
+ */
+int
+parsqr_threads(struct parsqr *ps)
+{
+    /*
+     * firewall
+     */
+    if (ps == NULL) {
+	err(112, __func__, "ps is NULL");
+	return 1;	// NOT REACHED
+    }
+    return ps->threads;
+}
+
+
+/*
+ * parsqr_set_threads - change the number of threads that a squad squares with
+ *
+ * given:
+ *      ps              squad
+ *      threads         threads, including the calling thread, to square with
+ *
+ * NOTE: This function must not be called while a square is in progress.
+ *
+ * This function does not return on error.
+ */
+void
+parsqr_set_threads(struct parsqr *ps, int threads)
+{
+    /*
+     * firewall
+     */
+    if (ps == NULL) {
+	err(113, __func__, "ps is NULL");
+	return;	// NOT REACHED
+    }
+
+    /*
+     * replan with a new set of helpers
+     */
+    if (threads < 1) {
+	threads = 1;
+    } else if (threads > PARSQR_MAX_THREADS) {
+	threads = PARSQR_MAX_THREADS;
+    }
+    if (threads == ps->threads) {
+	return;
+    }
+    dbg(DBG_MED, "squaring threads: %d => %d", ps->threads, threads);
+    parsqr_stop(ps);
+    parsqr_plan(ps, threads);
+    parsqr_start(ps);
+    return;
+}
+
+
+/*
+ * parsqr - square a value using a squad of threads
+ *
+ * given:
+ *      ps      squad
+ *      r       set to a^2
+ *      a       value to square, must not be the same mpz_t as r
+ *
+ * This function does not return on error.
+ */
+void
+parsqr(struct parsqr *ps, mpz_t r, const mpz_t a)
+{
+    struct parsqr_prod *p;	/* product being added */
+    mp_bitcnt_t shift;		/* bits to shift a product */
+    int k;			/* product index */
+
+    /*
+     * firewall
+     */
+    if (ps == NULL) {
+	err(114, __func__, "ps is NULL");
+	return;	// NOT REACHED
+    }
+    if (r == a) {
+	err(114, __func__, "r and a must be different");
+	return;	// NOT REACHED
+    }
+
+    /*
+     * small values, or a squad of one, are squared by the calling thread
+     */
+    if (ps->threads <= 1 || mpz_sizeinbase(a, 2) < PARSQR_MIN_BITS) {
+	mpz_mul(r, a, a);
+	return;
+    }
+
+    /*
+     * post the value to the helpers
+     */
+    ps->limbs = mpz_limbs_read(a);
+    ps->nlimbs = mpz_size(a);
+    ps->piece_limbs = (ps->nlimbs + ps->pieces - 1) / ps->pieces;
+    pthread_mutex_lock(&ps->lock);
+    ++ps->posted;
+    ps->busy = ps->threads - 1;
+    pthread_cond_broadcast(&ps->work);
+    pthread_mutex_unlock(&ps->lock);
+
+    /*
+     * form our share of the products and wait for the helpers
+     */
+    parsqr_share(ps, 0);
+    pthread_mutex_lock(&ps->lock);
+    while (ps->busy > 0) {
+	pthread_cond_wait(&ps->done, &ps->lock);
+    }
+    pthread_mutex_unlock(&ps->lock);
+
+    /*
+     * a^2 = sum(a[i]^2 * B^(2*i)) + sum(2 * a[i]*a[j] * B^(i+j))
+     */
+    mpz_set_ui(r, 0);
+    for (k = 0; k < ps->nprod; ++k) {
+	p = &ps->prod[k];
+	shift = (mp_bitcnt_t) (p->i + p->j) * ps->piece_limbs * GMP_NUMB_BITS;
+	if (p->i != p->j) {
+	    ++shift;
+	}
+	mpz_mul_2exp(ps->tmp, p->value, shift);
+	mpz_add(r, r, ps->tmp);
+    }
+    return;
+}
+
+
+/*
+ * parsqr_helper - helper thread main loop
+ *
+ * given:
+ *      arg     pointer to the struct parsqr_helper of this thread
+ *
+ * returns:
+ *      NULL
+ */
+static void *
+parsqr_helper(void *arg)
+{
+    struct parsqr_helper *hp = (struct parsqr_helper *)arg;	/* this helper */
+    struct parsqr *ps = hp->ps;		/* squad of this helper */
+
+    pthread_mutex_lock(&ps->lock);
+    for (;;) {
+
+	/*
+	 * wait for a new square or for the squad to stop
+	 */
+	while (!ps->quit && ps->posted == hp->seen) {
+	    pthread_cond_wait(&ps->work, &ps->lock);
+	}
+	if (ps->quit) {
+	    break;
+	}
+	hp->seen = ps->posted;
+	pthread_mutex_unlock(&ps->lock);
+
+	/*
+	 * form our products
+	 */
+	parsqr_share(ps, hp->idx);
+
+	/*
+	 * report that we are done
+	 */
+	pthread_mutex_lock(&ps->lock);
+	if (--ps->busy <= 0) {
+	    pthread_cond_signal(&ps->done);
+	}
+    }
+    pthread_mutex_unlock(&ps->lock);
+    return NULL;
+}
+
+
+/*
+ * parsqr_share - form the products owned by a squad member
+ *
+ * given:
+ *      ps      squad
+ *      idx     squad member, 0 ==> calling thread
+ */
+static void
+parsqr_share(struct parsqr *ps, int idx)
+{
+    struct parsqr_prod *p;	/* product to form */
+    mpz_t ai;			/* read-only view of piece a[i] */
+    mpz_t aj;			/* read-only view of piece a[j] */
+    mp_size_t off;		/* limb offset of a piece */
+    mp_size_t len;		/* limb length of a piece */
+    int k;			/* product index */
+
+    for (k = 0; k < ps->nprod; ++k) {
+	p = &ps->prod[k];
+	if (p->owner != idx) {
+	    continue;
+	}
+
+	/*
+	 * view a[i]
+	 */
+	off = p->i * ps->piece_limbs;
+	len = (off >= ps->nlimbs) ? 0 : ps->nlimbs - off;
+	if (len > ps->piece_limbs) {
+	    len = ps->piece_limbs;
+	}
+	mpz_roinit_n(ai, ps->limbs + off, len);
+
+	/*
+	 * square a[i] or multiply by a view of a[j]
+	 */
+	if (p->i == p->j) {
+	    mpz_mul(p->value, ai, ai);
+	} else {
+	    off = p->j * ps->piece_limbs;
+	    len = (off >= ps->nlimbs) ? 0 : ps->nlimbs - off;
+	    if (len > ps->piece_limbs) {
+		len = ps->piece_limbs;
+	    }
+	    mpz_roinit_n(aj, ps->limbs + off, len);
+	    mpz_mul(p->value, ai, aj);
+	}
+    }
+    return;
+}
+
+
+/*
+ * parsqr_plan - decide how a squad splits a value and who forms which product
+ *
+ * given:
+ *      ps              squad with no running helpers
+ *      threads         threads, including the calling thread, to square with
+ *
+ * Products are handed out largest first to the least loaded squad member.
+ */
+static void
+parsqr_plan(struct parsqr *ps, int threads)
+{
+    int load[PARSQR_MAX_THREADS];	/* planned cost for each squad member */
+    int cost;			/* cost of a product */
+    int least;			/* least loaded squad member */
+    int i;			/* lower piece index */
+    int j;			/* upper piece index */
+    int k;			/* product index */
+    int t;			/* squad member index */
+
+    /*
+     * pick the fewest pieces that gives every thread a product
+     */
+    if (threads < 1) {
+	threads = 1;
+    } else if (threads > PARSQR_MAX_THREADS) {
+	threads = PARSQR_MAX_THREADS;
+    }
+    ps->threads = threads;
+    for (ps->pieces = 2; ps->pieces < PARSQR_MAX_PIECES; ++ps->pieces) {
+	if ((ps->pieces * (ps->pieces + 1)) / 2 >= threads) {
+	    break;
+	}
+    }
+
+    /*
+     * list products, cross products first as they cost the most
+     */
+    ps->nprod = 0;
+    for (i = 0; i < ps->pieces; ++i) {
+	for (j = i + 1; j < ps->pieces; ++j) {
+	    ps->prod[ps->nprod].i = i;
+	    ps->prod[ps->nprod].j = j;
+	    ++ps->nprod;
+	}
+    }
+    for (i = 0; i < ps->pieces; ++i) {
+	ps->prod[ps->nprod].i = i;
+	ps->prod[ps->nprod].j = i;
+	++ps->nprod;
+    }
+
+    /*
+     * hand out products to the least loaded member
+     */
+    memset(load, 0, sizeof(load));
+    for (k = 0; k < ps->nprod; ++k) {
+	least = 0;
+	for (t = 1; t < threads; ++t) {
+	    if (load[t] < load[least]) {
+		least = t;
+	    }
+	}
+	cost = (ps->prod[k].i == ps->prod[k].j) ? PARSQR_SQUARE_COST : PARSQR_CROSS_COST;
+	load[least] += cost;
+	ps->prod[k].owner = least;
+    }
+    return;
+}
+
+
+/*
+ * parsqr_start - start the helper threads of a squad
+ *
+ * given:
+ *      ps      squad with no running helpers
+ *
+ * This function does not return on error.
+ */
+static void
+parsqr_start(struct parsqr *ps)
+{
+    int t;			/* squad member index */
+    int ret;			/* pthread return value */
+
+    ps->quit = false;
+    for (t = 1; t < ps->threads; ++t) {
+	ps->helper[t].ps = ps;
+	ps->helper[t].idx = t;
+	ps->helper[t].seen = ps->posted;
+	ret = pthread_create(&ps->helper[t].tid, NULL, parsqr_helper, &ps->helper[t]);
+	if (ret != 0) {
+	    err(115, __func__, "pthread_create of helper %d returned: %d", t, ret);
+	    return;	// NOT REACHED
+	}
+    }
+    return;
+}
+
+
+/*
+ * parsqr_stop - stop the helper threads of a squad
+ *
+ * given:
+ *      ps      squad
+ *
+ * This function does not return on error.
+ */
+static void
+parsqr_stop(struct parsqr *ps)
+{
+    int t;			/* squad member index */
+    int ret;			/* pthread return value */
+
+    pthread_mutex_lock(&ps->lock);
+    ps->quit = true;
+    pthread_cond_broadcast(&ps->work);
+    pthread_mutex_unlock(&ps->lock);
+    for (t = 1; t < ps->threads; ++t) {
+	ret = pthread_join(ps->helper[t].tid, NULL);
+	if (ret != 0) {
+	    err(116, __func__, "pthread_join of helper %d returned: %d", t, ret);
+	    return;	// NOT REACHED
+	}
+    }
+    return;
+}
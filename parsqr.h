@@ -0,0 +1,55 @@
+/*
+ * parsqr - square a large mpz_t using several threads
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_PARSQR_H)
+#define INCLUDE_PARSQR_H
+
+#include <gmp.h>
+
+/*
+ * parsqr constants
+ */
+#define PARSQR_MAX_THREADS	(10)		// most threads, including the caller, that will square one value
+#define PARSQR_MIN_BITS		(200000)	// below this size, thread hand-off costs more than it saves
+
+/*
+ * squaring squad - opaque outside of parsqr.c
+ */
+struct parsqr;
+
+/*
+ * external functions
+ */
+extern struct parsqr *parsqr_alloc(int threads);
+extern void parsqr_free(struct parsqr *ps);
+extern int parsqr_threads(struct parsqr *ps);
+extern void parsqr_set_threads(struct parsqr *ps, int threads);
+extern void parsqr(struct parsqr *ps, mpz_t r, const mpz_t a);
+
+#endif				/* INCLUDE_PARSQR_H */
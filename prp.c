@@ -0,0 +1,492 @@
+/*
+ * prp - Fermat probable prime test of k*b^n-1 for bases b that are not a power of 2
+ *
+ * The Lucas-Lehmer-Riesel test of lucas.c only applies to h*2^n-1.  For any
+ * other base b, gmprime --base b tests N = k*b^n-1 with a base PRP_BASE
+ * Fermat test.  As N+1 == k*b^n, the test computes:
+ *
+ *      x = a^k mod N, then n times: x = x^b mod N
+ *
+ * to form a^(N+1) mod N, and N is a probable prime when a^(N+1) == a^2 mod N.
+ * Each of the n steps x = x^b takes the place of a Lucas term, so the
+ * checkpoint, history, control and throttle code work as they do for lucas.c.
+ *
+ * The reduction mod N is a Barrett reduction, specialised to the base:
+ * with b = c*2^a where c is odd, N = k*c^n*2^(a*n)-1, so q*N is formed as
+ *
+ *      ((q * c^n) << a*n) * k - q
+ *
+ * a multiply by c^n, which is a*n + log2(k) bits shorter than N, followed
+ * by a shift and a single limb multiply.  For b = 10, c^n is about 70% of
+ * the size of N.  Even when b is odd, the reduction avoids the division
+ * of mpz_tdiv_r().
+ *
+ * NOTE: When b is a power of 2, gmprime converts k*b^n-1 into h*2^n-1
+ *	 and uses the Riesel test instead (see gmprime.c).
+ *
+ * NOTE: A probable prime is not proven prime.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 20-29	prp.c - reserved for internal errors */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <gmp.h>
+
+#include "gmprime.h"
+#include "riesel.h"
+#include "debug.h"
+#include "checkpoint.h"
+#include "throttle.h"
+#include "control.h"
+#include "zcalc.h"
+#include "watchdog.h"
+#include "lucas.h"
+#include "prp.h"
+
+/*
+ * Fermat test state of k*b^n-1
+ */
+struct prp {
+    unsigned long k;		/* multiplier of b^n */
+    unsigned long b;		/* base */
+    int b_bits;			/* bits in b */
+    unsigned long shift;	/* a*n where b = c*2^a and c is odd */
+    size_t bits;		/* bits in N */
+    mpz_t N;			/* k*b^n-1 - our test candidate */
+    mpz_t odd;			/* c^n, the odd part of b^n */
+    mpz_t mu;			/* floor(2^(2*bits) / N) */
+    mpz_t x;			/* a^(k*b^i) mod N */
+    mpz_t x0;			/* x before the current step */
+    mpz_t y;			/* unreduced product */
+    mpz_t q;			/* Barrett quotient estimate */
+    mpz_t t;			/* q*N */
+};
+
+
+/*
+ * prp_init - initialize the Fermat test state of k*b^n-1
+ *
+ * given:
+ *      p               Fermat test state
+ *      k               multiplier of b^n
+ *      b               base
+ *      n               power of b
+ */
+static void
+prp_init(struct prp *p, unsigned long k, unsigned long b, unsigned long n)
+{
+    unsigned long c;		/* odd part of b */
+    unsigned long a;		/* power of 2 in b */
+
+    /*
+     * firewall
+     */
+    if (p == NULL) {
+	err(20, __func__, "p is NULL");
+	exit(20); // NOT REACHED
+    }
+    if (k < 1 || b < 2) {
+	err(20, __func__, "k: %lu must be >= 1 and b: %lu must be >= 2", k, b);
+	exit(20); // NOT REACHED
+    }
+
+    /*
+     * b = c*2^a
+     */
+    for (c = b, a = 0; c % 2 == 0; c >>= 1, ++a) {
+    }
+    if (a > 0 && n > ULONG_MAX / a) {
+	err(21, __func__, "%lu*%lu^%lu-1 is too large", k, b, n);
+	exit(21); // NOT REACHED
+    }
+    p->k = k;
+    p->b = b;
+    p->b_bits = (int)(sizeof(unsigned long) * 8) - __builtin_clzl(b);
+    p->shift = a * n;
+
+    /*
+     * N = k*c^n*2^(a*n)-1
+     */
+    mpz_init(p->odd);
+    mpz_ui_pow_ui(p->odd, c, n);
+    mpz_init(p->N);
+    mpz_mul_2exp(p->N, p->odd, p->shift);
+    mpz_mul_ui(p->N, p->N, k);
+    mpz_sub_ui(p->N, p->N, 1);
+    p->bits = mpz_sizeinbase(p->N, 2);
+
+    /*
+     * Barrett constant
+     */
+    mpz_init(p->mu);
+    mpz_setbit(p->mu, 2 * p->bits);
+    mpz_fdiv_q(p->mu, p->mu, p->N);
+
+    /*
+     * allocate the working values at their largest size
+     */
+    mpz_init2(p->x, p->bits);
+    mpz_init2(p->x0, p->bits);
+    mpz_init2(p->y, 2 * p->bits + 2 * GMP_NUMB_BITS);
+    mpz_init2(p->q, p->bits + 2 * GMP_NUMB_BITS);
+    mpz_init2(p->t, 2 * p->bits + 2 * GMP_NUMB_BITS);
+    return;
+}
+
+
+/*
+ * prp_clear - free the Fermat test state
+ *
+ * given:
+ *      p               Fermat test state
+ */
+static void
+prp_clear(struct prp *p)
+{
+    if (p == NULL) {
+	return;
+    }
+    mpz_clear(p->N);
+    mpz_clear(p->odd);
+    mpz_clear(p->mu);
+    mpz_clear(p->x);
+    mpz_clear(p->x0);
+    mpz_clear(p->y);
+    mpz_clear(p->q);
+    mpz_clear(p->t);
+    return;
+}
+
+
+/*
+ * prp_reduce - x = y mod N
+ *
+ * given:
+ *      p               Fermat test state
+ *      x               where to place y mod N
+ *      y               value to reduce, 0 <= y < 2^(2*bits)
+ *
+ * The Barrett estimate of y/N is at most 2 too small, so at most two
+ * subtractions of N remain after subtracting q*N.
+ */
+static void
+prp_reduce(struct prp *p, mpz_t x, const mpz_t y)
+{
+    /*
+     * q = ((y >> (bits-1)) * mu) >> (bits+1)
+     */
+    mpz_tdiv_q_2exp(p->q, y, p->bits - 1);
+    mpz_mul(p->q, p->q, p->mu);
+    mpz_tdiv_q_2exp(p->q, p->q, p->bits + 1);
+
+    /*
+     * t = q*N = ((q * c^n) << a*n) * k - q
+     */
+    mpz_mul(p->t, p->q, p->odd);
+    mpz_mul_2exp(p->t, p->t, p->shift);
+    mpz_mul_ui(p->t, p->t, p->k);
+    mpz_sub(p->t, p->t, p->q);
+
+    /*
+     * x = y - q*N, then correct the estimate
+     */
+    mpz_sub(x, y, p->t);
+    while (mpz_cmp(x, p->N) >= 0) {
+	mpz_sub(x, x, p->N);
+    }
+    return;
+}
+
+
+/*
+ * prp_step - x = x^b mod N
+ *
+ * given:
+ *      p               Fermat test state
+ */
+static void
+prp_step(struct prp *p)
+{
+    int bit;
+
+    mpz_set(p->x0, p->x);
+    for (bit = p->b_bits - 2; bit >= 0; --bit) {
+	mpz_mul(p->y, p->x, p->x);
+	prp_reduce(p, p->x, p->y);
+	if ((p->b >> bit) & 1) {
+	    mpz_mul(p->y, p->x, p->x0);
+	    prp_reduce(p, p->x, p->y);
+	}
+    }
+    return;
+}
+
+
+/*
+ * prp_announce - print the result of a test unless quiet
+ *
+ * given:
+ *      k               multiplier of b^n
+ *      b               base
+ *      n               power of b
+ *      result          EXIT_IS_PRIME or EXIT_IS_COMPOSITE
+ *      proven          true ==> a prime was proven, not just found to be probable
+ *      quiet           true ==> do not print
+ */
+static void
+prp_announce(unsigned long k, unsigned long b, unsigned long n, int result, bool proven, bool quiet)
+{
+    if (quiet) {
+	return;
+    }
+    if (result != EXIT_IS_PRIME) {
+	printf("%lu * %lu ^ %lu - 1 is composite\n", k, b, n);
+    } else if (proven) {
+	printf("%lu * %lu ^ %lu - 1 is prime\n", k, b, n);
+    } else {
+	printf("%lu * %lu ^ %lu - 1 is a probable prime\n", k, b, n);
+    }
+    return;
+}
+
+
+/*
+ * prp_test - Fermat test of k*b^n-1
+ *
+ * given:
+ *      k               multiplier of b^n (ignored if opts->restore)
+ *      n               power of b (ignored if opts->restore)
+ *      opts            how the candidate is to be tested, opts->base is b
+ *
+ * returns:
+ *      EXIT_IS_PRIME           k*b^n-1 is a base PRP_BASE probable prime
+ *      EXIT_IS_COMPOSITE       k*b^n-1 has been proven to be composite
+ *
+ * The squaring threads and engines of lucas_test() do not apply, and
+ * opts->calc_mode, opts->live, opts->threads and opts->engine are ignored.
+ *
+ * This function does not return on error.  It also does not return if
+ * k*b^n-1 cannot be tested, or if a signal causes a checkpoint and exit.
+ */
+int
+prp_test(unsigned long k, unsigned long n, const struct lucas_opts *opts)
+{
+    struct prp p;			/* Fermat test state */
+    unsigned long b;			/* base */
+    unsigned long i;			/* steps computed, x = a^(k*b^i) mod N */
+    unsigned long a;			/* Fermat base */
+    char *checkpoint_dir;		/* form checkpoint files under checkpoint_dir */
+    struct throttle *th;		/* CPU budget */
+    struct control *ctl;		/* control socket, NULL ==> not checkpointing */
+    struct watchdog *wd;		/* watchdog of the test, NULL ==> none */
+    mpz_t restored;			/* x as restored from checkpoint_dir */
+    int ret;				/* mpz_probab_prime_p() or test result */
+
+    /*
+     * firewall
+     */
+    if (opts == NULL) {
+	err(22, __func__, "opts is NULL");
+	return EXIT_CANNOT_TEST; // NOT REACHED
+    }
+    b = opts->base;
+    if (b < 3 || b > PRP_MAX_BASE) {
+	err(22, __func__, "base: %lu must be >= 3 and <= %d", b, PRP_MAX_BASE);
+	return EXIT_CANNOT_TEST; // NOT REACHED
+    }
+    checkpoint_dir = opts->checkpoint_dir;
+    if (opts->calc_mode || opts->live || opts->engine != NULL) {
+	dbg(DBG_LOW, "calc code, live residue and engines do not apply to base: %lu", b);
+    }
+    checkpoint_base(b);
+
+    /*
+     * case: no k and n given, must obtain by restoring from the checkpoint_dir
+     */
+    mpz_init(restored);
+    i = 0;
+    a = PRP_BASE;
+    if (opts->restore) {
+
+	/*
+	 * restore k, n, i, a, and x from checkpoint_dir
+	 *
+	 * NOTE: If we cannot restore from checkpoint_dir, this function will not return.
+	 */
+	dbg(DBG_LOW, "restoring from: %s", checkpoint_dir);
+	restore_checkpoint(checkpoint_dir, &k, &n, &i, &a, restored);
+	if (a != PRP_BASE) {
+	    err(EXIT_CANNOT_RESTORE, __func__, "checkpoint Fermat base: %lu != %d", a, PRP_BASE);
+	    // exit(6);
+	    exit(EXIT_CANNOT_RESTORE); // NOT REACHED
+	}
+    }
+    if (k < 1 || n < 1) {
+	err(EXIT_CANNOT_TEST, __func__, "k: %lu and n: %lu must be >= 1", k, n);
+	// exit(2);
+	exit(EXIT_CANNOT_TEST); // NOT REACHED
+    }
+    prp_init(&p, k, b, n);
+    dbg(DBG_MED, "k: %lu", k);
+    dbg(DBG_MED, "b: %lu", b);
+    dbg(DBG_MED, "n: %lu", n);
+    if (debuglevel >= DBG_HIGH) {
+	write_calc_mpz_hex(stderr, NULL, "prp_cand", p.N);
+    }
+
+    /*
+     * firewall - small candidates are tested directly, as are multiples of 2 and a
+     *
+     * NOTE: These are not checkpointed, they take far less time than a checkpoint.
+     */
+    if (p.bits <= PRP_SMALL_BITS || n < 2 || mpz_even_p(p.N) || mpz_divisible_ui_p(p.N, PRP_BASE)) {
+	ret = mpz_probab_prime_p(p.N, PRP_REPS);
+	dbg(DBG_MED, "mpz_probab_prime_p returned: %d", ret);
+	prp_announce(k, b, n, (ret > 0 ? EXIT_IS_PRIME : EXIT_IS_COMPOSITE), (ret == 2), opts->quiet);
+	prp_clear(&p);
+	mpz_clear(restored);
+	return (ret > 0 ? EXIT_IS_PRIME : EXIT_IS_COMPOSITE);
+    }
+
+    /*
+     * NOTE: the values of k and n have been established and will not change thruout the test
+     */
+    zcalc_flush(); // paranoia
+    dbg(DBG_LOW, "testing %lu*%lu^%lu-1", k, b, n);
+    fflush(stderr); // paranoia
+
+    /*
+     * initialize prime stats for this run, and the checkpoint system (see lucas_test())
+     */
+    initialize_beginrun_stats();
+    initialize_checkpoint(checkpoint_dir, opts->checkpoint_secs, k, n, opts->force);
+
+    /*
+     * keep to the CPU budget, and when checkpointing, listen for commands on
+     * the control socket of the checkpoint directory
+     */
+    th = throttle_start((opts->cpu > 0 ? opts->cpu : THROTTLE_MAX_CPU), opts->idle);
+    ctl = NULL;
+    if (checkpoint_dir != NULL) {
+	ctl = control_start(k, n, opts->checkpoint_secs, opts->threads, th);
+    }
+
+    /*
+     * x = a^k mod N, unless we restored
+     */
+    if (opts->restore) {
+	if (mpz_sgn(restored) < 0 || mpz_cmp(restored, p.N) >= 0) {
+	    err(EXIT_CANNOT_RESTORE, __func__, "checkpoint x is not in [0, %lu*%lu^%lu-1)", k, b, n);
+	    // exit(6);
+	    exit(EXIT_CANNOT_RESTORE); // NOT REACHED
+	}
+	mpz_set(p.x, restored);
+    } else {
+	mpz_set_ui(p.x, a);
+	mpz_powm_ui(p.x, p.x, k, p.N);
+    }
+    mpz_clear(restored);
+
+    /*
+     * note the start of this run in the history of the test, and watch its rate
+     */
+    wd = NULL;
+    if (checkpoint_dir != NULL) {
+	checkpoint_history_begin(PRP_ENGINE, i);
+	wd = watchdog_start(opts->watchdog, opts->watchdog_secs, i, PRP_ENGINE, checkpoint_history_rate(PRP_ENGINE));
+    }
+
+    /*
+     * compute a^(k*b^n) mod N
+     */
+    while (i < n) {
+
+	/*
+	 * every LUCAS_BLOCK steps, keep to the CPU budget, apply control commands
+	 * and note the progress for the watchdog
+	 */
+	if ((i % LUCAS_BLOCK) == 0) {
+	    watchdog_pause(wd);
+	    throttle_block(th);
+	    control_poll(ctl, i);
+	    watchdog_block(wd, i);
+	}
+
+	/*
+	 * x = x^b mod N
+	 */
+	prp_step(&p);
+	++i;
+
+	/*
+	 * after the last step, x = a^(k*b^n) = a^(N+1) mod N
+	 *
+	 * The final checkpoint holds a^(N+1) - a^2 mod N, which is 0 for a probable
+	 * prime, so that it links the result file as the final Lucas term would.
+	 */
+	if (i == n) {
+	    mpz_sub_ui(p.x, p.x, a * a);
+	    mpz_mod(p.x, p.x, p.N);
+	}
+
+	/*
+	 * checkpoint if checkpointing and needed
+	 *
+	 * NOTE: checkpoints, like Lucas terms, start at index FIRST_TERM_INDEX.
+	 */
+	if (checkpoint_dir != NULL && i >= FIRST_TERM_INDEX && checkpoint_needed(k, n, i, opts->multiple)) {
+	    dbg(DBG_MED, "checkpointing for x[%lu]: %s", i, checkpoint_dir);
+	    checkpoint(checkpoint_dir, true, k, n, i, a, p.x);
+	}
+    }
+    watchdog_stop(wd);
+    control_stop(ctl);
+    throttle_stop(th);
+    checkpoint_close();		// unlock the checkpoint directory, so another test may use it
+    dbg(DBG_LOW, "finished testing %lu*%lu^%lu-1", k, b, n);
+    debug_flush(); // so the stats follow the messages before them
+
+    /*
+     * print final prime stats according to -t and/or -T
+     */
+    if (opts->write_stats) {
+	update_stats();
+	write_calc_prime_stats(stderr, opts->write_extended_stats);
+    }
+
+    /*
+     * k*b^n-1 is a probable prime if and only if a^(N+1) - a^2 == 0 mod N
+     */
+    ret = (mpz_sgn(p.x) == 0 ? EXIT_IS_PRIME : EXIT_IS_COMPOSITE);
+    prp_announce(k, b, n, ret, false, opts->quiet);
+    dbg(DBG_LOW, "exit %s", (ret == EXIT_IS_PRIME ? "probable prime" : "composite"));
+    prp_clear(&p);
+    return ret;
+}
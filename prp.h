@@ -0,0 +1,49 @@
+/*
+ * prp - Fermat probable prime test of k*b^n-1 for bases b that are not a power of 2
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_PRP_H)
+#define INCLUDE_PRP_H
+
+#include "lucas.h"
+
+/*
+ * prp constants
+ */
+#define PRP_BASE	(3)		// Fermat base a, N is a probable prime when a^(N-1) == 1 mod N
+#define PRP_MAX_BASE	(65536)		// largest b of k*b^n-1
+#define PRP_SMALL_BITS	(64)		// k*b^n-1 of at most this many bits is tested by mpz_probab_prime_p()
+#define PRP_REPS	(25)		// mpz_probab_prime_p() repetitions
+#define PRP_ENGINE	"prp"		// name of the test in the checkpoint history
+
+/*
+ * external functions
+ */
+extern int prp_test(unsigned long k, unsigned long n, const struct lucas_opts *opts);
+
+#endif				/* INCLUDE_PRP_H */
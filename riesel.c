@@ -42,7 +42,7 @@
  * Share and enjoy! :-)
  */
 
-/* NUMERIC EXIT CODES: 40-69	riesel.c - reserved for internal errors */
+/* NUMERIC EXIT CODES: 40-49	riesel.c - reserved for internal errors */
 
 #include <stdio.h>
 #include <limits.h>
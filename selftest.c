@@ -0,0 +1,377 @@
+/*
+ * selftest - check the engines against the GMP code on this host
+ *
+ * An engine is only as good as the host it runs on: a compiler, a CPU
+ * or a kernel may break a fast path that works elsewhere.  The self-test
+ * (--selftest) runs each engine usable on this host on a few candidates
+ * from the verified prime lists of the test sub-directory:
+ *
+ *      the whole Lucas sequence of a prime, which must end in 0
+ *      SELFTEST_TERMS terms from each of SELFTEST_RESIDUES random residues,
+ *          which must match the terms computed with plain mpz_t arithmetic
+ *
+ * The outcome for each engine is written to the tuning profile of the
+ * host, $GMPRIME_PROFILE or else $HOME/.gmprime/hostname.profile, one
+ * line per engine:
+ *
+ *      engine passed|failed|unusable
+ *
+ * At startup, the profile is read, and engines that failed are disabled
+ * (see engine_disable()), so -e auto and -e engine fall back to the GMP
+ * code for them.  Without a profile, every engine is enabled.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 210-219	selftest.c - reserved for internal errors */
+
+#define _DEFAULT_SOURCE		/* for gethostname() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <gmp.h>
+
+#include "gmprime.h"
+#include "debug.h"
+#include "riesel.h"
+#include "engine.h"
+#include "selftest.h"
+
+/*
+ * candidates the engines are checked on, all verified primes
+ */
+static const struct selftest_case {
+    unsigned long h;		/* multiplier of 2, odd */
+    unsigned long n;		/* power of 2 */
+    bool whole;			/* true ==> compute the whole Lucas sequence */
+} cases[] = {
+    { 1247, 2000, true },	/* test/h-n.med.txt */
+    { 2685, 40002, false },	/* test/h-n.large.txt */
+
+    { 0, 0, false }		/* MUST BE THE LAST ENTRY! */
+};
+
+/*
+ * static functions
+ */
+static bool selftest_path(char *path, size_t len, bool create);
+static bool selftest_engine(const struct engine *eng, gmp_randstate_t rand, bool *tested);
+static bool selftest_case(const struct engine *eng, const struct selftest_case *tc, gmp_randstate_t rand);
+
+
+/*
+ * selftest_run - check each engine and record the outcome in the tuning profile
+ *
+ * given:
+ *      name    only check this engine, or ENGINE_AUTO to check them all
+ *      quiet   true ==> do not print the outcome of each engine
+ *
+ * returns:
+ *      EXIT_IS_PRIME   every engine checked passed (or could not run on this host)
+ *      EXIT_3          at least one engine failed
+ *
+ * A profile that cannot be written is warned about, the outcome is still returned.
+ */
+int
+selftest_run(const char *name, bool quiet)
+{
+    char path[BUFSIZ + 1];	/* tuning profile */
+    char tmp[BUFSIZ + 32];	/* profile being written */
+    char host[BUFSIZ + 1];	/* this host */
+    const struct engine *eng;	/* engine being checked */
+    const char *outcome;	/* engine passed, failed or unusable */
+    gmp_randstate_t rand;	/* random residue state */
+    unsigned long seed;		/* random residue seed */
+    bool tested;		/* true ==> engine could run on this host */
+    bool passed;		/* true ==> engine passed */
+    int status = EXIT_IS_PRIME;	/* self-test exit code */
+    FILE *fp;			/* open profile, NULL ==> none */
+    int e;			/* engine index */
+
+    /*
+     * firewall
+     */
+    if (name == NULL) {
+	err(210, __func__, "called with NULL arg");
+	return EXIT_USAGE;	// NOT REACHED
+    }
+
+    /*
+     * open the new profile, if we can
+     */
+    fp = NULL;
+    if (selftest_path(path, sizeof(path), true)) {
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	errno = 0;
+	fp = fopen(tmp, "w");
+	if (fp == NULL) {
+	    warnp(__func__, "cannot write tuning profile: %s", tmp);
+	}
+    }
+    if (fp != NULL) {
+	memset(host, 0, sizeof(host));
+	(void) gethostname(host, BUFSIZ);
+	fprintf(fp, "# %s tuning profile of %s, written by --selftest at %ld\n",
+		version_string, host, (long)time(NULL));
+    }
+
+    /*
+     * check the engines
+     */
+    seed = (unsigned long)time(NULL) ^ ((unsigned long)getpid() << 16);
+    dbg(DBG_MED, "random residue seed: %lu", seed);
+    gmp_randinit_default(rand);
+    gmp_randseed_ui(rand, seed);
+    for (e = 0; (eng = engine_nth(e)) != NULL; ++e) {
+	if (strcmp(name, ENGINE_AUTO) != 0 && strcmp(name, eng->name) != 0) {
+	    continue;
+	}
+	passed = selftest_engine(eng, rand, &tested);
+	if (!tested) {
+	    outcome = "unusable";
+	} else if (passed) {
+	    outcome = "passed";
+	} else {
+	    outcome = "failed";
+	    status = EXIT_3;
+	}
+	if (!quiet) {
+	    printf("engine %s: %s\n", eng->name, outcome);
+	}
+	if (fp != NULL) {
+	    fprintf(fp, "%s %s\n", eng->name, outcome);
+	}
+    }
+    gmp_randclear(rand);
+    fflush(stdout);
+
+    /*
+     * replace the old profile
+     */
+    if (fp != NULL) {
+	if (fclose(fp) != 0 || rename(tmp, path) < 0) {
+	    warnp(__func__, "cannot write tuning profile: %s", path);
+	    (void) unlink(tmp);
+	} else {
+	    dbg(DBG_LOW, "wrote tuning profile: %s", path);
+	}
+    }
+    return status;
+}
+
+
+/*
+ * selftest_load - disable the engines that failed in the tuning profile of this host
+ *
+ * A missing profile is not an error: every engine stays enabled.
+ */
+void
+selftest_load(void)
+{
+    char path[BUFSIZ + 1];	/* tuning profile */
+    char line[BUFSIZ + 1];	/* profile line */
+    char eng[BUFSIZ + 1];	/* engine name */
+    char outcome[BUFSIZ + 1];	/* engine outcome */
+    FILE *fp;			/* open profile */
+
+    if (!selftest_path(path, sizeof(path), false)) {
+	return;
+    }
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+	return;
+    }
+    dbg(DBG_MED, "reading tuning profile: %s", path);
+    while (fgets(line, BUFSIZ, fp) != NULL) {
+	if (line[0] == '#' || sscanf(line, "%1024s %1024s", eng, outcome) != 2) {
+	    continue;
+	}
+	if (strcmp(outcome, "failed") == 0) {
+	    engine_disable(eng);
+	}
+    }
+    (void) fclose(fp);
+    return;
+}
+
+
+/*
+ * selftest_path - form the path of the tuning profile of this host
+ *
+ * given:
+ *      path    where to form the path
+ *      len     size of path
+ *      create  true ==> create the default profile directory if needed
+ *
+ * returns:
+ *      true ==> path is set, false ==> this host has no profile
+ */
+static bool
+selftest_path(char *path, size_t len, bool create)
+{
+    char host[BUFSIZ + 1];	/* this host */
+    const char *env;		/* environment value */
+    int ret;			/* snprintf return */
+
+    env = getenv(SELFTEST_PROFILE_ENV);
+    if (env != NULL && env[0] != '\0') {
+	ret = snprintf(path, len, "%s", env);
+	return ret > 0 && (size_t)ret < len;
+    }
+    env = getenv("HOME");
+    memset(host, 0, sizeof(host));
+    if (env == NULL || env[0] == '\0' || gethostname(host, BUFSIZ) < 0) {
+	return false;
+    }
+    ret = snprintf(path, len, "%s/%s", env, SELFTEST_PROFILE_DIR);
+    if (ret <= 0 || (size_t)ret >= len) {
+	return false;
+    }
+    if (create) {
+	errno = 0;
+	if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+	    warnp(__func__, "cannot create profile directory: %s", path);
+	    return false;
+	}
+    }
+    ret = snprintf(path, len, "%s/%s/%s.profile", env, SELFTEST_PROFILE_DIR, host);
+    return ret > 0 && (size_t)ret < len;
+}
+
+
+/*
+ * selftest_engine - check an engine on each self-test candidate it can test
+ *
+ * given:
+ *      eng     engine to check
+ *      rand    random residue state
+ *      tested  set to true if the engine could test at least one candidate
+ *
+ * returns:
+ *      true ==> every candidate tested gave the expected terms
+ */
+static bool
+selftest_engine(const struct engine *eng, gmp_randstate_t rand, bool *tested)
+{
+    const struct selftest_case *tc;	/* self-test candidate */
+    bool passed = true;			/* true ==> no failure so far */
+
+    *tested = false;
+    for (tc = cases; tc->h > 0; ++tc) {
+	if (!eng->usable(tc->h, tc->n)) {
+	    dbg(DBG_MED, "engine: %s cannot test %lu*2^%lu-1 on this host", eng->name, tc->h, tc->n);
+	    continue;
+	}
+	*tested = true;
+	if (!selftest_case(eng, tc, rand)) {
+	    passed = false;
+	}
+    }
+    return passed;
+}
+
+
+/*
+ * selftest_case - check an engine on a self-test candidate
+ *
+ * given:
+ *      eng     engine to check, usable on tc
+ *      tc      self-test candidate
+ *      rand    random residue state
+ *
+ * returns:
+ *      true ==> the engine gave the expected terms, or could not setup
+ */
+static bool
+selftest_case(const struct engine *eng, const struct selftest_case *tc, gmp_randstate_t rand)
+{
+    void *state;		/* engine state */
+    mpz_t cand;			/* h*2^n-1 */
+    mpz_t u;			/* term computed by the engine */
+    mpz_t ref;			/* term computed with mpz_t arithmetic */
+    bool passed = true;		/* true ==> no failure so far */
+    unsigned long i;		/* term index */
+    int r;			/* random residue index */
+
+    state = eng->setup(tc->h, tc->n);
+    if (state == NULL) {
+	dbg(DBG_MED, "engine: %s did not setup for %lu*2^%lu-1", eng->name, tc->h, tc->n);
+	return true;
+    }
+    mpz_init(cand);
+    mpz_init(u);
+    mpz_init(ref);
+    mpz_set_ui(cand, tc->h);
+    mpz_mul_2exp(cand, cand, tc->n);
+    mpz_sub_ui(cand, cand, 1);
+
+    /*
+     * U(n) of a prime is 0 mod h*2^n-1
+     */
+    if (tc->whole) {
+	(void) gen_u2(tc->h, tc->n, cand, u);
+	eng->import(state, u);
+	eng->step(state, tc->n - FIRST_TERM_INDEX);
+	eng->export(state, u);
+	mpz_mod(u, u, cand);
+	if (mpz_sgn(u) != 0) {
+	    warn(__func__, "engine: %s did not prove %lu*2^%lu-1 prime", eng->name, tc->h, tc->n);
+	    passed = false;
+	}
+    }
+
+    /*
+     * terms from random residues match u^2-2 mod h*2^n-1
+     */
+    for (r = 0; r < SELFTEST_RESIDUES && passed; ++r) {
+	mpz_urandomm(ref, rand, cand);
+	eng->import(state, ref);
+	eng->step(state, SELFTEST_TERMS);
+	eng->export(state, u);
+	for (i = 0; i < SELFTEST_TERMS; ++i) {
+	    mpz_mul(ref, ref, ref);
+	    mpz_sub_ui(ref, ref, 2);
+	    mpz_mod(ref, ref, cand);
+	}
+	mpz_mod(u, u, cand);
+	if (mpz_cmp(u, ref) != 0) {
+	    warn(__func__, "engine: %s computed a wrong term mod %lu*2^%lu-1", eng->name, tc->h, tc->n);
+	    passed = false;
+	}
+    }
+    dbg(DBG_LOW, "engine: %s %s on %lu*2^%lu-1", eng->name, (passed ? "passed" : "failed"), tc->h, tc->n);
+    eng->cleanup(state);
+    mpz_clear(ref);
+    mpz_clear(u);
+    mpz_clear(cand);
+    return passed;
+}
@@ -0,0 +1,49 @@
+/*
+ * selftest - check the engines against the GMP code on this host
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_SELFTEST_H)
+#define INCLUDE_SELFTEST_H
+
+#include <stdbool.h>
+
+/*
+ * selftest constants
+ */
+#define SELFTEST_PROFILE_ENV	"GMPRIME_PROFILE"	// environment variable naming the tuning profile
+#define SELFTEST_PROFILE_DIR	".gmprime"		// default profile is $HOME/SELFTEST_PROFILE_DIR/hostname.profile
+#define SELFTEST_RESIDUES	(2)			// random residues each engine squares per candidate
+#define SELFTEST_TERMS		(16)			// Lucas terms computed from each random residue
+
+/*
+ * external functions
+ */
+extern int selftest_run(const char *name, bool quiet);
+extern void selftest_load(void);
+
+#endif				/* INCLUDE_SELFTEST_H */
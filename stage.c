@@ -0,0 +1,782 @@
+/*
+ * stage - filter stages that run ahead of the Lucas tests of a batch
+ *
+ * The candidates of a batch list flow through a pipeline of stages, each
+ * connected to the next by a bounded lock-free queue:
+ *
+ *      read    parse the list (see hnlist.c)
+ *      sieve   look for a factor of h*2^n-1 among the odd primes below
+ *              STAGE_SIEVE_LIMIT, including the mod 3 case of lucas_test()
+ *      factor  look for a factor among the primes below n*STAGE_FACTOR_SCALE,
+ *              but below STAGE_FACTOR_LIMIT, so the work grows with the cost
+ *              of the Lucas test it may save
+ *
+ * and out of the last queue to the batch scheduler, which hands them to
+ * the Lucas test workers (see batch.c).  A candidate found to have a factor
+ * skips the rest of the pipeline and comes out with that factor.
+ *
+ * A queue holds STAGE_QUEUE_LEN candidates.  A stage that finds the next
+ * queue full waits for it to drain, so the stages run ahead of the Lucas
+ * tests by a bounded amount of memory, no matter how long the list is.
+ *
+ * The sieve and factor stages run on as many threads as they need to keep
+ * up, up to STAGE_MAX_THREADS between them.  Every STAGE_TUNE_MS, the time
+ * each stage was busy is measured, and threads are shared out in proportion
+ * to that demand.  A thread not needed by its stage parks until it is.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 200-209	stage.c - reserved for internal errors */
+
+#define _DEFAULT_SOURCE		/* for nanosleep() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "gmprime.h"
+#include "debug.h"
+#include "hnlist.h"
+#include "known.h"
+#include "stage.h"
+
+/*
+ * stages of the pipeline
+ */
+#define STAGE_SIEVE	(0)		// sieve stage
+#define STAGE_FACTOR	(1)		// factor stage
+#define STAGE_WORKERS	(2)		// number of stages that run on a variable number of threads
+
+/*
+ * a queue cell
+ *
+ * A cell may be written when seq equals the position of the producer, and
+ * may be read when seq equals the position of the consumer plus 1.
+ */
+struct stage_cell {
+    atomic_size_t seq;		/* position at which the cell is next written or read */
+    struct stage_item item;	/* candidate in the cell */
+};
+
+/*
+ * a bounded multi-producer multi-consumer queue between stages
+ */
+struct stage_queue {
+    struct stage_cell cell[STAGE_QUEUE_LEN];	/* ring of cells */
+    atomic_size_t head;		/* position of the next cell to read */
+    atomic_size_t tail;		/* position of the next cell to write */
+};
+
+/*
+ * a thread of a stage
+ */
+struct stage_thread {
+    pthread_t tid;		/* thread ID */
+    bool started;		/* true ==> thread has been created */
+    struct stages *sp;		/* the stages the thread belongs to */
+    int stage;			/* STAGE_SIEVE or STAGE_FACTOR */
+    int idx;			/* thread number within the stage */
+};
+
+/*
+ * measurements of a stage
+ */
+struct stage_stats {
+    atomic_ulong count;		/* candidates the stage has looked at */
+    atomic_ulong factored;	/* candidates in which the stage found a factor */
+    atomic_ullong busy_ns;	/* nanoseconds the threads of the stage were busy */
+    unsigned long long tuned_ns;	/* busy_ns as of the last tuning */
+};
+
+/*
+ * running stages
+ */
+struct stages {
+    struct hnlist *list;	/* list being read */
+    struct stage_queue q[STAGE_WORKERS + 1];	/* queue in front of each stage, then the output */
+    atomic_ulong in_flight;	/* candidates read but not yet out of the pipeline */
+    atomic_bool eof;		/* true ==> the whole list has been read */
+    atomic_bool quit;		/* true ==> threads are to stop */
+    pthread_t reader;		/* thread of the read stage */
+    struct stage_thread thread[STAGE_WORKERS][STAGE_MAX_THREADS];	/* threads of the other stages */
+    atomic_int want[STAGE_WORKERS];	/* threads each stage should run */
+    struct stage_stats stats[STAGE_WORKERS];	/* measurements of each stage */
+    unsigned long long tuned;	/* when the threads were last shared out */
+    uint32_t *prime;		/* odd primes in increasing order */
+    atomic_size_t nprime;	/* number of primes in prime[] */
+    atomic_ulong covered;	/* prime[] holds every odd prime below this value */
+    size_t nsieve;		/* number of primes below STAGE_SIEVE_LIMIT */
+    pthread_mutex_t grow;	/* serializes the extension of prime[] */
+    unsigned char segment[STAGE_SIEVE_LIMIT / 2];	/* odd numbers of the segment being sieved */
+};
+
+/*
+ * static functions
+ */
+static unsigned long long stage_now(void);
+static void stage_nap(void);
+static bool stage_push(struct stage_queue *q, const struct stage_item *item);
+static bool stage_pop(struct stage_queue *q, struct stage_item *item);
+static void stage_put(struct stages *sp, struct stage_queue *q, const struct stage_item *item);
+static void stage_primes(struct stages *sp, unsigned long limit);
+static void stage_extend(struct stages *sp, unsigned long limit);
+static uint32_t stage_divide(const struct stages *sp, unsigned long h, unsigned long n,
+			     size_t first, unsigned long limit);
+static void *stage_read(void *arg);
+static void *stage_work(void *arg);
+static void stage_launch(struct stages *sp, int stage, int idx);
+static void stage_tune(struct stages *sp);
+
+
+/*
+ * stage_start - start the stages on a list
+ *
+ * given:
+ *      list    opened list, read by the stages until stage_stop() is called
+ *
+ * returns:
+ *      running stages
+ *
+ * This function does not return on error.
+ */
+struct stages *
+stage_start(struct hnlist *list)
+{
+    struct stages *sp;		/* running stages */
+    size_t pos;			/* queue position */
+    int s;			/* queue or stage index */
+    int ret;			/* pthread return value */
+
+    /*
+     * firewall
+     */
+    if (list == NULL) {
+	err(200, __func__, "called with NULL arg");
+	return NULL;	// NOT REACHED
+    }
+
+    /*
+     * allocate the stages and the prime table
+     *
+     * The prime table is only touched as far as the largest n needs it.
+     */
+    errno = 0;
+    sp = calloc(1, sizeof(struct stages));
+    if (sp == NULL) {
+	errp(201, __func__, "calloc of stages failed, errno: %d", errno);
+	return NULL;	// NOT REACHED
+    }
+    errno = 0;
+    sp->prime = calloc(STAGE_MAX_PRIMES, sizeof(uint32_t));
+    if (sp->prime == NULL) {
+	errp(201, __func__, "calloc of %d primes failed, errno: %d", STAGE_MAX_PRIMES, errno);
+	return NULL;	// NOT REACHED
+    }
+    sp->list = list;
+    for (s = 0; s <= STAGE_WORKERS; ++s) {
+	for (pos = 0; pos < STAGE_QUEUE_LEN; ++pos) {
+	    atomic_init(&sp->q[s].cell[pos].seq, pos);
+	}
+	atomic_init(&sp->q[s].head, 0);
+	atomic_init(&sp->q[s].tail, 0);
+    }
+    atomic_init(&sp->in_flight, 0);
+    atomic_init(&sp->eof, false);
+    atomic_init(&sp->quit, false);
+    atomic_init(&sp->nprime, 0);
+    atomic_init(&sp->covered, 1);
+    ret = pthread_mutex_init(&sp->grow, NULL);
+    if (ret != 0) {
+	err(202, __func__, "pthread_mutex_init returned: %d", ret);
+	return NULL;	// NOT REACHED
+    }
+
+    /*
+     * the sieve primes
+     */
+    stage_extend(sp, STAGE_SIEVE_LIMIT);
+    sp->nsieve = atomic_load(&sp->nprime);
+
+    /*
+     * start reading, and one thread per stage until demand is measured
+     */
+    sp->tuned = stage_now();
+    ret = pthread_create(&sp->reader, NULL, stage_read, sp);
+    if (ret != 0) {
+	err(202, __func__, "pthread_create of reader returned: %d", ret);
+	return NULL;	// NOT REACHED
+    }
+    for (s = 0; s < STAGE_WORKERS; ++s) {
+	atomic_init(&sp->want[s], 1);
+	stage_launch(sp, s, 0);
+    }
+    return sp;
+}
+
+
+/*
+ * stage_next - take the next candidate out of the stages
+ *
+ * given:
+ *      sp      running stages
+ *      item    where to store the candidate
+ *
+ * returns:
+ *      STAGE_READY     item holds the next candidate
+ *      STAGE_EMPTY     no candidate is out yet, more are on their way
+ *      STAGE_DRAINED   every candidate of the list has come out
+ */
+int
+stage_next(struct stages *sp, struct stage_item *item)
+{
+    /*
+     * firewall
+     */
+    if (sp == NULL || item == NULL) {
+	err(200, __func__, "called with NULL arg(s)");
+	return STAGE_DRAINED;	// NOT REACHED
+    }
+
+    /*
+     * share out threads now and then
+     */
+    if (stage_now() - sp->tuned >= STAGE_TUNE_MS * 1000000ULL) {
+	stage_tune(sp);
+    }
+
+    /*
+     * The reader counts a candidate as in flight before it sets eof, so
+     * once eof is set and nothing is in flight, every candidate is out.
+     */
+    if (stage_pop(&sp->q[STAGE_WORKERS], item)) {
+	atomic_fetch_sub(&sp->in_flight, 1);
+	return STAGE_READY;
+    }
+    if (atomic_load(&sp->eof) && atomic_load(&sp->in_flight) == 0) {
+	return STAGE_DRAINED;
+    }
+    return STAGE_EMPTY;
+}
+
+
+/*
+ * stage_stop - stop the stages and free them
+ *
+ * given:
+ *      sp      running stages, or NULL
+ */
+void
+stage_stop(struct stages *sp)
+{
+    struct stage_stats *st;	/* measurements of a stage */
+    int s;			/* stage index */
+    int t;			/* thread index */
+
+    if (sp == NULL) {
+	return;
+    }
+    atomic_store(&sp->quit, true);
+    (void) pthread_join(sp->reader, NULL);
+    for (s = 0; s < STAGE_WORKERS; ++s) {
+	for (t = 0; t < STAGE_MAX_THREADS; ++t) {
+	    if (sp->thread[s][t].started) {
+		(void) pthread_join(sp->thread[s][t].tid, NULL);
+	    }
+	}
+	st = &sp->stats[s];
+	dbg(DBG_LOW, "%s stage: %lu candidates, %lu with a factor, %.3f busy seconds",
+	    (s == STAGE_SIEVE ? "sieve" : "factor"), atomic_load(&st->count), atomic_load(&st->factored),
+	    (double)atomic_load(&st->busy_ns) / 1e9);
+    }
+    (void) pthread_mutex_destroy(&sp->grow);
+    free(sp->prime);
+    free(sp);
+    return;
+}
+
+
+/*
+ * stage_now - nanoseconds on the monotonic clock
+ */
+static unsigned long long
+stage_now(void)
+{
+    struct timespec ts;		/* current time */
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+
+/*
+ * stage_nap - wait a little for a queue to change
+ */
+static void
+stage_nap(void)
+{
+    struct timespec ts;		/* how long to wait */
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = STAGE_WAIT_NS;
+    (void) nanosleep(&ts, NULL);
+    return;
+}
+
+
+/*
+ * stage_push - add a candidate to a queue
+ *
+ * given:
+ *      q       queue
+ *      item    candidate to add
+ *
+ * returns:
+ *      true ==> added, false ==> queue is full
+ */
+static bool
+stage_push(struct stage_queue *q, const struct stage_item *item)
+{
+    struct stage_cell *cell;	/* cell to write */
+    size_t pos;			/* position of the producer */
+    size_t seq;			/* position of the cell */
+
+    pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+	cell = &q->cell[pos & (STAGE_QUEUE_LEN - 1)];
+	seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+	if (seq == pos) {
+	    if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+						      memory_order_relaxed, memory_order_relaxed)) {
+		break;
+	    }
+	} else if (seq < pos) {
+	    return false;
+	} else {
+	    pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	}
+    }
+    cell->item = *item;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+
+/*
+ * stage_pop - take the oldest candidate from a queue
+ *
+ * given:
+ *      q       queue
+ *      item    where to store the candidate
+ *
+ * returns:
+ *      true ==> item was taken, false ==> queue is empty
+ */
+static bool
+stage_pop(struct stage_queue *q, struct stage_item *item)
+{
+    struct stage_cell *cell;	/* cell to read */
+    size_t pos;			/* position of the consumer */
+    size_t seq;			/* position of the cell */
+
+    pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;) {
+	cell = &q->cell[pos & (STAGE_QUEUE_LEN - 1)];
+	seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+	if (seq == pos + 1) {
+	    if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+						      memory_order_relaxed, memory_order_relaxed)) {
+		break;
+	    }
+	} else if (seq < pos + 1) {
+	    return false;
+	} else {
+	    pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+	}
+    }
+    *item = cell->item;
+    atomic_store_explicit(&cell->seq, pos + STAGE_QUEUE_LEN, memory_order_release);
+    return true;
+}
+
+
+/*
+ * stage_put - add a candidate to a queue, waiting while it is full
+ *
+ * given:
+ *      sp      running stages
+ *      q       queue
+ *      item    candidate to add
+ *
+ * The candidate is dropped if the stages are stopped while waiting.
+ */
+static void
+stage_put(struct stages *sp, struct stage_queue *q, const struct stage_item *item)
+{
+    while (!stage_push(q, item)) {
+	if (atomic_load(&sp->quit)) {
+	    return;
+	}
+	stage_nap();
+    }
+    return;
+}
+
+
+/*
+ * stage_primes - make sure prime[] holds every odd prime below a limit
+ *
+ * given:
+ *      sp      running stages
+ *      limit   bound on the primes needed, at most STAGE_FACTOR_LIMIT
+ */
+static void
+stage_primes(struct stages *sp, unsigned long limit)
+{
+    if (atomic_load_explicit(&sp->covered, memory_order_acquire) >= limit) {
+	return;
+    }
+    pthread_mutex_lock(&sp->grow);
+    stage_extend(sp, limit);
+    pthread_mutex_unlock(&sp->grow);
+    return;
+}
+
+
+/*
+ * stage_extend - add primes to prime[] until it holds every odd prime below a limit
+ *
+ * given:
+ *      sp      running stages, with grow locked unless called by stage_start()
+ *      limit   bound on the primes needed, at most STAGE_FACTOR_LIMIT
+ *
+ * The odd numbers from covered on are sieved a segment at a time by the
+ * primes already found.  The first segment holds every prime below
+ * STAGE_SIEVE_LIMIT, and as STAGE_SIEVE_LIMIT^2 >= STAGE_FACTOR_LIMIT, those
+ * are enough to sieve any later segment.  Other threads
+ * read prime[] without the lock, so each segment's primes are written before
+ * nprime, and nprime is updated before covered.
+ */
+static void
+stage_extend(struct stages *sp, unsigned long limit)
+{
+    unsigned long lo;		/* first odd number of the segment */
+    unsigned long hi;		/* end of the segment */
+    unsigned long start;	/* first odd multiple of p in the segment */
+    unsigned long m;		/* multiple of p */
+    unsigned long p;		/* sieving prime */
+    size_t np;			/* number of primes found so far */
+    size_t k;			/* prime index */
+    size_t i;			/* segment index */
+
+    if (limit > STAGE_FACTOR_LIMIT) {
+	limit = STAGE_FACTOR_LIMIT;
+    }
+    np = atomic_load(&sp->nprime);
+    for (lo = atomic_load(&sp->covered); lo < limit; lo = hi) {
+	hi = lo + STAGE_SIEVE_LIMIT;
+	memset(sp->segment, 1, sizeof(sp->segment));
+	for (k = 0; k < np; ++k) {
+	    p = sp->prime[k];
+	    if (p * p >= hi) {
+		break;
+	    }
+	    start = ((lo + p - 1) / p) * p;
+	    if (start < p * p) {
+		start = p * p;
+	    }
+	    if (start % 2 == 0) {
+		start += p;
+	    }
+	    for (m = start; m < hi; m += 2 * p) {
+		sp->segment[(m - lo) / 2] = 0;
+	    }
+	}
+	for (i = 0; i < STAGE_SIEVE_LIMIT / 2; ++i) {
+	    p = lo + 2 * i;
+	    if (sp->segment[i] && p > 1) {
+		sp->prime[np++] = (uint32_t)p;
+		/* only the first segment holds primes that sieve it */
+		for (m = p * p; m < hi; m += 2 * p) {
+		    sp->segment[(m - lo) / 2] = 0;
+		}
+	    }
+	}
+
+	/*
+	 * publish the segment
+	 */
+	atomic_store_explicit(&sp->nprime, np, memory_order_release);
+	atomic_store_explicit(&sp->covered, hi, memory_order_release);
+    }
+    return;
+}
+
+
+/*
+ * stage_divide - look for a prime that divides h*2^n-1
+ *
+ * given:
+ *      sp      running stages
+ *      h       odd multiplier of 2
+ *      n       power of 2, with h < 2^n
+ *      first   index in prime[] of the first prime to try
+ *      limit   try primes below this value, they must be in prime[]
+ *
+ * returns:
+ *      a prime factor of h*2^n-1 that is smaller than h*2^n-1, or 0
+ *
+ * p divides h*2^n-1 when h*2^n mod p == 1.
+ */
+static uint32_t
+stage_divide(const struct stages *sp, unsigned long h, unsigned long n, size_t first, unsigned long limit)
+{
+    uint64_t value;		/* h*2^n-1 if it fits in 64 bits, else 0 */
+    uint64_t r;			/* h*2^n mod p */
+    uint64_t sq;		/* 2^(2^bit) mod p */
+    uint64_t p;			/* trial prime */
+    unsigned long e;		/* bits of n left to use */
+    size_t np;			/* primes available */
+    size_t k;			/* prime index */
+
+    value = 0;
+    if (n < 64 && (h >> (64 - n)) == 0) {
+	value = (h << n) - 1;
+    }
+    np = atomic_load_explicit(&sp->nprime, memory_order_acquire);
+    for (k = first; k < np && sp->prime[k] < limit; ++k) {
+	p = sp->prime[k];
+	r = h % p;
+	sq = 2;
+	for (e = n; e > 0; e >>= 1) {
+	    if (e & 1) {
+		r = (r * sq) % p;
+	    }
+	    sq = (sq * sq) % p;
+	}
+	if (r == 1 && value != p) {
+	    return (uint32_t)p;
+	}
+    }
+    return 0;
+}
+
+
+/*
+ * stage_read - thread of the read stage
+ *
+ * given:
+ *      arg     running stages
+ *
+ * returns:
+ *      NULL
+ *
+ * This function does not return on a malformed list.
+ */
+static void *
+stage_read(void *arg)
+{
+    struct stages *sp = arg;	/* running stages */
+    struct stage_item item;	/* candidate read */
+
+    item.factor = 0;
+    while (!atomic_load(&sp->quit) && hnlist_next(sp->list, &item.h, &item.n)) {
+	atomic_fetch_add(&sp->in_flight, 1);
+	stage_put(sp, &sp->q[STAGE_SIEVE], &item);
+    }
+    atomic_store(&sp->eof, true);
+    return NULL;
+}
+
+
+/*
+ * stage_work - thread of the sieve or factor stage
+ *
+ * given:
+ *      arg     the stage_thread
+ *
+ * returns:
+ *      NULL
+ *
+ * Candidates that are not Riesel candidates are passed on untouched, so
+ * that their Lucas test reports why they cannot be tested, and so are the
+ * known primes (see known.c), that have no factor to find.
+ */
+static void *
+stage_work(void *arg)
+{
+    struct stage_thread *th = arg;	/* this thread */
+    struct stages *sp = th->sp;		/* running stages */
+    struct stage_stats *st = &sp->stats[th->stage];	/* measurements of this stage */
+    struct stage_queue *in = &sp->q[th->stage];	/* queue of candidates to look at */
+    struct stage_queue *out;	/* where the candidate goes next */
+    struct stage_item item;	/* candidate */
+    unsigned long long start;	/* when work on the candidate started */
+    unsigned long h;		/* odd multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+    unsigned long limit;	/* trial primes are below this value */
+
+    while (!atomic_load(&sp->quit)) {
+
+	/*
+	 * park while the stage does not need this thread, or has nothing to do
+	 */
+	if (th->idx >= atomic_load(&sp->want[th->stage]) || !stage_pop(in, &item)) {
+	    stage_nap();
+	    continue;
+	}
+	start = stage_now();
+
+	/*
+	 * look for a factor the way lucas_test() sees the candidate, with h odd
+	 */
+	h = item.h;
+	n = item.n;
+	while (h % 2 == 0 && h > 0) {
+	    h >>= 1;
+	    ++n;
+	}
+	if (h > 0 && (n >= sizeof(h) * 8 || (h >> n) == 0) && !known_prime(h, n)) {
+	    if (th->stage == STAGE_SIEVE) {
+		item.factor = stage_divide(sp, h, n, 0, STAGE_SIEVE_LIMIT);
+	    } else {
+		limit = (n < STAGE_FACTOR_LIMIT / STAGE_FACTOR_SCALE) ? n * STAGE_FACTOR_SCALE : STAGE_FACTOR_LIMIT;
+		stage_primes(sp, limit);
+		item.factor = stage_divide(sp, h, n, sp->nsieve, limit);
+	    }
+	}
+
+	/*
+	 * a candidate with a factor goes straight out
+	 */
+	atomic_fetch_add(&st->count, 1);
+	if (item.factor != 0) {
+	    atomic_fetch_add(&st->factored, 1);
+	    out = &sp->q[STAGE_WORKERS];
+	} else {
+	    out = &sp->q[th->stage + 1];
+	}
+	atomic_fetch_add(&st->busy_ns, stage_now() - start);
+	stage_put(sp, out, &item);
+    }
+    return NULL;
+}
+
+
+/*
+ * stage_launch - create a thread of a stage if it has not been created
+ *
+ * given:
+ *      sp      running stages
+ *      stage   STAGE_SIEVE or STAGE_FACTOR
+ *      idx     thread number within the stage
+ *
+ * This function does not return on error.
+ */
+static void
+stage_launch(struct stages *sp, int stage, int idx)
+{
+    struct stage_thread *th = &sp->thread[stage][idx];	/* thread to create */
+    int ret;			/* pthread return value */
+
+    if (th->started) {
+	return;
+    }
+    th->sp = sp;
+    th->stage = stage;
+    th->idx = idx;
+    ret = pthread_create(&th->tid, NULL, stage_work, th);
+    if (ret != 0) {
+	err(202, __func__, "pthread_create of stage %d thread %d returned: %d", stage, idx, ret);
+	return;	// NOT REACHED
+    }
+    th->started = true;
+    return;
+}
+
+
+/*
+ * stage_tune - share out threads among the stages in proportion to their demand
+ *
+ * given:
+ *      sp      running stages
+ *
+ * The demand of a stage is the number of threads it kept busy since the
+ * last tuning.  Each stage is given a quarter more threads than its demand,
+ * so a stage that keeps up shows it, and at least one.
+ */
+static void
+stage_tune(struct stages *sp)
+{
+    unsigned long long now;	/* current time */
+    unsigned long long busy;	/* busy_ns now */
+    double demand[STAGE_WORKERS];	/* threads kept busy by each stage */
+    int want[STAGE_WORKERS];	/* threads for each stage */
+    int total;			/* threads of all stages */
+    int s;			/* stage index */
+    int t;			/* thread index */
+
+    now = stage_now();
+    total = 0;
+    for (s = 0; s < STAGE_WORKERS; ++s) {
+	busy = atomic_load(&sp->stats[s].busy_ns);
+	demand[s] = (double)(busy - sp->stats[s].tuned_ns) / (double)(now - sp->tuned);
+	sp->stats[s].tuned_ns = busy;
+	want[s] = (int)(demand[s] * 1.25) + 1;
+	if (want[s] > STAGE_MAX_THREADS) {
+	    want[s] = STAGE_MAX_THREADS;
+	}
+	total += want[s];
+    }
+    sp->tuned = now;
+
+    /*
+     * when too many threads are wanted, scale each stage down
+     */
+    if (total > STAGE_MAX_THREADS) {
+	for (s = 0; s < STAGE_WORKERS; ++s) {
+	    want[s] = (want[s] * STAGE_MAX_THREADS) / total;
+	    if (want[s] < 1) {
+		want[s] = 1;
+	    }
+	}
+    }
+    for (s = 0; s < STAGE_WORKERS; ++s) {
+	if (want[s] != atomic_load(&sp->want[s])) {
+	    dbg(DBG_HIGH, "%s stage: %.2f busy threads, now using %d",
+		(s == STAGE_SIEVE ? "sieve" : "factor"), demand[s], want[s]);
+	}
+	for (t = 0; t < want[s]; ++t) {
+	    stage_launch(sp, s, t);
+	}
+	atomic_store(&sp->want[s], want[s]);
+    }
+    return;
+}
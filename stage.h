@@ -0,0 +1,77 @@
+/*
+ * stage - filter stages that run ahead of the Lucas tests of a batch
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_STAGE_H)
+#define INCLUDE_STAGE_H
+
+#include <stdint.h>
+
+#include "hnlist.h"
+
+/*
+ * stage constants
+ */
+#define STAGE_QUEUE_LEN		(256)		// candidates each queue between stages holds, a power of 2
+#define STAGE_SIEVE_LIMIT	(65536)		// the sieve stage tries the odd primes below this
+#define STAGE_FACTOR_SCALE	(16)		// the factor stage tries primes below n*STAGE_FACTOR_SCALE ...
+#define STAGE_FACTOR_LIMIT	(1UL << 26)	// ... and below this
+#define STAGE_MAX_PRIMES	(3957809)	// room for the odd primes below STAGE_FACTOR_LIMIT
+#define STAGE_MAX_THREADS	(4)		// most threads of the sieve and factor stages together
+#define STAGE_TUNE_MS		(500)		// milliseconds between reallocations of stage threads
+#define STAGE_WAIT_NS		(1000000)	// nanoseconds a stage thread waits on an empty or full queue
+
+/*
+ * stage_next() returns
+ */
+#define STAGE_DRAINED		(-1)		// every candidate of the list has come out
+#define STAGE_EMPTY		(0)		// no candidate is ready yet, try again later
+#define STAGE_READY		(1)		// a candidate came out
+
+/*
+ * a candidate as it comes out of the stages
+ */
+struct stage_item {
+    unsigned long h;		/* multiplier of 2 */
+    unsigned long n;		/* power of 2 */
+    uint32_t factor;		/* a factor of h*2^n-1, 0 ==> no factor found, h*2^n-1 must be tested */
+};
+
+/*
+ * running stages - opaque outside of stage.c
+ */
+struct stages;
+
+/*
+ * external functions
+ */
+extern struct stages *stage_start(struct hnlist *list);
+extern int stage_next(struct stages *sp, struct stage_item *item);
+extern void stage_stop(struct stages *sp);
+
+#endif				/* INCLUDE_STAGE_H */
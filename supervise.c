@@ -0,0 +1,428 @@
+/*
+ * supervise - restart a checkpointed test from its checkpoint when it crashes
+ *
+ * With --supervise, gmprime forks the test and waits for it.  When the
+ * test ends with a result, or with an exit code below 10 (it cannot be
+ * tested, the checkpoint directory is locked, it was asked to stop, ...),
+ * its exit code is ours.  When it exits with an internal error (10-255),
+ * or is killed by a signal (say by the kernel when out of memory), it is
+ * restarted from the newest complete checkpoint, after SUPERVISE_BACKOFF
+ * seconds, doubled after each crash up to SUPERVISE_BACKOFF_MAX.  A test
+ * that ran SUPERVISE_HEALTHY seconds before crashing restarts quickly.
+ *
+ * Progress is read from the history of the test (see checkpoint_history()).
+ * When the test crashes twice without making progress, it restarts with
+ * the gmp engine and a single squaring thread.  After SUPERVISE_REPEATS
+ * crashes without progress, we give up with the exit code of the last one.
+ *
+ * A test stopped by --watchdog restart for running far slower than expected
+ * exits with WATCHDOG_EXIT (see watchdog.c).  It is restarted like a crash,
+ * and should it be stopped as slow a second time, it restarts with the gmp
+ * engine and a single squaring thread.
+ *
+ * SIGHUP, SIGINT, SIGQUIT and SIGTERM are passed on to the test, which
+ * checkpoints and exits, and then we exit too.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 30-39	supervise.c - reserved for internal errors */
+
+#define _DEFAULT_SOURCE		/* for nanosleep() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <gmp.h>
+
+#include "gmprime.h"
+#include "debug.h"
+#include "checkpoint.h"
+#include "engine.h"
+#include "watchdog.h"
+#include "supervise.h"
+
+/*
+ * the test being supervised
+ */
+static volatile pid_t child = 0;	/* pid of the test, 0 ==> not running */
+static volatile sig_atomic_t stopping = 0;	/* != 0 ==> we were asked to stop */
+
+/*
+ * static functions
+ */
+static void supervise_signal(int signum);
+static void supervise_path(char *path, size_t len, const char *dir, const char *file);
+static bool supervise_complete(const char *path);
+static bool supervise_checkpoint(const char *dir);
+static unsigned long supervise_progress(const char *dir, char *engine, size_t len);
+
+
+/*
+ * supervise_test - test h*2^n-1, restarting the test from its checkpoint when it crashes
+ *
+ * given:
+ *      h               multiplier of 2
+ *      n               power of 2
+ *      opts            how h*2^n-1 is to be tested, opts->checkpoint_dir must not be NULL
+ *
+ * returns:
+ *      exit code of the test (see lucas_test())
+ *
+ * This function does not return on error.
+ */
+int
+supervise_test(unsigned long h, unsigned long n, struct lucas_opts *opts)
+{
+    static const int signals[] = { SIGHUP, SIGINT, SIGQUIT, SIGTERM };	/* passed on to the test */
+    struct lucas_opts copts;	/* how the test is run this time */
+    struct sigaction psa;	/* sigaction info for signal handler setup */
+    struct timespec ts;		/* backoff left to sleep */
+    char engine[BUFSIZ];	/* engine of the last history record */
+    unsigned long i;		/* Lucas sequence index the test had reached */
+    unsigned long last_i = 0;	/* index at the previous crash */
+    int same = 0;		/* crashes in a row without progress */
+    int slow = 0;		/* times the test was stopped by the watchdog */
+    bool fell_back = false;	/* true ==> restarted with the gmp engine and a single thread */
+    int backoff = SUPERVISE_BACKOFF;	/* seconds before the next restart */
+    time_t started;		/* when the test was started */
+    int wstatus;		/* test wait status */
+    int status;			/* test exit code */
+    size_t s;
+    pid_t pid;
+
+    /*
+     * firewall
+     */
+    if (opts == NULL || opts->checkpoint_dir == NULL) {
+	err(30, __func__, "opts or opts->checkpoint_dir is NULL");
+	return EXIT_CANNOT_TEST;	// NOT REACHED
+    }
+
+    /*
+     * pass signals that stop the test on to it
+     */
+    memset(&psa, 0, sizeof(psa));
+    psa.sa_handler = supervise_signal;
+    sigemptyset(&psa.sa_mask);
+    psa.sa_flags = 0;
+    for (s = 0; s < sizeof(signals) / sizeof(signals[0]); ++s) {
+	errno = 0;
+	if (sigaction(signals[s], &psa, NULL) < 0) {
+	    errp(31, __func__, "cannot sigaction signal %d, errno: %d", signals[s], errno);
+	    return EXIT_CANNOT_TEST;	// NOT REACHED
+	}
+    }
+
+    copts = *opts;
+    for (;;) {
+
+	/*
+	 * start the test
+	 */
+	started = time(NULL);
+	fflush(stdout);
+	debug_flush();
+	errno = 0;
+	pid = fork();
+	if (pid < 0) {
+	    errp(32, __func__, "fork failed, errno: %d", errno);
+	    return EXIT_CANNOT_TEST;	// NOT REACHED
+	} else if (pid == 0) {
+	    psa.sa_handler = SIG_DFL;
+	    for (s = 0; s < sizeof(signals) / sizeof(signals[0]); ++s) {
+		(void) sigaction(signals[s], &psa, NULL);
+	    }
+	    exit(lucas_test(h, n, &copts));
+	}
+	child = pid;
+	dbg(DBG_LOW, "supervising test pid: %d", (int)pid);
+
+	/*
+	 * wait for the test to end
+	 */
+	while (waitpid(pid, &wstatus, 0) < 0) {
+	    if (errno != EINTR) {
+		errp(33, __func__, "waitpid of test pid %d failed, errno: %d", (int)pid, errno);
+		return EXIT_CANNOT_TEST;	// NOT REACHED
+	    }
+	}
+	child = 0;
+	if (WIFEXITED(wstatus)) {
+	    status = WEXITSTATUS(wstatus);
+	    if (status < 10 || stopping) {
+		dbg(DBG_LOW, "test pid %d exited: %d", (int)pid, status);
+		return status;
+	    }
+	    if (status == WATCHDOG_EXIT) {
+		warn(__func__, "test pid %d was stopped by the watchdog as too slow", (int)pid);
+		++slow;
+	    } else {
+		warn(__func__, "test pid %d exited with internal error: %d", (int)pid, status);
+	    }
+	} else {
+	    if (stopping) {
+		return EXIT_SIGNAL;
+	    }
+	    status = FORCED_EXIT;
+	    if (WIFSIGNALED(wstatus)) {
+		warn(__func__, "test pid %d killed by signal: %d%s", (int)pid, WTERMSIG(wstatus),
+		     (WTERMSIG(wstatus) == SIGKILL ? " (out of memory?)" : ""));
+	    }
+	}
+
+	/*
+	 * fall back to the safest way to square when the test makes no progress or is too slow,
+	 * then give up when it still makes no progress
+	 */
+	i = supervise_progress(opts->checkpoint_dir, engine, sizeof(engine));
+	if (same > 0 && i == last_i) {
+	    ++same;
+	} else {
+	    same = 1;
+	    last_i = i;
+	}
+	if (same >= SUPERVISE_REPEATS) {
+	    warn(__func__, "test crashed %d times at u[%lu], giving up", same, i);
+	    return status;
+	}
+	if ((same >= 2 || slow >= 2) && !fell_back) {
+	    if (slow >= 2) {
+		warn(__func__, "test was too slow %d times with engine: %s, restarting with engine: %s and 1 thread",
+		     slow, engine, ENGINE_GMP);
+	    } else {
+		warn(__func__, "test crashed %d times at u[%lu] with engine: %s, restarting with engine: %s and 1 thread",
+		     same, i, engine, ENGINE_GMP);
+	    }
+	    copts.engine = ENGINE_GMP;
+	    if (copts.threads != NULL) {
+		*copts.threads = 1;
+	    }
+	    fell_back = true;
+	}
+
+	/*
+	 * back off, unless the test ran a good while
+	 */
+	if (time(NULL) - started >= SUPERVISE_HEALTHY) {
+	    backoff = SUPERVISE_BACKOFF;
+	}
+	warn(__func__, "restarting the test from its checkpoint in %d secs", backoff);
+	ts.tv_sec = backoff;
+	ts.tv_nsec = 0;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR && !stopping) {
+	    continue;
+	}
+	if (stopping) {
+	    return EXIT_SIGNAL;
+	}
+	backoff = (backoff * 2 < SUPERVISE_BACKOFF_MAX ? backoff * 2 : SUPERVISE_BACKOFF_MAX);
+
+	/*
+	 * resume from the live residue, or from the newest complete checkpoint
+	 */
+	copts.force = false;
+	if (!copts.live) {
+	    copts.restore = supervise_checkpoint(opts->checkpoint_dir);
+	}
+    }
+}
+
+
+/*
+ * supervise_signal - pass a signal on to the test
+ *
+ * given:
+ *      signum          the signal that has been delivered
+ */
+static void
+supervise_signal(int signum)
+{
+    stopping = 1;
+    if (child > 0) {
+	(void) kill(child, signum);
+    }
+    return;
+}
+
+
+/*
+ * supervise_path - form the path of a file in the checkpoint directory
+ *
+ * given:
+ *      path            where to form the path
+ *      len             size of path
+ *      dir             checkpoint directory
+ *      file            file in dir
+ *
+ * This function does not return on error.
+ */
+static void
+supervise_path(char *path, size_t len, const char *dir, const char *file)
+{
+    int ret;			/* snprintf return */
+
+    ret = snprintf(path, len, "%s/%s", dir, file);
+    if (ret < 0 || (size_t)ret >= len) {
+	err(34, __func__, "path of %s under %s is too long", file, dir);
+	return;	// NOT REACHED
+    }
+    return;
+}
+
+
+/*
+ * supervise_complete - determine if a checkpoint file was completely written
+ *
+ * given:
+ *      path            checkpoint file
+ *
+ * returns:
+ *      true ==> path ends with the complete line that checkpoint() writes last
+ */
+static bool
+supervise_complete(const char *path)
+{
+    char tail[SUPERVISE_TAIL + 1];	/* end of the file */
+    size_t len;			/* bytes read */
+    FILE *stream;		/* open checkpoint file */
+
+    stream = fopen(path, "r");
+    if (stream == NULL) {
+	return false;
+    }
+    if (fseek(stream, -SUPERVISE_TAIL, SEEK_END) < 0) {
+	rewind(stream);
+    }
+    len = fread(tail, 1, SUPERVISE_TAIL, stream);
+    (void) fclose(stream);
+    tail[len] = '\0';
+    return strstr(tail, "complete = \"true\" ;") != NULL;
+}
+
+
+/*
+ * supervise_checkpoint - make the current checkpoint the newest complete one
+ *
+ * given:
+ *      dir             checkpoint directory
+ *
+ * returns:
+ *      true ==> there is a current checkpoint to restore from
+ *
+ * A test that crashed while writing a checkpoint leaves it incomplete.
+ * It is set aside as SUPERVISE_BAD_FILE, and the newest complete previous
+ * checkpoint takes its place.
+ *
+ * This function does not return on error.
+ */
+static bool
+supervise_checkpoint(const char *dir)
+{
+    static const char *older[] = { CHKPT_PREV0_FILE, CHKPT_PREV1_FILE, CHKPT_PREV2_FILE };
+    char cur[PATH_MAX + 1];	/* current checkpoint */
+    char path[PATH_MAX + 1];	/* an older checkpoint, or where the current one is set aside */
+    size_t k;
+
+    supervise_path(cur, sizeof(cur), dir, CHKPT_CUR_FILE);
+    if (supervise_complete(cur)) {
+	return true;
+    }
+    for (k = 0; k < sizeof(older) / sizeof(older[0]); ++k) {
+	supervise_path(path, sizeof(path), dir, older[k]);
+	if (!supervise_complete(path)) {
+	    continue;
+	}
+	if (access(cur, F_OK) == 0) {
+	    supervise_path(path, sizeof(path), dir, SUPERVISE_BAD_FILE);
+	    errno = 0;
+	    if (rename(cur, path) < 0) {
+		errp(35, __func__, "cannot mv -f %s %s, errno: %d", cur, path, errno);
+		return false;	// NOT REACHED
+	    }
+	    warn(__func__, "set aside incomplete checkpoint as: %s", path);
+	    supervise_path(path, sizeof(path), dir, older[k]);
+	}
+	errno = 0;
+	if (rename(path, cur) < 0) {
+	    errp(35, __func__, "cannot mv -f %s %s, errno: %d", path, cur, errno);
+	    return false;	// NOT REACHED
+	}
+	dbg(DBG_LOW, "restoring from the older checkpoint: %s", older[k]);
+	return true;
+    }
+    return access(cur, F_OK) == 0;
+}
+
+
+/*
+ * supervise_progress - find how far the test got
+ *
+ * given:
+ *      dir             checkpoint directory
+ *      engine          where to copy the engine of the last history record
+ *      len             size of engine
+ *
+ * returns:
+ *      Lucas sequence index of the last history record, 0 ==> no record
+ */
+static unsigned long
+supervise_progress(const char *dir, char *engine, size_t len)
+{
+    char path[PATH_MAX + 1];	/* history file */
+    char buf[BUFSIZ];		/* a line of the history */
+    char name[BUFSIZ];		/* engine of a record */
+    unsigned long i = 0;	/* index of the last record */
+    unsigned long rec_i;	/* index of a record */
+    FILE *stream;		/* open history file */
+
+    snprintf(engine, len, "%s", "unknown");
+    supervise_path(path, sizeof(path), dir, HISTORY_FILE);
+    stream = fopen(path, "r");
+    if (stream == NULL) {
+	return 0;
+    }
+    if (fseek(stream, -(long)sizeof(buf), SEEK_END) == 0) {
+	(void) fgets(buf, sizeof(buf), stream);	/* skip a partial line */
+    } else {
+	rewind(stream);
+    }
+    while (fgets(buf, sizeof(buf), stream) != NULL) {
+	if (buf[0] != '#' &&
+	    sscanf(buf, "%*s %*s %lu %*s %*s %*s %*s %*s %*s %*s %s", &rec_i, name) == 2) {
+	    i = rec_i;
+	    snprintf(engine, len, "%s", name);
+	}
+    }
+    (void) fclose(stream);
+    return i;
+}
@@ -0,0 +1,50 @@
+/*
+ * supervise - restart a checkpointed test from its checkpoint when it crashes
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_SUPERVISE_H)
+#define INCLUDE_SUPERVISE_H
+
+#include "lucas.h"
+
+/*
+ * supervise constants
+ */
+#define SUPERVISE_BACKOFF	(2)	// seconds before the first restart, doubled after each crash
+#define SUPERVISE_BACKOFF_MAX	(3600)	// most seconds between restarts
+#define SUPERVISE_HEALTHY	(3600)	// a test that ran this many seconds before crashing restarts quickly
+#define SUPERVISE_REPEATS	(5)	// give up after this many crashes without the test making progress
+#define SUPERVISE_TAIL		(64)	// bytes at the end of a checkpoint file that show it is complete
+#define SUPERVISE_BAD_FILE	"chk.bad.pt"	// an incomplete current checkpoint, set aside
+
+/*
+ * external functions
+ */
+extern int supervise_test(unsigned long h, unsigned long n, struct lucas_opts *opts);
+
+#endif				/* INCLUDE_SUPERVISE_H */
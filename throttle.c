@@ -0,0 +1,345 @@
+/*
+ * throttle - hold a test to a CPU budget while the host is busy
+ *
+ * On a host shared with other work, a test may be given a budget of
+ * percent of a CPU (-C percent).  Every LUCAS_BLOCK terms, lucas_test()
+ * calls throttle_block(), which measures the CPU time the test used since
+ * the last call (on every thread of the process, so the squaring helper
+ * threads count too) and sleeps long enough to keep to the budget:
+ *
+ *      sleep = used * (100 - percent) / percent
+ *
+ * The budget is only kept while the host is busy.  Every THROTTLE_CHECK_SECS
+ * a housekeeping task (see housekeep.c) checks the host, so that the test
+ * does not read /proc in its squaring loop: with Linux pressure stall information, the host is
+ * idle when tasks waited for a CPU less than THROTTLE_IDLE_PSI percent of
+ * the last 10 seconds; otherwise the host is idle when the 1 minute load
+ * average, less the load of this test, is below THROTTLE_IDLE_LOAD per
+ * online CPU.  While the host is idle, the test runs at full speed.
+ *
+ * The time slept is accounted in the throttled prime stats (see checkpoint.c).
+ *
+ * Independently of the budget, --idle runs the test under the SCHED_IDLE
+ * policy, so that it only gets a CPU that no other task wants.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 230-239	throttle.c - reserved for internal errors */
+
+#define _GNU_SOURCE		/* for SCHED_IDLE, nanosleep() and getloadavg() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <gmp.h>
+
+#include "gmprime.h"
+#include "debug.h"
+#include "checkpoint.h"
+#include "housekeep.h"
+#include "throttle.h"
+
+/*
+ * CPU budget of a test
+ */
+struct throttle {
+    _Atomic int percent;	/* CPU budget in percent */
+    _Atomic bool idle_host;	/* true ==> the host was idle when last checked */
+    int task;			/* housekeeping task checking the host, < 0 ==> none yet */
+    unsigned long long cpu;	/* process CPU time at the last call, nanoseconds */
+};
+
+/*
+ * static functions
+ */
+static unsigned long long throttle_clock(clockid_t clock);
+static bool throttle_idle(const struct throttle *th);
+static double throttle_check(void *arg);
+
+
+/*
+ * throttle_start - start keeping a test to a CPU budget
+ *
+ * given:
+ *      percent         CPU budget in percent, THROTTLE_MAX_CPU ==> never throttle
+ *      idle            true ==> run the calling thread, and the threads it starts, under SCHED_IDLE
+ *
+ * returns:
+ *      CPU budget of the test
+ *
+ * This function does not return on error.
+ */
+struct throttle *
+throttle_start(int percent, bool idle)
+{
+    struct throttle *th;	/* CPU budget */
+    struct sched_param param;	/* scheduling parameters */
+
+    /*
+     * firewall
+     */
+    if (percent < THROTTLE_MIN_CPU || percent > THROTTLE_MAX_CPU) {
+	err(230, __func__, "percent: %d must be >= %d and <= %d", percent, THROTTLE_MIN_CPU, THROTTLE_MAX_CPU);
+	return NULL;	// NOT REACHED
+    }
+
+    /*
+     * only use the CPU no other task wants, if requested
+     */
+    if (idle) {
+#if defined(SCHED_IDLE)
+	memset(&param, 0, sizeof(param));
+	errno = 0;
+	if (sched_setscheduler(0, SCHED_IDLE, &param) < 0) {
+	    warnp(__func__, "cannot run under SCHED_IDLE, errno: %d", errno);
+	} else {
+	    dbg(DBG_MED, "running under SCHED_IDLE");
+	}
+#else
+	(void) param;
+	warn(__func__, "SCHED_IDLE is not supported on this host");
+#endif
+    }
+
+    /*
+     * allocate the budget
+     */
+    errno = 0;
+    th = calloc(1, sizeof(struct throttle));
+    if (th == NULL) {
+	errp(231, __func__, "calloc of throttle failed, errno: %d", errno);
+	return NULL;	// NOT REACHED
+    }
+    th->percent = percent;
+    th->cpu = throttle_clock(CLOCK_PROCESS_CPUTIME_ID);
+
+    /*
+     * check the host now and every THROTTLE_CHECK_SECS, once there is a budget to keep
+     */
+    th->task = -1;
+    if (percent < THROTTLE_MAX_CPU) {
+	th->task = housekeep_add("throttle", throttle_check, th, 0.0);
+    }
+    return th;
+}
+
+
+/*
+ * throttle_block - sleep as needed to keep to the CPU budget
+ *
+ * given:
+ *      th      CPU budget of the test, or NULL
+ */
+void
+throttle_block(struct throttle *th)
+{
+    struct timespec ts;		/* how long to sleep */
+    struct timeval slept;	/* how long we slept */
+    unsigned long long cpu;	/* process CPU time now */
+    unsigned long long used;	/* CPU time used since the last call */
+    unsigned long long rest;	/* nanoseconds to sleep */
+    unsigned long long now;	/* monotonic time now */
+    int percent;		/* CPU budget in percent */
+
+    if (th == NULL) {
+	return;
+    }
+    cpu = throttle_clock(CLOCK_PROCESS_CPUTIME_ID);
+    used = cpu - th->cpu;
+    th->cpu = cpu;
+    percent = th->percent;
+    if (percent >= THROTTLE_MAX_CPU) {
+	return;
+    }
+
+    /*
+     * run at full speed while the host is idle
+     */
+    if (th->idle_host) {
+	return;
+    }
+
+    /*
+     * sleep off the rest of the budget
+     */
+    now = throttle_clock(CLOCK_MONOTONIC);
+    rest = used * (unsigned long long)(THROTTLE_MAX_CPU - percent) / (unsigned long long)percent;
+    ts.tv_sec = (time_t)(rest / 1000000000ULL);
+    ts.tv_nsec = (long)(rest % 1000000000ULL);
+    (void) nanosleep(&ts, NULL);
+    rest = throttle_clock(CLOCK_MONOTONIC) - now;
+    slept.tv_sec = (time_t)(rest / 1000000000ULL);
+    slept.tv_usec = (suseconds_t)(rest % 1000000000ULL / 1000ULL);
+    add_throttled_stats(&slept);
+    return;
+}
+
+
+/*
+ * throttle_set - change the CPU budget
+ *
+ * given:
+ *      th              CPU budget of the test
+ *      percent         CPU budget in percent, THROTTLE_MAX_CPU ==> never throttle
+ */
+void
+throttle_set(struct throttle *th, int percent)
+{
+    if (th == NULL || percent < THROTTLE_MIN_CPU || percent > THROTTLE_MAX_CPU) {
+	err(232, __func__, "called with NULL arg or percent: %d not >= %d and <= %d",
+	    percent, THROTTLE_MIN_CPU, THROTTLE_MAX_CPU);
+	return;	// NOT REACHED
+    }
+    dbg(DBG_LOW, "CPU budget: %d%%", percent);
+    th->percent = percent;
+
+    /*
+     * check the host again now
+     */
+    if (th->task < 0) {
+	th->task = housekeep_add("throttle", throttle_check, th, 0.0);
+    } else {
+	housekeep_wake(th->task, 0.0);
+    }
+    return;
+}
+
+
+/*
+ * throttle_percent - the CPU budget in percent
+ *
+ * given:
+ *      th              CPU budget of the test, or NULL
+ */
+int
+throttle_percent(const struct throttle *th)
+{
+    return (th == NULL) ? THROTTLE_MAX_CPU : th->percent;
+}
+
+
+/*
+ * throttle_stop - stop keeping to the CPU budget
+ *
+ * given:
+ *      th      CPU budget of the test, or NULL
+ */
+void
+throttle_stop(struct throttle *th)
+{
+    if (th == NULL) {
+	return;
+    }
+    housekeep_remove(th->task);
+    free(th);
+    return;
+}
+
+
+/*
+ * throttle_clock - nanoseconds on a clock
+ */
+static unsigned long long
+throttle_clock(clockid_t clock)
+{
+    struct timespec ts;		/* current time */
+
+    (void) clock_gettime(clock, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+
+/*
+ * throttle_idle - determine if no other task wants the CPU
+ *
+ * given:
+ *      th      CPU budget of the test
+ *
+ * returns:
+ *      true ==> the host is idle, false ==> it is busy
+ */
+static bool
+throttle_idle(const struct throttle *th)
+{
+    FILE *psi;			/* CPU pressure stall information */
+    double avg10;		/* percent of the last 10 seconds some task waited for a CPU */
+    double load[1];		/* 1 minute load average */
+    long cpus;			/* online CPUs */
+    int ret;			/* return value */
+
+    /*
+     * prefer pressure stall information, a measure of tasks waiting for a CPU
+     */
+    psi = fopen(THROTTLE_PSI_FILE, "r");
+    if (psi != NULL) {
+	ret = fscanf(psi, "some avg10=%lf", &avg10);
+	fclose(psi);
+	if (ret == 1) {
+	    return avg10 < THROTTLE_IDLE_PSI;
+	}
+    }
+
+    /*
+     * otherwise use the load average less the load of this test
+     */
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1 || getloadavg(load, 1) != 1) {
+	return false;
+    }
+    return load[0] - (th->idle_host ? 1.0 : (double)th->percent / 100.0) < THROTTLE_IDLE_LOAD * (double)cpus;
+}
+
+
+/*
+ * throttle_check - housekeeping task, check if the host is idle
+ *
+ * given:
+ *      arg     CPU budget of the test
+ *
+ * returns:
+ *      seconds until the next check
+ */
+static double
+throttle_check(void *arg)
+{
+    struct throttle *th = arg;	/* CPU budget of the test */
+    bool idle;			/* true ==> the host is idle */
+
+    if (th->percent < THROTTLE_MAX_CPU) {
+	idle = throttle_idle(th);
+	if (idle != th->idle_host) {
+	    th->idle_host = idle;
+	    dbg(DBG_MED, "host is %s, %s", (idle ? "idle" : "busy"),
+		(idle ? "running at full speed" : "keeping to the CPU budget"));
+	}
+    }
+    return THROTTLE_CHECK_SECS;
+}
@@ -0,0 +1,59 @@
+/*
+ * throttle - hold a test to a CPU budget while the host is busy
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_THROTTLE_H)
+#define INCLUDE_THROTTLE_H
+
+#include <stdbool.h>
+
+/*
+ * throttle constants
+ */
+#define THROTTLE_MIN_CPU	(1)		// lowest CPU budget, in percent
+#define THROTTLE_MAX_CPU	(100)		// highest CPU budget, in percent, 100 ==> never throttle
+#define THROTTLE_CHECK_SECS	(5.0)		// seconds between checks for an idle host
+#define THROTTLE_PSI_FILE	"/proc/pressure/cpu"	// CPU pressure stall information, Linux 4.20 and later
+#define THROTTLE_IDLE_PSI	(1.0)		// idle: tasks waited for a CPU less than this % of the last 10 secs
+#define THROTTLE_IDLE_LOAD	(0.5)		// idle without PSI: other runnable tasks per CPU below this
+
+/*
+ * CPU budget of a test - opaque outside of throttle.c
+ */
+struct throttle;
+
+/*
+ * external functions
+ */
+extern struct throttle *throttle_start(int percent, bool idle);
+extern void throttle_block(struct throttle *th);
+extern void throttle_set(struct throttle *th, int percent);
+extern int throttle_percent(const struct throttle *th);
+extern void throttle_stop(struct throttle *th);
+
+#endif				/* INCLUDE_THROTTLE_H */
@@ -0,0 +1,406 @@
+/*
+ * watchdog - detect a test that stalls or runs far slower than expected
+ *
+ * On a shared host, a test may slow down tenfold (memory errors, thermal
+ * throttling, swapping) without a signal or an error.  With --watchdog,
+ * a housekeeping task (see housekeep.c) measures the rate of the test, in
+ * terms per second of squaring, over windows of secs seconds (WATCHDOG_SECS by default).
+ * Time the test spends keeping to a CPU budget or paused by a control
+ * command is not squaring, so lucas_test() brackets it with watchdog_pause()
+ * and watchdog_block() every LUCAS_BLOCK terms.
+ *
+ * The rate expected of the test is the best of:
+ *
+ *      the best rate of the engine on this host in the history of the test
+ *          (see checkpoint_history_rate()), when checkpointing
+ *      the rate of each window found not to be slow, after a first window
+ *          that is ignored while the test warms up
+ *
+ * A window is slow when its rate is below 1/WATCHDOG_SLOW of the expected
+ * rate, or when no block of terms completes in it: a stall.  A window lasts
+ * at least WATCHDOG_BLOCKS blocks of terms at the expected rate, so that
+ * large terms that take minutes each are not mistaken for a stall.
+ *
+ * Like the control thread (see control.c), the watchdog task only records
+ * what it found: the test acts on it when it next calls watchdog_block().
+ * The first slow window is warned about.  After WATCHDOG_STRIKES slow windows
+ * in a row, the test checkpoints at its next term.  With --watchdog restart,
+ * it then exits with WATCHDOG_EXIT, so that --supervise restarts the test
+ * from that checkpoint (falling back to the gmp engine should the restarted
+ * test be stopped as slow again, see supervise.c).
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 60-69	watchdog.c - reserved for internal errors */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#include "gmprime.h"
+#include "debug.h"
+#include "checkpoint.h"
+#include "lucas.h"
+#include "housekeep.h"
+#include "watchdog.h"
+
+/*
+ * watchdog of a running test
+ */
+struct watchdog {
+    int action;			/* WATCHDOG_WARN or WATCHDOG_RESTART */
+    double secs;		/* seconds of squaring in each window */
+    const char *engine;		/* engine computing the terms */
+    int task;			/* housekeeping task measuring each window */
+    pthread_mutex_t lock;	/* guards the values below */
+
+    /* set by the test */
+    unsigned long i;		/* Lucas sequence index at the last watchdog_block() */
+    double work;		/* seconds squaring up to the last watchdog_pause() */
+    double resumed;		/* when squaring resumed, < 0.0 ==> not squaring */
+
+    /* set by the housekeeping task */
+    double expected;		/* expected terms per second, 0.0 ==> not yet known */
+    double rate;		/* terms per second of the last slow window */
+    int strikes;		/* slow windows in a row */
+    bool warn;			/* true ==> warn of a slow window */
+    bool act;			/* true ==> WATCHDOG_STRIKES slow windows in a row */
+
+    /* used only by the housekeeping task */
+    double start_work;		/* seconds squaring at the start of the window */
+    unsigned long start_i;	/* Lucas sequence index at the start of the window */
+    bool warm;			/* true ==> the warm up window is over */
+
+    /* used only by the test */
+    bool stopping;		/* true ==> exit once the forced checkpoint is taken */
+};
+
+/*
+ * static functions
+ */
+static double watchdog_window(void *arg);
+static double watchdog_now(void);
+
+
+/*
+ * watchdog_action - convert a --watchdog argument into a WATCHDOG_* action
+ *
+ * given:
+ *      arg     warn or restart, optionally followed by :secs
+ *      secs    set to the seconds of squaring per window
+ *
+ * returns:
+ *      WATCHDOG_WARN or WATCHDOG_RESTART, or -1 if arg is not valid
+ */
+int
+watchdog_action(const char *arg, int *secs)
+{
+    const char *colon;		/* start of :secs, NULL ==> none */
+    size_t len;			/* length of the action name */
+    char *end;			/* end of secs */
+    long val;			/* secs value */
+    int action;			/* action named */
+
+    if (arg == NULL || secs == NULL) {
+	return -1;
+    }
+    colon = strchr(arg, ':');
+    len = (colon != NULL ? (size_t)(colon - arg) : strlen(arg));
+    if (len == strlen("warn") && strncmp(arg, "warn", len) == 0) {
+	action = WATCHDOG_WARN;
+    } else if (len == strlen("restart") && strncmp(arg, "restart", len) == 0) {
+	action = WATCHDOG_RESTART;
+    } else {
+	return -1;
+    }
+    *secs = WATCHDOG_SECS;
+    if (colon != NULL) {
+	errno = 0;
+	val = strtol(colon + 1, &end, 10);
+	if (errno != 0 || end == colon + 1 || *end != '\0' || val < 1 || val > 86400) {
+	    return -1;
+	}
+	*secs = (int)val;
+    }
+    return action;
+}
+
+
+/*
+ * watchdog_start - start watching the rate of a test
+ *
+ * given:
+ *      action          WATCHDOG_NONE, WATCHDOG_WARN or WATCHDOG_RESTART
+ *      secs            seconds of squaring in each window
+ *      i               Lucas sequence index the test starts at
+ *      engine          engine computing the terms
+ *      expected        terms per second expected of engine (see checkpoint_history_rate()), 0.0 ==> unknown
+ *
+ * returns:
+ *      watchdog of the test, NULL ==> WATCHDOG_NONE
+ */
+struct watchdog *
+watchdog_start(int action, int secs, unsigned long i, const char *engine, double expected)
+{
+    struct watchdog *wd;	/* watchdog of the test */
+    int ret;			/* return value */
+
+    if (action == WATCHDOG_NONE) {
+	return NULL;
+    }
+    if ((action != WATCHDOG_WARN && action != WATCHDOG_RESTART) || secs < 1 || engine == NULL) {
+	err(60, __func__, "invalid action: %d secs: %d or NULL engine", action, secs);
+	return NULL;	// NOT REACHED
+    }
+
+    /*
+     * allocate the watchdog state
+     */
+    errno = 0;
+    wd = calloc(1, sizeof(struct watchdog));
+    if (wd == NULL) {
+	errp(61, __func__, "calloc of watchdog failed, errno: %d", errno);
+	return NULL;	// NOT REACHED
+    }
+    wd->action = action;
+    wd->secs = (double)secs;
+    wd->engine = engine;
+    wd->i = i;
+    wd->work = 0.0;
+    wd->resumed = watchdog_now();
+    wd->expected = (expected > 0.0 ? expected : 0.0);
+    wd->start_work = 0.0;
+    wd->start_i = i;
+    ret = pthread_mutex_init(&wd->lock, NULL);
+    if (ret != 0) {
+	err(62, __func__, "pthread_mutex_init returned: %d", ret);
+	return NULL;	// NOT REACHED
+    }
+
+    /*
+     * measure the rate every window
+     */
+    wd->task = housekeep_add("watchdog", watchdog_window, wd, wd->secs);
+    dbg(DBG_MED, "watchdog: %s every %d secs, expecting %.3f terms/sec with engine: %s",
+	(action == WATCHDOG_RESTART ? "restart" : "warn"), secs, wd->expected, engine);
+    return wd;
+}
+
+
+/*
+ * watchdog_pause - note that the test stops squaring
+ *
+ * given:
+ *      wd      watchdog of the test, or NULL
+ *
+ * Until the next watchdog_block(), time is not counted as squaring.
+ */
+void
+watchdog_pause(struct watchdog *wd)
+{
+    double now;			/* time now */
+
+    if (wd == NULL) {
+	return;
+    }
+    now = watchdog_now();
+    (void) pthread_mutex_lock(&wd->lock);
+    if (wd->resumed >= 0.0) {
+	wd->work += now - wd->resumed;
+	wd->resumed = -1.0;
+    }
+    (void) pthread_mutex_unlock(&wd->lock);
+    return;
+}
+
+
+/*
+ * watchdog_block - note the progress of the test, and act on what the watchdog found
+ *
+ * given:
+ *      wd      watchdog of the test, or NULL
+ *      i       Lucas sequence index of the current term
+ *
+ * The test squares from now until the next watchdog_pause().
+ *
+ * This function does not return if the test was stopped by WATCHDOG_RESTART.
+ */
+void
+watchdog_block(struct watchdog *wd, unsigned long i)
+{
+    bool warn_now;		/* true ==> warn of a slow window */
+    bool act_now;		/* true ==> WATCHDOG_STRIKES slow windows in a row */
+    double rate;		/* rate of the last slow window */
+    double expected;		/* expected rate */
+
+    if (wd == NULL) {
+	return;
+    }
+
+    /*
+     * once the checkpoint forced by WATCHDOG_RESTART is taken, exit for --supervise to restart the test
+     */
+    if (wd->stopping && checkpoint_alarm == 0) {
+	err(WATCHDOG_EXIT, __func__, "checkpointed slow test at u[%lu], exiting to restart it", i);
+	// exit(60);
+	exit(WATCHDOG_EXIT);	// NOT REACHED
+    }
+
+    /*
+     * note the progress, and collect what the watchdog found
+     */
+    (void) pthread_mutex_lock(&wd->lock);
+    wd->i = i;
+    wd->resumed = watchdog_now();
+    warn_now = wd->warn;
+    act_now = wd->act;
+    rate = wd->rate;
+    expected = wd->expected;
+    wd->warn = false;
+    wd->act = false;
+    (void) pthread_mutex_unlock(&wd->lock);
+
+    /*
+     * act on a slow test
+     */
+    if (warn_now) {
+	warn(__func__, "test at u[%lu] squares %.3f terms/sec, expected %.3f terms/sec with engine: %s",
+	     i, rate, expected, wd->engine);
+    }
+    if (act_now && !wd->stopping) {
+	warn(__func__, "test at u[%lu] was slow for %d windows of %.0f secs, checkpointing%s",
+	     i, WATCHDOG_STRIKES, wd->secs, (wd->action == WATCHDOG_RESTART ? " and exiting to restart" : ""));
+	++checkpoint_alarm;
+	wd->stopping = (wd->action == WATCHDOG_RESTART);
+    }
+    return;
+}
+
+
+/*
+ * watchdog_stop - stop watching the test
+ *
+ * given:
+ *      wd      watchdog of the test, or NULL
+ */
+void
+watchdog_stop(struct watchdog *wd)
+{
+    if (wd == NULL) {
+	return;
+    }
+    housekeep_remove(wd->task);
+    (void) pthread_mutex_destroy(&wd->lock);
+    free(wd);
+    return;
+}
+
+
+/*
+ * watchdog_window - housekeeping task, measure the rate of the test over the last window
+ *
+ * given:
+ *      arg     watchdog of the test
+ *
+ * returns:
+ *      seconds until the next window ends, or the rest of a window too short to measure
+ */
+static double
+watchdog_window(void *arg)
+{
+    struct watchdog *wd = arg;	/* watchdog of the test */
+    double now;			/* time now */
+    double work;		/* seconds squaring as of now */
+    double least;		/* least seconds of squaring in a window */
+    double rate;		/* terms per second in the window */
+
+    (void) pthread_mutex_lock(&wd->lock);
+
+    /*
+     * wait for a window long enough to hold WATCHDOG_BLOCKS blocks of terms
+     */
+    now = watchdog_now();
+    work = wd->work + (wd->resumed >= 0.0 ? now - wd->resumed : 0.0);
+    least = wd->secs;
+    if (wd->expected > 0.0 && least < (double)(WATCHDOG_BLOCKS * LUCAS_BLOCK) / wd->expected) {
+	least = (double)(WATCHDOG_BLOCKS * LUCAS_BLOCK) / wd->expected;
+    }
+    if (work - wd->start_work < least) {
+	least -= work - wd->start_work;
+	(void) pthread_mutex_unlock(&wd->lock);
+	return least;
+    }
+    rate = (double)(wd->i - wd->start_i) / (work - wd->start_work);
+    wd->start_work = work;
+    wd->start_i = wd->i;
+    dbg(DBG_HIGH, "watchdog: %.3f terms/sec, expected %.3f terms/sec", rate, wd->expected);
+
+    /*
+     * ignore the first window, while the test warms up
+     */
+    if (!wd->warm) {
+	wd->warm = true;
+
+    /*
+     * count slow windows in a row, the others raise the expected rate
+     */
+    } else if (wd->expected > 0.0 && rate < wd->expected / (double)WATCHDOG_SLOW) {
+	wd->rate = rate;
+	++wd->strikes;
+	if (wd->strikes == 1) {
+	    wd->warn = true;
+	}
+	if (wd->strikes >= WATCHDOG_STRIKES) {
+	    wd->act = true;
+	    wd->strikes = 0;
+	}
+    } else {
+	wd->strikes = 0;
+	if (rate > wd->expected) {
+	    wd->expected = rate;
+	}
+    }
+    (void) pthread_mutex_unlock(&wd->lock);
+    return wd->secs;
+}
+
+
+/*
+ * watchdog_now - seconds on the monotonic clock
+ */
+static double
+watchdog_now(void)
+{
+    struct timespec ts;		/* current time */
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
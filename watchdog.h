@@ -0,0 +1,59 @@
+/*
+ * watchdog - detect a test that stalls or runs far slower than expected
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_WATCHDOG_H)
+#define INCLUDE_WATCHDOG_H
+
+/*
+ * watchdog constants
+ */
+#define WATCHDOG_NONE		(0)	// no watchdog
+#define WATCHDOG_WARN		(1)	// warn and checkpoint when the test stays slow
+#define WATCHDOG_RESTART	(2)	// also exit with WATCHDOG_EXIT, for --supervise to restart the test
+#define WATCHDOG_SECS		(60)	// default seconds of squaring in each window the rate is measured over
+#define WATCHDOG_BLOCKS		(4)	// fewest blocks of terms expected in a window
+#define WATCHDOG_SLOW		(4)	// a window is slow when its rate is below 1/WATCHDOG_SLOW of expected
+#define WATCHDOG_STRIKES	(3)	// slow windows in a row before acting
+#define WATCHDOG_EXIT		(60)	// exit code of a test stopped by WATCHDOG_RESTART
+
+/*
+ * watchdog of a test - opaque outside of watchdog.c
+ */
+struct watchdog;
+
+/*
+ * external functions
+ */
+extern int watchdog_action(const char *arg, int *secs);
+extern struct watchdog *watchdog_start(int action, int secs, unsigned long i, const char *engine, double expected);
+extern void watchdog_pause(struct watchdog *wd);
+extern void watchdog_block(struct watchdog *wd, unsigned long i);
+extern void watchdog_stop(struct watchdog *wd);
+
+#endif				/* INCLUDE_WATCHDOG_H */
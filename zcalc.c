@@ -0,0 +1,299 @@
+/*
+ * zcalc - gzip the -c calc code on a writer thread
+ *
+ * With -c, lucas_test() writes several hex values per term to stdout,
+ * so the size of the calc code limits the n that may be verified.  With
+ * -z, zcalc_start() turns stdout into the write end of a pipe with a
+ * ZCALC_BUFFER byte buffer, and a writer thread reads the pipe and writes
+ * the calc code, gzip compressed, to where stdout went before.  Hex digits
+ * compress by about 2x.  As the compute thread only fills the pipe, it no
+ * longer flushes stdout after each term: zcalc_flush() only flushes when
+ * the calc code is not compressed.
+ *
+ * The compressed calc code is fed to calc with:
+ *
+ *      gmprime -c -z h n | gzip -dc | calc -p
+ *
+ * or kept in a file and later verified with:
+ *
+ *      gzip -dc file.gz | calc -p
+ *
+ * zcalc_stop() runs at exit, so the gzip stream is complete on every exit
+ * path, including a checkpoint and end after a signal.
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+/* NUMERIC EXIT CODES: 240-249	zcalc.c - reserved for internal errors */
+
+#define _GNU_SOURCE		/* for F_SETPIPE_SZ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "gmprime.h"
+#include "debug.h"
+#include "zcalc.h"
+
+/*
+ * writer thread state
+ */
+static bool running = false;	/* true ==> stdout is the pipe to the writer thread */
+static bool atexit_set = false;	/* true ==> zcalc_stop() was registered with atexit() */
+static pthread_t tid;		/* writer thread */
+static int pipe_fd = -1;	/* read end of the pipe from stdout */
+static gzFile gz = NULL;	/* gzip stream to where stdout went before */
+static char *out_buf = NULL;	/* stdout buffer */
+static char *in_buf = NULL;	/* what the writer thread read from the pipe */
+
+/*
+ * static functions
+ */
+static void *zcalc_writer(void *arg);
+static void zcalc_atexit(void);
+
+
+/*
+ * zcalc_start - gzip what is written to stdout from now on, on a writer thread
+ *
+ * This function must be called before anything is written to stdout.
+ *
+ * This function does not return on error.
+ */
+void
+zcalc_start(void)
+{
+    int fd[2];			/* pipe from stdout to the writer thread */
+    int out_fd;			/* where stdout went before */
+    sigset_t all;		/* every signal */
+    sigset_t old;		/* signal mask before the writer thread was started */
+    int ret;			/* pthread_create() return */
+
+    if (running) {
+	return;
+    }
+
+    /*
+     * allocate the buffers
+     */
+    errno = 0;
+    out_buf = malloc(ZCALC_BUFFER);
+    in_buf = malloc(ZCALC_BUFFER);
+    if (out_buf == NULL || in_buf == NULL) {
+	errp(240, __func__, "malloc of %d byte buffers failed, errno: %d", ZCALC_BUFFER, errno);
+	return;	// NOT REACHED
+    }
+
+    /*
+     * keep where stdout went, the writer thread writes the gzip stream there
+     */
+    errno = 0;
+    out_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (out_fd < 0) {
+	errp(241, __func__, "cannot dup stdout, errno: %d", errno);
+	return;	// NOT REACHED
+    }
+    errno = 0;
+    gz = gzdopen(out_fd, ZCALC_MODE);
+    if (gz == NULL) {
+	errp(242, __func__, "gzdopen of stdout failed, errno: %d", errno);
+	return;	// NOT REACHED
+    }
+    (void) gzbuffer(gz, ZCALC_BUFFER);
+
+    /*
+     * make stdout the write end of a pipe to the writer thread
+     */
+    errno = 0;
+    if (pipe(fd) < 0) {
+	errp(243, __func__, "pipe failed, errno: %d", errno);
+	return;	// NOT REACHED
+    }
+#if defined(F_SETPIPE_SZ)
+    (void) fcntl(fd[1], F_SETPIPE_SZ, ZCALC_PIPE);	/* a larger pipe is only an optimization */
+#endif
+    (void) fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+    errno = 0;
+    if (dup2(fd[1], STDOUT_FILENO) < 0) {
+	errp(244, __func__, "dup2 of pipe onto stdout failed, errno: %d", errno);
+	return;	// NOT REACHED
+    }
+    (void) close(fd[1]);
+    pipe_fd = fd[0];
+    (void) setvbuf(stdout, out_buf, _IOFBF, ZCALC_BUFFER);
+
+    /*
+     * start the writer thread with every signal blocked, so that signals
+     * are still taken by the test thread
+     */
+    sigfillset(&all);
+    (void) pthread_sigmask(SIG_SETMASK, &all, &old);
+    ret = pthread_create(&tid, NULL, zcalc_writer, NULL);
+    (void) pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+	err(245, __func__, "pthread_create of writer thread returned: %d", ret);
+	return;	// NOT REACHED
+    }
+    running = true;
+    dbg(DBG_MED, "calc code is gzip compressed by a writer thread");
+
+    /*
+     * complete the gzip stream on every exit
+     */
+    if (!atexit_set) {
+	if (atexit(zcalc_atexit) != 0) {
+	    warn(__func__, "cannot register atexit handler, the calc code may be truncated");
+	}
+	atexit_set = true;
+    }
+    return;
+}
+
+
+/*
+ * zcalc_flush - flush stdout, unless the calc code is compressed
+ *
+ * While the calc code is compressed, stdout is only written when its buffer
+ * fills, and the writer thread is left to write out what it has read.
+ */
+void
+zcalc_flush(void)
+{
+    if (!running) {
+	fflush(stdout);
+    }
+    return;
+}
+
+
+/*
+ * zcalc_stop - write out the rest of stdout and complete the gzip stream
+ *
+ * Anything written to stdout after this call is discarded.
+ */
+void
+zcalc_stop(void)
+{
+    int fd;			/* /dev/null */
+    int ret;			/* pthread_join() return */
+
+    /*
+     * the writer thread exits after an error, without waiting for itself
+     */
+    if (!running || pthread_equal(pthread_self(), tid)) {
+	return;
+    }
+    running = false;
+
+    /*
+     * close the write end of the pipe, so the writer thread reads EOF
+     */
+    fflush(stdout);
+    fd = open("/dev/null", O_WRONLY);
+    if (fd >= 0) {
+	(void) dup2(fd, STDOUT_FILENO);
+	(void) close(fd);
+    } else {
+	(void) close(STDOUT_FILENO);
+    }
+
+    /*
+     * wait for the writer thread to complete the gzip stream
+     */
+    ret = pthread_join(tid, NULL);
+    if (ret != 0) {
+	warn(__func__, "pthread_join of writer thread returned: %d", ret);
+    }
+    (void) close(pipe_fd);
+    pipe_fd = -1;
+    return;
+}
+
+
+/*
+ * zcalc_atexit - complete the gzip stream should the test exit
+ */
+static void
+zcalc_atexit(void)
+{
+    zcalc_stop();
+    return;
+}
+
+
+/*
+ * zcalc_writer - gzip what is read from the pipe until EOF
+ *
+ * given:
+ *      arg     unused
+ *
+ * returns:
+ *      NULL
+ *
+ * This function does not return on error.
+ */
+static void *
+zcalc_writer(void *arg)
+{
+    ssize_t len;		/* bytes read from the pipe */
+    int ret;			/* gzclose() return */
+
+    (void) arg;
+    for (;;) {
+	errno = 0;
+	len = read(pipe_fd, in_buf, ZCALC_BUFFER);
+	if (len < 0 && errno == EINTR) {
+	    continue;
+	} else if (len < 0) {
+	    errp(246, __func__, "read of calc code from pipe failed, errno: %d", errno);
+	    return NULL;	// NOT REACHED
+	} else if (len == 0) {
+	    break;
+	}
+	errno = 0;
+	if (gzwrite(gz, in_buf, (unsigned)len) != (int)len) {
+	    errp(247, __func__, "gzwrite of %zd bytes of calc code failed, errno: %d", len, errno);
+	    return NULL;	// NOT REACHED
+	}
+    }
+
+    /*
+     * complete the gzip stream
+     */
+    errno = 0;
+    ret = gzclose(gz);
+    gz = NULL;
+    if (ret != Z_OK) {
+	warnp(__func__, "gzclose of calc code returned: %d, errno: %d", ret, errno);
+    }
+    return NULL;
+}
@@ -0,0 +1,49 @@
+/*
+ * zcalc - gzip the -c calc code on a writer thread
+ *
+ * Copyright (c) 2020 by Landon Curt Noll.  All Rights Reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby granted,
+ * provided that the above copyright, this permission notice and text
+ * this comment, and the disclaimer below appear in all of the following:
+ *
+ *       supporting documentation
+ *       source copies
+ *       source works derived from this source
+ *       binaries derived from this source or from derived source
+ *
+ * LANDON CURT NOLL DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO
+ * EVENT SHALL LANDON CURT NOLL BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF
+ * USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ *
+ * chongo (Landon Curt Noll, http://www.isthe.com/chongo/index.html) /\oo/\
+ *
+ * Share and enjoy! :-)
+ */
+
+
+#if !defined(INCLUDE_ZCALC_H)
+#define INCLUDE_ZCALC_H
+
+#include <stdbool.h>
+
+/*
+ * zcalc constants
+ */
+#define ZCALC_MODE	"wb1"			// gzdopen() mode, gzip level 1: hex compresses about as well at any level
+#define ZCALC_BUFFER	(1024*1024)		// bytes of stdout buffer, and of each read and gzip buffer
+#define ZCALC_PIPE	(1024*1024)		// bytes the pipe to the writer thread is asked to hold
+
+/*
+ * external functions
+ */
+extern void zcalc_start(void);
+extern void zcalc_flush(void);
+extern void zcalc_stop(void);
+
+#endif				/* INCLUDE_ZCALC_H */